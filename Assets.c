@@ -0,0 +1,632 @@
+/*********************************************************************
+    FileName:     	Assets.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 MHz
+
+    File Description:
+        Images in the external flash
+
+        The images the screens draw (splash, config, menu) are kept
+        in the flash instead of the program flash, as one read only
+        store from sector ASSET_FIRST up to the flash map sector.
+        The host builds the store (host/mbz_assets) and sends it
+        over USB, the MCU is not reflashed to change an image.
+
+        Store header (16 bytes):
+            Byte 0-1    'A' 'S', programmed by the MainBrain once the
+                        store has been checked
+            Byte 2      version, 1
+            Byte 3      assets
+            Byte 4-7    length of the store
+            Byte 8-11   CRC-32 of byte 16 to the end of the store
+        Asset (32 bytes each, after the header):
+            Byte 0-15   name, 0 padded
+            Byte 16-17  width
+            Byte 18-19  height
+            Byte 20-23  offset of the pixels from the start of the store
+            Byte 24-27  length of the pixels
+            Byte 28     format
+        All values are little endian. The pixels are RGB565 in rows,
+        ASSET_RAW as they are, ASSET_RLE as records:
+            0x00-0x7f   n + 1 pixels follow
+            0x80-0xff   one pixel follows, repeated (n & 0x7f) + 1 times
+
+        Asset_Init() (from Flash_Init()) loads the directory into RAM.
+        Asset_Blit() draws an asset, FLASH_READER_CHUNK bytes at a
+        time are read with a flash burst (Flash_Cache.c), decoded
+        and written to the display.
+        Flash and display share the PMP and only one chip select can
+        be low, the display keeps its memory write going across /CS.
+
+        0x77 Asset Begin
+            Request:  Byte 1-4   length of the new store
+            Reply:    Byte 0 = 0x77, Byte 1 = 1 when started
+                      Byte 2-3   sectors to erase
+                      Byte 4-7   room for the store
+            The old store is gone, its used sectors are erased with
+            flash jobs while the host waits for ASSET_WRITING.
+        0x78 Asset Write
+            Request:  Byte 1-3   offset in the store
+                      Byte 4     bytes, up to ASSET_WRITE_MAX
+                      Byte 5-    the bytes
+            Reply:    Byte 0 = 0x78, Byte 1 = 1 queued, 0 busy (send
+                      it again), 2 refused
+        0x79 Asset Status
+            Request:  Byte 1 = 1 checks the store when it is written
+                      Byte 1 = 2 checks a store already in the flash,
+                      sent with the flash programming commands
+                      (Flash_Program.c) with 0xff for the 'A' 'S'
+            Reply:    Byte 0 = 0x79, Byte 1 state (ASSET_*)
+                      Byte 2     assets
+                      Byte 3-6   bytes programmed
+                      Byte 7-8   sectors erased
+                      Byte 9-10  errors
+                      Byte 11-14 length of the store
+        The bytes are programmed by flash jobs from the USB interrupt,
+        the check reads the store back from the main loop
+        (Asset_Service()) and programs the 'A' 'S' when the CRC-32
+        matches.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include <stddef.h>
+#include "MainBrain.h"
+
+#define ASSET_FIRST             9
+#define ASSET_BASE              0x9000
+#define ASSET_SECTOR_BYTES      0x1000
+#define ASSET_HEADER            16
+#define ASSET_ENTRY             32
+#define ASSET_VERSION           1
+
+//Pixels per write to the display
+#define ASSET_PIXELS            64
+
+//Bytes of a write request, and the writes queued at once
+#define ASSET_WRITE_MAX         56
+#define ASSET_SLOTS             8
+
+//Bytes checked per Asset_Service()
+#define ASSET_VERIFY_BYTES      1024
+
+//Update states
+#define ASSET_IDLE              0
+#define ASSET_ERASING           1
+#define ASSET_WRITING           2
+#define ASSET_VERIFYING         3
+#define ASSET_FAILED            4
+
+typedef struct
+{
+    FLASH_JOB job;
+    volatile bool used;
+    uint8_t data[ASSET_WRITE_MAX];
+} ASSET_SLOT;
+
+static ASSET asset_dir[ASSET_MAX];
+static uint8_t asset_count = 0;
+
+static volatile uint8_t asset_state = ASSET_IDLE;
+static uint32_t asset_length;
+static uint16_t asset_sector;
+static uint16_t asset_last;
+static FLASH_JOB asset_erase_job;
+static ASSET_SLOT asset_slots[ASSET_SLOTS];
+static volatile uint32_t asset_programmed;
+static volatile uint16_t asset_erased;
+static volatile uint16_t asset_errors;
+static uint32_t asset_verified;
+static uint32_t asset_crc;
+
+static void Asset_Erased(FLASH_JOB *job);
+
+static uint16_t Asset_Get16(const uint8_t *buffer)
+{
+    return buffer[0] | (buffer[1] << 8);
+}
+
+static uint32_t Asset_Get32(const volatile uint8_t *buffer)
+{
+    return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+static void Asset_Put16(volatile uint8_t *buffer, uint16_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+}
+
+static void Asset_Put32(volatile uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+//Room for the store, up to the flash map sector
+static uint32_t Asset_Room(void)
+{
+    if(Flash_Map_Sectors() <= (ASSET_FIRST + 1))
+    {
+        return 0;
+    }
+
+    return (uint32_t)(Flash_Map_Sectors() - ASSET_FIRST - 1) * ASSET_SECTOR_BYTES;
+}
+
+//Loads the directory, no assets when the store is not there
+void Asset_Init(void)
+{
+    uint8_t header[ASSET_HEADER];
+    uint8_t entry[ASSET_ENTRY];
+    uint32_t length;
+    ASSET *asset;
+
+    asset_count = 0;
+
+    Flash_Read(ASSET_BASE, header, ASSET_HEADER);
+    length = Asset_Get32(&header[4]);
+
+    if((header[0] != 'A') || (header[1] != 'S') || (header[2] != ASSET_VERSION) ||
+       (header[3] > ASSET_MAX) || (length > Asset_Room()))
+    {
+        return;
+    }
+
+    for(int i=0;i<header[3];i++)
+    {
+        Flash_Read(ASSET_BASE + ASSET_HEADER + (i * ASSET_ENTRY), entry, ASSET_ENTRY);
+        asset = &asset_dir[asset_count];
+
+        for(int j=0;j<ASSET_NAME;j++)
+        {
+            asset->name[j] = entry[j];
+        }
+        asset->name[ASSET_NAME - 1] = 0;
+
+        asset->width = Asset_Get16(&entry[16]);
+        asset->height = Asset_Get16(&entry[18]);
+        asset->offset = Asset_Get32(&entry[20]);
+        asset->length = Asset_Get32(&entry[24]);
+        asset->format = entry[28];
+
+        //Skip what does not fit in the store
+        if((asset->offset > length) || (asset->length > (length - asset->offset)) ||
+           (asset->format > ASSET_RLE))
+        {
+            continue;
+        }
+
+        asset_count++;
+    }
+}
+
+const ASSET *Asset_Find(const char *name)
+{
+    int j;
+
+    for(int i=0;i<asset_count;i++)
+    {
+        for(j=0;j<ASSET_NAME;j++)
+        {
+            if((asset_dir[i].name[j] != name[j]) || (name[j] == 0))
+            {
+                break;
+            }
+        }
+
+        if((j < ASSET_NAME) && (asset_dir[i].name[j] == name[j]))
+        {
+            return &asset_dir[i];
+        }
+    }
+
+    return NULL;
+}
+
+void Asset_Open(ASSET_READER *reader, const ASSET *asset)
+{
+    reader->asset = asset;
+    reader->run = 0;
+    reader->literal = 0;
+    
+    Flash_Reader_Open(&reader->flash, ASSET_BASE + asset->offset, asset->length);
+}
+
+static bool Asset_Pixel(ASSET_READER *reader, uint16_t *pixel)
+{
+    uint8_t lo;
+    uint8_t hi;
+
+    if(!Flash_Reader_Byte(&reader->flash, &lo) || !Flash_Reader_Byte(&reader->flash, &hi))
+    {
+        return false;
+    }
+
+    *pixel = lo | (hi << 8);
+
+    return true;
+}
+
+//Decodes up to count pixels, returns how many there were
+uint32_t Asset_Read(ASSET_READER *reader, uint16_t *pixels, uint32_t count)
+{
+    uint32_t i;
+    uint8_t record;
+
+    //Little endian like the MCU, the bytes go straight in
+    if(reader->asset->format == ASSET_RAW)
+    {
+        return Flash_Reader_Read(&reader->flash, (uint8_t *)pixels, count * 2) / 2;
+    }
+
+    for(i=0;i<count;i++)
+    {
+        if((reader->run == 0) && (reader->literal == 0))
+        {
+            if(!Flash_Reader_Byte(&reader->flash, &record))
+            {
+                break;
+            }
+
+            if(record & 0x80)
+            {
+                if(!Asset_Pixel(reader, &reader->pixel))
+                {
+                    break;
+                }
+                reader->run = (record & 0x7f) + 1;
+            }
+            else
+            {
+                reader->literal = record + 1;
+            }
+        }
+
+        if(reader->run != 0)
+        {
+            pixels[i] = reader->pixel;
+            reader->run--;
+        }
+        else
+        {
+            if(!Asset_Pixel(reader, &pixels[i]))
+            {
+                break;
+            }
+            reader->literal--;
+        }
+    }
+
+    return i;
+}
+
+//Writes count pixels from pixel skip on to the memory write the
+//caller started, returns the pixels written
+uint32_t Asset_Stream(const ASSET *asset, uint32_t skip, uint32_t count)
+{
+    ASSET_READER reader;
+    uint16_t pixels[ASSET_PIXELS];
+    uint32_t written = 0;
+    uint32_t n;
+
+    Asset_Open(&reader, asset);
+
+    while(skip > 0)
+    {
+        n = Asset_Read(&reader, pixels, (skip < ASSET_PIXELS) ? skip : ASSET_PIXELS);
+        if(n == 0)
+        {
+            return 0;
+        }
+        skip = skip - n;
+    }
+
+    while(written < count)
+    {
+        n = Asset_Read(&reader, pixels, ((count - written) < ASSET_PIXELS) ? (count - written) : ASSET_PIXELS);
+        if(n == 0)
+        {
+            break;
+        }
+
+        Display_Pixels(pixels, n);
+        written = written + n;
+    }
+
+    return written;
+}
+
+//Draws the asset with its top left corner at col, row
+bool Asset_Blit(const char *name, unsigned col, unsigned row)
+{
+    const ASSET *asset = Asset_Find(name);
+
+    if((asset == NULL) || (asset->width == 0) || (asset->height == 0))
+    {
+        return false;
+    }
+
+    Display_Window(col, col + asset->width - 1, row, row + asset->height - 1);
+    Asset_Stream(asset, 0, (uint32_t)asset->width * asset->height);
+
+    return true;
+}
+
+//Erases the next used sector of the store, writing starts when
+//there is none
+static void Asset_Erase_Next(void)
+{
+    while(asset_sector <= asset_last)
+    {
+        if(Flash_Map_Sector_Used(asset_sector))
+        {
+            Flash_Jobs_Erase(&asset_erase_job, asset_sector, Asset_Erased, NULL);
+            return;
+        }
+        asset_sector++;
+    }
+
+    asset_state = ASSET_WRITING;
+}
+
+static void Asset_Erased(FLASH_JOB *job)
+{
+    if(job->state != FLASH_JOB_DONE)
+    {
+        asset_errors++;
+        asset_state = ASSET_FAILED;
+        return;
+    }
+
+    asset_erased++;
+    asset_sector++;
+    Asset_Erase_Next();
+}
+
+static void Asset_Written(FLASH_JOB *job)
+{
+    ASSET_SLOT *slot = job->context;
+
+    if(job->state != FLASH_JOB_DONE)
+    {
+        asset_errors++;
+        asset_state = ASSET_FAILED;
+    }
+
+    asset_programmed = asset_programmed + job->done_bytes;
+    slot->used = false;
+}
+
+static bool Asset_Writing(void)
+{
+    for(int i=0;i<ASSET_SLOTS;i++)
+    {
+        if(asset_slots[i].used)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//0x77, starts an update
+void Asset_Begin_Report(void)
+{
+    uint32_t length = Asset_Get32(&EP[1].rx_buffer[1]);
+    uint8_t started = 0;
+
+    EP[2].tx_buffer[0] = 0x77;
+
+    if((asset_state != ASSET_ERASING) && (asset_state != ASSET_VERIFYING) && !Asset_Writing() &&
+       (length >= ASSET_HEADER) && (length <= Asset_Room()))
+    {
+        //The directory goes with the store
+        asset_count = 0;
+
+        asset_length = length;
+        asset_sector = ASSET_FIRST;
+        asset_last = ASSET_FIRST + ((length - 1) / ASSET_SECTOR_BYTES);
+        asset_programmed = 0;
+        asset_erased = 0;
+        asset_errors = 0;
+
+        asset_state = ASSET_ERASING;
+        started = 1;
+
+        Asset_Erase_Next();
+    }
+
+    EP[2].tx_buffer[1] = started;
+    Asset_Put16(&EP[2].tx_buffer[2], started ? (asset_last - ASSET_FIRST + 1) : 0);
+    Asset_Put32(&EP[2].tx_buffer[4], Asset_Room());
+
+    EP2_TX(EP[2].tx_buffer);
+}
+
+//0x78, queues bytes of the store
+void Asset_Write_Report(void)
+{
+    uint32_t offset = EP[1].rx_buffer[1] | (EP[1].rx_buffer[2] << 8) | (EP[1].rx_buffer[3] << 16);
+    uint8_t count = EP[1].rx_buffer[4];
+    ASSET_SLOT *slot = NULL;
+    uint8_t result = 2;
+
+    if(asset_state == ASSET_ERASING)
+    {
+        result = 0;
+    }
+    else if((asset_state == ASSET_WRITING) && (count > 0) && (count <= ASSET_WRITE_MAX) &&
+            ((offset + count) <= asset_length))
+    {
+        result = 0;
+
+        for(int i=0;i<ASSET_SLOTS;i++)
+        {
+            if(!asset_slots[i].used)
+            {
+                slot = &asset_slots[i];
+                break;
+            }
+        }
+
+        if(slot != NULL)
+        {
+            for(int i=0;i<count;i++)
+            {
+                slot->data[i] = EP[1].rx_buffer[5 + i];
+
+                //The 'A' 'S' is programmed when the store checks out
+                if((offset + i) < 2)
+                {
+                    slot->data[i] = 0xff;
+                }
+            }
+
+            slot->used = true;
+            if(Flash_Jobs_Program(&slot->job, ASSET_BASE + offset, slot->data, count, Asset_Written, slot))
+            {
+                result = 1;
+            }
+            else
+            {
+                slot->used = false;
+                result = 2;
+            }
+        }
+    }
+
+    EP[2].tx_buffer[0] = 0x78;
+    EP[2].tx_buffer[1] = result;
+
+    EP2_TX(EP[2].tx_buffer);
+}
+
+//0x79, the state of the update
+void Asset_Status_Report(void)
+{
+    if((EP[1].rx_buffer[1] == 1) && (asset_state == ASSET_WRITING))
+    {
+        asset_verified = ASSET_HEADER;
+        asset_crc = 0xffffffff;
+        asset_state = ASSET_VERIFYING;
+    }
+    else if((EP[1].rx_buffer[1] == 2) && (asset_state != ASSET_ERASING) &&
+            (asset_state != ASSET_VERIFYING) && !Asset_Writing())
+    {
+        //The length comes from the header, Asset_Service() reads it
+        asset_count = 0;
+        asset_length = 0;
+        asset_programmed = 0;
+        asset_erased = 0;
+        asset_errors = 0;
+        asset_verified = ASSET_HEADER;
+        asset_crc = 0xffffffff;
+        asset_state = ASSET_VERIFYING;
+    }
+
+    EP[2].tx_buffer[0] = 0x79;
+    EP[2].tx_buffer[1] = asset_state;
+    EP[2].tx_buffer[2] = asset_count;
+    Asset_Put32(&EP[2].tx_buffer[3], asset_programmed);
+    Asset_Put16(&EP[2].tx_buffer[7], asset_erased);
+    Asset_Put16(&EP[2].tx_buffer[9], asset_errors);
+    Asset_Put32(&EP[2].tx_buffer[11], asset_length);
+
+    EP2_TX(EP[2].tx_buffer);
+}
+
+//Main loop, checks a written store a piece at a time
+void Asset_Service(void)
+{
+    uint8_t buffer[ASSET_CHUNK];
+    uint8_t header[ASSET_HEADER];
+    uint32_t end;
+    uint32_t count;
+
+    if((asset_state != ASSET_VERIFYING) || Asset_Writing())
+    {
+        return;
+    }
+
+    if(asset_length == 0)
+    {
+        Flash_Read(ASSET_BASE, header, ASSET_HEADER);
+        asset_length = Asset_Get32(&header[4]);
+
+        if((asset_length < ASSET_HEADER) || (asset_length > Asset_Room()))
+        {
+            asset_errors++;
+            asset_state = ASSET_FAILED;
+            return;
+        }
+    }
+
+    end = asset_verified + ASSET_VERIFY_BYTES;
+    if(end > asset_length)
+    {
+        end = asset_length;
+    }
+
+    while(asset_verified < end)
+    {
+        count = end - asset_verified;
+        if(count > ASSET_CHUNK)
+        {
+            count = ASSET_CHUNK;
+        }
+
+        Flash_Read(ASSET_BASE + asset_verified, buffer, count);
+        asset_crc = CRC32(asset_crc, buffer, count);
+        asset_verified = asset_verified + count;
+    }
+
+    if(asset_verified < asset_length)
+    {
+        return;
+    }
+
+    Flash_Read(ASSET_BASE, header, ASSET_HEADER);
+
+    if(((asset_crc ^ 0xffffffff) != Asset_Get32(&header[8])) || (Asset_Get32(&header[4]) != asset_length))
+    {
+        asset_errors++;
+        asset_state = ASSET_FAILED;
+        return;
+    }
+
+    Flash_WR(ASSET_BASE, 'A');
+    Flash_WR(ASSET_BASE + 1, 'S');
+
+    Asset_Init();
+    asset_state = ASSET_IDLE;
+
+    //The screen may show an old image
+    NeedsRefresh = true;
+}
@@ -0,0 +1,383 @@
+/*********************************************************************
+    FileName:     	Bench.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 MHz, Core Timer = System Clock / 2
+
+    File Description:
+        USB benchmark commands
+
+        Every timestamp is the Core Timer count (10 nS per tick,
+        wraps every 42.9 seconds). The USB interrupt records the count
+        on entry and the ticks spent in the handler, so the Host can
+        see how much CPU time the USB traffic costs.
+
+        0x10 Loopback
+            Request:  Byte 1 = number of bytes (max 54), Byte 2- = bytes
+            Reply:    Byte 0 = 0x10, Byte 1 = number of bytes
+                      Byte 2-5 = timestamp at USB interrupt entry
+                      Byte 6-9 = timestamp when the reply is queued
+                      Byte 10- = the bytes
+
+        0x11 Source
+            Request:  Byte 1-4 = number of packets
+            The packets are sent back to back on Endpoint 2, the next
+            one is loaded from the Endpoint 2 TX complete interrupt.
+            Packet:   Byte 0 = 0x11, Byte 1 = 1 on the last packet
+                      Byte 2-5 = sequence number
+                      Byte 6-9 = timestamp
+
+        0x12 Sink
+            Request:  Byte 1-4 = number of packets
+            The next packets on Endpoint 1 are counted, not dispatched.
+
+        0x13 Report
+            Request:  Byte 1 = 1 resets the counters after the report
+            Reply (all 32-bit):
+                      Byte 2     Core Timer now
+                      Byte 6     Core Timer frequency
+                      Byte 10    USB interrupts
+                      Byte 14    USB interrupt ticks (total)
+                      Byte 18    USB interrupt ticks (longest)
+                      Byte 22    Sink packets
+                      Byte 26    Sink bytes
+                      Byte 30    Sink first packet timestamp
+                      Byte 34    Sink last packet timestamp
+                      Byte 38    Source packets sent
+                      Byte 42    Source first packet timestamp
+                      Byte 46    Source last packet timestamp
+
+        0x14 SRAM
+            Request:  Byte 1-2 = SRAM address, Byte 3-4 = number of
+                      bytes (max 1024)
+            The bytes are read and written back unchanged, once a byte
+            at a time, once as a block and once as a DMA block. The
+            bytes stop before the mailbox words (0x1ffe), the regions
+            they are in are locked so no board writes in between.
+            Reply (all 32-bit):
+                      Byte 1     1 = a board held the region, not run
+                      Byte 2     number of bytes
+                      Byte 6     byte read ticks
+                      Byte 10    byte write ticks
+                      Byte 14    block read ticks
+                      Byte 18    block write ticks
+                      Byte 22    DMA block read ticks
+                      Byte 26    DMA block write ticks
+
+        All values are little endian.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include "MainBrain.h"
+
+#define BENCH_CORE_TIMER_HZ     100000000
+
+//Loopback payload after the 10 byte reply header
+#define BENCH_LOOPBACK_MAX      54
+
+//One board region
+#define BENCH_SRAM_MAX          1024
+
+//The mailbox words, a write there interrupts a board
+#define BENCH_SRAM_END          0x1ffe
+
+//A board holding a region is not waited for longer
+#define BENCH_SRAM_LOCK_US      50
+
+volatile uint32_t BenchISRStart = 0;
+volatile uint32_t BenchISRCount = 0;
+volatile uint32_t BenchISRTicks = 0;
+volatile uint32_t BenchISRMax = 0;
+volatile uint32_t BenchSourceRemaining = 0;
+
+static volatile uint32_t bench_sink_remaining = 0;
+static uint32_t bench_sink_packets = 0;
+static uint32_t bench_sink_bytes = 0;
+static uint32_t bench_sink_first = 0;
+static uint32_t bench_sink_last = 0;
+
+static uint32_t bench_source_sequence = 0;
+static uint32_t bench_source_first = 0;
+static uint32_t bench_source_last = 0;
+
+//The block functions use the DMA for the coherent one
+static uint8_t bench_sram_cached[BENCH_SRAM_MAX];
+static uint8_t __attribute__((coherent)) bench_sram_coherent[BENCH_SRAM_MAX];
+
+static uint32_t bench_get32(volatile uint8_t *buffer)
+{
+    return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+static void bench_put32(volatile uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+//First thing in the USB interrupt
+void Bench_ISR_Enter(void)
+{
+    BenchISRStart = _CP0_GET_COUNT();
+}
+
+//Last thing in the USB interrupt
+void Bench_ISR_Exit(void)
+{
+    uint32_t ticks = _CP0_GET_COUNT() - BenchISRStart;
+
+    BenchISRCount++;
+    BenchISRTicks = BenchISRTicks + ticks;
+
+    if(ticks > BenchISRMax)
+    {
+        BenchISRMax = ticks;
+    }
+}
+
+void Bench_Loopback(void)
+{
+    uint8_t length = EP[1].rx_buffer[1];
+
+    if(length > BENCH_LOOPBACK_MAX)
+    {
+        length = BENCH_LOOPBACK_MAX;
+    }
+
+    EP[2].tx_buffer[0] = 0x10;
+    EP[2].tx_buffer[1] = length;
+    bench_put32(&EP[2].tx_buffer[2], BenchISRStart);
+
+    for(int i=0;i<length;i++)
+    {
+        EP[2].tx_buffer[10 + i] = EP[1].rx_buffer[2 + i];
+    }
+
+    bench_put32(&EP[2].tx_buffer[6], _CP0_GET_COUNT());
+    EP2_TX(EP[2].tx_buffer);
+}
+
+void Bench_Source_Start(void)
+{
+    BenchSourceRemaining = bench_get32(&EP[1].rx_buffer[1]);
+    bench_source_sequence = 0;
+
+    if(BenchSourceRemaining == 0)
+    {
+        return;
+    }
+
+    //The Endpoint 2 TX complete interrupt loads the rest
+    USBCSR1bits.EP2TXIE = 1;
+
+    Bench_Source_Next();
+}
+
+//Called when Endpoint 2 has sent its packet
+void Bench_Source_Next(void)
+{
+    uint32_t now;
+
+    if(BenchSourceRemaining == 0)
+    {
+        USBCSR1bits.EP2TXIE = 0;
+        return;
+    }
+
+    BenchSourceRemaining--;
+
+    now = _CP0_GET_COUNT();
+    if(bench_source_sequence == 0)
+    {
+        bench_source_first = now;
+    }
+    bench_source_last = now;
+
+    EP[2].tx_buffer[0] = 0x11;
+    EP[2].tx_buffer[1] = (BenchSourceRemaining == 0);
+    bench_put32(&EP[2].tx_buffer[2], bench_source_sequence++);
+    bench_put32(&EP[2].tx_buffer[6], now);
+
+    EP2_TX(EP[2].tx_buffer);
+}
+
+void Bench_Sink_Start(void)
+{
+    bench_sink_packets = 0;
+    bench_sink_bytes = 0;
+    bench_sink_first = 0;
+    bench_sink_last = 0;
+
+    bench_sink_remaining = bench_get32(&EP[1].rx_buffer[1]);
+}
+
+//Returns true when the packet in EP[1] belongs to the sink
+bool Bench_Sink(void)
+{
+    if(bench_sink_remaining == 0)
+    {
+        return false;
+    }
+
+    bench_sink_remaining--;
+
+    if(bench_sink_packets == 0)
+    {
+        bench_sink_first = BenchISRStart;
+    }
+    bench_sink_last = BenchISRStart;
+
+    bench_sink_packets++;
+    bench_sink_bytes = bench_sink_bytes + EP[1].rx_num_bytes;
+
+    return true;
+}
+
+void Bench_Report(void)
+{
+    EP[2].tx_buffer[0] = 0x13;
+    EP[2].tx_buffer[1] = 0;
+
+    bench_put32(&EP[2].tx_buffer[2], _CP0_GET_COUNT());
+    bench_put32(&EP[2].tx_buffer[6], BENCH_CORE_TIMER_HZ);
+    bench_put32(&EP[2].tx_buffer[10], BenchISRCount);
+    bench_put32(&EP[2].tx_buffer[14], BenchISRTicks);
+    bench_put32(&EP[2].tx_buffer[18], BenchISRMax);
+    bench_put32(&EP[2].tx_buffer[22], bench_sink_packets);
+    bench_put32(&EP[2].tx_buffer[26], bench_sink_bytes);
+    bench_put32(&EP[2].tx_buffer[30], bench_sink_first);
+    bench_put32(&EP[2].tx_buffer[34], bench_sink_last);
+    bench_put32(&EP[2].tx_buffer[38], bench_source_sequence);
+    bench_put32(&EP[2].tx_buffer[42], bench_source_first);
+    bench_put32(&EP[2].tx_buffer[46], bench_source_last);
+
+    EP2_TX(EP[2].tx_buffer);
+
+    if(EP[1].rx_buffer[1] == 1)
+    {
+        BenchISRCount = 0;
+        BenchISRTicks = 0;
+        BenchISRMax = 0;
+        bench_sink_packets = 0;
+        bench_sink_bytes = 0;
+        bench_source_sequence = 0;
+    }
+}
+
+void Bench_SRAM(void)
+{
+    uint32_t address = EP[1].rx_buffer[1] | (EP[1].rx_buffer[2] << 8);
+    uint16_t length = EP[1].rx_buffer[3] | (EP[1].rx_buffer[4] << 8);
+    uint32_t start;
+    uint8_t first;
+    uint8_t last;
+    bool locked;
+
+    if(length > BENCH_SRAM_MAX)
+    {
+        length = BENCH_SRAM_MAX;
+    }
+
+    if(address >= BENCH_SRAM_END)
+    {
+        length = 0;
+    }
+    else if((address + length) > BENCH_SRAM_END)
+    {
+        length = BENCH_SRAM_END - address;
+    }
+
+    EP[2].tx_buffer[0] = 0x14;
+    EP[2].tx_buffer[1] = 0;
+    bench_put32(&EP[2].tx_buffer[2], length);
+
+    if(length == 0)
+    {
+        EP2_TX(EP[2].tx_buffer);
+        return;
+    }
+
+    //What the shadow copy holds goes out first, it is written
+    //back with the rest. At most two regions, length <= 1024.
+    SRAM_Shadow_FlushRange(address, length);
+
+    first = SRAM_FLAG(address);
+    last = SRAM_FLAG(address + length - 1);
+    if(!REN70V05_LOCK(first, BENCH_SRAM_LOCK_US))
+    {
+        EP[2].tx_buffer[1] = 1;
+        EP2_TX(EP[2].tx_buffer);
+        return;
+    }
+    locked = (last != first);
+    if(locked && !REN70V05_LOCK(last, BENCH_SRAM_LOCK_US))
+    {
+        REN70V05_RELEASE(first);
+        EP[2].tx_buffer[1] = 1;
+        EP2_TX(EP[2].tx_buffer);
+        return;
+    }
+
+    start = _CP0_GET_COUNT();
+    for(int i=0;i<length;i++)
+    {
+        bench_sram_cached[i] = REN70V05_RD(address + i);
+    }
+    bench_put32(&EP[2].tx_buffer[6], _CP0_GET_COUNT() - start);
+
+    start = _CP0_GET_COUNT();
+    for(int i=0;i<length;i++)
+    {
+        REN70V05_WR(address + i, bench_sram_cached[i]);
+    }
+    bench_put32(&EP[2].tx_buffer[10], _CP0_GET_COUNT() - start);
+
+    start = _CP0_GET_COUNT();
+    REN70V05_ReadBlock(address, bench_sram_cached, length);
+    bench_put32(&EP[2].tx_buffer[14], _CP0_GET_COUNT() - start);
+
+    start = _CP0_GET_COUNT();
+    REN70V05_WriteBlock(address, bench_sram_cached, length);
+    bench_put32(&EP[2].tx_buffer[18], _CP0_GET_COUNT() - start);
+
+    start = _CP0_GET_COUNT();
+    REN70V05_ReadBlock(address, bench_sram_coherent, length);
+    bench_put32(&EP[2].tx_buffer[22], _CP0_GET_COUNT() - start);
+
+    start = _CP0_GET_COUNT();
+    REN70V05_WriteBlock(address, bench_sram_coherent, length);
+    bench_put32(&EP[2].tx_buffer[26], _CP0_GET_COUNT() - start);
+
+    if(locked)
+    {
+        REN70V05_RELEASE(last);
+    }
+    REN70V05_RELEASE(first);
+
+    EP2_TX(EP[2].tx_buffer);
+}
@@ -0,0 +1,92 @@
+/*********************************************************************
+    FileName:     	Board_Events.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 MHz, Core Timer = System Clock / 2
+
+    File Description:
+        Queue of notifications from the I/O boards
+
+        A board notifies the MainBrain by writing the 70V05 mailbox
+        interrupt word (REN70V05.c), CN_ISR reads it and posts it
+        here with the Core Timer count. The word is
+            Bits 0-2    board address
+            Bits 3-7    event code, BOARD_EVENT_DONE when the board
+                        has finished the last directive
+        The MainBrain posts the end of each directive the same way
+        (Directives.c), BOARD_EVENT_ACK or BOARD_EVENT_TIMEOUT.
+
+        The posts come from ipl5 interrupts or with interrupts off,
+        one reader takes, the reader is the USB interrupt (vendor
+        Read Board Events). When the queue is full the event is
+        dropped and counted.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include "MainBrain.h"
+
+#define BOARD_EVENT_QUEUE       32
+
+volatile uint32_t BoardEventsLost = 0;
+
+static BOARD_EVENT board_events[BOARD_EVENT_QUEUE];
+static volatile uint8_t board_event_head = 0;
+static volatile uint8_t board_event_tail = 0;
+
+void Board_Event_Post(uint8_t value)
+{
+    BOARD_EVENT *event;
+    uint8_t head = board_event_head;
+
+    if((uint8_t)(head - board_event_tail) >= BOARD_EVENT_QUEUE)
+    {
+        BoardEventsLost++;
+        return;
+    }
+
+    event = &board_events[head % BOARD_EVENT_QUEUE];
+    event->board = value & 7;
+    event->code = value >> 3;
+    event->time = _CP0_GET_COUNT();
+
+    //The event, then the index that hands it over
+    board_event_head = head + 1;
+}
+
+bool Board_Event_Get(BOARD_EVENT *event)
+{
+    uint8_t tail = board_event_tail;
+
+    if(tail == board_event_head)
+    {
+        return false;
+    }
+
+    *event = board_events[tail % BOARD_EVENT_QUEUE];
+    board_event_tail = tail + 1;
+
+    return true;
+}
@@ -133,3 +133,23 @@ void Binary2ASCIIHex(int i_hex)
     
     return;
 }
+
+/********************************************/
+/*CRC-32, polynomial 0xedb88320 (reflected) */
+/*Start with 0xffffffff, the CRC is the     */
+/*result ^ 0xffffffff                       */
+/********************************************/
+uint32_t CRC32(uint32_t crc, const uint8_t *data, uint32_t length)
+{
+    for(uint32_t i=0;i<length;i++)
+    {
+        crc = crc ^ data[i];
+
+        for(int j=0;j<8;j++)
+        {
+            crc = (crc & 1) ? ((crc >> 1) ^ 0xedb88320) : (crc >> 1);
+        }
+    }
+
+    return crc;
+}
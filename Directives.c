@@ -0,0 +1,793 @@
+/*********************************************************************
+    FileName:     	Directives.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 MHz
+
+    File Description:
+        Directives to the I/O boards, without waiting for the /ACK
+
+        A directive tells a board to read the command at offset 0 of
+        its SRAM region: the region is flushed (SRAM_Shadow.c), the
+        board address is put on the select lines and the board pulls
+        /ACK (RG13) low when it is done. Timer 3 times it out.
+
+        Only one board can be selected at a time, but the boards
+        work on their own. Each board has its own queue of up to
+        DIRECTIVE_DEPTH directives, with the bytes (up to 64) that go
+        to the start of its region. While a board works on its
+        directive the next board's bytes are written to its region,
+        so when the /ACK comes the next directive only needs the
+        select lines. A board's own next directive cannot be written
+        while it reads the region, the scheduler takes another board
+        when there is one.
+
+        Which board is next: the highest priority (0 - 3, 3 first,
+        DIRECTIVE_PRIORITY_NORMAL to start with) of the boards with
+        work, the boards of that priority in turn after the last one
+        served. A higher priority board can wait for one directive,
+        the one already written. A board that asked for service at
+        priority 3 (Service.c, Directive_Urgent()) goes before all of
+        them with its next directive.
+
+        The end of a directive is seen by interrupts, not by a loop:
+            - the falling edge of /ACK, change notice on port G
+            - Timer 3 reaching the period, the time out
+        Both call Directive_Tick(), which ends the directive, starts
+        the next one and writes the one after. The tick runs with
+        interrupts off and takes the PMP like the flash jobs
+        (REN70V05_PMP_Take()), so it can land in the middle of a
+        display or SRAM access.
+
+        The tick never waits for a board holding its region: it tries
+        the semaphore once (REN70V05_SEM()), and what it could not do
+        (write the bytes, flush the shadow copy, put back a probe's
+        command byte) stays for a later tick. With no board selected
+        Timer 3 runs with DIRECTIVE_RETRY_PERIOD for that tick.
+
+        The end of every directive is posted on the board event queue
+        (Board_Events.c, Vendor request 0x06) with the Core Timer
+        count, BOARD_EVENT_ACK or BOARD_EVENT_TIMEOUT.
+
+        Directive_Submit() copies the bytes, a full queue runs the
+        tick until there is room. Directive_Queue() is a directive
+        whose bytes the caller already wrote, Directive_Wait() waits
+        until a board has no directive left. Directive_Probe() is a
+        no command (0x00) with a DIRECTIVE_PROBE_PERIOD time out, for
+        finding which boards are there (Peripherals.c). The command
+        byte it replaces is put back when the probe ends, unless
+        something else was written there meanwhile. A probe is
+        not counted with the directives, ACKs and time outs, or
+        posted as an event. Directives with refresh
+        redraw the screen from Directive_Service() in the main loop
+        once the board has written its data.
+
+        0x7a Directive Stats
+            Request:  Byte 1     0 read, 1 set the priorities to
+                                 Byte 2-8 (boards 1 - 7) first,
+                                 2 clear the counters first
+            Reply:    Byte 0     0x7a
+                      Byte 1     boards with directives queued, bit
+                                 0 is board 1
+                      Byte 2-8   priorities of boards 1 - 7
+                      Byte 9-12  directives started
+                      Byte 13-16 ACKs
+                      Byte 17-20 time outs
+                      Byte 21-24 directives per second, the last
+                                 whole second, 0 after 2 s of none
+                      Byte 25-28 directives written while another
+                                 board worked
+                      Byte 29-32 waits for a full queue
+                      Byte 33-36 Core Timer ticks from select to ACK,
+                                 all ACKs
+                      Byte 37-40 longest select to ACK
+            All values are little endian.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include <stddef.h>
+#include "MainBrain.h"
+
+#define DIRECTIVE_BOARDS        7
+#define DIRECTIVE_DEPTH         4
+#define DIRECTIVE_DATA          64
+
+//Timer 3 counts to the next try when a board held its region,
+//20 us at 1:256 of PBCLK3
+#define DIRECTIVE_RETRY_PERIOD  16
+
+//Directives per second over this many Core Timer ticks, 1 s
+#define DIRECTIVE_WINDOW        100000000
+
+//Timer 3 counts to the time out of a probe, 200 us at 1:256 of
+//PBCLK3, a board that is there ACKs in a few us
+#define DIRECTIVE_PROBE_PERIOD  156
+
+#define DIRECTIVE_REFRESH       0x01
+#define DIRECTIVE_PROBE         0x02
+
+typedef struct
+{
+    uint8_t length;
+    uint8_t flags;
+    uint8_t data[DIRECTIVE_DATA];
+} DIRECTIVE;
+
+DIRECTIVE_STATS DirectiveStats;
+
+static DIRECTIVE directive_work[DIRECTIVE_BOARDS][DIRECTIVE_DEPTH];
+
+//The command byte a probe wrote over, and the boards it still
+//has to go back to, bit 0 is board 1
+static uint8_t directive_probe_saved[DIRECTIVE_BOARDS];
+static volatile uint8_t directive_restore = 0;
+
+//Boards that ACKed while holding their region, the shadow copy of
+//the region is dropped on a later tick
+static volatile uint8_t directive_invalidate = 0;
+static uint8_t directive_head[DIRECTIVE_BOARDS];
+static uint8_t directive_tail[DIRECTIVE_BOARDS];
+static uint8_t directive_priority[DIRECTIVE_BOARDS] = {
+    DIRECTIVE_PRIORITY_NORMAL, DIRECTIVE_PRIORITY_NORMAL, DIRECTIVE_PRIORITY_NORMAL,
+    DIRECTIVE_PRIORITY_NORMAL, DIRECTIVE_PRIORITY_NORMAL, DIRECTIVE_PRIORITY_NORMAL,
+    DIRECTIVE_PRIORITY_NORMAL
+};
+
+//Directives queued on all the boards
+static volatile uint8_t directive_queued = 0;
+
+//The board waiting for its /ACK, 0 for none, and the flags
+static volatile uint8_t directive_active = 0;
+static uint8_t directive_flags;
+static uint32_t directive_start;
+
+//The board whose next directive is already in its region
+static uint8_t directive_next = 0;
+
+//Boards whose next directive goes first, bit 0 is board 1
+static volatile uint8_t directive_urgent = 0;
+
+//The last board started, the turn goes on from there
+static uint8_t directive_last = DIRECTIVE_BOARDS;
+
+//Directives per second
+static uint32_t directive_window_start;
+static uint32_t directive_window_count = 0;
+static uint32_t directive_rate = 0;
+static uint32_t directive_rate_time;
+
+static volatile bool directive_refresh = false;
+
+void Directive_Init(void)
+{
+    //RG13 = /ACK
+    TRISGbits.TRISG13 = 1;
+
+    CNCONGbits.ON = 1;
+    CNCONGbits.EDGEDETECT = 1;
+
+    //Falling edge of /ACK
+    CNNEGbits.CNNEG13 = 1;
+    CNFGCLR = 1 << 13;
+
+    IPC31bits.CNGIP = 5;
+    IPC31bits.CNGIS = 2;
+    IFS3bits.CNGIF = 0;
+    IEC3bits.CNGIE = 1;
+
+    //Timer 3 time out, PR3 = 0xffff at 1:256
+    T3CONbits.ON = 0;
+    T3CONbits.TCKPS = 7;
+    IPC3bits.T3IP = 5;
+    IPC3bits.T3IS = 1;
+    IFS0bits.T3IF = 0;
+    IEC0bits.T3IE = 1;
+
+    directive_window_start = _CP0_GET_COUNT();
+    directive_rate_time = directive_window_start;
+}
+
+static DIRECTIVE *Directive_Head(uint8_t board)
+{
+    return &directive_work[board - 1][directive_tail[board - 1] % DIRECTIVE_DEPTH];
+}
+
+static bool Directive_Has_Work(uint8_t board)
+{
+    return directive_head[board - 1] != directive_tail[board - 1];
+}
+
+static uint8_t Directive_Rank(uint8_t board)
+{
+    if((directive_urgent & (1 << (board - 1))) != 0)
+    {
+        return DIRECTIVE_PRIORITY_HIGH + 1;
+    }
+
+    return directive_priority[board - 1];
+}
+
+//The next board with work other than busy, 0 for none
+static uint8_t Directive_Pick(uint8_t busy)
+{
+    uint8_t best = 0;
+    uint8_t board;
+
+    for(int i=1;i<=DIRECTIVE_BOARDS;i++)
+    {
+        board = ((directive_last + i - 1) % DIRECTIVE_BOARDS) + 1;
+
+        if((board == busy) || !Directive_Has_Work(board))
+        {
+            continue;
+        }
+
+        if((best == 0) || (Directive_Rank(board) > Directive_Rank(best)))
+        {
+            best = board;
+        }
+    }
+
+    return best;
+}
+
+//The command byte back, if it still holds the probe's 0x00,
+//false when the board holds its region
+static bool Directive_Probe_Restore(uint8_t board)
+{
+    uint32_t region = (board - 1) * 0x400;
+    uint8_t command;
+
+    if((directive_restore & (1 << (board - 1))) == 0)
+    {
+        return true;
+    }
+
+    if(!REN70V05_SEM(SRAM_FLAG(region)))
+    {
+        return false;
+    }
+
+    REN70V05_ReadBlock(region, &command, 1);
+    if(command == 0x00)
+    {
+        REN70V05_WriteBlock(region, &directive_probe_saved[board - 1], 1);
+    }
+    REN70V05_RELEASE(SRAM_FLAG(region));
+
+    directive_restore = directive_restore & ~(1 << (board - 1));
+
+    return true;
+}
+
+//The board has written its data, false when it holds its region
+//and there were bytes to write first
+static bool Directive_Invalidate(uint8_t board)
+{
+    if((directive_invalidate & (1 << (board - 1))) == 0)
+    {
+        return true;
+    }
+
+    if(!SRAM_Shadow_TryInvalidateRange((board - 1) * 0x400, 0x400))
+    {
+        return false;
+    }
+
+    directive_invalidate = directive_invalidate & ~(1 << (board - 1));
+
+    return true;
+}
+
+//The bytes of the board's next directive to its region, false
+//when the board holds its region
+static bool Directive_Fill(uint8_t board)
+{
+    DIRECTIVE *work = Directive_Head(board);
+    uint32_t region = (board - 1) * 0x400;
+
+    //What the last directive left to do goes first
+    if(!Directive_Invalidate(board) || !Directive_Probe_Restore(board))
+    {
+        return false;
+    }
+
+    if(work->length == 0)
+    {
+        return true;
+    }
+
+    //Writes what is still only in the shadow copy, a probe keeps
+    //the command byte with it
+    if(!SRAM_Shadow_TryInvalidateRange(region, work->length))
+    {
+        return false;
+    }
+
+    if(!REN70V05_SEM(SRAM_FLAG(region)))
+    {
+        return false;
+    }
+
+    if((work->flags & DIRECTIVE_PROBE) != 0)
+    {
+        REN70V05_ReadBlock(region, &directive_probe_saved[board - 1], 1);
+        directive_restore = directive_restore | (1 << (board - 1));
+    }
+    REN70V05_WriteBlock(region, work->data, work->length);
+    REN70V05_RELEASE(SRAM_FLAG(region));
+
+    return true;
+}
+
+//Nothing is selected, Timer 3 runs the tick again for another try
+static void Directive_Retry(void)
+{
+    PR3 = DIRECTIVE_RETRY_PERIOD;
+    TMR3 = 0;
+    IFS0bits.T3IF = 0;
+    T3CONSET = 1 << 15;
+}
+
+static void Directive_Start(uint8_t board)
+{
+    directive_flags = Directive_Head(board)->flags;
+    directive_tail[board - 1]++;
+    directive_queued--;
+    directive_last = board;
+    directive_urgent = directive_urgent & ~(1 << (board - 1));
+
+    //The board reads what the last burst wrote
+    SRAM_DMA_Wait();
+
+    //Zero Timer 3 and set period
+    PR3 = ((directive_flags & DIRECTIVE_PROBE) != 0) ? DIRECTIVE_PROBE_PERIOD : 0xffff;
+    TMR3 = 0;
+    IFS0bits.T3IF = 0;
+
+    //An /ACK from here on is this board's
+    CNFGCLR = 1 << 13;
+
+    directive_active = board;
+    directive_start = _CP0_GET_COUNT();
+    if((directive_flags & DIRECTIVE_PROBE) == 0)
+    {
+        DirectiveStats.directives++;
+    }
+
+    //Set the board select address
+    SetPeripheralAddress(board);
+
+    //Start Timer 3
+    T3CONSET = 1 << 15;
+}
+
+static void Directive_Rate(uint32_t now)
+{
+    directive_window_count++;
+
+    if((now - directive_window_start) >= DIRECTIVE_WINDOW)
+    {
+        directive_rate = ((uint64_t)directive_window_count * DIRECTIVE_WINDOW) / (now - directive_window_start);
+        directive_rate_time = now;
+        directive_window_start = now;
+        directive_window_count = 0;
+    }
+}
+
+static void Directive_End(bool ack)
+{
+    uint8_t board = directive_active;
+    uint32_t now = _CP0_GET_COUNT();
+    uint32_t ticks = now - directive_start;
+
+    //Reset the board select address
+    SetPeripheralAddress(0);
+
+    //Stop Timer 3
+    T3CONCLR = 1 << 15;
+    IFS0bits.T3IF = 0;
+    CNFGCLR = 1 << 13;
+
+    //Every answer, or none, tells if the board is there and how
+    //long it took
+    Peripheral_Answer(board, ack, ticks, (directive_flags & DIRECTIVE_PROBE) != 0);
+
+    //Put back now or on a later tick
+    if((directive_flags & DIRECTIVE_PROBE) != 0)
+    {
+        Directive_Probe_Restore(board);
+        directive_active = 0;
+        return;
+    }
+
+    if(ack)
+    {
+        LED_Port(0x2);
+
+        //The board has written its data, now or on a later tick
+        directive_invalidate = directive_invalidate | (1 << (board - 1));
+        Directive_Invalidate(board);
+
+        DirectiveStats.acks++;
+        DirectiveStats.ack_ticks += ticks;
+        if(ticks > DirectiveStats.ack_max)
+        {
+            DirectiveStats.ack_max = ticks;
+        }
+
+        Board_Event_Post((BOARD_EVENT_ACK << 3) | board);
+    }
+    else
+    {
+        LED_Port(0x4);
+
+        DirectiveStats.timeouts++;
+
+        Board_Event_Post((BOARD_EVENT_TIMEOUT << 3) | board);
+    }
+
+    if((directive_flags & DIRECTIVE_REFRESH) != 0)
+    {
+        directive_refresh = true;
+    }
+
+    Directive_Rate(now);
+
+    directive_active = 0;
+}
+
+//Ends the directive when it is over, starts the next one, writes
+//the one after, false when there is nothing to do
+static bool Directive_Step(void)
+{
+    uint8_t board;
+
+    if(directive_active != 0)
+    {
+        if((CNFGbits.CNFG13 == 1) || (PORTGbits.RG13 == 0))
+        {
+            Directive_End(true);
+            return true;
+        }
+
+        if(IFS0bits.T3IF == 1)
+        {
+            Directive_End(false);
+            return true;
+        }
+
+        //While the board works, a board holding its region is
+        //tried again on the next tick
+        if(directive_next == 0)
+        {
+            board = Directive_Pick(directive_active);
+            if((board != 0) && Directive_Fill(board))
+            {
+                directive_next = board;
+                DirectiveStats.prefills++;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    //A retry that ran out
+    T3CONCLR = 1 << 15;
+    IFS0bits.T3IF = 0;
+
+    //What could not be done while a board held its region
+    for(board=1;board<=DIRECTIVE_BOARDS;board++)
+    {
+        Directive_Invalidate(board);
+        Directive_Probe_Restore(board);
+    }
+
+    board = directive_next;
+    if(board == 0)
+    {
+        board = Directive_Pick(0);
+        if(board == 0)
+        {
+            if((directive_restore != 0) || (directive_invalidate != 0))
+            {
+                Directive_Retry();
+            }
+            return false;
+        }
+
+        if(!Directive_Fill(board))
+        {
+            Directive_Retry();
+            return false;
+        }
+
+        directive_next = board;
+    }
+
+    //The board reads what is still only in the shadow copy
+    if(!SRAM_Shadow_TryFlushRange((board - 1) * 0x400, 0x400))
+    {
+        Directive_Retry();
+        return false;
+    }
+
+    directive_next = 0;
+    Directive_Start(board);
+
+    return true;
+}
+
+//The interrupts, Directive_Submit() and Directive_Wait()
+void Directive_Tick(void)
+{
+    REN70V05_PMP_STATE state;
+    uint32_t status;
+
+    status = __builtin_disable_interrupts();
+
+    if((directive_active != 0) || (directive_queued != 0) ||
+       (directive_restore != 0) || (directive_invalidate != 0))
+    {
+        REN70V05_PMP_Take(&state);
+
+        while(Directive_Step());
+
+        REN70V05_PMP_Give(&state);
+    }
+
+    //An edge with no directive is no one's /ACK
+    if(directive_active == 0)
+    {
+        CNFGCLR = 1 << 13;
+    }
+
+    __builtin_mtc0(12, 0, status);
+}
+
+/*************************************************************
+ Queues a directive to board (1 - 7) with length bytes for the
+ start of its region (0 when the caller wrote them), and starts
+ it if none is running. DIRECTIVE_REFRESH redraws the screen
+ when it is done. With the board's queue full it runs the tick
+ until there is room.
+*************************************************************/
+static void Directive_Put(uint8_t board, const uint8_t *data, uint8_t length, uint8_t flags)
+{
+    DIRECTIVE *work;
+    uint32_t status;
+    bool waited = false;
+
+    if((board < 1) || (board > DIRECTIVE_BOARDS))
+    {
+        return;
+    }
+
+    if(length > DIRECTIVE_DATA)
+    {
+        length = DIRECTIVE_DATA;
+    }
+
+    while(1)
+    {
+        status = __builtin_disable_interrupts();
+
+        if((uint8_t)(directive_head[board - 1] - directive_tail[board - 1]) < DIRECTIVE_DEPTH)
+        {
+            work = &directive_work[board - 1][directive_head[board - 1] % DIRECTIVE_DEPTH];
+            work->length = length;
+            work->flags = flags;
+            for(int i=0;i<length;i++)
+            {
+                work->data[i] = data[i];
+            }
+
+            directive_head[board - 1]++;
+            directive_queued++;
+
+            __builtin_mtc0(12, 0, status);
+            break;
+        }
+
+        __builtin_mtc0(12, 0, status);
+
+        if(!waited)
+        {
+            waited = true;
+            DirectiveStats.waits++;
+        }
+
+        Directive_Tick();
+    }
+
+    Directive_Tick();
+}
+
+void Directive_Submit(uint8_t board, const uint8_t *data, uint8_t length, bool refresh)
+{
+    Directive_Put(board, data, length, refresh ? DIRECTIVE_REFRESH : 0);
+}
+
+//Is the board there, the answer goes to Peripheral_Answer()
+void Directive_Probe(uint8_t board)
+{
+    static const uint8_t none = 0x00;
+
+    Directive_Put(board, &none, 1, DIRECTIVE_PROBE);
+}
+
+//The bytes are already in the board's region
+void Directive_Queue(uint8_t board, bool refresh)
+{
+    Directive_Submit(board, NULL, 0, refresh);
+}
+
+void Directive_Priority(uint8_t board, uint8_t priority)
+{
+    if((board < 1) || (board > DIRECTIVE_BOARDS))
+    {
+        return;
+    }
+
+    directive_priority[board - 1] = (priority > DIRECTIVE_PRIORITY_HIGH) ? DIRECTIVE_PRIORITY_HIGH : priority;
+}
+
+//The board's next directive goes before the others
+void Directive_Urgent(uint8_t board)
+{
+    uint32_t status;
+
+    if((board < 1) || (board > DIRECTIVE_BOARDS))
+    {
+        return;
+    }
+
+    status = __builtin_disable_interrupts();
+    directive_urgent = directive_urgent | (1 << (board - 1));
+    __builtin_mtc0(12, 0, status);
+}
+
+//A directive to board is queued or running
+bool Directive_Pending(uint8_t board)
+{
+    if((board < 1) || (board > DIRECTIVE_BOARDS))
+    {
+        return false;
+    }
+
+    return (directive_active == board) || Directive_Has_Work(board);
+}
+
+//Returns when the board has no directive left, it has read its
+//region. The tick is run from here, this can be in the USB interrupt.
+void Directive_Wait(uint8_t board)
+{
+    if(!Directive_Pending(board))
+    {
+        return;
+    }
+
+    DirectiveStats.waits++;
+
+    while(Directive_Pending(board))
+    {
+        Directive_Tick();
+    }
+}
+
+bool Directive_Idle(void)
+{
+    return (directive_active == 0) && (directive_queued == 0);
+}
+
+//Main loop
+void Directive_Service(void)
+{
+    if(directive_refresh)
+    {
+        directive_refresh = false;
+        NeedsRefresh = true;
+    }
+}
+
+static void Directive_Put32(volatile uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+void Directive_Stats_Report(void)
+{
+    uint32_t status;
+    uint32_t rate;
+    uint8_t queued = 0;
+
+    if(EP[1].rx_buffer[1] == 1)
+    {
+        for(int i=0;i<DIRECTIVE_BOARDS;i++)
+        {
+            Directive_Priority(i + 1, EP[1].rx_buffer[2 + i]);
+        }
+    }
+
+    status = __builtin_disable_interrupts();
+
+    if(EP[1].rx_buffer[1] == 2)
+    {
+        DirectiveStats.directives = 0;
+        DirectiveStats.acks = 0;
+        DirectiveStats.timeouts = 0;
+        DirectiveStats.ack_ticks = 0;
+        DirectiveStats.ack_max = 0;
+        DirectiveStats.prefills = 0;
+        DirectiveStats.waits = 0;
+    }
+
+    rate = directive_rate;
+    if((_CP0_GET_COUNT() - directive_rate_time) >= (2 * DIRECTIVE_WINDOW))
+    {
+        rate = 0;
+    }
+
+    for(int i=0;i<DIRECTIVE_BOARDS;i++)
+    {
+        if(Directive_Has_Work(i + 1) || (directive_active == (i + 1)))
+        {
+            queued = queued | (1 << i);
+        }
+    }
+
+    EP[2].tx_buffer[0] = 0x7a;
+    EP[2].tx_buffer[1] = queued;
+    for(int i=0;i<DIRECTIVE_BOARDS;i++)
+    {
+        EP[2].tx_buffer[2 + i] = directive_priority[i];
+    }
+    Directive_Put32(&EP[2].tx_buffer[9], DirectiveStats.directives);
+    Directive_Put32(&EP[2].tx_buffer[13], DirectiveStats.acks);
+    Directive_Put32(&EP[2].tx_buffer[17], DirectiveStats.timeouts);
+    Directive_Put32(&EP[2].tx_buffer[21], rate);
+    Directive_Put32(&EP[2].tx_buffer[25], DirectiveStats.prefills);
+    Directive_Put32(&EP[2].tx_buffer[29], DirectiveStats.waits);
+    Directive_Put32(&EP[2].tx_buffer[33], DirectiveStats.ack_ticks);
+    Directive_Put32(&EP[2].tx_buffer[37], DirectiveStats.ack_max);
+
+    __builtin_mtc0(12, 0, status);
+
+    EP2_TX(EP[2].tx_buffer);
+}
+
+//The /ACK fell
+void __attribute__((vector(_CHANGE_NOTICE_G_VECTOR), interrupt(ipl5srs), nomips16)) CNG_ISR()
+{
+    //First, an /ACK during the tick comes back here
+    IFS3bits.CNGIF = 0;
+
+    Directive_Tick();
+}
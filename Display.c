@@ -979,6 +979,38 @@ void Display_Rect(unsigned col_start, unsigned col_end, unsigned row_start, unsi
     row_end = d;
 }
 
+//Sets the window and starts a memory write, the pixels then go
+//in with Display_Pixels(). The write goes on across /CS, so the
+//PMP is free for the flash between the blocks.
+void Display_Window(unsigned col_start, unsigned col_end, unsigned row_start, unsigned row_end)
+{
+    Display_CASET(col_start, col_end);
+    Display_RASET(row_start, row_end);
+    Display_RAMWR();
+
+    //Select Display (/CS)    
+    PORTAbits.RA9 = 1;
+}
+
+//Writes count pixels of the memory write Display_Window() started
+void Display_Pixels(const uint16_t *pixels, uint16_t count)
+{
+    //Select Display (/CS)    
+    PORTAbits.RA9 = 0;
+
+    //RB1 = D/C 1=Data, 0=Command
+    PORTBbits.RB1 = 1;
+
+    for(int i=0;i<count;i++)
+    {
+        PMDOUT = pixels[i];
+        while(PMMODEbits.BUSY == 1);
+    }
+
+    //Select Display (/CS)    
+    PORTAbits.RA9 = 1;
+}
+
 void Display_CLRSCN(int CanvasColor)
 {
     Display_CASET(0, 479);
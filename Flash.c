@@ -153,144 +153,145 @@ void Flash_Init(void)
 	lastError = lastError | 2;
     }
 
+    //Used sectors, then the settings
+    if((lastError & 3) == 0)
+    {
+	Flash_Map_Init();
+	Flash_KV_Init();
+	Asset_Init();
+    }
 }
 
+/*************************************************************
+ Upper address pins (A16-18) for address_flash, RB2 = A16,
+ RB4 = A17, RB3 = A18. They are left as they are after an
+ access, so only a change of 64K bank writes them.
+*************************************************************/
 void Flash_High_Address(unsigned address_flash)
 {
-    //Handle the upper address pins (A16-18)
-    //0000-ffff
-    if(address_flash > 0xffff)
+    uint32_t bank = 0;
+    
+    if((address_flash & 0x10000) != 0)
     {
-        //RB2 = A16
-        PORTBbits.RB2 = 1;
-
-        //RB4 = A17
-        PORTBbits.RB4 = 0;
-
-        //RB3 = A18
-        PORTBbits.RB3 = 0;
+        bank = bank | 0x04;
     }
     
-    //10000-1ffff
-    if(address_flash > 0x1ffff)
+    if((address_flash & 0x20000) != 0)
     {
-        //RB2 = A16
-        PORTBbits.RB2 = 0;
-
-        //RB4 = A17
-        PORTBbits.RB4 = 1;
-
-        //RB3 = A18
-        PORTBbits.RB3 = 0;
+        bank = bank | 0x10;
     }
     
-    //20000-2ffff
-    if(address_flash > 0x2ffff)
+    if((address_flash & 0x40000) != 0)
     {
-        //RB2 = A16
-        PORTBbits.RB2 = 1;
-
-        //RB4 = A17
-        PORTBbits.RB4 = 1;
-
-        //RB3 = A18
-        PORTBbits.RB3 = 0;
+        bank = bank | 0x08;
     }
     
-    //30000-3ffff
-    if(address_flash > 0x3ffff)
+    if((LATB & 0x1c) != bank)
     {
-        //RB2 = A16
-        PORTBbits.RB2 = 0;
+        LATBCLR = 0x1c & ~bank;
+        LATBSET = bank;
+    }
+}
 
-        //RB4 = A17
-        PORTBbits.RB4 = 0;
+//One byte into data_flash, through the cache (Flash_Cache.c)
+void Flash_RD(unsigned address_flash)
+{  
+    data_flash = Flash_Cache_RD(address_flash);
+}
 
-        //RB3 = A18
-        PORTBbits.RB3 = 1;
-    }
+/*************************************************************
+ Program and erase
+ These queue a job (Flash_Jobs.c) and run the engine until it
+ is done, anything queued before goes first. The chip reports
+ the end of the operation with the toggle bit, Flash_Status().
+*************************************************************/
+void Flash_WR(unsigned address_flash, uint8_t data_flash)
+{
+    FLASH_JOB job;
     
-     //40000-4ffff
-    if(address_flash > 0x4ffff)
+    if(Flash_Jobs_Program(&job, address_flash, &data_flash, 1, NULL, NULL))
     {
-        //RB2 = A16
-        PORTBbits.RB2 = 1;
-
-        //RB4 = A17
-        PORTBbits.RB4 = 0;
-
-        //RB3 = A18
-        PORTBbits.RB3 = 1;
+        Flash_Jobs_Wait(&job);
     }
+}
+
+void Flash_Sector_Erase(int erase_sector)
+{  
+    FLASH_JOB job;
     
-    //50000-5ffff
-    if(address_flash > 0x5ffff)
+    if(Flash_Jobs_Erase(&job, erase_sector, NULL, NULL))
     {
-        //RB2 = A16
-        PORTBbits.RB2 = 0;
-
-        //RB4 = A17
-        PORTBbits.RB4 = 1;
-
-        //RB3 = A18
-        PORTBbits.RB3 = 1;
+        Flash_Jobs_Wait(&job);
     }
+}
+
+void Flash_Chip_Erase(void)
+{  
+    FLASH_JOB job;
     
-    //60000-6ffff
-    if(address_flash > 0x6ffff)
+    if(Flash_Jobs_Chip_Erase(&job, NULL, NULL))
     {
-        //RB2 = A16
-        PORTBbits.RB2 = 1;
+        Flash_Jobs_Wait(&job);
+    }
+}
 
-        //RB4 = A17
-        PORTBbits.RB4 = 1;
+//Unlock cycles and the command, /CS2 is low
+static void Flash_Command(uint8_t command)
+{
+    PMWADDR = 0x5555;
+    PMDOUT = 0xaa;
+    while(PMMODEbits.BUSY == 1);  
+   
+    PMWADDR = 0x2aaa;
+    PMDOUT = 0x55;
+    while(PMMODEbits.BUSY == 1);  
+    
+    PMWADDR = 0x5555;
+    PMDOUT = command;
+    while(PMMODEbits.BUSY == 1);  
+}
 
-        //RB3 = A18
-        PORTBbits.RB3 = 1;
-    }    
+static void Flash_Deselect(void)
+{
+    ///CS2
+    PORTAbits.RA10 = 1;
 }
 
-void Flash_RD(unsigned address_flash)
-{  
+/*************************************************************
+ Start an operation and return, the caller owns the PMP and
+ polls Flash_Status() until it is not FLASH_BUSY
+*************************************************************/
+void Flash_Program_Start(unsigned address_flash, uint8_t data_flash)
+{        
     //Handle the upper address pins (A16-18)
     Flash_High_Address(address_flash);
-
-    //Clear off upper bits and load in to PMP
-    PMRADDR = address_flash & 0x0ffff;
     
     ///CS2
     PORTAbits.RA10 = 0;
-        
-    //dummy read
-    data_flash = PMRDIN;
-    while(PMMODEbits.BUSY == 1);
-   
-    data_flash = PMRDIN;
-    while(PMMODEbits.BUSY == 1);
-
-    ///CS2
-    PORTAbits.RA10 = 1;
     
-    //RB2 = A16
-    PORTBbits.RB2 = 0;
-
-    //RB4 = A17
-    PORTBbits.RB4 = 0;
-
-    //RB3 = A18
-    PORTBbits.RB3 = 0;
+    Flash_Command(0xa0);
+            
+    //write data
+    //Clear off upper bits and load in to PMP
+    PMWADDR = address_flash & 0x0ffff;
+    PMDOUT = data_flash;
+    while(PMMODEbits.BUSY == 1); 
+    
+    Flash_Deselect();
 }
 
-void Flash_WR(unsigned address_flash, uint8_t data_flash)
-{        
-    LED_Port(2);
+void Flash_Erase_Start(int erase_sector)
+{  
+    unsigned address_flash = erase_sector << 12;
+    
     //Handle the upper address pins (A16-18)
     Flash_High_Address(address_flash);
     
     ///CS2
     PORTAbits.RA10 = 0;
     
-    //Enter sequence
+    Flash_Command(0x80);
+    
     PMWADDR = 0x5555;
     PMDOUT = 0xaa;
     while(PMMODEbits.BUSY == 1);  
@@ -299,193 +300,262 @@ void Flash_WR(unsigned address_flash, uint8_t data_flash)
     PMDOUT = 0x55;
     while(PMMODEbits.BUSY == 1);  
     
-    PMWADDR = 0x5555;
-    PMDOUT = 0xa0;
-    while(PMMODEbits.BUSY == 1);  
-            
-    //write data
-    //Clear off upper bits and load in to PMP
+    //Sector address
     PMWADDR = address_flash & 0x0ffff;
-    PMRADDR = PMWADDR;
+    PMDOUT = 0x30;
+    while(PMMODEbits.BUSY == 1);  
     
-    PMDOUT = data_flash;
-    while(PMMODEbits.BUSY == 1); 
+    Flash_Deselect();
+}
+
+void Flash_Chip_Erase_Start(void)
+{  
+    //CS2
+    PORTAbits.RA10 = 0;
+   
+    Flash_Command(0x80);
+    Flash_Command(0x10);
     
-    uint8_t j = 0;
-    uint8_t i = PMRDIN;
-    //Wait for end of program
-    //using D7 - Data# polling
+    Flash_Deselect();
+}
+
+/*************************************************************
+ Erase suspend, Macronix parts
+ 0xb0 stops a sector erase within about 20 us, the toggle bit
+ stops when it has. The other sectors then read as data, the
+ one being erased does not. 0x30 carries on with the erase.
+ Returns false when the toggle bit kept going.
+*************************************************************/
+bool Flash_Erase_Suspend(unsigned address_flash)
+{
+    uint32_t start = _CP0_GET_COUNT();
+    bool suspended = false;
+    uint8_t first;
+    uint8_t second;
     
-    while(data_flash != i)
-    {
-        i = PMRDIN;
-        while(PMMODEbits.BUSY == 1);
-        j++;
-        LED_Port(j);
-    }
+    //Handle the upper address pins (A16-18)
+    Flash_High_Address(address_flash);
+    
+    ///CS2
+    PORTAbits.RA10 = 0;
     
-    j = 0;
+    PMWADDR = address_flash & 0x0ffff;
+    PMDOUT = 0xb0;
+    while(PMMODEbits.BUSY == 1);
     
-    //now we must verify at least 2 times
-    //to prevent false rejection
+    PMRADDR = address_flash & 0x0ffff;
     
+    //dummy read
+    first = PMRDIN;
+    while(PMMODEbits.BUSY == 1);
     
-    while(i != data_flash)
+    //100 us
+    while((_CP0_GET_COUNT() - start) < 10000)
     {
-        i = PMRDIN;
+        first = PMRDIN;
         while(PMMODEbits.BUSY == 1);
-        j++;
-        LED_Port(j);
-
+        second = PMRDIN;
+        while(PMMODEbits.BUSY == 1);
+        
+        if(((first ^ second) & 0x40) == 0)
+        {
+            suspended = true;
+            break;
+        }
     }
-    LED_Port(0);
-    ///CS2
-    PORTAbits.RA10 = 1;
     
-    //RB2 = A16
-    PORTBbits.RB2 = 0;
-
-    //RB4 = A17
-    PORTBbits.RB4 = 0;
+    Flash_Deselect();
+    
+    return suspended;
+}
 
-    //RB3 = A18
-    PORTBbits.RB3 = 0; 
+void Flash_Erase_Resume(unsigned address_flash)
+{
+    //Handle the upper address pins (A16-18)
+    Flash_High_Address(address_flash);
+    
+    ///CS2
+    PORTAbits.RA10 = 0;
+    
+    PMWADDR = address_flash & 0x0ffff;
+    PMDOUT = 0x30;
+    while(PMMODEbits.BUSY == 1);
+    
+    Flash_Deselect();
 }
 
-void Flash_Sector_Erase(int erase_sector)
-{  
-    data_flash = 0;
+/*************************************************************
+ Status of the operation started at address_flash
+ DQ6 toggles on every read while the chip is busy. When two
+ reads in a row agree the operation is over and the byte is the
+ data, which must be expect (0xff after an erase), otherwise a
+ 1 was programmed over a 0. DQ5 high while DQ6 still toggles is
+ the chip giving up, it is reset to read mode and it failed.
+*************************************************************/
+uint8_t Flash_Status(unsigned address_flash, uint8_t expect)
+{
+    uint8_t status = FLASH_BUSY;
+    uint8_t first;
+    uint8_t second;
+    
+    //Handle the upper address pins (A16-18)
+    Flash_High_Address(address_flash);
+    
+    PMRADDR = address_flash & 0x0ffff;
     
-    erase_sector = erase_sector << 12;
     ///CS2
     PORTAbits.RA10 = 0;
     
-    //Enter sequence
-    PMWADDR = 0x5555;
-    PMDOUT = 0xaa;
-    while(PMMODEbits.BUSY == 1);  
-   
-    PMWADDR = 0x2aaa;
-    PMDOUT = 0x55;
-    while(PMMODEbits.BUSY == 1);  
+    //dummy read
+    first = PMRDIN;
+    while(PMMODEbits.BUSY == 1);
     
-    PMWADDR = 0x5555;
-    PMDOUT = 0x80;
-    while(PMMODEbits.BUSY == 1);  
-            
-    PMWADDR = 0x5555;
-    PMDOUT = 0xaa;
-    while(PMMODEbits.BUSY == 1);  
-   
-    PMWADDR = 0x2aaa;
-    PMDOUT = 0x55;
-    while(PMMODEbits.BUSY == 1);  
+    first = PMRDIN;
+    while(PMMODEbits.BUSY == 1);
+    second = PMRDIN;
+    while(PMMODEbits.BUSY == 1);
     
-    //Sector address
-    PMWADDR = erase_sector;
-    PMDOUT = 0x30;
-    while(PMMODEbits.BUSY == 1);  
-    int j = 0;
-    while(data_flash != 0xff)
+    if(((first ^ second) & 0x40) != 0 && (second & 0x20) != 0)
     {
-        data_flash = PMRDIN;
+        //DQ5, read the toggle bit again before calling it a failure
+        first = PMRDIN;
+        while(PMMODEbits.BUSY == 1);
+        second = PMRDIN;
         while(PMMODEbits.BUSY == 1);
         
-        j++;
-        LED_Port(j);
+        if(((first ^ second) & 0x40) != 0)
+        {
+            //Reset
+            PMWADDR = 0;
+            PMDOUT = 0xf0;
+            while(PMMODEbits.BUSY == 1);
+            
+            status = FLASH_FAILED;
+        }
     }
-    //CS2
-    PORTAbits.RA10 = 1;
+    
+    if(((first ^ second) & 0x40) == 0)
+    {
+        status = (second == expect) ? FLASH_DONE : FLASH_FAILED;
+    }
+    
+    Flash_Deselect();
+    
+    return status;
 }
 
-void Flash_Chip_Erase(void)
-{  
-    int i;
-    data_flash = 0;
+/*************************************************************
+ Reads from address_flash until a byte is not erased (0xff)
+ and returns how many were, length when they all were.
+ The PMP increments the address, so the upper address pins
+ are set once and the bytes must not cross a 64K bank.
+ Interrupts stay on, an interrupt that goes to the SRAM takes
+ the PMP and gives the burst back with its byte read again
+ (REN70V05_PMP_Take()).
+*************************************************************/
+uint16_t Flash_Blank_Length(unsigned address_flash, uint16_t length)
+{
+    uint16_t i;
     
-    //CS2
-    PORTAbits.RA10 = 0;
-   
-    //Enter sequence
-    PMWADDR = 0x5555;
-    PMDOUT = 0xaa;
-    while(PMMODEbits.BUSY == 1);  
-   
-    PMWADDR = 0x2aaa;
-    PMDOUT = 0x55;
-    while(PMMODEbits.BUSY == 1);  
+    Flash_Jobs_Hold(address_flash, length);
     
-    PMWADDR = 0x5555;
-    PMDOUT = 0x80;
-    while(PMMODEbits.BUSY == 1);  
-            
-    PMWADDR = 0x5555;
-    PMDOUT = 0xaa;
-    while(PMMODEbits.BUSY == 1);  
-   
-    PMWADDR = 0x2aaa;
-    PMDOUT = 0x55;
-    while(PMMODEbits.BUSY == 1);  
+    SRAM_DMA_Wait();
     
-    PMWADDR = 0x5555;
-    PMDOUT = 0x10;
-    while(PMMODEbits.BUSY == 1);  
+    //Handle the upper address pins (A16-18)
+    Flash_High_Address(address_flash);
+    
+    PMMODEbits.INCM = 1;
+    PMRADDR = address_flash & 0x0ffff;
+    
+    ///CS2
+    PORTAbits.RA10 = 0;
     
-    while(data_flash != 0xff)
+    //dummy read, starts the cycle for the first byte
+    data_flash = PMRDIN;
+    while(PMMODEbits.BUSY == 1);
+    
+    //Each read returns a byte and starts the next cycle
+    for(i=0;i<length;i++)
     {
         data_flash = PMRDIN;
         while(PMMODEbits.BUSY == 1);
+        
+        if(data_flash != 0xff)
+        {
+            break;
+        }
     }
-
-    //CS2
+    
+    ///CS2
     PORTAbits.RA10 = 1;
+    
+    PMMODEbits.INCM = 0;
+    
+    Flash_Jobs_Release();
+    
+    return i;
 }
 
-void Flash_Get_Bytes_Used(void)
-{  
-    unsigned long i;
-    Bytes_used = 0;
+/*************************************************************
+ Reads length bytes from address_flash into data, a PMP burst
+ like Flash_Blank_Length() for each 64K bank the bytes are in.
+ The bank pins are only written again when the read crosses
+ into the next bank. Not through the cache, this is what the
+ cache and the checks of programmed data read with.
+*************************************************************/
+void Flash_Read(unsigned address_flash, uint8_t *data, uint16_t length)
+{
+    uint32_t count;
     
-    if(Flash_DID == 0xd5)
+    while(length > 0)
     {
-        for(i=0; i <= 0x1ffff; i++)
+        //The PMP only increments the lower 16 address bits
+        count = 0x10000 - (address_flash & 0x0ffff);
+        if(count > length)
         {
-            Flash_RD(i);
-            if(data_flash != 0xff)
-            {
-                Bytes_used++;
-            }
+            count = length;
         }
-    }
-    if(Flash_DID == 0xd6)
-    {
-        for(i=0; i <= 0x2ffff; i++)
-        {
-            Flash_RD(i);
-            if(data_flash != 0xff)
-            {
-                Bytes_used++;
-            }
-        }
-    }
-    
-    if(Flash_DID == 0xd7)
-    {
-        for(i=0; i <= 0x7ffff; i++)
+        
+        Flash_Jobs_Hold(address_flash, count);
+
+        SRAM_DMA_Wait();
+
+        //Handle the upper address pins (A16-18)
+        Flash_High_Address(address_flash);
+
+        PMMODEbits.INCM = 1;
+        PMRADDR = address_flash & 0x0ffff;
+
+        ///CS2
+        PORTAbits.RA10 = 0;
+
+        //dummy read, starts the cycle for the first byte
+        data_flash = PMRDIN;
+        while(PMMODEbits.BUSY == 1);
+
+        for(uint16_t i=0;i<count;i++)
         {
-            Flash_RD(i);
-            if(data_flash != 0xff)
-            {
-                Bytes_used++;
-            }
+            data[i] = PMRDIN;
+            while(PMMODEbits.BUSY == 1);
         }
+
+        ///CS2
+        PORTAbits.RA10 = 1;
+
+        PMMODEbits.INCM = 0;
+
+        Flash_Jobs_Release();
+        
+        address_flash = address_flash + count;
+        data = data + count;
+        length = length - count;
     }
-    
-    PORTBbits.RB8 = 0;
-    PORTAbits.RA5 = 0;
-    PORTAbits.RA3 = 0;        
+}
 
-    return;
+//Used space at sector granularity, from the map in Flash_Map.c
+void Flash_Get_Bytes_Used(void)
+{  
+    Bytes_used = (unsigned long)Flash_Map_Used() * (SECTOR_SIZE + 1);
 }
 
 
@@ -0,0 +1,257 @@
+/*********************************************************************
+    FileName:     	Flash_Cache.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 MHz
+
+    File Description:
+        Reads of the external flash
+
+        Block cache
+        FLASH_CACHE_LINES blocks of FLASH_CACHE_LINE bytes in
+        internal RAM, for the small reads that come back to the same
+        bytes: the settings records (Flash_KV.c), the flash map
+        records, the asset store header. Flash_RD() goes through it.
+        A miss reads the whole block with one Flash_Read() burst
+        into the block used longest ago.
+
+        The flash only changes through the jobs (Flash_Jobs.c). When
+        a job ends the tick invalidates the blocks it programmed or
+        erased, so a read after the job is done gets the new bytes.
+        A block read while the tick invalidated is not kept. Reads
+        are from the main loop, the invalidate is from the tick.
+
+        Flash_Read() is not cached, the checks of programmed data
+        (Assets.c, Flash_Program.c) must read the chip.
+
+        Streaming reader
+        For a long run of bytes read in order (an image), a
+        FLASH_READER reads FLASH_READER_CHUNK bytes at a time with a
+        burst, the bank pins are set once per burst. Reads of a chunk
+        or more go straight into the caller's buffer.
+
+        FlashCacheStats (Vendor request 0x0a):
+            reads, blocks found, blocks read, blocks invalidated
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include <stddef.h>
+#include "MainBrain.h"
+
+#define FLASH_CACHE_LINE        64
+#define FLASH_CACHE_LINES       8
+#define FLASH_CACHE_NONE        0xffffffff
+
+FLASH_CACHE_STATS FlashCacheStats;
+
+static uint8_t flash_cache[FLASH_CACHE_LINES][FLASH_CACHE_LINE];
+static volatile uint32_t flash_cache_tag[FLASH_CACHE_LINES] = {
+    FLASH_CACHE_NONE, FLASH_CACHE_NONE, FLASH_CACHE_NONE, FLASH_CACHE_NONE,
+    FLASH_CACHE_NONE, FLASH_CACHE_NONE, FLASH_CACHE_NONE, FLASH_CACHE_NONE
+};
+static uint32_t flash_cache_used[FLASH_CACHE_LINES];
+static uint32_t flash_cache_clock = 0;
+
+//Counts the invalidates, a block read across one is not kept
+static volatile uint32_t flash_cache_generation = 0;
+
+//The block with address in it, read from the flash if it is not
+static uint8_t Flash_Cache_Line(uint32_t address)
+{
+    uint32_t line = address & ~(uint32_t)(FLASH_CACHE_LINE - 1);
+    uint32_t generation;
+    uint32_t status;
+    uint8_t oldest = 0;
+
+    for(int i=0;i<FLASH_CACHE_LINES;i++)
+    {
+        if(flash_cache_tag[i] == line)
+        {
+            FlashCacheStats.hits++;
+            flash_cache_used[i] = ++flash_cache_clock;
+            return i;
+        }
+
+        if(flash_cache_used[i] < flash_cache_used[oldest])
+        {
+            oldest = i;
+        }
+    }
+
+    FlashCacheStats.misses++;
+
+    generation = flash_cache_generation;
+    flash_cache_tag[oldest] = FLASH_CACHE_NONE;
+
+    Flash_Read(line, flash_cache[oldest], FLASH_CACHE_LINE);
+
+    status = __builtin_disable_interrupts();
+    if(generation == flash_cache_generation)
+    {
+        flash_cache_tag[oldest] = line;
+    }
+    __builtin_mtc0(12, 0, status);
+
+    flash_cache_used[oldest] = ++flash_cache_clock;
+
+    return oldest;
+}
+
+void Flash_Cache_Read(uint32_t address, uint8_t *data, uint16_t length)
+{
+    uint8_t line;
+    uint16_t offset;
+    uint16_t count;
+
+    FlashCacheStats.reads++;
+
+    while(length > 0)
+    {
+        line = Flash_Cache_Line(address);
+        offset = address % FLASH_CACHE_LINE;
+
+        count = FLASH_CACHE_LINE - offset;
+        if(count > length)
+        {
+            count = length;
+        }
+
+        for(int i=0;i<count;i++)
+        {
+            data[i] = flash_cache[line][offset + i];
+        }
+
+        address = address + count;
+        data = data + count;
+        length = length - count;
+    }
+}
+
+uint8_t Flash_Cache_RD(uint32_t address)
+{
+    uint8_t data;
+
+    Flash_Cache_Read(address, &data, 1);
+
+    return data;
+}
+
+//From the job tick, the bytes address - address + length changed
+void Flash_Cache_Invalidate(uint32_t address, uint32_t length)
+{
+    uint32_t status = __builtin_disable_interrupts();
+
+    flash_cache_generation++;
+
+    for(int i=0;i<FLASH_CACHE_LINES;i++)
+    {
+        if((flash_cache_tag[i] != FLASH_CACHE_NONE) &&
+           ((flash_cache_tag[i] + FLASH_CACHE_LINE) > address) &&
+           (flash_cache_tag[i] < (address + length)))
+        {
+            flash_cache_tag[i] = FLASH_CACHE_NONE;
+            flash_cache_used[i] = 0;
+            FlashCacheStats.invalidated++;
+        }
+    }
+
+    __builtin_mtc0(12, 0, status);
+}
+
+void Flash_Reader_Open(FLASH_READER *reader, uint32_t address, uint32_t length)
+{
+    reader->address = address;
+    reader->end = address + length;
+    reader->have = 0;
+    reader->next = 0;
+}
+
+//Next byte, reads the next chunk when needed
+bool Flash_Reader_Byte(FLASH_READER *reader, uint8_t *data)
+{
+    uint32_t count;
+
+    if(reader->next == reader->have)
+    {
+        if(reader->address >= reader->end)
+        {
+            return false;
+        }
+
+        count = reader->end - reader->address;
+        if(count > FLASH_READER_CHUNK)
+        {
+            count = FLASH_READER_CHUNK;
+        }
+
+        Flash_Read(reader->address, reader->buffer, count);
+        reader->address = reader->address + count;
+        reader->have = count;
+        reader->next = 0;
+    }
+
+    *data = reader->buffer[reader->next++];
+
+    return true;
+}
+
+//Up to length bytes, returns how many there were
+uint32_t Flash_Reader_Read(FLASH_READER *reader, uint8_t *data, uint32_t length)
+{
+    uint32_t done = 0;
+    uint32_t count;
+
+    //What is left of the chunk
+    while((done < length) && (reader->next < reader->have))
+    {
+        data[done++] = reader->buffer[reader->next++];
+    }
+
+    //Whole chunks need no copy
+    while(((length - done) >= FLASH_READER_CHUNK) && (reader->address < reader->end))
+    {
+        count = reader->end - reader->address;
+        if(count > (length - done))
+        {
+            count = length - done;
+        }
+        if(count > 0x8000)
+        {
+            count = 0x8000;
+        }
+
+        Flash_Read(reader->address, &data[done], count);
+        reader->address = reader->address + count;
+        done = done + count;
+    }
+
+    while((done < length) && Flash_Reader_Byte(reader, &data[done]))
+    {
+        done++;
+    }
+
+    return done;
+}
@@ -0,0 +1,598 @@
+/*********************************************************************
+    FileName:     	Flash_Jobs.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 MHz, Core Timer = System Clock / 2
+
+    File Description:
+        Flash program and erase jobs
+
+        A caller fills in a FLASH_JOB (program a buffer, erase a
+        sector, erase the chip) and queues it, the jobs run one at
+        a time in the order they were queued. Timer 7 calls
+        Flash_Jobs_Tick() every 250 us, the tick starts operations
+        on the chip and polls them with Flash_Status() for at most
+        FLASH_JOBS_BUDGET Core Timer ticks, then returns:
+            - a program is one byte at a time, polled in the tick
+              (a few us each), bytes that are 0xff are skipped
+            - an erase is polled once per tick until the toggle bit
+              stops (about a second a sector)
+        The main loop keeps running in between.
+
+        The tick takes the PMP the way the SRAM side access does
+        (REN70V05_PMP_Take()), so it can land in the middle of a
+        display or SRAM access. A finished job goes on a list,
+        Flash_Jobs_Service() in the main loop updates the flash map
+        and calls the job's done function, job->state is then
+        FLASH_JOB_DONE or FLASH_JOB_FAILED. The job and a program's
+        data belong to the engine until then.
+
+        Flash_Read() and Flash_Blank_Length() hold the engine, it
+        starts no operation while held. One that is running:
+            - a program ends in a few us, the read waits for it
+            - a sector erase on a Macronix part (MID 0xc2) is
+              suspended when the read is outside the sector, and
+              resumed when the engine is released. After a resume
+              it runs at least FLASH_JOBS_RESUME_TICKS before it is
+              suspended again, so back to back reads cannot stop it
+              for good. A read waits at most that long plus the
+              suspend (about 20 us).
+            - a chip erase, or a read of the sector being erased,
+              waits for the erase
+        Flash_WR() and the erases queue a job and wait for it with
+        Flash_Jobs_Wait(), which calls the tick itself until the
+        job is done.
+
+        FlashJobStats counts the jobs (Vendor request 0x08):
+            jobs, failures, bytes programmed, sectors erased
+            program_ticks   Core Timer ticks from start to end of
+                            the program jobs, bytes / time is the
+                            program throughput
+            erase_ticks     the same for the erase jobs
+            tick_ticks      time spent in the tick
+            waits           jobs a caller waited for
+
+        FlashStallStats counts the reads that came while a program,
+        sector erase or chip erase was running (Vendor request
+        0x09): reads, erase suspends, Core Timer ticks the reads
+        waited and the longest wait.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include <stddef.h>
+#include "MainBrain.h"
+
+//Time a tick may spend, 50 us
+#define FLASH_JOBS_BUDGET       5000
+
+//Give up on an operation after this many Core Timer ticks
+#define FLASH_JOBS_PROGRAM_TIMEOUT      100000          //1 ms
+#define FLASH_JOBS_ERASE_TIMEOUT        1500000000      //15 s
+#define FLASH_JOBS_CHIP_TIMEOUT         4000000000u     //40 s
+
+#define FLASH_JOBS_SIZE         0x80000
+#define FLASH_JOBS_SECTOR       0x1000
+
+//An erase runs this long after a resume, 500 us
+#define FLASH_JOBS_RESUME_TICKS 50000
+
+FLASH_JOB_STATS FlashJobStats;
+FLASH_STALL_STATS FlashStallStats[3];
+
+static FLASH_JOB *flash_jobs_head = NULL;
+static FLASH_JOB *flash_jobs_tail = NULL;
+static FLASH_JOB *flash_jobs_current = NULL;
+static FLASH_JOB *flash_jobs_finished = NULL;
+static FLASH_JOB *flash_jobs_finished_tail = NULL;
+
+static volatile bool flash_jobs_ticking = false;
+static volatile bool flash_jobs_held = false;
+
+//An operation is running on the chip
+static volatile bool flash_jobs_op = false;
+static uint32_t flash_jobs_op_start;
+
+//The erase is suspended for a read
+static volatile bool flash_jobs_suspended = false;
+static uint32_t flash_jobs_suspend_start;
+static uint32_t flash_jobs_resumed;
+
+//Tick side, the job is over
+static void Flash_Jobs_End(FLASH_JOB *job, bool ok)
+{
+    uint32_t ticks = _CP0_GET_COUNT() - job->start;
+
+    FlashJobStats.jobs++;
+
+    if(job->type == FLASH_JOB_PROGRAM)
+    {
+        FlashJobStats.bytes += job->done_bytes;
+        FlashJobStats.program_ticks += ticks;
+    }
+    else
+    {
+        FlashJobStats.erase_ticks += ticks;
+
+        if(ok)
+        {
+            FlashJobStats.sectors += (job->type == FLASH_JOB_CHIP_ERASE) ? Flash_Map_Sectors() : 1;
+        }
+    }
+
+    if(!ok)
+    {
+        FlashJobStats.failures++;
+    }
+
+    job->next = NULL;
+    if(flash_jobs_finished == NULL)
+    {
+        flash_jobs_finished = job;
+    }
+    else
+    {
+        flash_jobs_finished_tail->next = job;
+    }
+    flash_jobs_finished_tail = job;
+
+    flash_jobs_current = NULL;
+    flash_jobs_op = false;
+
+    //Blocks in the cache (Flash_Cache.c) are read again
+    switch(job->type)
+    {
+        case FLASH_JOB_PROGRAM:
+            Flash_Cache_Invalidate(job->address, job->length);
+            break;
+
+        case FLASH_JOB_SECTOR_ERASE:
+            Flash_Cache_Invalidate(job->address, FLASH_JOBS_SECTOR);
+            break;
+
+        default:
+            Flash_Cache_Invalidate(0, FLASH_JOBS_SIZE);
+            break;
+    }
+
+    //Last, a waiting Flash_Jobs_Run() looks at the state
+    job->state = ok ? FLASH_JOB_DONE : FLASH_JOB_FAILED;
+}
+
+//One step of the current job, false when the tick should return
+static bool Flash_Jobs_Step(void)
+{
+    FLASH_JOB *job = flash_jobs_current;
+    uint32_t timeout;
+    uint32_t now;
+    uint8_t status;
+
+    if(!flash_jobs_op)
+    {
+        if(flash_jobs_held)
+        {
+            return false;
+        }
+
+        if(job == NULL)
+        {
+            job = flash_jobs_head;
+            if(job == NULL)
+            {
+                return false;
+            }
+
+            flash_jobs_head = job->next;
+            if(flash_jobs_head == NULL)
+            {
+                flash_jobs_tail = NULL;
+            }
+
+            flash_jobs_current = job;
+            job->state = FLASH_JOB_RUNNING;
+            job->done_bytes = 0;
+            job->start = _CP0_GET_COUNT();
+        }
+
+        switch(job->type)
+        {
+            case FLASH_JOB_PROGRAM:
+                //Erased is 0xff, nothing to program
+                while((job->done_bytes < job->length) && (job->data[job->done_bytes] == 0xff))
+                {
+                    job->done_bytes++;
+                }
+
+                if(job->done_bytes == job->length)
+                {
+                    Flash_Jobs_End(job, true);
+                    return true;
+                }
+
+                Flash_Program_Start(job->address + job->done_bytes, job->data[job->done_bytes]);
+                break;
+
+            case FLASH_JOB_SECTOR_ERASE:
+                Flash_Erase_Start(job->address >> 12);
+                break;
+
+            default:
+                Flash_Chip_Erase_Start();
+                break;
+        }
+
+        flash_jobs_op = true;
+        flash_jobs_op_start = _CP0_GET_COUNT();
+        flash_jobs_resumed = flash_jobs_op_start;
+        return true;
+    }
+
+    //Taken before the status, an interrupt in between is not
+    //counted against the operation
+    now = _CP0_GET_COUNT();
+
+    switch(job->type)
+    {
+        case FLASH_JOB_PROGRAM:
+            status = Flash_Status(job->address + job->done_bytes, job->data[job->done_bytes]);
+            timeout = FLASH_JOBS_PROGRAM_TIMEOUT;
+            break;
+
+        case FLASH_JOB_SECTOR_ERASE:
+            status = Flash_Status(job->address, 0xff);
+            timeout = FLASH_JOBS_ERASE_TIMEOUT;
+            break;
+
+        default:
+            status = Flash_Status(0, 0xff);
+            timeout = FLASH_JOBS_CHIP_TIMEOUT;
+            break;
+    }
+
+    if(status == FLASH_BUSY)
+    {
+        if((now - flash_jobs_op_start) > timeout)
+        {
+            Flash_Jobs_End(job, false);
+            return true;
+        }
+
+        //A byte is done in us, an erase is looked at next tick
+        return (job->type == FLASH_JOB_PROGRAM);
+    }
+
+    if(status == FLASH_FAILED)
+    {
+        Flash_Jobs_End(job, false);
+        return true;
+    }
+
+    flash_jobs_op = false;
+
+    if(job->type == FLASH_JOB_PROGRAM)
+    {
+        job->done_bytes++;
+
+        if(job->done_bytes < job->length)
+        {
+            return true;
+        }
+    }
+
+    Flash_Jobs_End(job, true);
+    return true;
+}
+
+//Takes job off the finished list, the first one when job is NULL
+static FLASH_JOB *Flash_Jobs_Unlink(FLASH_JOB *job)
+{
+    uint32_t status = __builtin_disable_interrupts();
+    FLASH_JOB *previous = NULL;
+    FLASH_JOB *item = flash_jobs_finished;
+
+    while((item != NULL) && (job != NULL) && (item != job))
+    {
+        previous = item;
+        item = item->next;
+    }
+
+    if(item != NULL)
+    {
+        if(previous == NULL)
+        {
+            flash_jobs_finished = item->next;
+        }
+        else
+        {
+            previous->next = item->next;
+        }
+
+        if(flash_jobs_finished_tail == item)
+        {
+            flash_jobs_finished_tail = previous;
+        }
+
+        item->next = NULL;
+    }
+
+    __builtin_mtc0(12, 0, status);
+
+    return item;
+}
+
+//Main loop side, the map and the caller hear about it
+static void Flash_Jobs_Complete(FLASH_JOB *job)
+{
+    switch(job->type)
+    {
+        case FLASH_JOB_PROGRAM:
+            for(int i=0;i<job->done_bytes;i++)
+            {
+                Flash_Map_Programmed(job->address + i, job->data[i]);
+            }
+            break;
+
+        case FLASH_JOB_SECTOR_ERASE:
+            if(job->state == FLASH_JOB_DONE)
+            {
+                Flash_Map_Erased(job->address >> 12);
+            }
+            break;
+
+        default:
+            if(job->state == FLASH_JOB_DONE)
+            {
+                Flash_Map_Cleared();
+            }
+            break;
+    }
+
+    if(job->done != NULL)
+    {
+        job->done(job);
+    }
+}
+
+bool Flash_Jobs_Submit(FLASH_JOB *job)
+{
+    uint32_t status;
+
+    if(job->type > FLASH_JOB_CHIP_ERASE)
+    {
+        return false;
+    }
+
+    if((job->type == FLASH_JOB_PROGRAM) && ((job->address + job->length) > FLASH_JOBS_SIZE))
+    {
+        return false;
+    }
+
+    if((job->type == FLASH_JOB_SECTOR_ERASE) && (job->address >= FLASH_JOBS_SIZE))
+    {
+        return false;
+    }
+
+    job->state = FLASH_JOB_QUEUED;
+    job->done_bytes = 0;
+    job->next = NULL;
+
+    status = __builtin_disable_interrupts();
+
+    if(flash_jobs_head == NULL)
+    {
+        flash_jobs_head = job;
+    }
+    else
+    {
+        flash_jobs_tail->next = job;
+    }
+    flash_jobs_tail = job;
+
+    __builtin_mtc0(12, 0, status);
+
+    return true;
+}
+
+bool Flash_Jobs_Program(FLASH_JOB *job, uint32_t address, const uint8_t *data, uint16_t length, void (*done)(FLASH_JOB *job), void *context)
+{
+    job->type = FLASH_JOB_PROGRAM;
+    job->address = address;
+    job->data = data;
+    job->length = length;
+    job->done = done;
+    job->context = context;
+
+    return Flash_Jobs_Submit(job);
+}
+
+bool Flash_Jobs_Erase(FLASH_JOB *job, uint16_t sector, void (*done)(FLASH_JOB *job), void *context)
+{
+    job->type = FLASH_JOB_SECTOR_ERASE;
+    job->address = (uint32_t)sector << 12;
+    job->data = NULL;
+    job->length = 0;
+    job->done = done;
+    job->context = context;
+
+    return Flash_Jobs_Submit(job);
+}
+
+bool Flash_Jobs_Chip_Erase(FLASH_JOB *job, void (*done)(FLASH_JOB *job), void *context)
+{
+    job->type = FLASH_JOB_CHIP_ERASE;
+    job->address = 0;
+    job->data = NULL;
+    job->length = 0;
+    job->done = done;
+    job->context = context;
+
+    return Flash_Jobs_Submit(job);
+}
+
+//Main loop, returns when the queued job is done, true when it worked
+bool Flash_Jobs_Wait(FLASH_JOB *job)
+{
+    if(job->state > FLASH_JOB_RUNNING)
+    {
+        return (job->state == FLASH_JOB_DONE);
+    }
+
+    FlashJobStats.waits++;
+
+    while(job->state < FLASH_JOB_DONE)
+    {
+        Flash_Jobs_Tick();
+    }
+
+    //Unless Service() got to it first
+    if(Flash_Jobs_Unlink(job) != NULL)
+    {
+        Flash_Jobs_Complete(job);
+    }
+
+    return (job->state == FLASH_JOB_DONE);
+}
+
+bool Flash_Jobs_Idle(void)
+{
+    return (flash_jobs_head == NULL) && (flash_jobs_current == NULL);
+}
+
+//Main loop, the bytes address - address + length read as data
+//until Flash_Jobs_Release()
+void Flash_Jobs_Hold(uint32_t address, uint16_t length)
+{
+    FLASH_STALL_STATS *stats;
+    FLASH_JOB *job = flash_jobs_current;
+    uint32_t start = _CP0_GET_COUNT();
+    uint32_t stall;
+
+    flash_jobs_held = true;
+
+    if(!flash_jobs_op)
+    {
+        return;
+    }
+
+    stats = &FlashStallStats[job->type];
+    stats->reads++;
+
+    if((job->type == FLASH_JOB_SECTOR_ERASE) && (Flash_MID == 0xc2) &&
+       (((address + length) <= job->address) || (address >= (job->address + FLASH_JOBS_SECTOR))))
+    {
+        //Let it get on with the erase since the last resume
+        while(flash_jobs_op && ((_CP0_GET_COUNT() - flash_jobs_resumed) < FLASH_JOBS_RESUME_TICKS))
+        {
+            Flash_Jobs_Tick();
+        }
+
+        if(flash_jobs_op)
+        {
+            //The tick leaves the chip alone from here
+            flash_jobs_suspended = true;
+            flash_jobs_suspend_start = _CP0_GET_COUNT();
+
+            if(Flash_Erase_Suspend(job->address))
+            {
+                stats->suspends++;
+            }
+            else
+            {
+                Flash_Erase_Resume(job->address);
+                flash_jobs_suspended = false;
+            }
+        }
+    }
+
+    while(flash_jobs_op && !flash_jobs_suspended)
+    {
+        Flash_Jobs_Tick();
+    }
+
+    stall = _CP0_GET_COUNT() - start;
+    stats->stall += stall;
+    if(stall > stats->stall_max)
+    {
+        stats->stall_max = stall;
+    }
+}
+
+void Flash_Jobs_Release(void)
+{
+    uint32_t now;
+
+    if(flash_jobs_suspended)
+    {
+        Flash_Erase_Resume(flash_jobs_current->address);
+
+        //The time out does not count the suspend
+        now = _CP0_GET_COUNT();
+        flash_jobs_op_start += now - flash_jobs_suspend_start;
+        flash_jobs_resumed = now;
+        flash_jobs_suspended = false;
+    }
+
+    flash_jobs_held = false;
+}
+
+//Timer 7, and the main loop while it waits
+void Flash_Jobs_Tick(void)
+{
+    REN70V05_PMP_STATE state;
+    uint32_t start = _CP0_GET_COUNT();
+    uint32_t status;
+
+    status = __builtin_disable_interrupts();
+
+    if(flash_jobs_ticking || flash_jobs_suspended || (!flash_jobs_op && (flash_jobs_held || Flash_Jobs_Idle())))
+    {
+        __builtin_mtc0(12, 0, status);
+        return;
+    }
+
+    flash_jobs_ticking = true;
+
+    __builtin_mtc0(12, 0, status);
+
+    REN70V05_PMP_Take(&state);
+
+    while(Flash_Jobs_Step() && ((_CP0_GET_COUNT() - start) < FLASH_JOBS_BUDGET));
+
+    REN70V05_PMP_Give(&state);
+
+    FlashJobStats.tick_ticks += _CP0_GET_COUNT() - start;
+    flash_jobs_ticking = false;
+}
+
+//Main loop, finished jobs
+void Flash_Jobs_Service(void)
+{
+    FLASH_JOB *job;
+
+    while((job = Flash_Jobs_Unlink(NULL)) != NULL)
+    {
+        Flash_Jobs_Complete(job);
+    }
+}
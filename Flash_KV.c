@@ -0,0 +1,611 @@
+/*********************************************************************
+    FileName:     	Flash_KV.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 MHz
+
+    File Description:
+        Settings store in the external flash
+
+        Values (up to FLASH_KV_MAX bytes) are kept by a one byte key
+        (FLASH_KV_* in MainBrain.h). A new value is added to the end
+        of a log and the old record is marked dead, nothing is erased
+        to change a value. A RAM index holds the flash address of
+        every key's record, so finding a value takes no flash reads.
+
+        The log is FLASH_KV_SECTORS sectors from FLASH_KV_FIRST.
+        Sector header (16 bytes):
+            Byte 0-1    'K' 'V'
+            Byte 2      state, 0xff erased, 0x7f active, 0x3f full
+            Byte 4-7    times the sector was erased
+            Byte 8-11   order the sector was started in
+        Record:
+            Byte 0      state, 0x7f being written, 0x3f valid,
+                        0x00 dead
+            Byte 1      key
+            Byte 2      length
+            Byte 3      CRC-8 of the key, length and data
+            Byte 4-     data
+        States only ever have bits cleared, so they are programmed
+        in place. A record that was not finished or fails its CRC is
+        skipped when the store is loaded.
+
+        When the active sector is full the erased sector with the
+        fewest erases is started, which spreads the erases over all
+        the sectors. One erased sector is always kept for compaction:
+        the live records of the full sector with the fewest of them
+        are copied to the log and that sector is erased.
+        Flash_KV_Service() does this from the main loop before the
+        store runs out, Flash_KV_Set() only has to when values are
+        changed faster than that. The main loop also moves a sector
+        that falls FLASH_KV_WEAR_GAP erases behind, so values that
+        never change do not keep their sector from wearing evenly.
+
+        The flash belongs to the main loop, Flash_KV_Set() must not
+        be called from an interrupt.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include "MainBrain.h"
+
+#define FLASH_KV_FIRST          1
+#define FLASH_KV_SECTORS        8
+#define FLASH_KV_SECTOR_BYTES   0x1000
+#define FLASH_KV_HEADER         16
+#define FLASH_KV_RECORD         4
+
+//Erased sectors kept for compaction
+#define FLASH_KV_SPARE          1
+
+//The main loop compacts a sector when it gets this much back
+#define FLASH_KV_SERVICE_GAIN   (FLASH_KV_SECTOR_BYTES / 4)
+
+//A full sector this many erases behind the most worn one is moved,
+//so sectors holding values that never change are erased too
+#define FLASH_KV_WEAR_GAP       16
+
+//Sector states
+#define FLASH_KV_ERASED         0xff
+#define FLASH_KV_ACTIVE         0x7f
+#define FLASH_KV_FULL           0x3f
+
+//Record states
+#define FLASH_KV_BLANK          0xff
+#define FLASH_KV_WRITING        0x7f
+#define FLASH_KV_VALID          0x3f
+#define FLASH_KV_DEAD           0x00
+
+//Sector header not found
+#define FLASH_KV_UNKNOWN        0x01
+
+static uint32_t flash_kv_index[256];
+static uint8_t flash_kv_state[FLASH_KV_SECTORS];
+static uint32_t flash_kv_erases[FLASH_KV_SECTORS];
+static uint32_t flash_kv_order[FLASH_KV_SECTORS];
+static uint16_t flash_kv_live[FLASH_KV_SECTORS];
+static uint32_t flash_kv_next_order = 0;
+static int8_t flash_kv_active = -1;
+static uint16_t flash_kv_write;
+static bool flash_kv_ready = false;
+
+static uint32_t Flash_KV_Base(uint8_t sector)
+{
+    return (uint32_t)(FLASH_KV_FIRST + sector) * FLASH_KV_SECTOR_BYTES;
+}
+
+static uint8_t Flash_KV_Sector(uint32_t address)
+{
+    return (address / FLASH_KV_SECTOR_BYTES) - FLASH_KV_FIRST;
+}
+
+static void Flash_KV_Read(uint32_t address, uint8_t *data, uint16_t length)
+{
+    Flash_Cache_Read(address, data, length);
+}
+
+static uint32_t Flash_KV_Read32(uint32_t address)
+{
+    uint8_t b[4];
+
+    Flash_KV_Read(address, b, 4);
+
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static void Flash_KV_Program32(uint32_t address, uint32_t value)
+{
+    for(int i=0;i<4;i++)
+    {
+        Flash_WR(address + i, value >> (i * 8));
+    }
+}
+
+//CRC-8, polynomial 0x07
+static uint8_t Flash_KV_CRC(uint8_t crc, const uint8_t *data, uint16_t length)
+{
+    for(int i=0;i<length;i++)
+    {
+        crc = crc ^ data[i];
+
+        for(int bit=0;bit<8;bit++)
+        {
+            crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+static uint8_t Flash_KV_Erased(void)
+{
+    uint8_t erased = 0;
+
+    for(int i=0;i<FLASH_KV_SECTORS;i++)
+    {
+        if(flash_kv_state[i] == FLASH_KV_ERASED)
+        {
+            erased++;
+        }
+    }
+
+    return erased;
+}
+
+//Erases the sector and writes its header
+static void Flash_KV_Format(uint8_t sector, uint32_t erases)
+{
+    uint32_t base = Flash_KV_Base(sector);
+
+    Flash_Sector_Erase(FLASH_KV_FIRST + sector);
+
+    Flash_WR(base, 'K');
+    Flash_WR(base + 1, 'V');
+    Flash_KV_Program32(base + 4, erases);
+
+    flash_kv_state[sector] = FLASH_KV_ERASED;
+    flash_kv_erases[sector] = erases;
+    flash_kv_order[sector] = 0xffffffff;
+    flash_kv_live[sector] = 0;
+}
+
+//Closes the active sector and starts the erased one with the fewest erases
+static bool Flash_KV_Open(void)
+{
+    int8_t sector = -1;
+
+    for(int i=0;i<FLASH_KV_SECTORS;i++)
+    {
+        if((flash_kv_state[i] == FLASH_KV_ERASED) &&
+	   ((sector < 0) || (flash_kv_erases[i] < flash_kv_erases[sector])))
+        {
+            sector = i;
+        }
+    }
+
+    if(sector < 0)
+    {
+        return false;
+    }
+
+    if(flash_kv_active >= 0)
+    {
+        Flash_WR(Flash_KV_Base(flash_kv_active) + 2, FLASH_KV_FULL);
+        flash_kv_state[flash_kv_active] = FLASH_KV_FULL;
+    }
+
+    Flash_WR(Flash_KV_Base(sector) + 2, FLASH_KV_ACTIVE);
+    Flash_KV_Program32(Flash_KV_Base(sector) + 8, flash_kv_next_order);
+
+    flash_kv_state[sector] = FLASH_KV_ACTIVE;
+    flash_kv_order[sector] = flash_kv_next_order++;
+    flash_kv_active = sector;
+    flash_kv_write = FLASH_KV_HEADER;
+
+    return true;
+}
+
+//Adds a record to the active sector, returns its address
+static uint32_t Flash_KV_Append(uint8_t key, const uint8_t *data, uint8_t length)
+{
+    uint32_t address = Flash_KV_Base(flash_kv_active) + flash_kv_write;
+    uint8_t header[2] = {key, length};
+
+    Flash_WR(address, FLASH_KV_WRITING);
+    Flash_WR(address + 1, key);
+    Flash_WR(address + 2, length);
+    Flash_WR(address + 3, Flash_KV_CRC(Flash_KV_CRC(0xff, header, 2), data, length));
+
+    for(int i=0;i<length;i++)
+    {
+        Flash_WR(address + FLASH_KV_RECORD + i, data[i]);
+    }
+
+    Flash_WR(address, FLASH_KV_VALID);
+
+    flash_kv_write = flash_kv_write + FLASH_KV_RECORD + length;
+    flash_kv_live[flash_kv_active] += FLASH_KV_RECORD + length;
+
+    return address;
+}
+
+static void Flash_KV_Kill(uint32_t address)
+{
+    Flash_RD(address + 2);
+    flash_kv_live[Flash_KV_Sector(address)] -= FLASH_KV_RECORD + data_flash;
+
+    Flash_WR(address, FLASH_KV_DEAD);
+}
+
+//Copies the live records of a full sector to the log and erases it
+static bool Flash_KV_Move(uint8_t sector)
+{
+    uint8_t record[FLASH_KV_RECORD];
+    uint8_t data[FLASH_KV_MAX];
+    uint32_t address;
+
+    for(uint16_t offset=FLASH_KV_HEADER;(offset + FLASH_KV_RECORD)<=FLASH_KV_SECTOR_BYTES;)
+    {
+        address = Flash_KV_Base(sector) + offset;
+        Flash_KV_Read(address, record, FLASH_KV_RECORD);
+
+        if((record[0] == FLASH_KV_BLANK) || (record[2] > FLASH_KV_MAX))
+        {
+            break;
+        }
+
+        if((record[0] == FLASH_KV_VALID) && (flash_kv_index[record[1]] == address))
+        {
+            if((flash_kv_write + FLASH_KV_RECORD + record[2]) > FLASH_KV_SECTOR_BYTES)
+            {
+                //The spare sector
+                if(!Flash_KV_Open())
+                {
+                    return false;
+                }
+            }
+
+            Flash_KV_Read(address + FLASH_KV_RECORD, data, record[2]);
+            flash_kv_index[record[1]] = Flash_KV_Append(record[1], data, record[2]);
+        }
+
+        offset = offset + FLASH_KV_RECORD + record[2];
+    }
+
+    Flash_KV_Format(sector, flash_kv_erases[sector] + 1);
+
+    return true;
+}
+
+//Moves the full sector with the fewest live bytes, when that gets
+//back at least gain bytes
+static bool Flash_KV_Compact(uint16_t gain)
+{
+    int8_t sector = -1;
+
+    for(int i=0;i<FLASH_KV_SECTORS;i++)
+    {
+        if((flash_kv_state[i] == FLASH_KV_FULL) &&
+	   ((sector < 0) || (flash_kv_live[i] < flash_kv_live[sector])))
+        {
+            sector = i;
+        }
+    }
+
+    if((sector < 0) || (((FLASH_KV_SECTOR_BYTES - FLASH_KV_HEADER) - flash_kv_live[sector]) < gain))
+    {
+        return false;
+    }
+
+    return Flash_KV_Move(sector);
+}
+
+//Moves the least worn full sector when it is too far behind
+static void Flash_KV_Level(void)
+{
+    uint32_t most = 0;
+    int8_t sector = -1;
+
+    for(int i=0;i<FLASH_KV_SECTORS;i++)
+    {
+        if(flash_kv_erases[i] > most)
+        {
+            most = flash_kv_erases[i];
+        }
+
+        if((flash_kv_state[i] == FLASH_KV_FULL) &&
+	   ((sector < 0) || (flash_kv_erases[i] < flash_kv_erases[sector])))
+        {
+            sector = i;
+        }
+    }
+
+    if((sector >= 0) && ((flash_kv_erases[sector] + FLASH_KV_WEAR_GAP) < most))
+    {
+        Flash_KV_Move(sector);
+    }
+}
+
+//Makes room for size bytes in the active sector
+static bool Flash_KV_Room(uint16_t size)
+{
+    if((flash_kv_write + size) <= FLASH_KV_SECTOR_BYTES)
+    {
+        return true;
+    }
+
+    while(Flash_KV_Erased() <= FLASH_KV_SPARE)
+    {
+        if(!Flash_KV_Compact(size))
+        {
+            return false;
+        }
+    }
+
+    return Flash_KV_Open();
+}
+
+//Walks the records of a sector into the index, returns where the
+//next record goes (FLASH_KV_SECTOR_BYTES when the sector is damaged)
+static uint16_t Flash_KV_Load(uint8_t sector)
+{
+    uint8_t record[FLASH_KV_RECORD];
+    uint8_t data[FLASH_KV_MAX];
+    uint32_t address;
+    uint16_t offset;
+
+    for(offset=FLASH_KV_HEADER;(offset + FLASH_KV_RECORD)<=FLASH_KV_SECTOR_BYTES;)
+    {
+        address = Flash_KV_Base(sector) + offset;
+        Flash_KV_Read(address, record, FLASH_KV_RECORD);
+
+        if((record[0] == FLASH_KV_BLANK) && (record[1] == 0xff) && (record[2] == 0xff))
+        {
+            return offset;
+        }
+
+        if(record[2] > FLASH_KV_MAX)
+        {
+            return FLASH_KV_SECTOR_BYTES;
+        }
+
+        if(record[0] == FLASH_KV_VALID)
+        {
+            Flash_KV_Read(address + FLASH_KV_RECORD, data, record[2]);
+
+            if(Flash_KV_CRC(Flash_KV_CRC(0xff, &record[1], 2), data, record[2]) == record[3])
+            {
+                flash_kv_live[sector] += FLASH_KV_RECORD + record[2];
+
+                //A later sector, or later in this one, is newer
+                if(flash_kv_index[record[1]] != 0)
+                {
+                    Flash_KV_Kill(flash_kv_index[record[1]]);
+                }
+                flash_kv_index[record[1]] = address;
+            }
+        }
+
+        offset = offset + FLASH_KV_RECORD + record[2];
+    }
+
+    return FLASH_KV_SECTOR_BYTES;
+}
+
+void Flash_KV_Init(void)
+{
+    uint8_t header[FLASH_KV_HEADER];
+    uint32_t most = 0;
+    int8_t sector;
+
+    for(int i=0;i<256;i++)
+    {
+        flash_kv_index[i] = 0;
+    }
+
+    flash_kv_active = -1;
+    flash_kv_next_order = 0;
+
+    for(int i=0;i<FLASH_KV_SECTORS;i++)
+    {
+        Flash_KV_Read(Flash_KV_Base(i), header, FLASH_KV_HEADER);
+
+        flash_kv_live[i] = 0;
+        flash_kv_state[i] = FLASH_KV_UNKNOWN;
+
+        if((header[0] == 'K') && (header[1] == 'V') &&
+	   ((header[2] == FLASH_KV_ERASED) || (header[2] == FLASH_KV_ACTIVE) || (header[2] == FLASH_KV_FULL)))
+        {
+            flash_kv_state[i] = header[2];
+            flash_kv_erases[i] = Flash_KV_Read32(Flash_KV_Base(i) + 4);
+            flash_kv_order[i] = Flash_KV_Read32(Flash_KV_Base(i) + 8);
+
+            if((flash_kv_erases[i] != 0xffffffff) && (flash_kv_erases[i] > most))
+            {
+                most = flash_kv_erases[i];
+            }
+
+            //Started, but the order was not written
+            if((flash_kv_state[i] != FLASH_KV_ERASED) && (flash_kv_order[i] == 0xffffffff))
+            {
+                flash_kv_state[i] = FLASH_KV_UNKNOWN;
+            }
+            else if((flash_kv_state[i] != FLASH_KV_ERASED) && (flash_kv_order[i] >= flash_kv_next_order))
+            {
+                flash_kv_next_order = flash_kv_order[i] + 1;
+            }
+        }
+    }
+
+    //New chip, or a sector that lost its header
+    for(int i=0;i<FLASH_KV_SECTORS;i++)
+    {
+        if(flash_kv_state[i] == FLASH_KV_UNKNOWN)
+        {
+            Flash_KV_Format(i, most);
+        }
+        else if((flash_kv_state[i] == FLASH_KV_ERASED) && (flash_kv_erases[i] == 0xffffffff))
+        {
+            flash_kv_erases[i] = most;
+        }
+    }
+
+    //The sectors in the order they were written, the newest record of
+    //a key wins. The newest started sector goes on as the active one.
+    for(uint32_t done=0;;done++)
+    {
+        sector = -1;
+
+        for(int i=0;i<FLASH_KV_SECTORS;i++)
+        {
+            if(((flash_kv_state[i] == FLASH_KV_ACTIVE) || (flash_kv_state[i] == FLASH_KV_FULL)) &&
+	       ((done == 0) || (flash_kv_order[i] > flash_kv_order[flash_kv_active])) &&
+	       ((sector < 0) || (flash_kv_order[i] < flash_kv_order[sector])))
+            {
+                sector = i;
+            }
+        }
+
+        if(sector < 0)
+        {
+            break;
+        }
+
+        flash_kv_write = Flash_KV_Load(sector);
+
+        //Only the newest one stays active
+        if((flash_kv_active >= 0) && (flash_kv_state[flash_kv_active] == FLASH_KV_ACTIVE))
+        {
+            Flash_WR(Flash_KV_Base(flash_kv_active) + 2, FLASH_KV_FULL);
+            flash_kv_state[flash_kv_active] = FLASH_KV_FULL;
+        }
+        flash_kv_active = sector;
+    }
+
+    flash_kv_ready = true;
+
+    if((flash_kv_active < 0) || (flash_kv_state[flash_kv_active] != FLASH_KV_ACTIVE) ||
+       (flash_kv_write >= FLASH_KV_SECTOR_BYTES))
+    {
+        Flash_KV_Open();
+    }
+}
+
+//Returns the length of the key's value, -1 when there is none.
+//At most max bytes are copied to data.
+int16_t Flash_KV_Get(uint8_t key, uint8_t *data, uint8_t max)
+{
+    uint32_t address = flash_kv_index[key];
+    uint8_t length;
+
+    if(!flash_kv_ready || (address == 0))
+    {
+        return -1;
+    }
+
+    Flash_RD(address + 2);
+    length = data_flash;
+
+    Flash_KV_Read(address + FLASH_KV_RECORD, data, (length < max) ? length : max);
+
+    return length;
+}
+
+bool Flash_KV_Set(uint8_t key, const uint8_t *data, uint8_t length)
+{
+    uint8_t stored[FLASH_KV_MAX];
+    uint32_t old;
+    bool same;
+
+    if(!flash_kv_ready || (key == 0) || (key == 0xff) || (length > FLASH_KV_MAX))
+    {
+        return false;
+    }
+
+    //An unchanged value is not written again
+    if(Flash_KV_Get(key, stored, FLASH_KV_MAX) == length)
+    {
+        same = true;
+        for(int i=0;i<length;i++)
+        {
+            if(stored[i] != data[i])
+            {
+                same = false;
+            }
+        }
+
+        if(same)
+        {
+            return true;
+        }
+    }
+
+    if(!Flash_KV_Room(FLASH_KV_RECORD + length))
+    {
+        return false;
+    }
+
+    //Compaction may have moved it
+    old = flash_kv_index[key];
+
+    flash_kv_index[key] = Flash_KV_Append(key, data, length);
+
+    if(old != 0)
+    {
+        Flash_KV_Kill(old);
+    }
+
+    return true;
+}
+
+void Flash_KV_Delete(uint8_t key)
+{
+    if(!flash_kv_ready || (flash_kv_index[key] == 0))
+    {
+        return;
+    }
+
+    Flash_KV_Kill(flash_kv_index[key]);
+    flash_kv_index[key] = 0;
+}
+
+//Main loop, compacts a sector before the store needs it, or moves
+//one that is falling behind on erases
+void Flash_KV_Service(void)
+{
+    if(!flash_kv_ready)
+    {
+        return;
+    }
+
+    if(Flash_KV_Erased() <= FLASH_KV_SPARE)
+    {
+        Flash_KV_Compact(FLASH_KV_SERVICE_GAIN);
+    }
+    else
+    {
+        Flash_KV_Level();
+    }
+}
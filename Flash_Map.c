@@ -0,0 +1,405 @@
+/*********************************************************************
+    FileName:     	Flash_Map.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 MHz, Core Timer = System Clock / 2
+
+    File Description:
+        Map of the used flash sectors
+
+        One bit per 4K sector, 0 = the sector holds data. The map is
+        kept in RAM and in the last sector of the flash (the map
+        sector), as 32 byte records:
+            Byte 0      state
+            Byte 1-15   0xff
+            Byte 16-31  the bits, sector 0 is bit 0 of byte 16
+
+        The state only ever has bits cleared, so it is programmed
+        in place:
+            0xff    blank
+            0x7f    being written
+            0x3f    the map
+            0x00    replaced by a later record
+
+        Flash_WR() of anything but 0xff clears the sector's bit in
+        the record in place. An erase needs a bit set again, so it
+        writes the next record and retires the old one. When the
+        map sector is full it is erased and starts over, about once
+        every 127 sector erases.
+
+        Flash_Init() loads the last record. When there is none (a
+        new chip, or the map sector was erased by someone else) the
+        map is built with a scan: every sector is read in a PMP burst
+        until the first byte that is not 0xff, so only the blank
+        sectors are read to the end.
+
+        0x76 Flash Used
+            Request:  Byte 1 = 1 scans the flash and rewrites the map
+            The scan erases and programs the map sector, so it runs
+            from the main loop (Flash_Map_Service()) and the reply
+            is sent when it is done. Without it the reply comes
+            straight from the USB interrupt.
+            Reply:    Byte 0 = 0x76, Byte 1 = 1 when scanned
+                      Byte 2-3   sectors
+                      Byte 4-5   sectors used
+                      Byte 6-9   Core Timer ticks it took
+            All values are little endian.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include "MainBrain.h"
+
+#define FLASH_MAP_RECORD        32
+#define FLASH_MAP_BITS          16
+#define FLASH_MAP_SECTOR_BYTES  0x1000
+
+#define FLASH_MAP_BLANK         0xff
+#define FLASH_MAP_WRITING       0x7f
+#define FLASH_MAP_CURRENT       0x3f
+#define FLASH_MAP_RETIRED       0x00
+
+//No record yet
+#define FLASH_MAP_NONE          0xffffffff
+
+static uint8_t flash_map[FLASH_MAP_BITS];
+static uint16_t flash_map_sectors = 0;
+static uint32_t flash_map_current = FLASH_MAP_NONE;
+static uint32_t flash_map_next;
+static bool flash_map_ready = false;
+
+//Set while the map writes its own sector
+static bool flash_map_busy = false;
+
+//Set by 0x76 in the USB interrupt
+static volatile bool flash_map_requested = false;
+
+static uint32_t Flash_Map_Base(void)
+{
+    return (uint32_t)(flash_map_sectors - 1) * FLASH_MAP_SECTOR_BYTES;
+}
+
+static bool Flash_Map_Bit(const uint8_t *map, uint16_t sector)
+{
+    return (map[sector / 8] & (1 << (sector % 8))) == 0;
+}
+
+//Writes the RAM map as the next record
+static void Flash_Map_Write(void)
+{
+    uint32_t record;
+
+    flash_map_busy = true;
+
+    if((flash_map_next + FLASH_MAP_RECORD) > (Flash_Map_Base() + FLASH_MAP_SECTOR_BYTES))
+    {
+        Flash_Sector_Erase(flash_map_sectors - 1);
+        flash_map_current = FLASH_MAP_NONE;
+        flash_map_next = Flash_Map_Base();
+    }
+
+    record = flash_map_next;
+    flash_map_next = flash_map_next + FLASH_MAP_RECORD;
+
+    Flash_WR(record, FLASH_MAP_WRITING);
+
+    for(int i=0;i<FLASH_MAP_BITS;i++)
+    {
+        if(flash_map[i] != 0xff)
+        {
+            Flash_WR(record + FLASH_MAP_BITS + i, flash_map[i]);
+        }
+    }
+
+    Flash_WR(record, FLASH_MAP_CURRENT);
+
+    if(flash_map_current != FLASH_MAP_NONE)
+    {
+        Flash_WR(flash_map_current, FLASH_MAP_RETIRED);
+    }
+
+    flash_map_current = record;
+    flash_map_busy = false;
+}
+
+//Fills map from the flash, returns the sectors used
+uint16_t Flash_Map_Scan(uint8_t *map)
+{
+    uint16_t used = 0;
+
+    for(int i=0;i<FLASH_MAP_BITS;i++)
+    {
+        map[i] = 0xff;
+    }
+
+    for(uint16_t sector=0;sector<flash_map_sectors;sector++)
+    {
+        if(Flash_Blank_Length((uint32_t)sector * FLASH_MAP_SECTOR_BYTES, FLASH_MAP_SECTOR_BYTES) < FLASH_MAP_SECTOR_BYTES)
+        {
+            map[sector / 8] &= ~(1 << (sector % 8));
+            used++;
+        }
+    }
+
+    return used;
+}
+
+//Scans the flash and writes the map when it changed
+void Flash_Map_Rebuild(void)
+{
+    uint8_t map[FLASH_MAP_BITS];
+    bool changed = (flash_map_current == FLASH_MAP_NONE);
+
+    Flash_Map_Scan(map);
+
+    //The map sector is always used
+    map[(flash_map_sectors - 1) / 8] &= ~(1 << ((flash_map_sectors - 1) % 8));
+
+    for(int i=0;i<FLASH_MAP_BITS;i++)
+    {
+        if(map[i] != flash_map[i])
+        {
+            changed = true;
+        }
+        flash_map[i] = map[i];
+    }
+
+    if(changed)
+    {
+        Flash_Map_Write();
+    }
+}
+
+void Flash_Map_Init(void)
+{
+    uint32_t record;
+
+    //SST39SF010 / 020, the rest are 512K
+    if(Flash_DID == 0xd5)
+    {
+        flash_map_sectors = 32;
+    }
+    else if(Flash_DID == 0xd6)
+    {
+        flash_map_sectors = 64;
+    }
+    else
+    {
+        flash_map_sectors = 128;
+    }
+
+    flash_map_current = FLASH_MAP_NONE;
+    flash_map_next = Flash_Map_Base();
+
+    for(int i=0;i<FLASH_MAP_BITS;i++)
+    {
+        flash_map[i] = 0xff;
+    }
+
+    //The last record that is the map, and the first one after
+    //everything ever written
+    for(record=Flash_Map_Base();record<(Flash_Map_Base() + FLASH_MAP_SECTOR_BYTES);record=record+FLASH_MAP_RECORD)
+    {
+        Flash_RD(record);
+
+        if(data_flash == FLASH_MAP_CURRENT)
+        {
+            flash_map_current = record;
+        }
+
+        if(data_flash != FLASH_MAP_BLANK)
+        {
+            flash_map_next = record + FLASH_MAP_RECORD;
+        }
+    }
+
+    flash_map_ready = true;
+
+    if(flash_map_current == FLASH_MAP_NONE)
+    {
+        Flash_Map_Rebuild();
+        return;
+    }
+
+    Flash_Read(flash_map_current + FLASH_MAP_BITS, flash_map, FLASH_MAP_BITS);
+}
+
+uint16_t Flash_Map_Sectors(void)
+{
+    return flash_map_sectors;
+}
+
+bool Flash_Map_Sector_Used(uint16_t sector)
+{
+    if(sector >= flash_map_sectors)
+    {
+        return false;
+    }
+
+    return Flash_Map_Bit(flash_map, sector);
+}
+
+uint16_t Flash_Map_Used(void)
+{
+    uint16_t used = 0;
+
+    for(uint16_t sector=0;sector<flash_map_sectors;sector++)
+    {
+        if(Flash_Map_Bit(flash_map, sector))
+        {
+            used++;
+        }
+    }
+
+    return used;
+}
+
+//Flash_WR() or a program job wrote data at address
+void Flash_Map_Programmed(uint32_t address, uint8_t data)
+{
+    uint16_t sector = address / FLASH_MAP_SECTOR_BYTES;
+
+    if(!flash_map_ready || flash_map_busy || (data == 0xff) || (sector >= flash_map_sectors))
+    {
+        return;
+    }
+
+    if(Flash_Map_Bit(flash_map, sector))
+    {
+        return;
+    }
+
+    flash_map[sector / 8] &= ~(1 << (sector % 8));
+
+    //Only clears a bit, the record is updated in place
+    flash_map_busy = true;
+    Flash_WR(flash_map_current + FLASH_MAP_BITS + (sector / 8), flash_map[sector / 8]);
+    flash_map_busy = false;
+}
+
+//Flash_Sector_Erase() or an erase job erased sector
+void Flash_Map_Erased(int sector)
+{
+    if(!flash_map_ready || flash_map_busy || (sector < 0) || (sector >= flash_map_sectors))
+    {
+        return;
+    }
+
+    //The records went with it, start over from the RAM map
+    if(sector == (flash_map_sectors - 1))
+    {
+        flash_map_current = FLASH_MAP_NONE;
+        flash_map_next = Flash_Map_Base();
+        Flash_Map_Write();
+        return;
+    }
+
+    if(!Flash_Map_Bit(flash_map, sector))
+    {
+        return;
+    }
+
+    flash_map[sector / 8] |= 1 << (sector % 8);
+    Flash_Map_Write();
+}
+
+//Flash_Chip_Erase() erased everything
+void Flash_Map_Cleared(void)
+{
+    if(!flash_map_ready)
+    {
+        return;
+    }
+
+    for(int i=0;i<FLASH_MAP_BITS;i++)
+    {
+        flash_map[i] = 0xff;
+    }
+    flash_map[(flash_map_sectors - 1) / 8] &= ~(1 << ((flash_map_sectors - 1) % 8));
+
+    flash_map_current = FLASH_MAP_NONE;
+    flash_map_next = Flash_Map_Base();
+    Flash_Map_Write();
+}
+
+static void Flash_Map_Put16(volatile uint8_t *buffer, uint16_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+}
+
+static void Flash_Map_Reply(uint8_t scanned, uint32_t ticks)
+{
+    Flash_Get_Bytes_Used();
+
+    EP[2].tx_buffer[0] = 0x76;
+    EP[2].tx_buffer[1] = scanned;
+    Flash_Map_Put16(&EP[2].tx_buffer[2], flash_map_sectors);
+    Flash_Map_Put16(&EP[2].tx_buffer[4], Flash_Map_Used());
+    EP[2].tx_buffer[6] = ticks;
+    EP[2].tx_buffer[7] = ticks >> 8;
+    EP[2].tx_buffer[8] = ticks >> 16;
+    EP[2].tx_buffer[9] = ticks >> 24;
+
+    EP2_TX(EP[2].tx_buffer);
+}
+
+//0x76, replies with the used sectors, a scan is left to the
+//main loop
+void Flash_Map_Report(void)
+{
+    if(flash_map_ready && (EP[1].rx_buffer[1] == 1))
+    {
+        flash_map_requested = true;
+        return;
+    }
+
+    Flash_Map_Reply(0, 0);
+}
+
+//Main loop, the scan 0x76 asked for
+void Flash_Map_Service(void)
+{
+    uint32_t start;
+    uint32_t ticks;
+    uint32_t status;
+
+    if(!flash_map_requested)
+    {
+        return;
+    }
+
+    start = _CP0_GET_COUNT();
+    Flash_Map_Rebuild();
+    ticks = _CP0_GET_COUNT() - start;
+
+    //The USB interrupt sends on Endpoint 2 too
+    status = __builtin_disable_interrupts();
+
+    flash_map_requested = false;
+    Flash_Map_Reply(1, ticks);
+
+    __builtin_mtc0(12, 0, status);
+}
@@ -0,0 +1,384 @@
+/*********************************************************************
+    FileName:     	Flash_Program.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 MHz, Core Timer = System Clock / 2
+
+    File Description:
+        Programs an image sent over USB into the external flash
+
+        The image is taken in blocks of one sector, into two RAM
+        buffers: the host fills one while the other is programmed.
+        For each block, one after the other:
+            - its sector is erased (not when the flash map has it
+              blank), while the host is still sending the block
+            - the buffer is programmed with one flash job
+            - the block is read back and its CRC-32 compared with
+              the buffer's, the buffer is then free again
+        The chip does one operation at a time, so the erase of the
+        next sector goes on while the host fills its buffer, not
+        while the current block is programmed.
+
+        The jobs finish from the main loop. While an image is taken
+        Flash_Program_Service() runs the job engine itself for up to
+        FLASH_PROGRAM_DRIVE_TICKS per pass, the timer tick alone
+        gives it only a fifth of the time.
+
+        The image starts on a sector and goes in sectors
+        FLASH_PROGRAM_FIRST up to the flash map sector, the end of
+        the last sector is erased too.
+
+        0x80 Flash Program Begin
+            Request:  Byte 1-3   flash address, on a sector
+                      Byte 4-7   length of the image
+            Reply:    Byte 0 = 0x80, Byte 1 = 1 when started
+                      Byte 2-3   blocks
+        0x81 Flash Program Data
+            Request:  Byte 1-3   offset in the image
+                      Byte 4     bytes, up to FLASH_PROGRAM_DATA_MAX,
+                                 not across a block
+                      Byte 5-    the bytes
+            Reply:    Byte 0 = 0x81, Byte 1 = 1 taken, 0 busy (both
+                      buffers in use), 2 refused
+                      Byte 2-4   offset expected next
+            The bytes are taken in order only, the host sends again
+            from the expected offset after a busy or refused reply.
+        0x82 Flash Program Status
+            Request:  Byte 1 = 1 stops the image
+            Reply:    Byte 0 = 0x82, Byte 1 state (FLASH_PROGRAM_*)
+                      Byte 2-5   bytes received
+                      Byte 6-9   bytes programmed and checked
+                      Byte 10-13 length of the image
+                      Byte 14-17 CRC-32 of the checked bytes
+                      Byte 18-19 errors
+                      Byte 20-21 block that failed, 0xffff for none
+                      Byte 22-25 Core Timer ticks since Begin, until
+                                 the last block was checked
+        All values are little endian.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include <stddef.h>
+#include "MainBrain.h"
+
+#define FLASH_PROGRAM_FIRST     9
+#define FLASH_PROGRAM_BLOCK     0x1000
+#define FLASH_PROGRAM_DATA_MAX  56
+
+//Bytes read back at a time
+#define FLASH_PROGRAM_CHECK     256
+
+//Main loop time given to the job engine per pass, 2 ms
+#define FLASH_PROGRAM_DRIVE_TICKS   200000
+
+#define FLASH_PROGRAM_IDLE      0
+#define FLASH_PROGRAM_RUNNING   1
+#define FLASH_PROGRAM_DONE      2
+#define FLASH_PROGRAM_FAILED    3
+
+//Buffer states
+#define FLASH_PROGRAM_FILLING   0
+#define FLASH_PROGRAM_READY     1
+#define FLASH_PROGRAM_WRITING   2
+
+#define FLASH_PROGRAM_NONE      0xffff
+
+static uint8_t flash_program_buffer[2][FLASH_PROGRAM_BLOCK];
+static volatile uint8_t flash_program_buffer_state[2];
+
+static volatile uint8_t flash_program_state = FLASH_PROGRAM_IDLE;
+static uint32_t flash_program_address;
+static uint32_t flash_program_length;
+static volatile uint32_t flash_program_received;
+static uint16_t flash_program_blocks;
+
+//Next block to erase, to program, and the blocks checked
+static uint16_t flash_program_erase_block;
+static uint16_t flash_program_block;
+static uint16_t flash_program_checked;
+
+static FLASH_JOB flash_program_erase_job;
+static FLASH_JOB flash_program_job;
+static volatile bool flash_program_erasing = false;
+static volatile bool flash_program_writing = false;
+
+static uint32_t flash_program_block_crc;
+static uint32_t flash_program_crc;
+static uint32_t flash_program_bytes;
+static uint16_t flash_program_errors;
+static uint16_t flash_program_failed;
+static uint32_t flash_program_start;
+static uint32_t flash_program_ticks;
+
+static void Flash_Program_Put16(volatile uint8_t *buffer, uint16_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+}
+
+static void Flash_Program_Put32(volatile uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+static uint16_t Flash_Program_Block_Length(uint16_t block)
+{
+    uint32_t left = flash_program_length - ((uint32_t)block * FLASH_PROGRAM_BLOCK);
+
+    return (left < FLASH_PROGRAM_BLOCK) ? left : FLASH_PROGRAM_BLOCK;
+}
+
+static void Flash_Program_Fail(uint16_t block)
+{
+    flash_program_errors++;
+    flash_program_failed = block;
+    flash_program_ticks = _CP0_GET_COUNT() - flash_program_start;
+    flash_program_state = FLASH_PROGRAM_FAILED;
+}
+
+static void Flash_Program_Erased(FLASH_JOB *job)
+{
+    flash_program_erasing = false;
+
+    if((flash_program_state == FLASH_PROGRAM_RUNNING) && (job->state != FLASH_JOB_DONE))
+    {
+        Flash_Program_Fail(flash_program_erase_block - 1);
+    }
+}
+
+//The block is read back and checked against its buffer
+static void Flash_Program_Written(FLASH_JOB *job)
+{
+    uint8_t data[FLASH_PROGRAM_CHECK];
+    uint16_t block = flash_program_block - 1;
+    uint8_t *buffer = flash_program_buffer[block & 1];
+    uint16_t length = job->length;
+    uint32_t crc = 0xffffffff;
+    uint16_t count;
+
+    flash_program_writing = false;
+
+    if(flash_program_state != FLASH_PROGRAM_RUNNING)
+    {
+        flash_program_buffer_state[block & 1] = FLASH_PROGRAM_FILLING;
+        return;
+    }
+
+    if(job->state != FLASH_JOB_DONE)
+    {
+        Flash_Program_Fail(block);
+        return;
+    }
+
+    for(uint16_t i=0;i<length;i=i+count)
+    {
+        count = length - i;
+        if(count > FLASH_PROGRAM_CHECK)
+        {
+            count = FLASH_PROGRAM_CHECK;
+        }
+
+        Flash_Read(job->address + i, data, count);
+        crc = CRC32(crc, data, count);
+    }
+
+    if(crc != flash_program_block_crc)
+    {
+        Flash_Program_Fail(block);
+        return;
+    }
+
+    flash_program_crc = CRC32(flash_program_crc, buffer, length);
+    flash_program_bytes = flash_program_bytes + length;
+    flash_program_checked++;
+
+    flash_program_buffer_state[block & 1] = FLASH_PROGRAM_FILLING;
+
+    if(flash_program_checked == flash_program_blocks)
+    {
+        flash_program_ticks = _CP0_GET_COUNT() - flash_program_start;
+        flash_program_state = FLASH_PROGRAM_DONE;
+    }
+}
+
+//Main loop, starts the next erase or program and runs the jobs
+void Flash_Program_Service(void)
+{
+    uint8_t *buffer;
+    uint16_t sector;
+    uint16_t length;
+    uint32_t start;
+
+    if(flash_program_state != FLASH_PROGRAM_RUNNING)
+    {
+        return;
+    }
+
+    //A sector is erased once the block before it checked out
+    if(!flash_program_erasing && !flash_program_writing &&
+       (flash_program_erase_block < flash_program_blocks) && (flash_program_erase_block == flash_program_checked))
+    {
+        sector = (flash_program_address / FLASH_PROGRAM_BLOCK) + flash_program_erase_block;
+        flash_program_erase_block++;
+
+        if(Flash_Map_Sector_Used(sector))
+        {
+            flash_program_erasing = true;
+            Flash_Jobs_Erase(&flash_program_erase_job, sector, Flash_Program_Erased, NULL);
+        }
+    }
+
+    if(!flash_program_erasing && !flash_program_writing && (flash_program_block < flash_program_erase_block) &&
+       (flash_program_buffer_state[flash_program_block & 1] == FLASH_PROGRAM_READY))
+    {
+        buffer = flash_program_buffer[flash_program_block & 1];
+        length = Flash_Program_Block_Length(flash_program_block);
+
+        flash_program_block_crc = CRC32(0xffffffff, buffer, length);
+        flash_program_buffer_state[flash_program_block & 1] = FLASH_PROGRAM_WRITING;
+        flash_program_writing = true;
+
+        Flash_Jobs_Program(&flash_program_job, flash_program_address + ((uint32_t)flash_program_block * FLASH_PROGRAM_BLOCK),
+                           buffer, length, Flash_Program_Written, NULL);
+        flash_program_block++;
+    }
+
+    start = _CP0_GET_COUNT();
+
+    while((flash_program_erasing || flash_program_writing) && ((_CP0_GET_COUNT() - start) < FLASH_PROGRAM_DRIVE_TICKS))
+    {
+        Flash_Jobs_Tick();
+        Flash_Jobs_Service();
+    }
+}
+
+//0x80, starts taking an image
+void Flash_Program_Begin_Report(void)
+{
+    uint32_t address = EP[1].rx_buffer[1] | (EP[1].rx_buffer[2] << 8) | (EP[1].rx_buffer[3] << 16);
+    uint32_t length = EP[1].rx_buffer[4] | (EP[1].rx_buffer[5] << 8) | (EP[1].rx_buffer[6] << 16) |
+                      ((uint32_t)EP[1].rx_buffer[7] << 24);
+    uint32_t end = (uint32_t)(Flash_Map_Sectors() - 1) * FLASH_PROGRAM_BLOCK;
+    uint8_t started = 0;
+
+    if((flash_program_state != FLASH_PROGRAM_RUNNING) && !flash_program_erasing && !flash_program_writing &&
+       ((address % FLASH_PROGRAM_BLOCK) == 0) && (address >= (FLASH_PROGRAM_FIRST * FLASH_PROGRAM_BLOCK)) &&
+       (length > 0) && (address < end) && (length <= (end - address)))
+    {
+        flash_program_address = address;
+        flash_program_length = length;
+        flash_program_received = 0;
+        flash_program_blocks = (length + FLASH_PROGRAM_BLOCK - 1) / FLASH_PROGRAM_BLOCK;
+        flash_program_erase_block = 0;
+        flash_program_block = 0;
+        flash_program_checked = 0;
+        flash_program_buffer_state[0] = FLASH_PROGRAM_FILLING;
+        flash_program_buffer_state[1] = FLASH_PROGRAM_FILLING;
+        flash_program_crc = 0xffffffff;
+        flash_program_bytes = 0;
+        flash_program_errors = 0;
+        flash_program_failed = FLASH_PROGRAM_NONE;
+        flash_program_ticks = 0;
+        flash_program_start = _CP0_GET_COUNT();
+        flash_program_state = FLASH_PROGRAM_RUNNING;
+        started = 1;
+    }
+
+    EP[2].tx_buffer[0] = 0x80;
+    EP[2].tx_buffer[1] = started;
+    Flash_Program_Put16(&EP[2].tx_buffer[2], started ? flash_program_blocks : 0);
+
+    EP2_TX(EP[2].tx_buffer);
+}
+
+//0x81, bytes of the image
+void Flash_Program_Data_Report(void)
+{
+    uint32_t offset = EP[1].rx_buffer[1] | (EP[1].rx_buffer[2] << 8) | (EP[1].rx_buffer[3] << 16);
+    uint8_t count = EP[1].rx_buffer[4];
+    uint16_t block = offset / FLASH_PROGRAM_BLOCK;
+    uint16_t start = offset % FLASH_PROGRAM_BLOCK;
+    uint8_t result = 2;
+
+    if((flash_program_state == FLASH_PROGRAM_RUNNING) && (offset == flash_program_received) && (count > 0) &&
+       (count <= FLASH_PROGRAM_DATA_MAX) && ((start + count) <= Flash_Program_Block_Length(block)) &&
+       ((offset + count) <= flash_program_length))
+    {
+        if(flash_program_buffer_state[block & 1] != FLASH_PROGRAM_FILLING)
+        {
+            result = 0;
+        }
+        else
+        {
+            for(int i=0;i<count;i++)
+            {
+                flash_program_buffer[block & 1][start + i] = EP[1].rx_buffer[5 + i];
+            }
+
+            flash_program_received = offset + count;
+            if((start + count) == Flash_Program_Block_Length(block))
+            {
+                flash_program_buffer_state[block & 1] = FLASH_PROGRAM_READY;
+            }
+
+            result = 1;
+        }
+    }
+
+    EP[2].tx_buffer[0] = 0x81;
+    EP[2].tx_buffer[1] = result;
+    EP[2].tx_buffer[2] = flash_program_received;
+    EP[2].tx_buffer[3] = flash_program_received >> 8;
+    EP[2].tx_buffer[4] = flash_program_received >> 16;
+
+    EP2_TX(EP[2].tx_buffer);
+}
+
+//0x82, progress of the image
+void Flash_Program_Status_Report(void)
+{
+    if((EP[1].rx_buffer[1] == 1) && (flash_program_state == FLASH_PROGRAM_RUNNING))
+    {
+        //The jobs already queued finish, nothing new is started
+        Flash_Program_Fail(FLASH_PROGRAM_NONE);
+    }
+
+    EP[2].tx_buffer[0] = 0x82;
+    EP[2].tx_buffer[1] = flash_program_state;
+    Flash_Program_Put32(&EP[2].tx_buffer[2], flash_program_received);
+    Flash_Program_Put32(&EP[2].tx_buffer[6], flash_program_bytes);
+    Flash_Program_Put32(&EP[2].tx_buffer[10], flash_program_length);
+    Flash_Program_Put32(&EP[2].tx_buffer[14], flash_program_crc ^ 0xffffffff);
+    Flash_Program_Put16(&EP[2].tx_buffer[18], flash_program_errors);
+    Flash_Program_Put16(&EP[2].tx_buffer[20], flash_program_failed);
+    Flash_Program_Put32(&EP[2].tx_buffer[22], (flash_program_state == FLASH_PROGRAM_RUNNING) ?
+                        (_CP0_GET_COUNT() - flash_program_start) : flash_program_ticks);
+
+    EP2_TX(EP[2].tx_buffer);
+}
@@ -0,0 +1,339 @@
+/*********************************************************************
+    FileName:     	Mailbox.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 MHz
+
+    File Description:
+        MainBrain side of the board mailboxes (layout in Mailbox.h)
+
+        Up to 8 requests can be posted to a board without a Directive
+        and /ACK for each one, the board answers in its response ring
+        when it gets to them. The MainBrain keeps the indices it owns
+        in RAM, so posting reads one byte (the board's request tail)
+        and receiving reads one byte (the board's response head)
+        before the slot.
+
+        A board that runs the mailbox writes MAILBOX_READY_MARK at
+        power up. Either side can start first, each one takes its
+        indices from the other side's.
+
+        The response ring is emptied from the main loop only
+        (Mailbox_Take()): when the board asks for service (Service.c)
+        and when the host asks for it with 0x7f. A
+        MAILBOX_SERVICE_DIRECTIVE frame is run as a directive, the
+        other frames are kept for 0x7f, the oldest go when more than
+        MAILBOX_KEPT are waiting.
+
+        0x7f Mailbox
+            Request:  Byte 1     board (1 - 7)
+                      Byte 2     1 posts a request
+                      Byte 3     command
+                      Byte 4     tag
+                      Byte 5     payload length (0 - 13)
+                      Byte 6-18  payload
+            The main loop (Mailbox_Service()) posts the request,
+            takes the board's responses and replies.
+            Reply:    Byte 0     0x7f
+                      Byte 1     1 the request was posted (0 the board
+                                 does not run the mailbox or its
+                                 request ring is full)
+                      Byte 2     requests the board has not taken
+                      Byte 3     frames in this reply (0 - 3)
+                      Byte 4     frames still kept
+                      Byte 5-8   frames dropped, MAILBOX_KEPT full
+                      Byte 9-    17 bytes per frame, oldest first
+                                 +0      board
+                                 +1      payload length
+                                 +2      command
+                                 +3      tag
+                                 +4-16   payload
+            All values are little endian.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include "MainBrain.h"
+
+//Responses kept for 0x7f, frames in one reply
+#define MAILBOX_KEPT            8
+#define MAILBOX_REPORT_MAX      3
+
+//Indices owned by the MainBrain, by board address
+static uint8_t mailbox_request_head[8];
+static uint8_t mailbox_response_tail[8];
+
+//Taken from the response rings, main loop only
+static MAILBOX_FRAME mailbox_kept[MAILBOX_KEPT];
+static uint8_t mailbox_kept_board[MAILBOX_KEPT];
+static uint8_t mailbox_kept_head;
+static uint8_t mailbox_kept_tail;
+static uint32_t mailbox_kept_lost;
+
+//Set by 0x7f in the USB interrupt, Byte 1 - 18 of the request
+static volatile bool mailbox_requested = false;
+static uint8_t mailbox_request[18];
+
+static uint32_t mailbox_region(uint8_t board)
+{
+    return (board - 1) * 0x400;
+}
+
+//Drops whatever is in the rings, the board's indices are kept so a
+//board that is already running stays in step
+void Mailbox_Init(void)
+{
+    uint32_t region;
+
+    for(int board=1;board<=7;board++)
+    {
+        region = mailbox_region(board);
+
+        mailbox_request_head[board] = REN70V05_RD(region + MAILBOX_REQUEST_TAIL);
+        mailbox_response_tail[board] = REN70V05_RD(region + MAILBOX_RESPONSE_HEAD);
+
+        REN70V05_WR(region + MAILBOX_REQUEST_HEAD, mailbox_request_head[board]);
+        REN70V05_WR(region + MAILBOX_RESPONSE_TAIL, mailbox_response_tail[board]);
+    }
+}
+
+bool Mailbox_Ready(uint8_t board)
+{
+    if((board < 1) || (board > 7))
+    {
+        return false;
+    }
+
+    return (uint8_t)REN70V05_RD(mailbox_region(board) + MAILBOX_READY) == MAILBOX_READY_MARK;
+}
+
+//Slots the board has not taken yet
+uint8_t Mailbox_Pending(uint8_t board)
+{
+    uint8_t tail;
+
+    if((board < 1) || (board > 7))
+    {
+        return 0;
+    }
+
+    tail = REN70V05_RD(mailbox_region(board) + MAILBOX_REQUEST_TAIL);
+
+    return (uint8_t)(mailbox_request_head[board] - tail);
+}
+
+//Returns false when the board's request ring is full
+bool Mailbox_Post(uint8_t board, uint8_t command, uint8_t tag, const uint8_t *data, uint8_t length)
+{
+    MAILBOX_FRAME frame;
+    uint32_t region;
+    uint8_t head;
+
+    if((board < 1) || (board > 7) || (length > MAILBOX_PAYLOAD_MAX))
+    {
+        return false;
+    }
+
+    if(Mailbox_Pending(board) >= MAILBOX_SLOTS)
+    {
+        return false;
+    }
+
+    region = mailbox_region(board);
+    head = mailbox_request_head[board];
+
+    frame.length = length;
+    frame.command = command;
+    frame.tag = tag;
+    for(int i=0;i<length;i++)
+    {
+        frame.data[i] = data[i];
+    }
+
+    //The slot, then the index that hands it over
+    REN70V05_WriteBlock(region + MAILBOX_REQUEST_SLOTS + ((head % MAILBOX_SLOTS) * MAILBOX_SLOT_SIZE),
+			(uint8_t *)&frame, 3 + length);
+
+    head++;
+    REN70V05_WR(region + MAILBOX_REQUEST_HEAD, head);
+    mailbox_request_head[board] = head;
+
+    return true;
+}
+
+//Returns false when the board has not answered anything new
+bool Mailbox_Receive(uint8_t board, MAILBOX_FRAME *frame)
+{
+    uint32_t region;
+    uint8_t tail;
+
+    if((board < 1) || (board > 7))
+    {
+        return false;
+    }
+
+    region = mailbox_region(board);
+    tail = mailbox_response_tail[board];
+
+    if((uint8_t)REN70V05_RD(region + MAILBOX_RESPONSE_HEAD) == tail)
+    {
+        return false;
+    }
+
+    REN70V05_ReadBlock(region + MAILBOX_RESPONSE_SLOTS + ((tail % MAILBOX_SLOTS) * MAILBOX_SLOT_SIZE),
+		       (uint8_t *)frame, MAILBOX_SLOT_SIZE);
+
+    if(frame->length > MAILBOX_PAYLOAD_MAX)
+    {
+        frame->length = MAILBOX_PAYLOAD_MAX;
+    }
+
+    //Hands the slot back to the board
+    tail++;
+    REN70V05_WR(region + MAILBOX_RESPONSE_TAIL, tail);
+    mailbox_response_tail[board] = tail;
+
+    return true;
+}
+
+//Main loop, everything in the board's response ring
+void Mailbox_Take(uint8_t board)
+{
+    MAILBOX_FRAME frame;
+
+    if(!Mailbox_Ready(board))
+    {
+        return;
+    }
+
+    while(Mailbox_Receive(board, &frame))
+    {
+        //Only a directive the board posted runs, never the command
+        //left at offset 0
+        if(frame.command == MAILBOX_SERVICE_DIRECTIVE)
+        {
+            if(frame.length != 0)
+            {
+                Directive_Submit(board, frame.data, frame.length, false);
+            }
+            continue;
+        }
+
+        if((uint8_t)(mailbox_kept_head - mailbox_kept_tail) >= MAILBOX_KEPT)
+        {
+            mailbox_kept_tail++;
+            mailbox_kept_lost++;
+        }
+        mailbox_kept[mailbox_kept_head % MAILBOX_KEPT] = frame;
+        mailbox_kept_board[mailbox_kept_head % MAILBOX_KEPT] = board;
+        mailbox_kept_head++;
+    }
+}
+
+//0x7f, the rings are only touched from the main loop
+void Mailbox_Request(void)
+{
+    for(int i=0;i<18;i++)
+    {
+        mailbox_request[i] = EP[1].rx_buffer[1 + i];
+    }
+
+    mailbox_requested = true;
+}
+
+static void Mailbox_Put32(volatile uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+//Main loop, posts what 0x7f asked for and replies with the kept
+//responses
+void Mailbox_Service(void)
+{
+    MAILBOX_FRAME *frame;
+    volatile uint8_t *entry;
+    uint32_t status;
+    uint8_t board;
+    uint8_t count = 0;
+    bool posted = false;
+
+    if(!mailbox_requested)
+    {
+        return;
+    }
+
+    board = mailbox_request[0];
+
+    if((mailbox_request[1] == 1) && Mailbox_Ready(board))
+    {
+        posted = Mailbox_Post(board, mailbox_request[2], mailbox_request[3], &mailbox_request[5],
+			      mailbox_request[4]);
+    }
+
+    Mailbox_Take(board);
+
+    //The USB interrupt sends on Endpoint 2 too
+    status = __builtin_disable_interrupts();
+
+    mailbox_requested = false;
+
+    for(int i=0;i<64;i++)
+    {
+        EP[2].tx_buffer[i] = 0;
+    }
+
+    EP[2].tx_buffer[0] = 0x7f;
+    EP[2].tx_buffer[1] = posted;
+    EP[2].tx_buffer[2] = Mailbox_Pending(board);
+
+    while((count < MAILBOX_REPORT_MAX) && (mailbox_kept_head != mailbox_kept_tail))
+    {
+        frame = &mailbox_kept[mailbox_kept_tail % MAILBOX_KEPT];
+        entry = &EP[2].tx_buffer[9 + (count * 17)];
+
+        entry[0] = mailbox_kept_board[mailbox_kept_tail % MAILBOX_KEPT];
+        entry[1] = frame->length;
+        entry[2] = frame->command;
+        entry[3] = frame->tag;
+        for(int i=0;i<frame->length;i++)
+        {
+            entry[4 + i] = frame->data[i];
+        }
+
+        mailbox_kept_tail++;
+        count++;
+    }
+
+    EP[2].tx_buffer[3] = count;
+    EP[2].tx_buffer[4] = (uint8_t)(mailbox_kept_head - mailbox_kept_tail);
+    Mailbox_Put32(&EP[2].tx_buffer[5], mailbox_kept_lost);
+
+    EP2_TX(EP[2].tx_buffer);
+
+    __builtin_mtc0(12, 0, status);
+}
@@ -0,0 +1,107 @@
+/*********************************************************************
+    FileName:     	Mailbox.h
+    Dependencies:	stdint.h
+    Processor:		PIC32MZ, I/O boards, Host
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        Mailbox layout in a board's 0x400 SRAM region
+
+    File Description:
+        Shared by the MainBrain (Mailbox.c) and the I/O boards
+        (board/Mailbox_Board.c), plain C only.
+
+        Offset from the start of the board's region:
+            0x100   Request head    written by the MainBrain
+            0x101   Request tail    written by the board
+            0x102   Response head   written by the board
+            0x103   Response tail   written by the MainBrain
+            0x104   Ready           the board writes MAILBOX_READY_MARK
+            0x105   Service count   written by the board
+            0x106   Service code    written by the board
+            0x110   Request slots   8 x 16 bytes
+            0x190   Response slots  8 x 16 bytes
+
+        The indices count frames and wrap at 256, the slot is the
+        index modulo 8. A ring is empty when head == tail and full
+        when head - tail == 8. Each side only writes its own index,
+        and writes it after the slot, so no lock is needed.
+
+        Frame (one slot):
+            Byte 0      payload length (0 - 13)
+            Byte 1      command
+            Byte 2      tag, copied into the response
+            Byte 3-15   payload
+
+        Service requests: the board writes the code (priority in
+        bits 0-1, 3 first, the reason in bits 2-7), then one more to
+        the count, then pulls the service request line (RA7) low for
+        a moment. The MainBrain (Service.c) looks for the counts that
+        changed.
+
+        A directive the board wants run goes in its own response ring
+        first: command MAILBOX_SERVICE_DIRECTIVE, tag 0, the payload
+        is the command for the start of its region. Then it asks for
+        service. The MainBrain (Service.c) writes the payload to
+        offset 0 and selects the board. A request without such a
+        frame runs nothing, the command already at offset 0 is never
+        run again.
+
+        The legacy command bytes (0x000 - 0x03f) and the sequence
+        table (0x300 - 0x3ff) are not touched.
+
+    Change History:
+
+/***********************************************************************/
+
+#ifndef MAILBOX_H
+#define	MAILBOX_H
+#include <stdint.h>
+
+#define MAILBOX_BASE            0x100
+#define MAILBOX_REQUEST_HEAD    (MAILBOX_BASE + 0x00)
+#define MAILBOX_REQUEST_TAIL    (MAILBOX_BASE + 0x01)
+#define MAILBOX_RESPONSE_HEAD   (MAILBOX_BASE + 0x02)
+#define MAILBOX_RESPONSE_TAIL   (MAILBOX_BASE + 0x03)
+#define MAILBOX_READY           (MAILBOX_BASE + 0x04)
+#define MAILBOX_SERVICE_COUNT   (MAILBOX_BASE + 0x05)
+#define MAILBOX_SERVICE_CODE    (MAILBOX_BASE + 0x06)
+#define MAILBOX_REQUEST_SLOTS   (MAILBOX_BASE + 0x10)
+#define MAILBOX_RESPONSE_SLOTS  (MAILBOX_BASE + 0x90)
+
+#define MAILBOX_SLOTS           8
+#define MAILBOX_SLOT_SIZE       16
+#define MAILBOX_PAYLOAD_MAX     13
+#define MAILBOX_READY_MARK      0xb1
+
+//Response frame posted by the board itself, a directive to run
+#define MAILBOX_SERVICE_DIRECTIVE   0xf0
+
+#define MAILBOX_SERVICE_CODE_OF(priority, reason)   (((reason) << 2) | ((priority) & 3))
+
+typedef struct
+{
+    uint8_t length;
+    uint8_t command;
+    uint8_t tag;
+    uint8_t data[MAILBOX_PAYLOAD_MAX];
+} MAILBOX_FRAME;
+
+#endif	/* MAILBOX_H */
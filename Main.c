@@ -114,11 +114,14 @@ int8_t dev_data = 0;
 uint8_t screen;
 bool NeedsRefresh = true;
 uint8_t default_Display_Brightness = 1;
+volatile bool SaveBrightness = false;
+volatile bool SaveSequence[FLASH_KV_SEQUENCES];
 bool Level2MenuActive = false;
 uint8_t CurrentLevel = HOMELEVEL;
 uint8_t FlashConfigData[100];
 uint8_t BuildPList = 0;
 uint8_t requestDirective = 0;
+//1 for a board that is there, [0] is board 1, see Peripherals.c
 uint8_t PeripheralList[7] = {0};
 uint8_t current_board_address;
 uint16_t myArray[480];
@@ -153,7 +156,7 @@ int main(void)
     LED_Port(0x3);
     
     //Test SRAM
-    //test_result = memtest_70V05(40);
+    //The quick test runs in REN70V05_Init(), before the SRAM is used
     
     //Indicates SRAM Test completed
     LED_Port(0x4);
@@ -162,6 +165,21 @@ int main(void)
     //ReleaseSRAM();
 
     Flash_Init();
+    
+    //Saved sequences back to the SRAM table
+    LoadSequences();
+    
+    //Flash jobs run in the background from here
+    TMR7_init();
+    
+    //Directives end on the /ACK and Timer 3 interrupts
+    Directive_Init();
+    
+    //Service requests from the boards on RA7
+    Service_Init();
+
+    //Motion sequences, Timer 8 writes the setpoints
+    Motion_Init();
 
     //Indicates Flash Setup completed
     LED_Port(0x5);
@@ -230,14 +248,8 @@ int main(void)
     //Specify the screen to load
     screen = HOME_SCREEN;  
     
-    //Build peripherals list
-    PeripheralList[1] = 1;
-    PeripheralList[2] = 2;
-    PeripheralList[3] = 3;
-    PeripheralList[4] = 4;
-    PeripheralList[5] = 5;
-    PeripheralList[6] = 6;
-    PeripheralList[7] = 7;
+    //Build peripherals list, probes every board address
+    Peripheral_Enumerate();
     
     uint8_t a = 5;
     
@@ -269,13 +281,50 @@ int main(void)
 	//check for a active directive
 	if(requestDirective == 1)
 	{
-	    //This initiates an I/O cycle
-	    Directive(current_board_address);
+	    //This queues an I/O cycle, the screen is drawn again
+	    //when the board has answered
+	    Directive_Queue(current_board_address, true);
 	    
 	    //clear the Directive flag
 	    requestDirective = 0;	    
 	}
 	
+	//Directives that ended
+	Directive_Service();
+	
+	//Boards that asked for service on RA7
+	Service_Dispatch();
+	
+	//Requests posted to a board's mailbox and its answers, 0x7f
+	Mailbox_Service();
+	
+	//Boards added or removed
+	Peripheral_Service();
+	
+	//The next record of a running motion sequence
+	Motion_Service();
+	
+	//Settings changed over USB go to the flash from here
+	SaveSettings();
+	
+	//Keep an erased sector ready for the settings
+	Flash_KV_Service();
+	
+	//Finished flash jobs
+	Flash_Jobs_Service();
+	
+	//Checks an asset store sent over USB
+	Asset_Service();
+	
+	//Programs the blocks of a flash image sent over USB
+	Flash_Program_Service();
+	
+	//A memory test asked for over USB
+	SRAM_Test_Service();
+	
+	//A flash map scan asked for over USB
+	Flash_Map_Service();
+	
         //Load the current screen
         switch(screen)
         {
@@ -295,6 +344,16 @@ int main(void)
 		    NeedsRefresh = false;
                 }                
 		break;
+            case DEBUG_SCREEN:
+                //Board ACK times, drawn again after the directives
+                //that refresh
+                if(NeedsRefresh == true)
+                {
+                    DrawScreen(DEBUG_SCREEN, HeaderString);
+                    CurrentLevel = HOMELEVEL;
+		    NeedsRefresh = false;
+                }
+		break;
 	}      
 	
         //Read single point touch position
@@ -356,6 +415,7 @@ void SystemSetup(void)
     TRISAbits.TRISA1 = 0;
 
     //This pin is used by the peripherals to indicate they need serviced
+    //Service.c takes its falling edges
     TRISAbits.TRISA7 = 1;
     
     //LED Port
@@ -551,112 +611,6 @@ void SystemReset(void)
     while(1);
 }
 
-/*************************************************************
- Sends an I/O request to the peripheral.
- 
- SRAM Data must be written prior to calling this function.
- 
- Once the board address is selected the peripheral reads
- SRAM location 0 of it's predefined memory region and returns
- an /ACK when finished.
- 
- This function responds to the /ACK by setting the current address
- to zero.
-*************************************************************/
-void Directive(uint8_t badd)
-{
-    //Zero Timer 3 and set period
-    //timeout is about 1 uS
-    //non-timeout is about 475 nS
-    PR3 = 0xffff;
-    TMR3 = 0;
-    
-    //Set the pre-scaler
-    T3CONbits.TCKPS = 7;
-    
-    //Write the command at board address of the I/O card
-    //REN70V05_WR((((boardAddress) - 1) * 0x400), EP[1].rx_buffer[2]);
-
-    //Set the board select address
-    SetPeripheralAddress(badd);
-
-    //Start Timer 3
-    T3CONSET = 1 << 15; 
-    
-    //Wait for either the /ACK or a timeout to occur
-    while((!IFS0bits.T3IF) && (PORTGbits.RG13));
-    
-    //Check to see what happened
-    //If /ACK went low add the board to the list
-    if(!PORTGbits.RG13)
-    {
-	//PeripheralList[EP[1].rx_buffer[1]] = 1;
-	LED_Port(0x2);
-    }
-    else   
-    {
-	// we timed out
-	//PeripheralList[EP[1].rx_buffer[1]] = 0;
-	LED_Port(0x4);
-    }
-
-    
-    //Reset the board select address
-    SetPeripheralAddress(0);
-
-    //Stop Timer 3
-    T3CONCLR = 1 << 15;     
-    
-    //Reset the flag
-    IFS0bits.T3IF = 0;
-}
-
-/*************************************************************
- Builds a list of all the present peripheral devices
- This array is used for all future I/O requests 
-*************************************************************/
-void BuildPeripheralList(void)
-{
-    //Zero Timer 3
-    PR3 = 0;
-    
-    //Set the pre-scaler
-    T3CONbits.TCKPS = 7;
-    
-    //Start Timer 3
-    T3CONSET = 1 << 15; 
-    
-    //Write the command at address 0 of the I/O card
-    REN70V05_WR(0, EP[1].rx_buffer[2]);
-    int i = 0;
-//    for(int i=1;i<=7;i++)
-//    {
-	//Set the board select address
-	SetPeripheralAddress(EP[1].rx_buffer[1]);
-
-	//Wait for either the /ACK or a timeout to occur
-	while((!IFS0bits.T3IF) && (PORTGbits.RG13));
-
-	//Check to see what happened
-	//If /ACK went low add the board to the list
-	if(!PORTGbits.RG13)
-	{
-	    PeripheralList[i] = 1;
-	}
-	else
-	{
-	    // we timed out
-	    PeripheralList[i] = 0;
-	}
-
-	//Reset the board select address
-	SetPeripheralAddress(0);
-
-	//Stop Timer 3
-	T3CONCLR = 1 << 15; 
-//    }
-}
-
 void SetPotentiometer(void)
 {
     
@@ -1023,17 +977,61 @@ void DMM(uint8_t data, uint16_t xchar, uint16_t ychar)
 
 void SetDisplayBrightness(void)
 {
-    Flash_RD(0);
-    default_Display_Brightness = data_flash;
-    
-    //If the flash is not programmed then set the default
-    if(data_flash == 0xff)
+    //Saved setting, or the single byte at flash address 0 it
+    //used to be
+    if(Flash_KV_Get(FLASH_KV_BRIGHTNESS, &default_Display_Brightness, 1) != 1)
     {
-        default_Display_Brightness = 5;
+        Flash_RD(0);
+        default_Display_Brightness = data_flash;
+    
+        //If the flash is not programmed then set the default
+        if(data_flash == 0xff)
+        {
+            default_Display_Brightness = 5;
+        }
     }
     Backlight_Control(default_Display_Brightness);    
 }
 
+//Copies the saved sequences to the SRAM sequence table
+void LoadSequences(void)
+{
+    uint8_t sequence[16];
+    
+    for(int i=0;i<FLASH_KV_SEQUENCES;i++)
+    {
+        if(Flash_KV_Get(FLASH_KV_SEQUENCE + i, sequence, sizeof(sequence)) == sizeof(sequence))
+        {
+            SRAM_Shadow_Write(0x300 + (i * sizeof(sequence)), sequence, sizeof(sequence));
+        }
+    }
+    
+    SRAM_Shadow_FlushAll();
+}
+
+//Saves what the USB interrupt changed, the flash is only
+//written from the main loop
+void SaveSettings(void)
+{
+    uint8_t sequence[16];
+    
+    if(SaveBrightness)
+    {
+        SaveBrightness = false;
+        Flash_KV_Set(FLASH_KV_BRIGHTNESS, &default_Display_Brightness, 1);
+    }
+    
+    for(int i=0;i<FLASH_KV_SEQUENCES;i++)
+    {
+        if(SaveSequence[i])
+        {
+            SaveSequence[i] = false;
+            SRAM_Shadow_Read(0x300 + (i * sizeof(sequence)), sequence, sizeof(sequence));
+            Flash_KV_Set(FLASH_KV_SEQUENCE + i, sequence, sizeof(sequence));
+        }
+    }
+}
+
 void Beep(void)
 {
     //Beep speaker
@@ -30,6 +30,7 @@
 #define	MAINBRAIN_H
 #include <stdbool.h>
 #include <stdint.h> 
+#include "Mailbox.h"
 
 //Display
 #define black   0x0000
@@ -89,9 +90,6 @@ extern int8_t dev_data;
 extern volatile uint8_t DeviceState;
 extern char MessageBoxTitle[];
 extern char myStr[];
-extern const uint16_t SplashImage[48000];
-extern const uint16_t ConfigImage[307200];
-extern const uint16_t DisplayMenu[22500];
 
 //Flash Sector Size
 extern const uint16_t SECTOR_SIZE;
@@ -147,6 +145,9 @@ extern uint8_t screen;
 extern uint8_t BuildPList;
 extern uint8_t requestDirective;
 extern uint8_t PeripheralList[7];
+extern uint8_t default_Display_Brightness;
+extern volatile bool SaveBrightness;
+extern volatile bool SaveSequence[];
 extern uint8_t current_board_address;
 extern bool ADC_Running;
 extern char ADCtitleStr[4];
@@ -185,7 +186,9 @@ void TMR3_init(void);
 void TMR4_init(void);
 void TMR5_init(void);
 void TMR6_init(void);
+void TMR7_init(void);
 void USB_init(void);
+int EP2_TX(volatile uint8_t *tx_buffer);
 void PMP_init(void);
 void Display_init(void);
 void LED_Port(int8_t led_port_data);
@@ -220,8 +223,12 @@ void Display_PLTAR(unsigned SR_HI, unsigned SR_LO, unsigned ER_HI, unsigned ER_L
 void Display_GETDEVICEID(void);
 void Display_Rect(unsigned col_start, unsigned col_end, unsigned row_start, unsigned row_end, unsigned rect_color);
 void Display_CLRSCN(int CanvasColor);
+void Display_Window(unsigned col_start, unsigned col_end, unsigned row_start, unsigned row_end);
+void Display_Pixels(const uint16_t *pixels, uint16_t count);
 void Display_DISPON(void);
 void SetDisplayBrightness(void);
+void LoadSequences(void);
+void SaveSettings(void);
 void Display_Rect(unsigned col_start, unsigned col_end, unsigned row_start, unsigned row_end, unsigned rect_color);
 void WriteString(unsigned col_start, unsigned row_start, char array_name[], int TextColor, int CanvasColor);
 void WriteChar(unsigned col_start, unsigned row_start, unsigned ascii_char, int TextColor, int CanvasColor);
@@ -231,15 +238,16 @@ void WriteButtonString(unsigned col_start, unsigned row_start, char array_name[]
 void Binary2ASCIIBCD(int bcd);
 void DrawHeader();
 void DrawScreen(uint8_t scrn, char title[]);
+void DrawTicks(uint32_t ticks);
+void DrawLatency(void);
 void ShowDrawScreen(void);
 void Display_RDDST(void);
 void Display_RDNUMED(void);
 void MessageBox(char text[], uint8_t show_time);
-void BuildPeripheralList(void);
-void Directive(uint8_t badd);
 void SetPeripheralAddress(uint8_t padd);
 void SetPotentiometer(void);
 void BoardData2SRAM(void);
+void BoardData2Directive(bool refresh);
 void dumpMem(void);
 void SRAM2USB(void);
 void USB2SRAM(void);
@@ -247,16 +255,119 @@ void DMM(uint8_t data, uint16_t xchar, uint16_t ychar);
 void Float2ASCIIBCD(float number, char* output);
 
 //SRAM
+//Semaphore flag of an address, one per 1K region
+#define SRAM_FLAG(address)      (((address) >> 10) & 7)
+
+typedef struct
+{
+    uint32_t locks;
+    uint32_t contended;
+    uint32_t timeouts;
+    uint32_t wait_max;
+} SRAM_LOCK_STATS;
+
+extern SRAM_LOCK_STATS SRAMLockStats[8];
+
+typedef struct
+{
+    uint32_t collisions;
+    uint32_t retries;
+    uint32_t failures;
+    uint32_t bursts;
+} SRAM_COLLISION_STATS;
+
+extern SRAM_COLLISION_STATS SRAMCollisionStats[8];
+extern volatile bool SRAM_BUSY;
+
+#define SRAM_TEST_QUICK         0
+#define SRAM_TEST_THOROUGH      1
+
+typedef struct
+{
+    uint8_t mode;
+    uint8_t expected;
+    uint8_t actual;
+    uint32_t failures;
+    uint32_t address;
+    uint32_t ticks;
+    uint32_t runs;
+} SRAM_TEST_RESULT;
+
+extern SRAM_TEST_RESULT SRAMTest;
+
+//SRAM shadow, counted per region
+typedef struct
+{
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t bursts;
+    uint32_t bytes;
+} SRAM_SHADOW_STATS;
+
+extern SRAM_SHADOW_STATS SRAMShadowStats[8];
+
+//PMP state an interrupt takes and gives back, see REN70V05.c
+typedef struct
+{
+    uint32_t pmwaddr;
+    uint32_t pmraddr;
+    uint32_t pending;
+    uint8_t incm;
+    uint8_t sem;
+    uint8_t cs_sram;
+    uint8_t cs_display;
+    uint8_t cs_flash;
+    uint8_t a16;
+    uint8_t a17;
+    uint8_t a18;
+} REN70V05_PMP_STATE;
+
 void REN70V05_Init(void);
 void REN70V05_WR(uint32_t address_70V05, uint8_t mdata_70V05);
 int8_t REN70V05_RD(uint32_t address_70V05);
 bool memtest_70V05(uint8_t test_data);
+bool SRAM_Test(uint8_t mode);
+void SRAM_Test_Request(void);
+void SRAM_Test_Service(void);
+uint8_t SRAM_Shadow_RD(uint32_t address);
+void SRAM_Shadow_WR(uint32_t address, uint8_t data);
+void SRAM_Shadow_Read(uint32_t address, uint8_t *data, uint16_t length);
+void SRAM_Shadow_Write(uint32_t address, const uint8_t *data, uint16_t length);
+void SRAM_Shadow_FlushRange(uint32_t address, uint16_t length);
+bool SRAM_Shadow_TryFlushRange(uint32_t address, uint16_t length);
+void SRAM_Shadow_InvalidateRange(uint32_t address, uint16_t length);
+bool SRAM_Shadow_TryInvalidateRange(uint32_t address, uint16_t length);
+void SRAM_Shadow_Flush(uint8_t board);
+void SRAM_Shadow_Invalidate(uint8_t board);
+void SRAM_Shadow_FlushAll(void);
 void ShowSRAM_FailScreen(void);
 void Binary2ASCIIHex(int i_hex);
+uint32_t CRC32(uint32_t crc, const uint8_t *data, uint32_t length);
 void SRAM_Semaphore_Test(void);
-bool REN70V05_SEM(void);
-void REN70V05_LOCK(void);
-void REN70V05_RELEASE(void);
+bool REN70V05_SEM(uint8_t flag);
+bool REN70V05_LOCK(uint8_t flag, uint32_t timeout_us);
+void REN70V05_RELEASE(uint8_t flag);
+void REN70V05_ReadBlock(uint32_t address, uint8_t *data, uint16_t length);
+void REN70V05_WriteBlock(uint32_t address, const uint8_t *data, uint16_t length);
+void REN70V05_ReadWords(uint32_t address, uint8_t *data, uint16_t length);
+void REN70V05_WriteWords(uint32_t address, const uint8_t *data, uint16_t length);
+void REN70V05_PMP_Take(REN70V05_PMP_STATE *state);
+void REN70V05_PMP_Give(const REN70V05_PMP_STATE *state);
+void SRAM_DMA_Init(void);
+void SRAM_DMA_Write(uint32_t address, const volatile uint8_t *source, uint16_t length, void (*done)(void));
+void SRAM_DMA_Read(uint32_t address, volatile uint8_t *destination, uint16_t length, void (*done)(void));
+bool SRAM_DMA_Busy(void);
+void SRAM_DMA_Wait(void);
+
+//Board Mailbox
+void Mailbox_Init(void);
+bool Mailbox_Ready(uint8_t board);
+uint8_t Mailbox_Pending(uint8_t board);
+bool Mailbox_Post(uint8_t board, uint8_t command, uint8_t tag, const uint8_t *data, uint8_t length);
+bool Mailbox_Receive(uint8_t board, MAILBOX_FRAME *frame);
+void Mailbox_Take(uint8_t board);
+void Mailbox_Request(void);
+void Mailbox_Service(void);
 
 //Flash
 void Flash_Init(void);
@@ -264,16 +375,354 @@ void Flash_RD(unsigned address_flash);
 void Flash_WR(unsigned address_flash, uint8_t data_flash);
 void Flash_Sector_Erase(int erase_sector);
 void Flash_Chip_Erase(void);
+uint16_t Flash_Blank_Length(unsigned address_flash, uint16_t length);
+void Flash_Read(unsigned address_flash, uint8_t *data, uint16_t length);
+void Flash_Get_Bytes_Used(void);
+extern unsigned long Bytes_used;
+
+//Flash block cache and streaming reader, see Flash_Cache.c
+#define FLASH_READER_CHUNK      128
+
+typedef struct
+{
+    uint32_t address;
+    uint32_t end;
+    uint16_t have;
+    uint16_t next;
+    uint8_t buffer[FLASH_READER_CHUNK];
+} FLASH_READER;
+
+typedef struct
+{
+    uint32_t reads;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t invalidated;
+} FLASH_CACHE_STATS;
+
+extern FLASH_CACHE_STATS FlashCacheStats;
+
+void Flash_Cache_Read(uint32_t address, uint8_t *data, uint16_t length);
+uint8_t Flash_Cache_RD(uint32_t address);
+void Flash_Cache_Invalidate(uint32_t address, uint32_t length);
+void Flash_Reader_Open(FLASH_READER *reader, uint32_t address, uint32_t length);
+bool Flash_Reader_Byte(FLASH_READER *reader, uint8_t *data);
+uint32_t Flash_Reader_Read(FLASH_READER *reader, uint8_t *data, uint32_t length);
+
+//Flash operations that return while the chip works, see Flash_Jobs.c
+#define FLASH_BUSY              0
+#define FLASH_DONE              1
+#define FLASH_FAILED            2
+
+void Flash_Program_Start(unsigned address_flash, uint8_t data_flash);
+void Flash_Erase_Start(int erase_sector);
+void Flash_Chip_Erase_Start(void);
+uint8_t Flash_Status(unsigned address_flash, uint8_t expect);
+bool Flash_Erase_Suspend(unsigned address_flash);
+void Flash_Erase_Resume(unsigned address_flash);
+
+//Flash jobs
+#define FLASH_JOB_PROGRAM       0
+#define FLASH_JOB_SECTOR_ERASE  1
+#define FLASH_JOB_CHIP_ERASE    2
+
+#define FLASH_JOB_QUEUED        0
+#define FLASH_JOB_RUNNING       1
+#define FLASH_JOB_DONE          2
+#define FLASH_JOB_FAILED        3
+
+typedef struct FLASH_JOB FLASH_JOB;
+
+//Owned by the caller until done is called, so is data
+struct FLASH_JOB
+{
+    uint8_t type;
+    volatile uint8_t state;
+    uint32_t address;
+    const uint8_t *data;
+    uint16_t length;
+    volatile uint16_t done_bytes;
+    void (*done)(FLASH_JOB *job);
+    void *context;
+    uint32_t start;
+    FLASH_JOB *next;
+};
+
+typedef struct
+{
+    uint32_t jobs;
+    uint32_t failures;
+    uint32_t bytes;
+    uint32_t sectors;
+    uint32_t program_ticks;
+    uint32_t erase_ticks;
+    uint32_t tick_ticks;
+    uint32_t waits;
+} FLASH_JOB_STATS;
+
+extern FLASH_JOB_STATS FlashJobStats;
+
+//Reads that came during an operation, one per job type
+typedef struct
+{
+    uint32_t reads;
+    uint32_t suspends;
+    uint32_t stall;
+    uint32_t stall_max;
+} FLASH_STALL_STATS;
+
+extern FLASH_STALL_STATS FlashStallStats[3];
+
+bool Flash_Jobs_Submit(FLASH_JOB *job);
+bool Flash_Jobs_Program(FLASH_JOB *job, uint32_t address, const uint8_t *data, uint16_t length, void (*done)(FLASH_JOB *job), void *context);
+bool Flash_Jobs_Erase(FLASH_JOB *job, uint16_t sector, void (*done)(FLASH_JOB *job), void *context);
+bool Flash_Jobs_Chip_Erase(FLASH_JOB *job, void (*done)(FLASH_JOB *job), void *context);
+bool Flash_Jobs_Wait(FLASH_JOB *job);
+bool Flash_Jobs_Idle(void);
+void Flash_Jobs_Hold(uint32_t address, uint16_t length);
+void Flash_Jobs_Release(void);
+void Flash_Jobs_Tick(void);
+void Flash_Jobs_Service(void);
+
+//Flash Map
+void Flash_Map_Init(void);
+uint16_t Flash_Map_Scan(uint8_t *map);
+void Flash_Map_Rebuild(void);
+uint16_t Flash_Map_Sectors(void);
+bool Flash_Map_Sector_Used(uint16_t sector);
+uint16_t Flash_Map_Used(void);
+void Flash_Map_Programmed(uint32_t address, uint8_t data);
+void Flash_Map_Erased(int sector);
+void Flash_Map_Cleared(void);
+void Flash_Map_Report(void);
+void Flash_Map_Service(void);
+
+//Flash settings store, keys
+#define FLASH_KV_BRIGHTNESS     0x01
+#define FLASH_KV_CALIBRATION    0x02
+#define FLASH_KV_PERIPHERALS    0x03
+#define FLASH_KV_SEQUENCE       0x10    //+ sequence number
+#define FLASH_KV_SEQUENCES      8
+#define FLASH_KV_MAX            64
+
+void Flash_KV_Init(void);
+int16_t Flash_KV_Get(uint8_t key, uint8_t *data, uint8_t max);
+bool Flash_KV_Set(uint8_t key, const uint8_t *data, uint8_t length);
+void Flash_KV_Delete(uint8_t key);
+void Flash_KV_Service(void);
+
+//Assets in the flash, see Assets.c
+#define ASSET_NAME              16
+#define ASSET_MAX               16
+#define ASSET_CHUNK             128
+
+#define ASSET_RAW               0
+#define ASSET_RLE               1
+
+typedef struct
+{
+    char name[ASSET_NAME];
+    uint16_t width;
+    uint16_t height;
+    uint32_t offset;
+    uint32_t length;
+    uint8_t format;
+} ASSET;
+
+typedef struct
+{
+    const ASSET *asset;
+    FLASH_READER flash;
+    uint16_t run;
+    uint16_t literal;
+    uint16_t pixel;
+} ASSET_READER;
+
+void Asset_Init(void);
+const ASSET *Asset_Find(const char *name);
+void Asset_Open(ASSET_READER *reader, const ASSET *asset);
+uint32_t Asset_Read(ASSET_READER *reader, uint16_t *pixels, uint32_t count);
+uint32_t Asset_Stream(const ASSET *asset, uint32_t skip, uint32_t count);
+bool Asset_Blit(const char *name, unsigned col, unsigned row);
+void Asset_Begin_Report(void);
+void Asset_Write_Report(void);
+void Asset_Status_Report(void);
+void Asset_Service(void);
+
+//Flash programming over USB, see Flash_Program.c
+void Flash_Program_Begin_Report(void);
+void Flash_Program_Data_Report(void);
+void Flash_Program_Status_Report(void);
+void Flash_Program_Service(void);
 
 //ADC
 void ADC_init(void);
 
+//Scope
+extern volatile uint8_t ScopeChannelMask;
+extern volatile uint32_t ScopeSamplesLost;
+extern volatile uint32_t ScopeSampleRate;
+void Scope_Start(uint8_t channel_mask);
+void Scope_Stop(void);
+void Scope_Capture(uint16_t ch0, uint16_t ch1);
+void Scope_Tick(void);
+void Scope_Service(void);
+
+//USB Benchmark
+extern volatile uint32_t BenchISRStart;
+extern volatile uint32_t BenchSourceRemaining;
+void Bench_ISR_Enter(void);
+void Bench_ISR_Exit(void);
+void Bench_Loopback(void);
+void Bench_Source_Start(void);
+void Bench_Source_Next(void);
+void Bench_Sink_Start(void);
+bool Bench_Sink(void);
+void Bench_Report(void);
+void Bench_SRAM(void);
+
 //Time
 void GetTime(void);
 
 //I/O Board
 void IO_Board_init(void);
 
+//Board Events
+#define BOARD_EVENT_DONE        0
+#define BOARD_EVENT_ADDED       0x1c    //posted by the MainBrain, see Peripherals.c
+#define BOARD_EVENT_REMOVED     0x1d
+#define BOARD_EVENT_ACK         0x1e    //posted by the MainBrain, see Directives.c
+#define BOARD_EVENT_TIMEOUT     0x1f
+
+typedef struct
+{
+    uint8_t board;
+    uint8_t code;
+    uint32_t time;
+} BOARD_EVENT;
+
+extern volatile uint32_t BoardEventsLost;
+void Board_Event_Post(uint8_t value);
+bool Board_Event_Get(BOARD_EVENT *event);
+
+//Directives to the boards, see Directives.c
+#define DIRECTIVE_PRIORITY_LOW      0
+#define DIRECTIVE_PRIORITY_NORMAL   1
+#define DIRECTIVE_PRIORITY_HIGH     3
+
+typedef struct
+{
+    uint32_t directives;
+    uint32_t acks;
+    uint32_t timeouts;
+    uint32_t ack_ticks;
+    uint32_t ack_max;
+    uint32_t prefills;
+    uint32_t waits;
+} DIRECTIVE_STATS;
+
+extern DIRECTIVE_STATS DirectiveStats;
+
+void Directive_Init(void);
+void Directive_Submit(uint8_t board, const uint8_t *data, uint8_t length, bool refresh);
+void Directive_Queue(uint8_t board, bool refresh);
+void Directive_Probe(uint8_t board);
+void Directive_Urgent(uint8_t board);
+void Directive_Priority(uint8_t board, uint8_t priority);
+bool Directive_Pending(uint8_t board);
+void Directive_Wait(uint8_t board);
+bool Directive_Idle(void);
+void Directive_Tick(void);
+void Directive_Service(void);
+void Directive_Stats_Report(void);
+
+//Which boards are there, see Peripherals.c
+typedef struct
+{
+    uint8_t present;
+    uint8_t misses;         //time outs in a row
+    uint16_t changes;       //added or removed
+    uint32_t ack_ticks;     //select to /ACK of the last answer
+} PERIPHERAL;
+
+//Select to /ACK in Core Timer ticks, bucket n counts the ACKs of
+//2^n to 2^(n+1) - 1 ticks, the last one the rest
+#define PERIPHERAL_BUCKETS  16
+
+typedef struct
+{
+    uint32_t acks;
+    uint32_t timeouts;
+    uint32_t min_ticks;
+    uint32_t max_ticks;
+    uint64_t sum_ticks;
+    uint32_t buckets[PERIPHERAL_BUCKETS];
+} PERIPHERAL_LATENCY;
+
+extern PERIPHERAL Peripherals[7];
+extern PERIPHERAL_LATENCY PeripheralLatency[7];
+extern uint32_t PeripheralEnumerateTicks;
+
+void Peripheral_Enumerate(void);
+void Peripheral_Answer(uint8_t board, bool ack, uint32_t ticks, bool probe);
+void Peripheral_Service(void);
+void Peripheral_Report(void);
+void Peripheral_Latency_Report(void);
+
+//Service requests from the boards on RA7, see Service.c
+typedef struct
+{
+    uint8_t board;
+    uint8_t code;           //priority in bits 0-1, reason in bits 2-7
+    uint32_t time;          //Core Timer count of the scan
+} SERVICE_EVENT;
+
+typedef struct
+{
+    uint32_t requests;
+    uint32_t scans;
+    uint32_t lost;
+    uint32_t scan_max;
+} SERVICE_STATS;
+
+extern SERVICE_STATS ServiceStats;
+
+void Service_Init(void);
+bool Service_Get(SERVICE_EVENT *event);
+void Service_Dispatch(void);
+void Service_Report(void);
+
+//Motion sequences run on Timer 8, see Motion.c
+#define MOTION_SEQUENCES    FLASH_KV_SEQUENCES
+
+#define MOTION_STOPPED      0
+#define MOTION_RUNNING      1
+
+#define MOTION_TRAPEZOID    0
+#define MOTION_SCURVE       1
+
+typedef struct
+{
+    uint32_t ticks;
+    uint32_t records;
+    uint32_t underruns;     //a record ended before the next was compiled
+    uint32_t late_max;      //Core Timer ticks from the period to the tick
+    uint64_t late_sum;
+    uint32_t interval_min;  //Core Timer ticks between ticks
+    uint32_t interval_max;
+    uint32_t write_max;     //the tick, from the interrupt to the setpoint written
+    uint32_t busy;          //the board held its region past MOTION_LOCK_US
+} MOTION_STATS;
+
+extern MOTION_STATS MotionStats;
+
+void Motion_Init(void);
+void Motion_Run(uint8_t sequence, uint8_t profile);
+void Motion_Stop(void);
+bool Motion_Running(void);
+void Motion_Service(void);
+void Motion_Report(void);
+
 //Buzzer
 void Beep(void);
 
@@ -0,0 +1,675 @@
+/*********************************************************************
+    FileName:     	Motion.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 MHz
+
+
+    File Description:
+        Motion sequences run by the MainBrain
+
+        The sequence records (opcode 0x0a, 16 bytes at 0x300
+        + (number - 1) * 16) are run here instead of by the host
+        sending 0x06 and 0x09. Each record is compiled into a plan
+        in the main loop, the ramps as tables of setpoints, and
+        Timer 8 writes one setpoint every 1 ms to the motion board
+        (board 1): the speed to 0x3f8, the direction to 0x3ff when a
+        record starts.
+
+        Record (see Host_CMDs, 0x0a):
+            Byte 0      number (1 - MOTION_SEQUENCES)
+            Byte 1      deceleration, speed per 10 ms
+            Byte 2-5    run distance
+            Byte 6      acceleration, speed per 10 ms
+            Byte 7      direction, the command byte
+            Byte 8      speed (0x3f8)
+            Byte 9-12   stop distance
+            Byte 13     delay after the record, 10 ms
+            Byte 14     records in the program, from this one
+            Byte 15     times the program runs, 0 is once
+
+        A distance is speed x ms, the sum of the setpoints. The run
+        distance is from the start to the deceleration, the
+        acceleration included. A stop distance other than 0 sets
+        how long the deceleration takes instead of its rate. Speed
+        0 or an acceleration of 0 goes to the speed at once.
+
+        The ramps are MOTION_RAMP setpoints, 8.8 fixed point, from
+        the shape of the profile: a trapezoid (straight ramps) or an
+        S-curve (3x^2 - 2x^3, no step in the acceleration). The
+        tick steps through them with a 16.16 index, so a ramp of any
+        length takes the same time per tick. A ramp covers half the
+        speed times its length with either shape.
+
+        The main loop compiles the next record while the tick runs
+        the last one. When a record ends before the next is ready
+        the tick writes 0 and counts an underrun.
+
+        The timing of every tick is kept: how late it came after
+        the Timer 8 period (the count Timer 8 has on entry), the
+        time between ticks (the jitter is the longest less the
+        shortest) and how long the setpoint write took.
+
+        0x7e Motion
+            Request:  Byte 1     0 read, 1 run, 2 stop, 3 clear the
+                                 timing counters first
+                      Byte 2     first record (1 run)
+                      Byte 3     0 trapezoid, 1 S-curve (1 run)
+            Reply:    Byte 0     0x7e
+                      Byte 1     0 stopped, 1 running
+                      Byte 2     record running
+                      Byte 3     last run request: 0 started, 1 no
+                                 such record, 2 no motion board
+                      Byte 4-5   setpoint, 8.8 fixed point
+                      Byte 6-9   distance so far
+                      Byte 10-13 ticks
+                      Byte 14-17 records done
+                      Byte 18-21 underruns
+                      Byte 22-25 latest tick, Core Timer ticks from
+                                 the period to the interrupt
+                      Byte 26-29 mean lateness
+                      Byte 30-33 shortest time between ticks
+                      Byte 34-37 longest time between ticks
+                      Byte 38-41 longest setpoint write
+                      Byte 42-45 writes the board held its region
+            All values are little endian.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include <stddef.h>
+#include "MainBrain.h"
+
+//The motion board and the bytes it reads in its region
+#define MOTION_BOARD            1
+#define MOTION_TABLE            0x300
+#define MOTION_RECORD           16
+#define MOTION_SPEED            0x3f8
+#define MOTION_COMMAND          0x3ff
+
+//Timer 8 at 1:4 of PBCLK3 (200 MHz), 1 ms
+#define MOTION_TCKPS            2
+#define MOTION_PERIOD           49999
+#define MOTION_TIMER_TICKS      2       //Core Timer ticks per count
+
+//Record times are in 10 ms
+#define MOTION_TICKS_10MS       10
+
+//Setpoints in a ramp
+#define MOTION_RAMP             128
+
+//A write does not wait longer for the board holding its region
+#define MOTION_LOCK_US          5
+
+#define MOTION_ACCEL            0
+#define MOTION_RUN              1
+#define MOTION_DECEL            2
+#define MOTION_DWELL            3
+#define MOTION_WAIT             4       //for the next plan
+
+#define MOTION_STARTED          0
+#define MOTION_NO_RECORD        1
+#define MOTION_NO_BOARD         2
+
+typedef struct
+{
+    uint16_t up[MOTION_RAMP];           //8.8 setpoints
+    uint16_t down[MOTION_RAMP];
+    uint32_t up_step;                   //16.16 entries per tick
+    uint32_t down_step;
+    uint32_t ticks[MOTION_WAIT];        //of each phase
+    uint8_t top;
+    uint8_t direction;
+    uint8_t sequence;
+} MOTION_PLAN;
+
+MOTION_STATS MotionStats;
+
+//The tick runs motion_plan[motion_current], the main loop
+//compiles the other one while motion_next_ready is false
+static MOTION_PLAN motion_plan[2];
+static volatile uint8_t motion_current = 0;
+static volatile bool motion_next_ready = false;
+static volatile bool motion_last = false;
+static volatile uint8_t motion_state = MOTION_STOPPED;
+
+//Where the tick is in the plan
+static uint8_t motion_phase = MOTION_WAIT;
+static uint32_t motion_phase_tick;
+static uint32_t motion_index;
+static uint16_t motion_setpoint = 0;
+static uint64_t motion_distance = 0;
+static uint32_t motion_then;
+static bool motion_ticked = false;
+
+//The program, main loop only
+static uint8_t motion_first;
+static uint8_t motion_count;
+static uint8_t motion_step;
+static uint8_t motion_loops;
+static uint8_t motion_profile;
+
+//Run request from the USB interrupt, 0 for none
+static volatile uint8_t motion_request = 0;
+static volatile uint8_t motion_request_profile;
+static uint8_t motion_result = MOTION_STARTED;
+
+void Motion_Init(void)
+{
+    T8CON = 0;
+    T8CONbits.TCKPS = MOTION_TCKPS;
+    TMR8 = 0;
+    PR8 = MOTION_PERIOD;
+    IPC9bits.T8IP = 6;
+    IPC9bits.T8IS = 1;
+    IFS1bits.T8IF = 0;
+    IEC1bits.T8IE = 1;
+}
+
+static uint32_t Motion_Get32(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+//The profile at x (0 - 1), both 16.16
+static uint32_t Motion_Shape(uint32_t x, uint8_t profile)
+{
+    uint64_t x2;
+    uint64_t x3;
+
+    if(profile == MOTION_TRAPEZOID)
+    {
+        return x;
+    }
+
+    //3x^2 - 2x^3
+    x2 = ((uint64_t)x * x) >> 16;
+    x3 = (x2 * x) >> 16;
+
+    return (uint32_t)((3 * x2) - (2 * x3));
+}
+
+//The setpoints from 0 to top, or down from top to 0, returns the
+//step through them for a ramp of ticks
+static uint32_t Motion_Ramp(uint16_t *table, uint8_t top, uint32_t ticks, uint8_t profile, bool down)
+{
+    uint32_t level;
+
+    for(int i=0;i<MOTION_RAMP;i++)
+    {
+        level = ((uint32_t)top * Motion_Shape(((i + 1) << 16) / MOTION_RAMP, profile)) >> 8;
+        table[i] = down ? ((top << 8) - level) : level;
+    }
+
+    if(ticks == 0)
+    {
+        return 0;
+    }
+
+    //Rounded up, the last tick is on the last setpoint
+    return ((MOTION_RAMP << 16) + ticks - 1) / ticks;
+}
+
+//false when there is no such record
+static bool Motion_Compile(MOTION_PLAN *plan, uint8_t sequence, uint8_t profile)
+{
+    uint8_t record[MOTION_RECORD];
+    uint32_t run;
+    uint32_t stop;
+    uint32_t area;
+
+    SRAM_Shadow_Read(MOTION_TABLE + ((sequence - 1) * MOTION_RECORD), record, MOTION_RECORD);
+    if(record[0] != sequence)
+    {
+        return false;
+    }
+
+    plan->sequence = sequence;
+    plan->direction = record[7];
+    plan->top = record[8];
+    run = Motion_Get32(&record[2]);
+    stop = Motion_Get32(&record[9]);
+
+    plan->ticks[MOTION_ACCEL] = (record[6] == 0) ? 0 : ((plan->top * MOTION_TICKS_10MS) / record[6]);
+
+    if((stop != 0) && (plan->top != 0))
+    {
+        plan->ticks[MOTION_DECEL] = ((uint64_t)stop * 2) / plan->top;
+    }
+    else
+    {
+        plan->ticks[MOTION_DECEL] = (record[1] == 0) ? 0 : ((plan->top * MOTION_TICKS_10MS) / record[1]);
+    }
+
+    //What is left of the run distance after the acceleration
+    area = (plan->top * plan->ticks[MOTION_ACCEL]) / 2;
+    plan->ticks[MOTION_RUN] = ((plan->top == 0) || (run <= area)) ? 0 : ((run - area) / plan->top);
+
+    plan->ticks[MOTION_DWELL] = record[13] * MOTION_TICKS_10MS;
+
+    plan->up_step = Motion_Ramp(plan->up, plan->top, plan->ticks[MOTION_ACCEL], profile, false);
+    plan->down_step = Motion_Ramp(plan->down, plan->top, plan->ticks[MOTION_DECEL], profile, true);
+
+    return true;
+}
+
+//The next record of the program to the free plan, false at the end
+static bool Motion_Plan_Next(void)
+{
+    if(motion_step >= motion_count)
+    {
+        if(motion_loops <= 1)
+        {
+            return false;
+        }
+
+        motion_loops--;
+        motion_step = 0;
+    }
+
+    //A record missing from the middle ends the program
+    if(!Motion_Compile(&motion_plan[motion_current ^ 1], motion_first + motion_step, motion_profile))
+    {
+        return false;
+    }
+
+    motion_step++;
+
+    return true;
+}
+
+//Stops at once, speed 0 goes out with the next flush
+void Motion_Stop(void)
+{
+    uint32_t status = __builtin_disable_interrupts();
+
+    T8CONbits.ON = 0;
+    IFS1bits.T8IF = 0;
+
+    if(motion_state == MOTION_RUNNING)
+    {
+        motion_state = MOTION_STOPPED;
+        SRAM_Shadow_WR(MOTION_SPEED, 0);
+    }
+
+    motion_next_ready = false;
+    motion_setpoint = 0;
+
+    __builtin_mtc0(12, 0, status);
+}
+
+static void Motion_Begin(uint8_t sequence, uint8_t profile)
+{
+    uint8_t record[MOTION_RECORD];
+
+    Motion_Stop();
+
+    if(sequence > MOTION_SEQUENCES)
+    {
+        motion_result = MOTION_NO_RECORD;
+        return;
+    }
+
+    SRAM_Shadow_Read(MOTION_TABLE + ((sequence - 1) * MOTION_RECORD), record, MOTION_RECORD);
+    if(record[0] != sequence)
+    {
+        motion_result = MOTION_NO_RECORD;
+        return;
+    }
+
+    if(!Peripherals[MOTION_BOARD - 1].present)
+    {
+        motion_result = MOTION_NO_BOARD;
+        return;
+    }
+
+    motion_first = sequence;
+    motion_count = (record[14] == 0) ? 1 : record[14];
+    if((motion_first + motion_count - 1) > MOTION_SEQUENCES)
+    {
+        motion_count = MOTION_SEQUENCES - motion_first + 1;
+    }
+    motion_loops = (record[15] == 0) ? 1 : record[15];
+    motion_step = 0;
+    motion_profile = (profile == MOTION_SCURVE) ? MOTION_SCURVE : MOTION_TRAPEZOID;
+
+    //The first plan is the next one, the first tick starts it
+    motion_current = 0;
+    Motion_Plan_Next();
+    motion_next_ready = true;
+    motion_last = false;
+    motion_phase = MOTION_WAIT;
+    motion_distance = 0;
+    motion_ticked = false;
+
+    motion_result = MOTION_STARTED;
+    motion_state = MOTION_RUNNING;
+
+    TMR8 = 0;
+    IFS1bits.T8IF = 0;
+    T8CONbits.ON = 1;
+}
+
+//From the USB interrupt, the main loop compiles and starts it
+void Motion_Run(uint8_t sequence, uint8_t profile)
+{
+    if(sequence == 0)
+    {
+        return;
+    }
+
+    motion_request_profile = profile;
+    motion_request = sequence;
+}
+
+//Main loop, the next plan while the tick runs this one
+void Motion_Service(void)
+{
+    uint8_t sequence = motion_request;
+
+    if(sequence != 0)
+    {
+        motion_request = 0;
+        Motion_Begin(sequence, motion_request_profile);
+    }
+
+    if((motion_state == MOTION_RUNNING) && !motion_next_ready && !motion_last)
+    {
+        if(Motion_Plan_Next())
+        {
+            motion_next_ready = true;
+        }
+        else
+        {
+            motion_last = true;
+        }
+    }
+}
+
+bool Motion_Running(void)
+{
+    return motion_state == MOTION_RUNNING;
+}
+
+//Goes past the phases with no ticks
+static void Motion_Enter(const MOTION_PLAN *plan, uint8_t phase)
+{
+    while((phase < MOTION_WAIT) && (plan->ticks[phase] == 0))
+    {
+        phase++;
+    }
+
+    motion_phase = phase;
+    motion_phase_tick = 0;
+
+    if(phase == MOTION_ACCEL)
+    {
+        motion_index = plan->up_step - 1;
+    }
+    if(phase == MOTION_DECEL)
+    {
+        motion_index = plan->down_step - 1;
+    }
+    if(phase == MOTION_WAIT)
+    {
+        MotionStats.records++;
+    }
+}
+
+//This tick's setpoint, moves on through the plan
+static uint16_t Motion_Setpoint(const MOTION_PLAN *plan)
+{
+    uint32_t entry;
+    uint16_t setpoint = 0;
+
+    switch(motion_phase)
+    {
+        case MOTION_ACCEL:
+        case MOTION_DECEL:
+            entry = motion_index >> 16;
+            if(entry >= MOTION_RAMP)
+            {
+                entry = MOTION_RAMP - 1;
+            }
+
+            if(motion_phase == MOTION_ACCEL)
+            {
+                setpoint = plan->up[entry];
+                motion_index = motion_index + plan->up_step;
+            }
+            else
+            {
+                setpoint = plan->down[entry];
+                motion_index = motion_index + plan->down_step;
+            }
+            break;
+
+        case MOTION_RUN:
+            setpoint = plan->top << 8;
+            break;
+    }
+
+    if(motion_phase < MOTION_WAIT)
+    {
+        motion_phase_tick++;
+        if(motion_phase_tick >= plan->ticks[motion_phase])
+        {
+            Motion_Enter(plan, motion_phase + 1);
+        }
+    }
+
+    return setpoint;
+}
+
+//The PMP taken
+static void Motion_Write(uint16_t setpoint, const uint8_t *direction)
+{
+    uint8_t speed = (setpoint + 0x80) >> 8;
+    bool locked;
+
+    SRAM_Shadow_InvalidateRange(MOTION_SPEED, MOTION_COMMAND - MOTION_SPEED + 1);
+
+    locked = REN70V05_LOCK(SRAM_FLAG(MOTION_SPEED), MOTION_LOCK_US);
+    if(!locked)
+    {
+        MotionStats.busy++;
+    }
+
+    REN70V05_WriteBlock(MOTION_SPEED, &speed, 1);
+    if(direction != NULL)
+    {
+        REN70V05_WriteBlock(MOTION_COMMAND, direction, 1);
+    }
+
+    if(locked)
+    {
+        REN70V05_RELEASE(SRAM_FLAG(MOTION_SPEED));
+    }
+}
+
+//Interrupts off, the PMP taken. now is the Core Timer at the
+//interrupt, late how long after the period that was.
+static void Motion_Tick(uint32_t now, uint32_t late)
+{
+    MOTION_PLAN *plan;
+    uint32_t interval;
+    uint32_t ticks;
+    bool start = false;
+
+    if(motion_state != MOTION_RUNNING)
+    {
+        return;
+    }
+
+    MotionStats.ticks++;
+    MotionStats.late_sum += late;
+    if(late > MotionStats.late_max)
+    {
+        MotionStats.late_max = late;
+    }
+
+    if(motion_ticked)
+    {
+        interval = now - motion_then;
+        if((MotionStats.interval_min == 0) || (interval < MotionStats.interval_min))
+        {
+            MotionStats.interval_min = interval;
+        }
+        if(interval > MotionStats.interval_max)
+        {
+            MotionStats.interval_max = interval;
+        }
+    }
+    motion_ticked = true;
+    motion_then = now;
+
+    if(motion_phase == MOTION_WAIT)
+    {
+        if(motion_next_ready)
+        {
+            motion_current = motion_current ^ 1;
+            motion_next_ready = false;
+            Motion_Enter(&motion_plan[motion_current], MOTION_ACCEL);
+            start = true;
+        }
+        else if(motion_last)
+        {
+            //The program is done
+            T8CONbits.ON = 0;
+            motion_state = MOTION_STOPPED;
+            motion_setpoint = 0;
+            Motion_Write(0, NULL);
+            return;
+        }
+        else
+        {
+            MotionStats.underruns++;
+        }
+    }
+
+    plan = &motion_plan[motion_current];
+
+    motion_setpoint = ((motion_phase == MOTION_WAIT) && !start) ? 0 : Motion_Setpoint(plan);
+    motion_distance = motion_distance + motion_setpoint;
+
+    Motion_Write(motion_setpoint, start ? &plan->direction : NULL);
+
+    ticks = _CP0_GET_COUNT() - now;
+    if(ticks > MotionStats.write_max)
+    {
+        MotionStats.write_max = ticks;
+    }
+}
+
+static void Motion_Put32(volatile uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+void Motion_Report(void)
+{
+    uint32_t status;
+
+    switch(EP[1].rx_buffer[1])
+    {
+        case 1:
+            Motion_Run(EP[1].rx_buffer[2], EP[1].rx_buffer[3]);
+            break;
+
+        case 2:
+            motion_request = 0;
+            Motion_Stop();
+            break;
+    }
+
+    for(int i=0;i<64;i++)
+    {
+        EP[2].tx_buffer[i] = 0;
+    }
+
+    status = __builtin_disable_interrupts();
+
+    if(EP[1].rx_buffer[1] == 3)
+    {
+        MotionStats.ticks = 0;
+        MotionStats.records = 0;
+        MotionStats.underruns = 0;
+        MotionStats.late_max = 0;
+        MotionStats.late_sum = 0;
+        MotionStats.interval_min = 0;
+        MotionStats.interval_max = 0;
+        MotionStats.write_max = 0;
+        MotionStats.busy = 0;
+        motion_ticked = false;
+    }
+
+    EP[2].tx_buffer[0] = 0x7e;
+    EP[2].tx_buffer[1] = motion_state;
+    EP[2].tx_buffer[2] = (motion_state == MOTION_RUNNING) ? motion_plan[motion_current].sequence : 0;
+    EP[2].tx_buffer[3] = motion_result;
+    EP[2].tx_buffer[4] = motion_setpoint;
+    EP[2].tx_buffer[5] = motion_setpoint >> 8;
+    Motion_Put32(&EP[2].tx_buffer[6], motion_distance >> 8);
+    Motion_Put32(&EP[2].tx_buffer[10], MotionStats.ticks);
+    Motion_Put32(&EP[2].tx_buffer[14], MotionStats.records);
+    Motion_Put32(&EP[2].tx_buffer[18], MotionStats.underruns);
+    Motion_Put32(&EP[2].tx_buffer[22], MotionStats.late_max);
+    Motion_Put32(&EP[2].tx_buffer[26], (MotionStats.ticks == 0) ? 0 : (MotionStats.late_sum / MotionStats.ticks));
+    Motion_Put32(&EP[2].tx_buffer[30], MotionStats.interval_min);
+    Motion_Put32(&EP[2].tx_buffer[34], MotionStats.interval_max);
+    Motion_Put32(&EP[2].tx_buffer[38], MotionStats.write_max);
+    Motion_Put32(&EP[2].tx_buffer[42], MotionStats.busy);
+
+    __builtin_mtc0(12, 0, status);
+
+    EP2_TX(EP[2].tx_buffer);
+}
+
+//Timer 8, the setpoint tick
+void __attribute__((vector(_TIMER_8_VECTOR), interrupt(ipl6srs), nomips16)) TMR8_handler()
+{
+    REN70V05_PMP_STATE state;
+    uint32_t status;
+    uint32_t late;
+    uint32_t now;
+
+    //Timer 8 counts on from 0 at the period, first
+    late = TMR8 * MOTION_TIMER_TICKS;
+    now = _CP0_GET_COUNT();
+
+    status = __builtin_disable_interrupts();
+
+    REN70V05_PMP_Take(&state);
+    Motion_Tick(now, late);
+    REN70V05_PMP_Give(&state);
+
+    __builtin_mtc0(12, 0, status);
+
+    //Clear interrupt flag
+    IFS1bits.T8IF = 0;
+}
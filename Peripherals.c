@@ -0,0 +1,341 @@
+/*********************************************************************
+    FileName:     	Peripherals.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 MHz
+
+    File Description:
+        Which I/O boards are there
+
+        A board that is there pulls /ACK when it is selected, the
+        probe is a directive with no command and a 200 us time out
+        (Directive_Probe()), so a missing board costs 200 us and not
+        the 84 ms of a directive.
+
+        At power on Peripheral_Enumerate() probes the 7 addresses,
+        they go through the directive queues one after the other.
+        After that Peripheral_Service() in the main loop probes one
+        board every PERIPHERAL_PERIOD, each board about every 2 s.
+        A board with directives of its own is not probed, the
+        directives answer for it. Every directive that ends tells
+        Peripheral_Answer() (from the tick): an ACK puts the board
+        in the list, PERIPHERAL_MISSES time outs in a row take it
+        out. Each change is posted on the board event queue,
+        BOARD_EVENT_ADDED or BOARD_EVENT_REMOVED, and the screen is
+        drawn again.
+
+        PeripheralList[] (Main.c) holds 1 for a board that is there,
+        Peripherals[] the rest.
+
+        Every ACK also goes in the board's PeripheralLatency[]: the
+        Core Timer ticks (10 ns) from the select to the tick that saw
+        the /ACK, so the interrupt latency is in it. Fastest,
+        slowest, the sum for the mean and a log2 histogram, bucket n
+        holds 2^n to 2^(n+1) - 1 ticks. A time out is counted for a
+        directive, and for a probe only when the board was there. The
+        debug screen (Screens.c) shows the table.
+
+        0x7b Peripherals
+            Request:  Byte 1     1 probes every board again, the
+                                 reply is the table before
+            Reply:    Byte 0     0x7b
+                      Byte 1     boards there, bit 0 is board 1
+                      Byte 2-5   Core Timer ticks the power on
+                                 probes took
+                      Byte 6-    8 bytes per board, boards 1 - 7
+                                 +0      1 there, 0 not
+                                 +1      time outs in a row
+                                 +2-3    times added or removed
+                                 +4-7    Core Timer ticks from
+                                         select to /ACK, last ACK
+
+        0x7c Board Latency
+            Request:  Byte 1     board 1 - 7
+                      Byte 2     1 clears the board's counts after
+                                 the reply
+            Reply:    Byte 0     0x7c
+                      Byte 1     board, 0 for a bad board number
+                      Byte 2-5   ACKs
+                      Byte 6-9   time outs
+                      Byte 10-13 fastest ACK, ticks
+                      Byte 14-17 slowest ACK, ticks
+                      Byte 18-21 mean, ticks
+                      Byte 22-53 16 buckets, 2 bytes each, a count
+                                 over 0xffff is sent as 0xffff
+            All values are little endian.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include "MainBrain.h"
+
+#define PERIPHERAL_BOARDS       7
+
+//Time outs in a row before a board is taken out
+#define PERIPHERAL_MISSES       2
+
+//Core Timer ticks between background probes, 250 ms
+#define PERIPHERAL_PERIOD       25000000
+
+PERIPHERAL Peripherals[PERIPHERAL_BOARDS];
+PERIPHERAL_LATENCY PeripheralLatency[PERIPHERAL_BOARDS];
+uint32_t PeripheralEnumerateTicks = 0;
+
+static volatile bool peripheral_changed = false;
+static uint32_t peripheral_time;
+static uint8_t peripheral_next = 1;
+
+void Peripheral_Enumerate(void)
+{
+    uint32_t start = _CP0_GET_COUNT();
+
+    for(int i=1;i<=PERIPHERAL_BOARDS;i++)
+    {
+        Directive_Probe(i);
+    }
+
+    for(int i=1;i<=PERIPHERAL_BOARDS;i++)
+    {
+        Directive_Wait(i);
+    }
+
+    PeripheralEnumerateTicks = _CP0_GET_COUNT() - start;
+    peripheral_time = _CP0_GET_COUNT();
+}
+
+static void Peripheral_Latency(PERIPHERAL_LATENCY *latency, uint32_t ticks)
+{
+    uint8_t bucket = 0;
+
+    if(ticks > 0)
+    {
+        bucket = 31 - __builtin_clz(ticks);
+        if(bucket >= PERIPHERAL_BUCKETS)
+        {
+            bucket = PERIPHERAL_BUCKETS - 1;
+        }
+    }
+
+    if((latency->acks == 0) || (ticks < latency->min_ticks))
+    {
+        latency->min_ticks = ticks;
+    }
+    if(ticks > latency->max_ticks)
+    {
+        latency->max_ticks = ticks;
+    }
+
+    latency->acks++;
+    latency->sum_ticks += ticks;
+    latency->buckets[bucket]++;
+}
+
+//From the directive tick, interrupts are off
+void Peripheral_Answer(uint8_t board, bool ack, uint32_t ticks, bool probe)
+{
+    PERIPHERAL *peripheral;
+
+    if((board < 1) || (board > PERIPHERAL_BOARDS))
+    {
+        return;
+    }
+
+    peripheral = &Peripherals[board - 1];
+
+    if(ack)
+    {
+        Peripheral_Latency(&PeripheralLatency[board - 1], ticks);
+
+        peripheral->misses = 0;
+        peripheral->ack_ticks = ticks;
+
+        if(peripheral->present == 0)
+        {
+            peripheral->present = 1;
+            peripheral->changes++;
+            PeripheralList[board - 1] = 1;
+            peripheral_changed = true;
+
+            Board_Event_Post((BOARD_EVENT_ADDED << 3) | board);
+        }
+        return;
+    }
+
+    if(!probe || (peripheral->present != 0))
+    {
+        PeripheralLatency[board - 1].timeouts++;
+    }
+
+    if(peripheral->misses < 0xff)
+    {
+        peripheral->misses++;
+    }
+
+    if((peripheral->present != 0) && (peripheral->misses >= PERIPHERAL_MISSES))
+    {
+        peripheral->present = 0;
+        peripheral->changes++;
+        PeripheralList[board - 1] = 0;
+        peripheral_changed = true;
+
+        Board_Event_Post((BOARD_EVENT_REMOVED << 3) | board);
+    }
+}
+
+//Main loop
+void Peripheral_Service(void)
+{
+    if(peripheral_changed)
+    {
+        peripheral_changed = false;
+        NeedsRefresh = true;
+    }
+
+    if((_CP0_GET_COUNT() - peripheral_time) < PERIPHERAL_PERIOD)
+    {
+        return;
+    }
+
+    peripheral_time = _CP0_GET_COUNT();
+
+    if(!Directive_Pending(peripheral_next))
+    {
+        Directive_Probe(peripheral_next);
+    }
+
+    peripheral_next = (peripheral_next % PERIPHERAL_BOARDS) + 1;
+}
+
+static void Peripheral_Put32(volatile uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+void Peripheral_Report(void)
+{
+    volatile uint8_t *entry;
+    uint32_t status;
+    uint8_t present = 0;
+
+    status = __builtin_disable_interrupts();
+
+    EP[2].tx_buffer[0] = 0x7b;
+    Peripheral_Put32(&EP[2].tx_buffer[2], PeripheralEnumerateTicks);
+
+    for(int i=0;i<PERIPHERAL_BOARDS;i++)
+    {
+        entry = &EP[2].tx_buffer[6 + (i * 8)];
+
+        entry[0] = Peripherals[i].present;
+        entry[1] = Peripherals[i].misses;
+        entry[2] = Peripherals[i].changes;
+        entry[3] = Peripherals[i].changes >> 8;
+        Peripheral_Put32(&entry[4], Peripherals[i].ack_ticks);
+
+        if(Peripherals[i].present != 0)
+        {
+            present = present | (1 << i);
+        }
+    }
+
+    EP[2].tx_buffer[1] = present;
+
+    __builtin_mtc0(12, 0, status);
+
+    //The answers come in from the tick, read the table again
+    if(EP[1].rx_buffer[1] == 1)
+    {
+        for(int i=1;i<=PERIPHERAL_BOARDS;i++)
+        {
+            Directive_Probe(i);
+        }
+    }
+
+    EP2_TX(EP[2].tx_buffer);
+}
+
+void Peripheral_Latency_Report(void)
+{
+    PERIPHERAL_LATENCY *latency;
+    uint8_t board = EP[1].rx_buffer[1];
+    uint32_t status;
+    uint32_t count;
+
+    for(int i=0;i<54;i++)
+    {
+        EP[2].tx_buffer[i] = 0;
+    }
+
+    EP[2].tx_buffer[0] = 0x7c;
+
+    if((board >= 1) && (board <= PERIPHERAL_BOARDS))
+    {
+        latency = &PeripheralLatency[board - 1];
+
+        status = __builtin_disable_interrupts();
+
+        EP[2].tx_buffer[1] = board;
+        Peripheral_Put32(&EP[2].tx_buffer[2], latency->acks);
+        Peripheral_Put32(&EP[2].tx_buffer[6], latency->timeouts);
+        Peripheral_Put32(&EP[2].tx_buffer[10], latency->min_ticks);
+        Peripheral_Put32(&EP[2].tx_buffer[14], latency->max_ticks);
+        if(latency->acks > 0)
+        {
+            Peripheral_Put32(&EP[2].tx_buffer[18], latency->sum_ticks / latency->acks);
+        }
+
+        for(int i=0;i<PERIPHERAL_BUCKETS;i++)
+        {
+            count = latency->buckets[i];
+            if(count > 0xffff)
+            {
+                count = 0xffff;
+            }
+
+            EP[2].tx_buffer[22 + (i * 2)] = count;
+            EP[2].tx_buffer[23 + (i * 2)] = count >> 8;
+        }
+
+        if(EP[1].rx_buffer[2] == 1)
+        {
+            latency->acks = 0;
+            latency->timeouts = 0;
+            latency->min_ticks = 0;
+            latency->max_ticks = 0;
+            latency->sum_ticks = 0;
+            for(int i=0;i<PERIPHERAL_BUCKETS;i++)
+            {
+                latency->buckets[i] = 0;
+            }
+        }
+
+        __builtin_mtc0(12, 0, status);
+    }
+
+    EP2_TX(EP[2].tx_buffer);
+}
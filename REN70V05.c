@@ -38,15 +38,29 @@
 //Flag 100 = address 1000 - 13ff
 //Flag 101 = address 1400 - 17ff
 //Flag 110 = address 1800 - 1bff
-//Flag 110 = address 1c00 - 1fff
+//Flag 111 = address 1c00 - 1fff
     
 
 #include <xc.h>
+#include <sys/kmem.h>
 #include "MainBrain.h"
 
+//Blocks at least this long go through the DMA when the buffer is coherent
+#define REN70V05_DMA_MIN        32
+
+//Core Timer ticks per uS
+#define REN70V05_TICKS_US       100
+
+//Left port mailbox word, writing it interrupts this side
+#define REN70V05_INT_ADDRESS    0x1fff
+
 uint8_t mdata_70V05;
 uint32_t address_70V05;
 volatile bool SRAM_BUSY = false;
+SRAM_LOCK_STATS SRAMLockStats[8];
+SRAM_COLLISION_STATS SRAMCollisionStats[8];
+
+static uint8_t REN70V05_INT_Read(void);
 
 void REN70V05_Init(void)
 {    
@@ -59,7 +73,7 @@ void REN70V05_Init(void)
     TRISGbits.TRISG15 = 0;
     PORTGbits.RG15 = 1;
     
-    //INT1 - INTR
+    //INTR, change notice
     TRISEbits.TRISE8 = 1;
     
     //RB5 = M/S
@@ -71,9 +85,12 @@ void REN70V05_Init(void)
     TRISEbits.TRISE9 = 1;
     
     CNCONEbits.ON = 1;
+    CNCONEbits.EDGEDETECT = 1;
     
-    // Enable CN interrupt on RE9
-    CNENEbits.CNIEE9 = 1;
+    // Enable CN interrupt on the falling edges of RE9 (BUSY) and
+    // RE8 (INTR)
+    CNNEEbits.CNNEE9 = 1;
+    CNNEEbits.CNNEE8 = 1;
     
     // Configure CN interrupt
     // Enable CN interrupt
@@ -86,78 +103,510 @@ void REN70V05_Init(void)
     // Clear the interrupt flag 
      IFS3bits.CNEIF = 0;       
      
-     REN70V05_WR(0,1);
-     Delay32(1,10000);
-     mdata_70V05 = 0;
-     REN70V05_RD(0);
-     if(mdata_70V05 != 1)
-     {
-	 lastError = lastError | 4;
-     }
+     //Sets lastError bit 2 when it fails
+     SRAM_Test(SRAM_TEST_QUICK);
      
      //clear the area for the peripherals list
-     for(int i=0;i<8;i++)
-     {
-	 REN70V05_WR(i,0);
-     }
+     uint8_t clear[8] = {0};
+     REN70V05_WriteBlock(0, clear, sizeof(clear));
+     
+     Mailbox_Init();
+     
+     SRAM_Semaphore_Test();
+     
+     //a board may have written the interrupt word before we were ready
+     REN70V05_INT_Read();
+     CNFECLR = 1 << 8;
+     
+     //DMA bridge to the USB buffers
+     SRAM_DMA_Init();
 }
 
-int8_t REN70V05_RD(uint32_t address_70V05)
-{        
+/*************************************************************
+ Collisions
+ When both ports access the same address at once the 70V05
+ holds BUSY low on the port that lost, and that access has to
+ be done again. RE9 is in edge detect mode, so a falling edge
+ of BUSY sets CNFE9 even while the USB interrupt (above the CN
+ interrupt) is running. CN_ISR only moves the edge into
+ SRAM_BUSY, it never waits.
+
+ Every word is checked on its own and only the words that
+ collided are done again, up to SRAM_RETRY_MAX times.
+*************************************************************/
+#define SRAM_RETRY_MAX          8
+
+static void REN70V05_Collision_Clear(void)
+{
+    CNFECLR = 1 << 9;
     SRAM_BUSY = false;
+}
+
+static bool REN70V05_Collision(void)
+{
+    return (CNFEbits.CNFE9 == 1) || SRAM_BUSY;
+}
+
+static void REN70V05_Collision_Count(uint32_t address, uint8_t tries, bool failed)
+{
+    SRAM_COLLISION_STATS *stats = &SRAMCollisionStats[SRAM_FLAG(address)];
+    
+    if(tries == 0)
+    {
+	return;
+    }
     
-    //get data
-    PMRADDR = address_70V05;
+    stats->collisions++;
+    stats->retries = stats->retries + tries;
+    
+    if(failed)
+    {
+	stats->failures++;
+    }
+}
+
+/*************************************************************
+ Word access
+ /CS1 is held for the whole block and the PMP increments the
+ address after every cycle, so the address is only written
+ again to retry a word. Collecting the last word of a read
+ starts one more cycle, /CS1 goes high first so it reads
+ nothing (after 0x1ffe it would be the mailbox interrupt word).
+
+ The USB interrupt gets here in the middle of a flash burst of
+ the main loop, so both take the PMP (REN70V05_PMP_Take()) and
+ give it back with the flash selected again.
+*************************************************************/
+void REN70V05_ReadWords(uint32_t address, uint8_t *data, uint16_t length)
+{
+    REN70V05_PMP_STATE state;
+    uint8_t tries;
+    
+    if(length == 0)
+    {
+	return;
+    }
+    
+    REN70V05_PMP_Take(&state);
+    
+    PMMODEbits.INCM = 1;
+    PMRADDR = address;
     
     //CS1
     PORTAbits.RA0 = 0;    
 
-    //dummy read
-    while(PMMODEbits.BUSY == 1);
+    //dummy read, every read after it starts the next cycle
+    REN70V05_Collision_Clear();
     mdata_70V05 = PMRDIN;
     
+    for(int i=0;i<length;i++)
+    {
+	tries = 0;
+	
+	while(PMMODEbits.BUSY == 1);
+	
+	//the cycle that just ended is the one for this word
+	while(REN70V05_Collision() && (tries < SRAM_RETRY_MAX))
+	{
+	    tries++;
+	    
+	    PMRADDR = address + i;
+	    REN70V05_Collision_Clear();
+	    mdata_70V05 = PMRDIN;
+	    while(PMMODEbits.BUSY == 1);
+	}
+	
+	REN70V05_Collision_Count(address + i, tries, REN70V05_Collision());
+	
+	//CS1, there is no next word
+	if(i == (length - 1))
+	{
+	    PORTAbits.RA0 = 1;
+	}
+	
+	//starts the cycle for the next word
+	REN70V05_Collision_Clear();
+	data[i] = PMRDIN;
+    }
+    
+    //the cycle the last read started
     while(PMMODEbits.BUSY == 1);
-    mdata_70V05 = PMRDIN;
+    
+    REN70V05_PMP_Give(&state);
+    
+    mdata_70V05 = data[length - 1];
+}
 
+void REN70V05_WriteWords(uint32_t address, const uint8_t *data, uint16_t length)
+{
+    REN70V05_PMP_STATE state;
+    uint8_t tries;
+    
+    if(length == 0)
+    {
+	return;
+    }
+    
+    REN70V05_PMP_Take(&state);
+    
+    PMMODEbits.INCM = 1;
+    PMWADDR = address;
+    
+    //CS1
+    PORTAbits.RA0 = 0; 
+    
+    for(int i=0;i<length;i++)
+    {
+	tries = 0;
+	
+	REN70V05_Collision_Clear();
+	PMDOUT = data[i];
+	while(PMMODEbits.BUSY == 1);
+	
+	while(REN70V05_Collision() && (tries < SRAM_RETRY_MAX))
+	{
+	    tries++;
+	    
+	    PMWADDR = address + i;
+	    REN70V05_Collision_Clear();
+	    PMDOUT = data[i];
+	    while(PMMODEbits.BUSY == 1);
+	}
+	
+	REN70V05_Collision_Count(address + i, tries, REN70V05_Collision());
+    }
+    
     //CS1
     PORTAbits.RA0 = 1;    
     
+    REN70V05_PMP_Give(&state);
+}
+
+int8_t REN70V05_RD(uint32_t address_70V05)
+{        
+    uint8_t data;
+    
+    REN70V05_ReadWords(address_70V05, &data, 1);
+    
     return mdata_70V05;
 }
 
 void REN70V05_WR(uint32_t address_70V05, uint8_t mdata_70V05)
 {        
-    PMWADDR = address_70V05;
+    REN70V05_WriteWords(address_70V05, &mdata_70V05, 1);
+}
+
+/*************************************************************
+ Block access
+ A coherent buffer of REN70V05_DMA_MIN bytes or more is moved
+ by the DMA (SRAM_DMA.c), which does the whole block again a
+ word at a time if BUSY fell during the burst.
+*************************************************************/
+void REN70V05_ReadBlock(uint32_t address, uint8_t *data, uint16_t length)
+{
+    //A burst reads the word after the block too, the CPU does the
+    //one that ends next to the mailbox interrupt word
+    if((length >= REN70V05_DMA_MIN) && IS_KVA1(data) &&
+       ((address + length) != REN70V05_INT_ADDRESS))
+    {
+	SRAM_DMA_Read(address, data, length, NULL);
+	SRAM_DMA_Wait();
+	return;
+    }
     
-    //CS1
-    PORTAbits.RA0 = 0; 
+    REN70V05_ReadWords(address, data, length);
+}
+
+void REN70V05_WriteBlock(uint32_t address, const uint8_t *data, uint16_t length)
+{
+    if((length >= REN70V05_DMA_MIN) && IS_KVA1(data))
+    {
+	SRAM_DMA_Write(address, data, length, NULL);
+	SRAM_DMA_Wait();
+	return;
+    }
+    
+    REN70V05_WriteWords(address, data, length);
+}
+
+/*************************************************************
+ Side access
+ The semaphores and the mailbox interrupt word can be used from
+ an interrupt, in the middle of a display, flash or SRAM access
+ by the main loop. The PMP state that access was using is taken
+ and given back untouched. The flash jobs (Flash_Jobs.c) use the
+ same pair from their timer tick, so the flash bank pins are
+ kept too.
+
+ A main loop read is a dummy PMRDIN followed by one PMRDIN per
+ word, each collecting the cycle the one before it started. The
+ word of the cycle in flight when the interrupt lands is lost
+ to the interrupt's own reads, so with the SRAM (or a semaphore
+ latch) selected Give reads that address again. The same for a
+ flash burst (Flash_Read(), Flash_Blank_Length(), the only flash
+ reads with INCM counting), the status polls and commands of
+ the flash jobs are not read again. PMRADDR has already moved
+ past the address when INCM counts.
+*************************************************************/
+void REN70V05_PMP_Take(REN70V05_PMP_STATE *state)
+{
+    SRAM_DMA_Wait();
     
     while(PMMODEbits.BUSY == 1);
-    PMDOUT = mdata_70V05;
+    
+    state->pmwaddr = PMWADDR;
+    state->pmraddr = PMRADDR;
+    state->incm = PMMODEbits.INCM;
+    state->pending = state->pmraddr;
+    
+    if(state->incm == 1)
+    {
+	state->pending = state->pmraddr - 1;
+    }
+    else if(state->incm == 2)
+    {
+	state->pending = state->pmraddr + 1;
+    }
+    
+    state->sem = PORTGbits.RG15;
+    state->cs_sram = PORTAbits.RA0;
+    state->cs_display = PORTAbits.RA9;
+    state->cs_flash = PORTAbits.RA10;
+    state->a16 = PORTBbits.RB2;
+    state->a17 = PORTBbits.RB4;
+    state->a18 = PORTBbits.RB3;
+    
+    PORTAbits.RA9 = 1;
+    PORTAbits.RA10 = 1;
+    PORTAbits.RA0 = 1;
+    PORTGbits.RG15 = 1;
+    PMMODEbits.INCM = 0;
+}
+
+void REN70V05_PMP_Give(const REN70V05_PMP_STATE *state)
+{
+    uint8_t dummy;
+    
     while(PMMODEbits.BUSY == 1);
     
-    if(SRAM_BUSY == true)
+    PORTBbits.RB2 = state->a16;
+    PORTBbits.RB4 = state->a17;
+    PORTBbits.RB3 = state->a18;
+    PMMODEbits.INCM = state->incm;
+    PMWADDR = state->pmwaddr;
+    PORTGbits.RG15 = state->sem;
+    PORTAbits.RA0 = state->cs_sram;
+    PORTAbits.RA9 = state->cs_display;
+    PORTAbits.RA10 = state->cs_flash;
+    
+    //Reading the mailbox word again would let go of an interrupt
+    //a board raised since, nobody would read its event
+    if((((state->cs_sram == 0) || (state->sem == 0)) &&
+        ((state->pending & 0x1fff) != REN70V05_INT_ADDRESS)) ||
+       ((state->cs_flash == 0) && (state->incm == 1)))
     {
-        while(PMMODEbits.BUSY == 1);
-        PMDOUT = mdata_70V05;
-        while(PMMODEbits.BUSY == 1);
+	PMRADDR = state->pending;
+	REN70V05_Collision_Clear();
+	dummy = PMRDIN;
+	while(PMMODEbits.BUSY == 1);
+	(void)dummy;
     }
     
-    SRAM_BUSY = false;
+    PMRADDR = state->pmraddr;
+}
+
+/*************************************************************
+ Semaphores
+ The 70V05 has one semaphore latch per flag (region) in the
+ table above, shared by both ports. With /SEM low and /CS1 high
+ the address selects the latch and D0 is its value:
+    write 0     request the flag
+    read 0      this side holds it, 1 the other side does
+    write 1     release it, or withdraw a request that failed
+*************************************************************/
+static uint8_t REN70V05_SEM_Access(uint8_t flag, bool write, uint8_t value)
+{
+    REN70V05_PMP_STATE state;
+    uint8_t latch = 0;
+    
+    REN70V05_PMP_Take(&state);
+    
+    //SEM
+    PORTGbits.RG15 = 0;
+    
+    if(write)
+    {
+	PMWADDR = flag & 7;
+	PMDOUT = value;
+	while(PMMODEbits.BUSY == 1);
+    }
+    else
+    {
+	PMRADDR = flag & 7;
+	
+	//dummy read
+	latch = PMRDIN;
+	while(PMMODEbits.BUSY == 1);
+	latch = PMRDIN & 1;
+	while(PMMODEbits.BUSY == 1);
+    }
+    
+    //SEM
+    PORTGbits.RG15 = 1;
+    
+    REN70V05_PMP_Give(&state);
+    
+    return latch;
+}
+
+/*************************************************************
+ Mailbox interrupt
+ A board (left port) writing REN70V05_INT_ADDRESS pulls INTR
+ (RE8) low, reading the word from this side lets it go. The
+ board writes (event code << 3) | board address.
+*************************************************************/
+static uint8_t REN70V05_INT_Read(void)
+{
+    REN70V05_PMP_STATE state;
+    uint8_t value;
+    
+    REN70V05_PMP_Take(&state);
+    
+    PMRADDR = REN70V05_INT_ADDRESS;
     
     //CS1
-    PORTAbits.RA0 = 1;    
+    PORTAbits.RA0 = 0;
+    
+    //dummy read
+    value = PMRDIN;
+    while(PMMODEbits.BUSY == 1);
+    value = PMRDIN;
+    while(PMMODEbits.BUSY == 1);
+    
+    //CS1
+    PORTAbits.RA0 = 1;
+    
+    REN70V05_PMP_Give(&state);
+    
+    return value;
+}
+
+//Try lock, returns true when the flag is ours
+bool REN70V05_SEM(uint8_t flag)
+{
+    flag = flag & 7;
+    
+    REN70V05_SEM_Access(flag, true, 0);
+    
+    if(REN70V05_SEM_Access(flag, false, 0) == 0)
+    {
+	SRAMLockStats[flag].locks++;
+	return true;
+    }
+    
+    //withdraw the request, it would be granted later on its own
+    REN70V05_SEM_Access(flag, true, 1);
+    
+    return false;
+}
+
+//Lock with a timeout, returns false when the board held the flag
+//for longer than timeout_us
+bool REN70V05_LOCK(uint8_t flag, uint32_t timeout_us)
+{
+    uint32_t start, waited;
+    
+    flag = flag & 7;
+    
+    if(REN70V05_SEM(flag))
+    {
+	return true;
+    }
+    
+    SRAMLockStats[flag].contended++;
+    start = _CP0_GET_COUNT();
+    
+    do
+    {
+	if(REN70V05_SEM(flag))
+	{
+	    waited = _CP0_GET_COUNT() - start;
+	    
+	    if(waited > SRAMLockStats[flag].wait_max)
+	    {
+		SRAMLockStats[flag].wait_max = waited;
+	    }
+	    return true;
+	}
+    }
+    while((_CP0_GET_COUNT() - start) < (timeout_us * REN70V05_TICKS_US));
+    
+    SRAMLockStats[flag].timeouts++;
+    
+    return false;
+}
+
+void REN70V05_RELEASE(uint8_t flag)
+{
+    REN70V05_SEM_Access(flag & 7, true, 1);
+}
+
+//Every latch has to lock, read back 0 and read 1 again once released
+void SRAM_Semaphore_Test(void)
+{
+    for(int flag=0;flag<8;flag++)
+    {
+	if(!REN70V05_LOCK(flag, 1000))
+	{
+	    lastError = lastError | 8;
+	    continue;
+	}
+	
+	if(REN70V05_SEM_Access(flag, false, 0) != 0)
+	{
+	    lastError = lastError | 8;
+	}
+	
+	REN70V05_RELEASE(flag);
+	
+	if(REN70V05_SEM_Access(flag, false, 0) != 1)
+	{
+	    lastError = lastError | 8;
+	}
+    }
+    
+    //The test is not contention
+    for(int flag=0;flag<8;flag++)
+    {
+	SRAMLockStats[flag].locks = 0;
+	SRAMLockStats[flag].contended = 0;
+	SRAMLockStats[flag].timeouts = 0;
+	SRAMLockStats[flag].wait_max = 0;
+    }
 }
 
 void __attribute__((vector(_CHANGE_NOTICE_E_VECTOR), interrupt(ipl5srs), nomips16)) CN_ISR()
 { 
-    // Check if the interrupt is caused by RE9 and that it was the falling edge
-    if (CNSTATEbits.CNSTATE9 && !PORTEbits.RE9)
+    uint32_t status;
+    
+    // BUSY fell, the access that lost checks SRAM_BUSY and does it again
+    if (CNFEbits.CNFE9)
     {    
-        Delay32(0, 1);
         SRAM_BUSY = true;
+        CNFECLR = 1 << 9;
+    }
+    
+    // INTR fell, a board wrote the mailbox interrupt word
+    if (CNFEbits.CNFE8)
+    {
+        CNFECLR = 1 << 8;
+        
+        // The USB interrupt uses the PMP too
+        status = __builtin_disable_interrupts();
+        Board_Event_Post(REN70V05_INT_Read());
+        __builtin_mtc0(12, 0, status);
     }
     
     // Clear the interrupt flag
     IFS3bits.CNEIF = 0;
-}
\ No newline at end of file
+}
@@ -110,6 +110,9 @@ void __attribute__((vector(_RTCC_VECTOR), interrupt(ipl4srs), nomips16)) RTCC_Ha
 {
     RTC_delay_counter++;
     
+    //Measures the scope sample rate
+    Scope_Tick();
+    
     //Turns ON LED0
     PORTFbits.RF3 = 1;
     
@@ -0,0 +1,281 @@
+/*********************************************************************
+    FileName:     	SRAM_DMA.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 MHz
+
+    File Description:
+        DMA bridge between RAM buffers (the USB packets) and the
+        dual port SRAM
+
+        A burst puts the PMP in address auto increment mode with an
+        interrupt request at the end of every cycle. DMA channel 0 is
+        triggered by that request and moves one byte per cycle, so
+        /CS1 and the address are set once per burst instead of once
+        per byte.
+
+        Write:  source buffer -> PMDOUT, the first byte is forced
+        Read:   PMRDIN -> destination buffer, a CPU dummy read starts
+                the first cycle, each DMA read starts the next
+
+        The burst completes in the DMA block complete interrupt, or
+        in SRAM_DMA_Wait() when someone needs the PMP first, and then
+        calls the caller's done function.
+
+        The PMP is shared with the display and the flash, which the
+        main loop drives directly. A burst takes the PMP with
+        REN70V05_PMP_Take() (a flash scan uses auto increment and
+        has a read in flight) and gives it back when it completes,
+        and the USB interrupt waits for its bursts before it
+        returns, so the main loop never sees one running.
+
+        Buffers must be coherent (uncached), the DMA works on
+        physical memory.
+
+        A burst can not retry a single word, so if BUSY fell during
+        it (see REN70V05.c) the whole burst is done again a word at
+        a time before the done function is called.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include <sys/kmem.h>
+#include "MainBrain.h"
+
+#define SRAM_DMA_IRQ_ALL        0x00ff00ff
+
+static volatile bool sram_dma_active = false;
+static void (*sram_dma_done)(void) = NULL;
+static volatile uint32_t sram_dma_dummy;
+
+//The burst, to do it again after a collision
+static uint32_t sram_dma_address;
+static volatile uint8_t *sram_dma_buffer;
+static uint16_t sram_dma_length;
+static bool sram_dma_read;
+
+//PMP state found when the burst started
+static REN70V05_PMP_STATE sram_dma_state;
+
+void SRAM_DMA_Init(void)
+{
+    DMACONbits.ON = 1;
+
+    DCH0CONbits.CHEN = 0;
+    DCH0CONbits.CHPRI = 3;              //Highest channel priority
+    DCH0CONbits.CHAEN = 0;              //One block per start
+
+    //Every PMP cycle moves one byte
+    DCH0ECONbits.CHSIRQ = _PMP_VECTOR;
+    DCH0ECONbits.SIRQEN = 1;
+    DCH0CSIZ = 1;
+
+    //Block complete interrupt
+    DCH0INTCLR = SRAM_DMA_IRQ_ALL;
+    DCH0INTbits.CHBCIE = 1;
+
+    IPC33bits.DMA0IP = 4;
+    IPC33bits.DMA0IS = 0;
+    IFS4bits.DMA0IF = 0;
+    IEC4bits.DMA0IE = 1;
+}
+
+static void sram_dma_start(uint32_t address, bool read)
+{
+    //Lets a cycle the main loop started finish
+    REN70V05_PMP_Take(&sram_dma_state);
+
+    DCH0INTCLR = SRAM_DMA_IRQ_ALL;
+    DCH0INTbits.CHBCIE = 1;
+    IFS4bits.DMA0IF = 0;
+    IFS4bits.PMPIF = 0;
+
+    //BUSY edge
+    CNFECLR = 1 << 9;
+    SRAM_BUSY = false;
+
+    //Auto increment, interrupt request at the end of every cycle
+    PMMODEbits.INCM = 1;
+    PMMODEbits.IRQM = 1;
+
+    if(read)
+    {
+        PMRADDR = address;
+    }
+    else
+    {
+        PMWADDR = address;
+    }
+
+    //CS1
+    PORTAbits.RA0 = 0;
+
+    sram_dma_active = true;
+    DCH0CONbits.CHEN = 1;
+}
+
+static void sram_dma_complete(void)
+{
+    void (*done)(void) = sram_dma_done;
+
+    //The last cycle (one extra read for a read burst) has to finish
+    while(PMMODEbits.BUSY == 1);
+
+    //CS1
+    PORTAbits.RA0 = 1;
+
+    DCH0CONbits.CHEN = 0;
+    DCH0INTCLR = SRAM_DMA_IRQ_ALL;
+    IFS4bits.DMA0IF = 0;
+    IFS4bits.PMPIF = 0;
+
+    PMMODEbits.IRQM = 0;
+    PMMODEbits.INCM = 0;
+
+    sram_dma_done = NULL;
+    sram_dma_active = false;
+
+    //Done again while the display and flash are still deselected
+    if((CNFEbits.CNFE9 == 1) || SRAM_BUSY)
+    {
+        SRAMCollisionStats[SRAM_FLAG(sram_dma_address)].bursts++;
+
+        if(sram_dma_read)
+        {
+            REN70V05_ReadWords(sram_dma_address, (uint8_t *)sram_dma_buffer, sram_dma_length);
+        }
+        else
+        {
+            REN70V05_WriteWords(sram_dma_address, (const uint8_t *)sram_dma_buffer, sram_dma_length);
+        }
+    }
+
+    REN70V05_PMP_Give(&sram_dma_state);
+
+    if(done != NULL)
+    {
+        done();
+    }
+}
+
+//Moves length bytes from source into the SRAM starting at address
+void SRAM_DMA_Write(uint32_t address, const volatile uint8_t *source, uint16_t length, void (*done)(void))
+{
+    //One burst at a time
+    SRAM_DMA_Wait();
+
+    if(length == 0)
+    {
+        if(done != NULL)
+        {
+            done();
+        }
+        return;
+    }
+
+    sram_dma_done = done;
+    sram_dma_address = address;
+    sram_dma_buffer = (volatile uint8_t *)source;
+    sram_dma_length = length;
+    sram_dma_read = false;
+
+    DCH0SSA = KVA_TO_PA(source);
+    DCH0SSIZ = length;
+    DCH0DSA = KVA_TO_PA(&PMDOUT);
+    DCH0DSIZ = 1;
+
+    sram_dma_start(address, false);
+
+    //The first byte is forced, the end of its cycle moves the next one
+    DCH0ECONbits.CFORCE = 1;
+}
+
+//Moves length bytes from the SRAM starting at address into destination
+void SRAM_DMA_Read(uint32_t address, volatile uint8_t *destination, uint16_t length, void (*done)(void))
+{
+    SRAM_DMA_Wait();
+
+    if(length == 0)
+    {
+        if(done != NULL)
+        {
+            done();
+        }
+        return;
+    }
+
+    sram_dma_done = done;
+    sram_dma_address = address;
+    sram_dma_buffer = destination;
+    sram_dma_length = length;
+    sram_dma_read = true;
+
+    DCH0SSA = KVA_TO_PA(&PMRDIN);
+    DCH0SSIZ = 1;
+    DCH0DSA = KVA_TO_PA(destination);
+    DCH0DSIZ = length;
+
+    sram_dma_start(address, true);
+
+    //dummy read, the end of its cycle moves the first byte
+    sram_dma_dummy = PMRDIN;
+}
+
+bool SRAM_DMA_Busy(void)
+{
+    return sram_dma_active;
+}
+
+//Finishes the burst in progress, if any
+void SRAM_DMA_Wait(void)
+{
+    uint32_t status;
+
+    if(!sram_dma_active)
+    {
+        return;
+    }
+
+    //The completion runs either here or in the DMA interrupt, never both
+    status = __builtin_disable_interrupts();
+
+    if(sram_dma_active)
+    {
+        while(DCH0INTbits.CHBCIF == 0);
+        sram_dma_complete();
+    }
+
+    __builtin_mtc0(12, 0, status);
+}
+
+void __attribute__((vector(_DMA0_VECTOR), interrupt(ipl4srs), nomips16)) SRAM_DMA_Handler()
+{
+    if(sram_dma_active && DCH0INTbits.CHBCIF)
+    {
+        sram_dma_complete();
+    }
+
+    IFS4bits.DMA0IF = 0;
+}
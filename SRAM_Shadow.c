@@ -0,0 +1,336 @@
+/*********************************************************************
+    FileName:     	SRAM_Shadow.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 MHz
+
+    File Description:
+        Copy of the dual port SRAM in internal RAM
+
+        For the bytes the MainBrain owns (commands, the sequence
+        table, motion bytes). A read is served from the copy once
+        its line has been read, a write only changes the copy and
+        marks the byte dirty. The dirty bytes go out together, runs
+        of neighbouring bytes as one block, when a region is flushed:
+            - by a directive (Directives.c), before the board is told
+              to read them
+            - at the end of every USB command (Host_CMDs)
+            - before the USB bridge and the vendor requests use the
+              SRAM directly
+
+        Each line (SRAM_SHADOW_LINE bytes) has a valid bit and a
+        dirty mask with a bit per byte, so a flush never writes
+        bytes a board changed in the same line.
+
+        The boards write their data in their own regions, so
+        the directive invalidates the region when the board is done,
+        the next read gets the line from the SRAM again. Mailbox
+        rings and the board's status bytes are read with
+        REN70V05_RD(), never through the copy.
+
+        The USB interrupt and the main loop both use the copy, every
+        function runs with interrupts off.
+
+        A flush waits up to SRAM_SHADOW_LOCK_US for a board holding
+        the region, and writes anyway when it is still held. The
+        directive tick (Directives.c) must not wait, it uses
+        SRAM_Shadow_TryFlushRange() and SRAM_Shadow_TryInvalidateRange()
+        which try the semaphore once and change nothing when the
+        board holds it.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include "MainBrain.h"
+
+#define SRAM_SHADOW_SIZE        0x2000
+#define SRAM_SHADOW_LINE        32
+#define SRAM_SHADOW_LINES       (SRAM_SHADOW_SIZE / SRAM_SHADOW_LINE)
+#define SRAM_SHADOW_REGION      0x400
+
+//A flush waits this long for a board holding the region
+#define SRAM_SHADOW_LOCK_US     50
+
+SRAM_SHADOW_STATS SRAMShadowStats[8];
+
+static uint8_t sram_shadow[SRAM_SHADOW_SIZE];
+static uint32_t sram_shadow_valid[SRAM_SHADOW_LINES / 32];
+static uint32_t sram_shadow_dirty[SRAM_SHADOW_LINES];
+
+static bool SRAM_Shadow_Valid(uint32_t line)
+{
+    return (sram_shadow_valid[line / 32] & (1 << (line % 32))) != 0;
+}
+
+//Makes the line valid, reading it from the SRAM if it is not
+static void SRAM_Shadow_Line(uint32_t address)
+{
+    uint32_t line = address / SRAM_SHADOW_LINE;
+
+    if(SRAM_Shadow_Valid(line))
+    {
+        SRAMShadowStats[SRAM_FLAG(address)].hits++;
+        return;
+    }
+
+    SRAMShadowStats[SRAM_FLAG(address)].misses++;
+
+    //A line is never dirty without being valid, nothing to keep
+    REN70V05_ReadWords(line * SRAM_SHADOW_LINE, &sram_shadow[line * SRAM_SHADOW_LINE], SRAM_SHADOW_LINE);
+    sram_shadow_valid[line / 32] |= 1 << (line % 32);
+}
+
+static void SRAM_Shadow_Burst(uint32_t address, uint16_t length)
+{
+    SRAMShadowStats[SRAM_FLAG(address)].bursts++;
+    SRAMShadowStats[SRAM_FLAG(address)].bytes += length;
+
+    REN70V05_WriteBlock(address, &sram_shadow[address], length);
+}
+
+//Writes the dirty bytes of the lines first - last, drop = true
+//invalidates them too. The lines are all in one region. Without
+//wait it returns false when the board holds the region.
+static bool SRAM_Shadow_Lines(uint32_t first, uint32_t last, bool drop, bool wait)
+{
+    uint32_t start = 0;
+    uint16_t length = 0;
+    uint32_t mask;
+    bool dirty = false;
+    bool locked;
+
+    for(uint32_t line=first;line<=last;line++)
+    {
+        if(sram_shadow_dirty[line] != 0)
+        {
+            dirty = true;
+            break;
+        }
+    }
+
+    if(dirty)
+    {
+        if(wait)
+        {
+            locked = REN70V05_LOCK(SRAM_FLAG(first * SRAM_SHADOW_LINE), SRAM_SHADOW_LOCK_US);
+        }
+        else
+        {
+            locked = REN70V05_SEM(SRAM_FLAG(first * SRAM_SHADOW_LINE));
+            if(!locked)
+            {
+                return false;
+            }
+        }
+
+        for(uint32_t line=first;line<=last;line++)
+        {
+            mask = sram_shadow_dirty[line];
+            sram_shadow_dirty[line] = 0;
+
+            for(int i=0;i<SRAM_SHADOW_LINE;i++)
+            {
+                if((mask & (1 << i)) != 0)
+                {
+                    if(length == 0)
+                    {
+                        start = (line * SRAM_SHADOW_LINE) + i;
+                    }
+                    length++;
+                }
+                else if(length != 0)
+                {
+                    SRAM_Shadow_Burst(start, length);
+                    length = 0;
+                }
+            }
+        }
+
+        if(length != 0)
+        {
+            SRAM_Shadow_Burst(start, length);
+        }
+
+        if(locked)
+        {
+            REN70V05_RELEASE(SRAM_FLAG(first * SRAM_SHADOW_LINE));
+        }
+    }
+
+    if(drop)
+    {
+        for(uint32_t line=first;line<=last;line++)
+        {
+            sram_shadow_valid[line / 32] &= ~(1 << (line % 32));
+        }
+    }
+
+    return true;
+}
+
+//Every region the bytes address - address + length touch
+static bool SRAM_Shadow_Range(uint32_t address, uint16_t length, bool drop, bool wait)
+{
+    uint32_t status;
+    uint32_t first;
+    uint32_t last;
+    bool done = true;
+
+    if(length == 0)
+    {
+        return true;
+    }
+
+    address = address & (SRAM_SHADOW_SIZE - 1);
+    if((address + length) > SRAM_SHADOW_SIZE)
+    {
+        length = SRAM_SHADOW_SIZE - address;
+    }
+
+    first = address / SRAM_SHADOW_LINE;
+    last = (address + length - 1) / SRAM_SHADOW_LINE;
+
+    status = __builtin_disable_interrupts();
+
+    for(uint32_t region=first/(SRAM_SHADOW_REGION / SRAM_SHADOW_LINE);region<=last/(SRAM_SHADOW_REGION / SRAM_SHADOW_LINE);region++)
+    {
+        uint32_t from = region * (SRAM_SHADOW_REGION / SRAM_SHADOW_LINE);
+        uint32_t to = from + (SRAM_SHADOW_REGION / SRAM_SHADOW_LINE) - 1;
+
+        if(!SRAM_Shadow_Lines((from > first) ? from : first, (to < last) ? to : last, drop, wait))
+        {
+            done = false;
+        }
+    }
+
+    __builtin_mtc0(12, 0, status);
+
+    return done;
+}
+
+uint8_t SRAM_Shadow_RD(uint32_t address)
+{
+    uint8_t data;
+
+    SRAM_Shadow_Read(address, &data, 1);
+
+    return data;
+}
+
+void SRAM_Shadow_WR(uint32_t address, uint8_t data)
+{
+    SRAM_Shadow_Write(address, &data, 1);
+}
+
+void SRAM_Shadow_Read(uint32_t address, uint8_t *data, uint16_t length)
+{
+    uint32_t status = __builtin_disable_interrupts();
+    uint32_t a;
+
+    for(int i=0;i<length;i++)
+    {
+        a = (address + i) & (SRAM_SHADOW_SIZE - 1);
+
+        if((i == 0) || ((a % SRAM_SHADOW_LINE) == 0))
+        {
+            SRAM_Shadow_Line(a);
+        }
+
+        data[i] = sram_shadow[a];
+    }
+
+    __builtin_mtc0(12, 0, status);
+}
+
+void SRAM_Shadow_Write(uint32_t address, const uint8_t *data, uint16_t length)
+{
+    uint32_t status = __builtin_disable_interrupts();
+    uint32_t a;
+
+    for(int i=0;i<length;i++)
+    {
+        a = (address + i) & (SRAM_SHADOW_SIZE - 1);
+
+        if((i == 0) || ((a % SRAM_SHADOW_LINE) == 0))
+        {
+            SRAM_Shadow_Line(a);
+        }
+
+        sram_shadow[a] = data[i];
+        sram_shadow_dirty[a / SRAM_SHADOW_LINE] |= 1 << (a % SRAM_SHADOW_LINE);
+    }
+
+    __builtin_mtc0(12, 0, status);
+}
+
+//Before the SRAM is read directly
+void SRAM_Shadow_FlushRange(uint32_t address, uint16_t length)
+{
+    SRAM_Shadow_Range(address, length, false, true);
+}
+
+//Before the SRAM is written directly
+void SRAM_Shadow_InvalidateRange(uint32_t address, uint16_t length)
+{
+    SRAM_Shadow_Range(address, length, true, true);
+}
+
+//The same without waiting, false when a board held a region
+bool SRAM_Shadow_TryFlushRange(uint32_t address, uint16_t length)
+{
+    return SRAM_Shadow_Range(address, length, false, false);
+}
+
+bool SRAM_Shadow_TryInvalidateRange(uint32_t address, uint16_t length)
+{
+    return SRAM_Shadow_Range(address, length, true, false);
+}
+
+//board = 1 - 8
+void SRAM_Shadow_Flush(uint8_t board)
+{
+    if((board < 1) || (board > 8))
+    {
+        return;
+    }
+
+    SRAM_Shadow_FlushRange((board - 1) * SRAM_SHADOW_REGION, SRAM_SHADOW_REGION);
+}
+
+//Flushes the region's dirty bytes, then forgets the region
+void SRAM_Shadow_Invalidate(uint8_t board)
+{
+    if((board < 1) || (board > 8))
+    {
+        return;
+    }
+
+    SRAM_Shadow_InvalidateRange((board - 1) * SRAM_SHADOW_REGION, SRAM_SHADOW_REGION);
+}
+
+void SRAM_Shadow_FlushAll(void)
+{
+    SRAM_Shadow_FlushRange(0, SRAM_SHADOW_SIZE);
+}
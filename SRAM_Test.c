@@ -0,0 +1,376 @@
+/*********************************************************************
+    FileName:     	SRAM_Test.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 MHz, Core Timer = System Clock / 2
+
+    File Description:
+        70V05 SRAM self test, using block transfers
+
+        Quick (every boot, about 6 mS)
+            checkerboard 0x55/0xaa, its inverse, then every byte
+            holding its own address (low byte ^ high byte) for the
+            address lines
+        Thorough (USB opcode 0x75, about 50 mS)
+            March C- with the data backgrounds 0x00, 0x55, 0x33 and
+            0x0f (and their inverses):
+                up w0, up r0w1, up r1w0, down r0w1, down r1w0, r0
+            The read and write of an element are done a block of
+            SRAM_TEST_BLOCK bytes at a time instead of a byte at a
+            time, the blocks of a down element go from the top.
+
+        Both save the SRAM first and put it back after, the boards
+        keep their bytes, the sequence table and the mailbox marks.
+
+        The mailbox interrupt words (0x1ffe - 0x1fff) are left out,
+        writing one interrupts the boards and reading the other
+        clears a board's notification.
+
+        All eight semaphores are held while the test runs, so a
+        board that takes them waits instead of failing the test.
+
+        The result is kept in SRAMTest. A failure sets lastError
+        bit 2 (SRAM), which the info screen shows with the first
+        failing address and the time the test took.
+
+        0x75 Memory Test
+            Request:  Byte 1 = 0 quick, 1 thorough
+            The test runs from the main loop (SRAM_Test_Service())
+            once no directive or motion sequence is running, the
+            reply is sent when it is done.
+            Reply:    Byte 0 = 0x75, Byte 1 = 1 passed
+                      Byte 2     mode
+                      Byte 3-6   failing bytes
+                      Byte 7-8   first failing address
+                      Byte 9     expected
+                      Byte 10    read
+                      Byte 11-14 Core Timer ticks the test took
+                      Byte 15-18 tests run since reset
+            All values are little endian.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include "MainBrain.h"
+
+#define SRAM_TEST_END           0x1ffe
+#define SRAM_TEST_BLOCK         256
+
+SRAM_TEST_RESULT SRAMTest;
+
+static uint8_t sram_test_write[SRAM_TEST_BLOCK];
+static uint8_t sram_test_read[SRAM_TEST_BLOCK];
+static uint8_t sram_test_save[SRAM_TEST_END];
+
+//Set by 0x75 in the USB interrupt
+static volatile bool sram_test_requested = false;
+static volatile uint8_t sram_test_requested_mode;
+
+//Data background pattern for an address
+static uint8_t SRAM_Test_Pattern(uint8_t background, uint32_t address)
+{
+    //The odd bytes of a checkerboard are the inverse
+    if((background == 0x55) && (address & 1))
+    {
+        return 0xaa;
+    }
+
+    return background;
+}
+
+static void SRAM_Test_Fail(uint32_t address, uint8_t expected, uint8_t actual)
+{
+    if(SRAMTest.failures == 0)
+    {
+        SRAMTest.address = address;
+        SRAMTest.expected = expected;
+        SRAMTest.actual = actual;
+    }
+
+    SRAMTest.failures++;
+}
+
+static void SRAM_Test_Fill(uint32_t address, uint16_t length, uint8_t background, bool invert)
+{
+    for(int i=0;i<length;i++)
+    {
+        sram_test_write[i] = SRAM_Test_Pattern(background, address + i) ^ (invert ? 0xff : 0);
+    }
+}
+
+static void SRAM_Test_Verify(uint32_t address, uint16_t length)
+{
+    for(int i=0;i<length;i++)
+    {
+        if(sram_test_read[i] != sram_test_write[i])
+        {
+            SRAM_Test_Fail(address + i, sram_test_write[i], sram_test_read[i]);
+        }
+    }
+}
+
+static uint16_t SRAM_Test_Length(uint32_t address)
+{
+    if((SRAM_TEST_END - address) < SRAM_TEST_BLOCK)
+    {
+        return SRAM_TEST_END - address;
+    }
+
+    return SRAM_TEST_BLOCK;
+}
+
+//Whole SRAM, one pass
+static void SRAM_Test_Write(uint8_t background, bool invert)
+{
+    uint16_t length;
+
+    for(uint32_t address=0;address<SRAM_TEST_END;address=address+length)
+    {
+        length = SRAM_Test_Length(address);
+
+        SRAM_Test_Fill(address, length, background, invert);
+        REN70V05_WriteWords(address, sram_test_write, length);
+    }
+}
+
+static void SRAM_Test_Read(uint8_t background, bool invert)
+{
+    uint16_t length;
+
+    for(uint32_t address=0;address<SRAM_TEST_END;address=address+length)
+    {
+        length = SRAM_Test_Length(address);
+
+        SRAM_Test_Fill(address, length, background, invert);
+        REN70V05_ReadWords(address, sram_test_read, length);
+        SRAM_Test_Verify(address, length);
+    }
+}
+
+//One read then write March element, up or down
+static void SRAM_Test_March(uint8_t background, bool read_invert, bool down)
+{
+    uint32_t address;
+    uint16_t length;
+    int blocks = (SRAM_TEST_END + SRAM_TEST_BLOCK - 1) / SRAM_TEST_BLOCK;
+
+    for(int block=0;block<blocks;block++)
+    {
+        address = (down ? (blocks - 1 - block) : block) * SRAM_TEST_BLOCK;
+        length = SRAM_Test_Length(address);
+
+        SRAM_Test_Fill(address, length, background, read_invert);
+        REN70V05_ReadWords(address, sram_test_read, length);
+        SRAM_Test_Verify(address, length);
+
+        SRAM_Test_Fill(address, length, background, !read_invert);
+        REN70V05_WriteWords(address, sram_test_write, length);
+    }
+}
+
+static void SRAM_Test_Address(void)
+{
+    uint16_t length;
+
+    for(uint32_t address=0;address<SRAM_TEST_END;address=address+length)
+    {
+        length = SRAM_Test_Length(address);
+
+        for(int i=0;i<length;i++)
+        {
+            sram_test_write[i] = (address + i) ^ ((address + i) >> 8);
+        }
+        REN70V05_WriteWords(address, sram_test_write, length);
+    }
+
+    for(uint32_t address=0;address<SRAM_TEST_END;address=address+length)
+    {
+        length = SRAM_Test_Length(address);
+
+        for(int i=0;i<length;i++)
+        {
+            sram_test_write[i] = (address + i) ^ ((address + i) >> 8);
+        }
+        REN70V05_ReadWords(address, sram_test_read, length);
+        SRAM_Test_Verify(address, length);
+    }
+}
+
+//Returns true when the SRAM passed
+bool SRAM_Test(uint8_t mode)
+{
+    static const uint8_t backgrounds[4] = {0x00, 0x55, 0x33, 0x0f};
+    uint32_t start;
+    bool locked[8];
+
+    for(int flag=0;flag<8;flag++)
+    {
+        locked[flag] = REN70V05_LOCK(flag, 100);
+    }
+
+    SRAMTest.mode = mode;
+    SRAMTest.failures = 0;
+    SRAMTest.address = 0;
+    SRAMTest.expected = 0;
+    SRAMTest.actual = 0;
+
+    start = _CP0_GET_COUNT();
+
+    //Saved with what is still only in the shadow copy
+    SRAM_Shadow_FlushAll();
+    REN70V05_ReadWords(0, sram_test_save, SRAM_TEST_END);
+
+    if(mode == SRAM_TEST_THOROUGH)
+    {
+        for(int i=0;i<4;i++)
+        {
+            SRAM_Test_Write(backgrounds[i], false);
+            SRAM_Test_March(backgrounds[i], false, false);
+            SRAM_Test_March(backgrounds[i], true, false);
+            SRAM_Test_March(backgrounds[i], false, true);
+            SRAM_Test_March(backgrounds[i], true, true);
+            SRAM_Test_Read(backgrounds[i], false);
+        }
+
+        SRAM_Test_Address();
+    }
+    else
+    {
+        SRAM_Test_Write(0x55, false);
+        SRAM_Test_Read(0x55, false);
+        SRAM_Test_Write(0x55, true);
+        SRAM_Test_Read(0x55, true);
+        SRAM_Test_Address();
+    }
+
+    REN70V05_WriteWords(0, sram_test_save, SRAM_TEST_END);
+
+    SRAMTest.ticks = _CP0_GET_COUNT() - start;
+    SRAMTest.runs++;
+
+    for(int flag=0;flag<8;flag++)
+    {
+        if(locked[flag])
+        {
+            REN70V05_RELEASE(flag);
+        }
+    }
+
+    if(SRAMTest.failures != 0)
+    {
+        lastError = lastError | 4;
+        return false;
+    }
+
+    lastError = lastError & ~4;
+    return true;
+}
+
+static void SRAM_Test_Put32(volatile uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+//0x75, the test takes too long for the USB interrupt, the main
+//loop runs it
+void SRAM_Test_Request(void)
+{
+    sram_test_requested_mode = SRAM_TEST_QUICK;
+
+    if(EP[1].rx_buffer[1] == SRAM_TEST_THOROUGH)
+    {
+        sram_test_requested_mode = SRAM_TEST_THOROUGH;
+    }
+
+    sram_test_requested = true;
+}
+
+//Main loop, runs the test asked for and replies with the result.
+//Waits for the directives and motion sequences, whatever they
+//would write to the SRAM while it is saved would be lost.
+void SRAM_Test_Service(void)
+{
+    uint32_t status;
+    bool passed;
+
+    if(!sram_test_requested || !Directive_Idle() || Motion_Running())
+    {
+        return;
+    }
+
+    passed = SRAM_Test(sram_test_requested_mode);
+
+    //The USB interrupt sends on Endpoint 2 too
+    status = __builtin_disable_interrupts();
+
+    sram_test_requested = false;
+
+    EP[2].tx_buffer[0] = 0x75;
+    EP[2].tx_buffer[1] = passed;
+    EP[2].tx_buffer[2] = SRAMTest.mode;
+    SRAM_Test_Put32(&EP[2].tx_buffer[3], SRAMTest.failures);
+    EP[2].tx_buffer[7] = SRAMTest.address;
+    EP[2].tx_buffer[8] = SRAMTest.address >> 8;
+    EP[2].tx_buffer[9] = SRAMTest.expected;
+    EP[2].tx_buffer[10] = SRAMTest.actual;
+    SRAM_Test_Put32(&EP[2].tx_buffer[11], SRAMTest.ticks);
+    SRAM_Test_Put32(&EP[2].tx_buffer[15], SRAMTest.runs);
+
+    EP2_TX(EP[2].tx_buffer);
+
+    __builtin_mtc0(12, 0, status);
+}
+
+//Fills the SRAM with test_data and reads it back
+bool memtest_70V05(uint8_t test_data)
+{
+    uint16_t length;
+    bool pass = true;
+
+    for(uint32_t address=0;address<SRAM_TEST_END;address=address+length)
+    {
+        length = SRAM_Test_Length(address);
+
+        for(int i=0;i<length;i++)
+        {
+            sram_test_write[i] = test_data;
+        }
+        REN70V05_WriteWords(address, sram_test_write, length);
+        REN70V05_ReadWords(address, sram_test_read, length);
+
+        for(int i=0;i<length;i++)
+        {
+            if(sram_test_read[i] != test_data)
+            {
+                pass = false;
+            }
+        }
+    }
+
+    return pass;
+}
@@ -0,0 +1,264 @@
+/*********************************************************************
+    FileName:     	Scope.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 - 250 MHz
+
+    File Description:
+        Scope sample streaming on Endpoint 3 (High Bandwidth Interrupt IN)
+
+        Timer 1 captures a sample set (one sample per enabled channel)
+        into a ring buffer. The USB Start of Frame interrupt (every
+        125 uS microframe) packs the waiting sample sets into one frame
+        and hands it to the Endpoint 3 FIFO. A partial frame is sent
+        once the oldest sample has waited SCOPE_MAX_AGE microframes, so
+        the latency to the Host is bounded.
+
+        Frame Format (little endian):
+        Byte 0-1    Sync (0xA55A)
+        Byte 2-3    Frame sequence number
+        Byte 4-7    Sample rate (sample sets per second)
+        Byte 8      Channel mask
+        Byte 9      Number of channels in each sample set
+        Byte 10-11  Number of 16-bit samples in the payload
+        Byte 12-15  Sample sets lost since the stream was started
+        Byte 16-    Samples, channels interleaved in channel order
+
+        Channels:
+        Bit 0 = ADC0 (Current)
+        Bit 1 = ADC6 (Voltage)
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include "MainBrain.h"
+
+//Number of 16-bit samples the ring buffer holds, must be a power of 2
+#define SCOPE_RING_SIZE     4096
+
+//Two 512 byte transactions per microframe
+#define SCOPE_FRAME_SIZE    1024
+#define SCOPE_HEADER_SIZE   16
+#define SCOPE_PAYLOAD_MAX   ((SCOPE_FRAME_SIZE - SCOPE_HEADER_SIZE) / 2)
+
+//Microframes the oldest sample may wait before a partial frame is sent
+#define SCOPE_MAX_AGE       8
+
+#define SCOPE_SYNC          0xA55A
+#define SCOPE_CHANNELS      2
+
+//Timer 1 rate until the first one second measurement is available
+#define SCOPE_NOMINAL_RATE  2000
+
+volatile uint8_t ScopeChannelMask = 0;
+volatile uint32_t ScopeSamplesLost = 0;
+volatile uint32_t ScopeSampleRate = SCOPE_NOMINAL_RATE;
+
+static uint16_t scope_ring[SCOPE_RING_SIZE];
+static volatile uint32_t scope_head = 0;
+static volatile uint32_t scope_tail = 0;
+static volatile uint32_t scope_sets_this_second = 0;
+static uint8_t scope_channels = 0;
+static uint16_t scope_sequence = 0;
+static uint8_t scope_age = 0;
+static uint32_t scope_frame[SCOPE_FRAME_SIZE / 4];
+
+void Scope_Start(uint8_t channel_mask)
+{
+    //Stop the capture while the ring is reset
+    ScopeChannelMask = 0;
+
+    channel_mask = channel_mask & ((1 << SCOPE_CHANNELS) - 1);
+
+    scope_channels = 0;
+    for(int i=0;i<SCOPE_CHANNELS;i++)
+    {
+        if((channel_mask >> i) & 1)
+        {
+            scope_channels++;
+        }
+    }
+
+    scope_head = 0;
+    scope_tail = 0;
+    scope_sequence = 0;
+    scope_age = 0;
+    ScopeSamplesLost = 0;
+
+    //The Start of Frame interrupt paces the stream
+    USBCSR2bits.SOFIE = (channel_mask != 0);
+
+    ScopeChannelMask = channel_mask;
+}
+
+void Scope_Stop(void)
+{
+    ScopeChannelMask = 0;
+    USBCSR2bits.SOFIE = 0;
+}
+
+/*************************************************************
+ Called from the Timer 1 interrupt once both ADC results
+ are ready. A sample set is only stored if the ring has room
+ for all of its channels, otherwise it is counted as lost.
+*************************************************************/
+void Scope_Capture(uint16_t ch0, uint16_t ch1)
+{
+    uint8_t mask = ScopeChannelMask;
+    uint32_t head = scope_head;
+
+    if(mask == 0)
+    {
+        return;
+    }
+
+    scope_sets_this_second++;
+
+    if((head - scope_tail) > (uint32_t)(SCOPE_RING_SIZE - scope_channels))
+    {
+        ScopeSamplesLost++;
+        return;
+    }
+
+    if(mask & 0x01)
+    {
+        scope_ring[head & (SCOPE_RING_SIZE - 1)] = ch0;
+        head++;
+    }
+
+    if(mask & 0x02)
+    {
+        scope_ring[head & (SCOPE_RING_SIZE - 1)] = ch1;
+        head++;
+    }
+
+    //Publish the complete set
+    scope_head = head;
+}
+
+//Called once a second from the RTCC interrupt
+void Scope_Tick(void)
+{
+    if(ScopeChannelMask != 0)
+    {
+        ScopeSampleRate = scope_sets_this_second;
+    }
+
+    scope_sets_this_second = 0;
+}
+
+/*************************************************************
+ Called from the USB interrupt on every Start of Frame.
+ Loads at most one frame into the Endpoint 3 FIFO.
+*************************************************************/
+void Scope_Service(void)
+{
+    uint32_t available;
+    uint32_t count;
+    uint32_t tail;
+    uint16_t *payload;
+    uint8_t *header;
+
+    if((ScopeChannelMask == 0) || (scope_channels == 0))
+    {
+        return;
+    }
+
+    //Previous frame has not been collected by the Host yet
+    if(USBE3CSR0bits.TXPKTRDY)
+    {
+        return;
+    }
+
+    available = scope_head - scope_tail;
+
+    if(available == 0)
+    {
+        scope_age = 0;
+        return;
+    }
+
+    //Wait for a full frame unless the oldest sample is getting stale
+    if((available < SCOPE_PAYLOAD_MAX) && (scope_age < SCOPE_MAX_AGE))
+    {
+        scope_age++;
+        return;
+    }
+
+    scope_age = 0;
+
+    //Whole sample sets only
+    count = available;
+    if(count > SCOPE_PAYLOAD_MAX)
+    {
+        count = SCOPE_PAYLOAD_MAX;
+    }
+    count = count - (count % scope_channels);
+
+    header = (uint8_t *)scope_frame;
+    header[0] = SCOPE_SYNC & 0xff;
+    header[1] = SCOPE_SYNC >> 8;
+    header[2] = scope_sequence & 0xff;
+    header[3] = scope_sequence >> 8;
+    header[4] = ScopeSampleRate & 0xff;
+    header[5] = (ScopeSampleRate >> 8) & 0xff;
+    header[6] = (ScopeSampleRate >> 16) & 0xff;
+    header[7] = (ScopeSampleRate >> 24) & 0xff;
+    header[8] = ScopeChannelMask;
+    header[9] = scope_channels;
+    header[10] = count & 0xff;
+    header[11] = count >> 8;
+    header[12] = ScopeSamplesLost & 0xff;
+    header[13] = (ScopeSamplesLost >> 8) & 0xff;
+    header[14] = (ScopeSamplesLost >> 16) & 0xff;
+    header[15] = (ScopeSamplesLost >> 24) & 0xff;
+
+    payload = (uint16_t *)&header[SCOPE_HEADER_SIZE];
+    tail = scope_tail;
+
+    for(uint32_t i=0;i<count;i++)
+    {
+        payload[i] = scope_ring[tail & (SCOPE_RING_SIZE - 1)];
+        tail++;
+    }
+
+    //Release the ring space to Timer 1
+    scope_tail = tail;
+
+    //Pad the last word, then load the FIFO a word at a time
+    if(count & 1)
+    {
+        payload[count] = 0;
+    }
+
+    for(uint32_t i=0;i<(SCOPE_HEADER_SIZE + (count * 2) + 3) / 4;i++)
+    {
+        USBFIFO3 = scope_frame[i];
+    }
+
+    scope_sequence++;
+
+    USBE3CSR0bits.TXPKTRDY = 1;
+}
@@ -64,6 +64,7 @@ char M307Str[] = {"0x307:"};
 char M308Str[] = {"0x308:"};
 char StatusStr[8] = {"Status:"};
 char ControlStr[9] = {"Control:"};
+char LatencyStr[] = {"B     Min   Mean    Max   T/O"};
 char ADCtitleStr[4] = {"ADC"};
 char BoardtitleStr[12] = {"Peripherals"};
 uint8_t LastError = 0;
@@ -74,30 +75,16 @@ bool motionScreenActive = false;
 
 void ShowSplashScreen(uint8_t option)
 {
-    int i;
-    
     //Clear the Screen
     Display_CLRSCN(white);
         
-    //Load Splash Image
+    //Load Splash Image from the flash (Assets.c)
     /****************************/
-    Display_CASET(0, 479);
-    Display_RASET(120, 170);
-    Display_RAMWR();
-
-    //Data
-    //RF3 = D/C 1=Data, 0=Command
-    PORTBbits.RB1 = 1;       
-    
-    for(i=0;i<=23040; i++)
+    if(!Asset_Blit("splash", 0, 120))
     {
-        PMDOUT = SplashImage[i*2];
-        while(PMMODEbits.BUSY == 1);    
+        //No image loaded yet
+        WriteString(170, 130, HeaderString, black, white);
     }
-    
-    //This must be here to prevent the Display /CS from remaining low
-    //after the function ends
-    PORTAbits.RA9 = 1;
 
     if(option == 1)
     {
@@ -140,59 +127,96 @@ void DrawHeader()
 
 void DrawMenu(void)
 {
-    int i;
-    
-    Display_CASET(100, 249);
-    Display_RASET(80, 229);
-    Display_RAMWR();
-
-    //Data
-    //RF3 = D/C 1=Data, 0=Command
-    PORTBbits.RB1 = 1;       
-
-    for(i=0;i<=22500; i++)
+    if(!Asset_Blit("menu", 100, 80))
     {
-        PMDOUT = DisplayMenu[i];
-        while(PMMODEbits.BUSY == 1);    
+        Display_Rect(100, 250, 80, 230, white);
     }
 
     WriteChar(192, 120, '5', black, white);
-    
-    //This must be here to prevent the Display /CS from remaining low
-    //after the function ends
-    PORTAbits.RA9 = 1;
-                    
 }
 
 void DrawCanvas(uint8_t screen_, uint32_t begin_xpos, uint32_t begin_ypos, uint32_t _count)
 {
-    uint32_t i;
     uint32_t array_begin;
-    uint32_t array_count;
+    const ASSET *asset;
     
     //CONFIG_SCREEN
     if(screen_ == CONFIG_SCREEN)    
     {        
-        //calculate the start position in the array
+        asset = Asset_Find("config");
+        if(asset == NULL)
+        {
+            return;
+        }
+        
+        //calculate the start position in the image
         array_begin = (((begin_ypos + 1) * 480) - (480 - (begin_xpos + 1))) - 1;
         
         //set the frame size to full screen
-        Display_CASET(0, 479);
-        Display_RASET(0, 319);
-        
-        //Enable display memory write
         //Data will be written until another command is received by the display
-        Display_RAMWR();
+        Display_Window(0, 479, 0, 319);
+
+        Asset_Stream(asset, array_begin, _count + 1);
+    }
+}
+
+//Core Timer ticks as us, dddd.d
+void DrawTicks(uint32_t ticks)
+{
+    ticks = ticks / 10;
+    if(ticks > 65535)
+    {
+        ticks = 65535;
+    }
+
+    Binary2ASCIIBCD(ticks);
+    WriteChar(hchar, vchar, d4, black, white);
+    WriteChar(hchar, vchar, d3, black, white);
+    WriteChar(hchar, vchar, d2, black, white);
+    WriteChar(hchar, vchar, d1, black, white);
+    WriteChar(hchar, vchar, '.', black, white);
+    WriteChar(hchar, vchar, d0, black, white);
+}
 
-        //Set Display Data Mode
-        //RF3 = D/C 1=Data, 0=Command
-        PORTBbits.RB1 = 1;       
+//ACK times of the boards, Peripherals.c
+void DrawLatency(void)
+{
+    PERIPHERAL_LATENCY *latency;
+    uint32_t timeouts;
+
+    hchar = 10;
+    vchar = 80;
+    WriteString(hchar, vchar, LatencyStr, black, white);
+
+    for(int i=0;i<7;i++)
+    {
+        latency = &PeripheralLatency[i];
+
+        hchar = 10;
+        vchar = vchar + 25;
+
+        WriteChar(hchar, vchar, '1' + i, blue, white);
+        hchar = hchar + 30;
 
-        for(i=0;i<=_count; i++)
+        DrawTicks(latency->min_ticks);
+        hchar = hchar + 15;
+        DrawTicks((latency->acks > 0) ? (latency->sum_ticks / latency->acks) : 0);
+        hchar = hchar + 15;
+        DrawTicks(latency->max_ticks);
+        hchar = hchar + 15;
+
+        timeouts = latency->timeouts;
+        if(timeouts > 65535)
         {
-            PMDOUT = ConfigImage[i + array_begin];
-            while(PMMODEbits.BUSY == 1);    
+            timeouts = 65535;
         }
+
+        Binary2ASCIIBCD(timeouts);
+        WriteChar(hchar, vchar, d4, (timeouts > 0) ? red : black, white);
+        WriteChar(hchar, vchar, d3, (timeouts > 0) ? red : black, white);
+        WriteChar(hchar, vchar, d2, (timeouts > 0) ? red : black, white);
+        WriteChar(hchar, vchar, d1, (timeouts > 0) ? red : black, white);
+        WriteChar(hchar, vchar, d0, (timeouts > 0) ? red : black, white);
     }
 }
 
@@ -257,6 +281,35 @@ void DrawScreen(uint8_t scrn, char title[])
 
             hchar = hchar + 15;
 
+            //How long the last SRAM test took (uS)
+            if((SRAMTest.ticks / 100) > 65535)
+            {
+                Binary2ASCIIBCD(65535);
+            }
+            else
+            {
+                Binary2ASCIIBCD(SRAMTest.ticks / 100);
+            }
+            WriteChar(hchar, vchar, d4, black, white);
+            WriteChar(hchar, vchar, d3, black, white);
+            WriteChar(hchar, vchar, d2, black, white);
+            WriteChar(hchar, vchar, d1, black, white);
+            WriteChar(hchar, vchar, d0, black, white);
+            WriteChar(hchar, vchar, 'u', black, white);
+            WriteChar(hchar, vchar, 'S', black, white);
+
+            //First failing address
+            if(SRAMTest.failures != 0)
+            {
+                hchar = hchar + 15;
+                Binary2ASCIIHex(SRAMTest.address);
+                WriteChar(hchar, vchar, '@', red, white);
+                WriteChar(hchar, vchar, d_hex[3], red, white);
+                WriteChar(hchar, vchar, d_hex[2], red, white);
+                WriteChar(hchar, vchar, d_hex[1], red, white);
+                WriteChar(hchar, vchar, d_hex[0], red, white);
+            }
+
             //Flash Size
             hchar = 10;
             vchar = vchar + 25;
@@ -274,6 +327,14 @@ void DrawScreen(uint8_t scrn, char title[])
             WriteChar(hchar, vchar, d_hex[1], black, white);
             WriteChar(hchar, vchar, d_hex[0], black, white);            
 
+            //Flash used (K)
+            hchar = hchar + 15;
+            Binary2ASCIIBCD(Flash_Map_Used() * 4);
+            WriteChar(hchar, vchar, d2, black, white);
+            WriteChar(hchar, vchar, d1, black, white);
+            WriteChar(hchar, vchar, d0, black, white);
+            WriteChar(hchar, vchar, 'K', black, white);
+
             hchar = 10;
             vchar = vchar + 25;
             
@@ -282,7 +343,7 @@ void DrawScreen(uint8_t scrn, char title[])
             
             hchar = hchar + 15;
             
-            for(int i=1;i<8;i++)
+            for(int i=0;i<7;i++)
             {            
                 Binary2ASCIIHex(PeripheralList[i]);
                 WriteChar(hchar, vchar, d_hex[1], blue, white);
@@ -319,20 +380,11 @@ void DrawScreen(uint8_t scrn, char title[])
             
         case CONFIG_SCREEN:
             
-            //Load Splash Image
+            //Load Config Image from the flash (Assets.c)
             /****************************/
-            Display_CASET(0, 479);
-            Display_RASET(0, 319);
-            Display_RAMWR();
-
-            //Data
-            //RF3 = D/C 1=Data, 0=Command
-            PORTBbits.RB1 = 1;       
-
-            for(int i=0;i<=153600; i++)
+            if(!Asset_Blit("config", 0, 0))
             {
-                PMDOUT = ConfigImage[i];
-                while(PMMODEbits.BUSY == 1);    
+                Display_CLRSCN(white);
             }
             
             break;
@@ -368,6 +420,8 @@ void DrawScreen(uint8_t scrn, char title[])
             
             WriteString(180, 50, ControlStr, black, white);
             
+            DrawLatency();
+            
             break;
     
         case ADC_SCREEN:
@@ -0,0 +1,322 @@
+/*********************************************************************
+    FileName:     	Service.c
+    Dependencies:	See #includes
+    Processor:		PIC32MZ
+    Hardware:		MainBrain MZ
+    Complier:		XC32 4.40
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        System Clock = 200 MHz
+
+    File Description:
+        Service requests from the I/O boards
+
+        The boards share one service request line, RA7, any board
+        pulls it low. A board writes the request in its mailbox
+        first (Mailbox.h, service count and code), so the falling
+        edge only says that some board wants something.
+
+        The falling edge interrupts (change notice on port A, ipl5),
+        the interrupt reads the 7 service counts and takes every
+        board whose count changed since the last scan. Each request
+        goes in the queue of its priority (the code, bits 0-1) with
+        the Core Timer count of the scan. A request of priority 3
+        also puts the board's next directive ahead of the others
+        (Directive_Urgent()). The edge flag is cleared before the
+        scan, an edge during the scan scans again.
+
+        Service_Get() takes the highest priority first, in the order
+        they came within a priority. When a queue is full the
+        request is dropped and counted.
+
+        Service_Dispatch() in the main loop takes every request that
+        way. A board that runs the mailbox has its response ring
+        emptied (Mailbox_Take()), each MAILBOX_SERVICE_DIRECTIVE
+        frame is a directive with the frame's payload as the command,
+        the other frames are kept for 0x7f (Mailbox.c). A request
+        alone runs nothing, offset 0 may still hold the last command
+        the host sent. The requests it handed on are kept for 0x7d,
+        the oldest go when more than SERVICE_DEPTH are waiting.
+
+        0x7d Service Requests
+            Request:  Byte 1     1 clears the counters first
+            Takes the requests Service_Dispatch() handed on.
+            Reply:    Byte 0     0x7d
+                      Byte 1     requests in this reply (0 - 7)
+                      Byte 2-5   requests
+                      Byte 6-9   scans
+                      Byte 10-13 requests dropped, queue full
+                      Byte 14-17 longest scan, Core Timer ticks
+                      Byte 18-   6 bytes per request, highest
+                                 priority first
+                                 +0      board
+                                 +1      code
+                                 +2-5    Core Timer count of the
+                                         scan
+                      Byte 60    requests still queued
+            All values are little endian.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <xc.h>
+#include "MainBrain.h"
+
+#define SERVICE_BOARDS          7
+#define SERVICE_LEVELS          4
+#define SERVICE_DEPTH           8
+
+//Requests in one reply
+#define SERVICE_REPORT_MAX      7
+
+SERVICE_STATS ServiceStats;
+
+static SERVICE_EVENT service_queue[SERVICE_LEVELS][SERVICE_DEPTH];
+static volatile uint8_t service_head[SERVICE_LEVELS];
+static volatile uint8_t service_tail[SERVICE_LEVELS];
+
+//Handed on by Service_Dispatch(), for 0x7d
+static SERVICE_EVENT service_done[SERVICE_DEPTH];
+static volatile uint8_t service_done_head;
+static volatile uint8_t service_done_tail;
+
+//Service count of each board at the last scan
+static uint8_t service_seen[SERVICE_BOARDS];
+
+void Service_Init(void)
+{
+    //RA7, service request from the boards
+    TRISAbits.TRISA7 = 1;
+
+    //Counts written before now are not requests
+    for(int i=0;i<SERVICE_BOARDS;i++)
+    {
+        service_seen[i] = REN70V05_RD((i * 0x400) + MAILBOX_SERVICE_COUNT);
+    }
+
+    CNCONAbits.ON = 1;
+    CNCONAbits.EDGEDETECT = 1;
+
+    //Falling edge of RA7
+    CNNEAbits.CNNEA7 = 1;
+    CNFACLR = 1 << 7;
+
+    IPC29bits.CNAIP = 5;
+    IPC29bits.CNAIS = 0;
+    IFS3bits.CNAIF = 0;
+    IEC3bits.CNAIE = 1;
+}
+
+static void Service_Post(uint8_t board, uint8_t code, uint32_t time)
+{
+    SERVICE_EVENT *event;
+    uint8_t level = code & 3;
+    uint8_t head = service_head[level];
+
+    ServiceStats.requests++;
+
+    if(level == 3)
+    {
+        Directive_Urgent(board);
+    }
+
+    if((uint8_t)(head - service_tail[level]) >= SERVICE_DEPTH)
+    {
+        ServiceStats.lost++;
+        return;
+    }
+
+    event = &service_queue[level][head % SERVICE_DEPTH];
+    event->board = board;
+    event->code = code;
+    event->time = time;
+
+    service_head[level] = head + 1;
+}
+
+//Interrupts off, the PMP taken
+static void Service_Scan(void)
+{
+    uint32_t start = _CP0_GET_COUNT();
+    uint32_t ticks;
+    uint32_t region;
+    uint8_t count;
+
+    ServiceStats.scans++;
+
+    for(int board=1;board<=SERVICE_BOARDS;board++)
+    {
+        region = (board - 1) * 0x400;
+
+        count = REN70V05_RD(region + MAILBOX_SERVICE_COUNT);
+        if(count == service_seen[board - 1])
+        {
+            continue;
+        }
+
+        //More than one since the last scan is one request, the
+        //code is the last one written
+        service_seen[board - 1] = count;
+
+        Service_Post(board, REN70V05_RD(region + MAILBOX_SERVICE_CODE), start);
+    }
+
+    ticks = _CP0_GET_COUNT() - start;
+    if(ticks > ServiceStats.scan_max)
+    {
+        ServiceStats.scan_max = ticks;
+    }
+}
+
+//Highest priority first, false when there is none
+bool Service_Get(SERVICE_EVENT *event)
+{
+    uint32_t status;
+    bool found = false;
+
+    status = __builtin_disable_interrupts();
+
+    for(int level=SERVICE_LEVELS-1;level>=0;level--)
+    {
+        if(service_head[level] != service_tail[level])
+        {
+            *event = service_queue[level][service_tail[level] % SERVICE_DEPTH];
+            service_tail[level]++;
+            found = true;
+            break;
+        }
+    }
+
+    __builtin_mtc0(12, 0, status);
+
+    return found;
+}
+
+//Main loop, every queued request is kept for 0x7d and runs the
+//directives the board posted
+void Service_Dispatch(void)
+{
+    SERVICE_EVENT event;
+    uint32_t status;
+
+    while(Service_Get(&event))
+    {
+        Mailbox_Take(event.board);
+
+        status = __builtin_disable_interrupts();
+
+        if((uint8_t)(service_done_head - service_done_tail) >= SERVICE_DEPTH)
+        {
+            service_done_tail++;
+        }
+        service_done[service_done_head % SERVICE_DEPTH] = event;
+        service_done_head++;
+
+        __builtin_mtc0(12, 0, status);
+    }
+}
+
+//Interrupts off
+static bool Service_Done(SERVICE_EVENT *event)
+{
+    if(service_done_head == service_done_tail)
+    {
+        return false;
+    }
+
+    *event = service_done[service_done_tail % SERVICE_DEPTH];
+    service_done_tail++;
+
+    return true;
+}
+
+static void Service_Put32(volatile uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+void Service_Report(void)
+{
+    SERVICE_EVENT event;
+    volatile uint8_t *entry;
+    uint32_t status;
+    uint8_t count = 0;
+
+    for(int i=0;i<64;i++)
+    {
+        EP[2].tx_buffer[i] = 0;
+    }
+
+    status = __builtin_disable_interrupts();
+
+    if(EP[1].rx_buffer[1] == 1)
+    {
+        ServiceStats.requests = 0;
+        ServiceStats.scans = 0;
+        ServiceStats.lost = 0;
+        ServiceStats.scan_max = 0;
+    }
+
+    EP[2].tx_buffer[0] = 0x7d;
+    Service_Put32(&EP[2].tx_buffer[2], ServiceStats.requests);
+    Service_Put32(&EP[2].tx_buffer[6], ServiceStats.scans);
+    Service_Put32(&EP[2].tx_buffer[10], ServiceStats.lost);
+    Service_Put32(&EP[2].tx_buffer[14], ServiceStats.scan_max);
+
+    while((count < SERVICE_REPORT_MAX) && Service_Done(&event))
+    {
+        entry = &EP[2].tx_buffer[18 + (count * 6)];
+
+        entry[0] = event.board;
+        entry[1] = event.code;
+        Service_Put32(&entry[2], event.time);
+
+        count++;
+    }
+
+    EP[2].tx_buffer[1] = count;
+    EP[2].tx_buffer[60] = (uint8_t)(service_done_head - service_done_tail);
+
+    __builtin_mtc0(12, 0, status);
+
+    EP2_TX(EP[2].tx_buffer);
+}
+
+//RA7 fell
+void __attribute__((vector(_CHANGE_NOTICE_A_VECTOR), interrupt(ipl5srs), nomips16)) CNA_ISR()
+{
+    REN70V05_PMP_STATE state;
+    uint32_t status;
+
+    //First, a request during the scan comes back here
+    CNFACLR = 1 << 7;
+    IFS3bits.CNAIF = 0;
+
+    status = __builtin_disable_interrupts();
+
+    REN70V05_PMP_Take(&state);
+    Service_Scan();
+    REN70V05_PMP_Give(&state);
+
+    __builtin_mtc0(12, 0, status);
+}
@@ -64,9 +64,10 @@ void TMR2_init(void)
     T2CONbits.ON = 1;
 }
 
+//Directive time out, Directive_Init() sets it up
 void TMR3_init(void)
 {
-    IPC3bits.T3IP = 7;
+    IPC3bits.T3IP = 5;
     IPC3bits.T3IS = 1;
     
     IEC0bits.T3IE = 0;
@@ -105,6 +106,20 @@ void TMR6_init(void)
     IFS0bits.T6IF = 0;
 }
 
+//Flash jobs tick, 250 us (PBCLK3 200 MHz / 4 = 50 MHz, 12500 counts)
+void TMR7_init(void)
+{
+    T7CON = 0;
+    T7CONbits.TCKPS = 2;
+    TMR7 = 0;
+    PR7 = 12499;
+    IPC8bits.T7IP = 3;
+    IPC8bits.T7IS = 0;
+    IFS1bits.T7IF = 0;
+    IEC1bits.T7IE = 1;
+    T7CONbits.ON = 1;
+}
+
 //Timer 1
 void __attribute__((vector(_TIMER_1_VECTOR), interrupt(ipl6srs), nomips16)) TMR1_handler()
 {
@@ -123,6 +138,9 @@ void __attribute__((vector(_TIMER_1_VECTOR), interrupt(ipl6srs), nomips16)) TMR1
     
     while (ADCDSTAT1bits.ARDY6 == 0);
     ADC6_result = ADCDATA6;
+    
+    //Feed the scope stream with the raw conversions
+    Scope_Capture(ADC0_result, ADCDATA6);
 
     //Clear interrupt flag
     IFS0bits.T1IF = 0;
@@ -135,9 +153,11 @@ void __attribute__((vector(_TIMER_2_VECTOR), interrupt(ipl6srs), nomips16)) TMR2
     IFS0bits.T2IF = 0;
 }
 
-//Timer 3
-void __attribute__((vector(_TIMER_3_VECTOR), interrupt(ipl6srs), nomips16)) TMR3_handler()
+//Timer 3, a directive timed out
+void __attribute__((vector(_TIMER_3_VECTOR), interrupt(ipl5srs), nomips16)) TMR3_handler()
 {
+    Directive_Tick();
+    
     //Clear interrupt flag
     IFS0bits.T3IF = 0;
 }
@@ -174,3 +194,12 @@ void __attribute__((vector(_TIMER_6_VECTOR), interrupt(ipl5srs), nomips16)) TMR6
     IFS0bits.T6IF = 0;
 }
 
+//Timer 7
+void __attribute__((vector(_TIMER_7_VECTOR), interrupt(ipl3srs), nomips16)) TMR7_handler()
+{
+    Flash_Jobs_Tick();
+    
+    //Clear interrupt flag
+    IFS1bits.T7IF = 0;
+}
+
@@ -14,6 +14,8 @@
         Uses Microsoft OS Descriptors to load a Winusb driver,
         Endpoint 1 is the receiving endpoint,
         Endpoint 2 is the transmitting endpoint,
+        Endpoint 3 streams scope samples (High Bandwidth Interrupt),
+        Endpoint 0 also answers vendor requests (status, SRAM read/write),
         Host application sends commands to the device, 
         Device responds to the commands by sending requested data to the Host
 
@@ -57,9 +59,10 @@ typedef struct
 
 USB_TRANSACTION USB_transaction;
 
-USB_ENDPOINT EP[3];
+//Coherent, the SRAM bridge moves the packets by DMA
+USB_ENDPOINT __attribute__((coherent)) EP[3];
 
-uint8_t device_descriptor[] = 
+const uint8_t device_descriptor[] = 
 {
     /* Descriptor Length			*/ 0x12, //Size of this descriptor in bytes
     /* DescriptorType: DEVICE			*/ 0x01,
@@ -77,12 +80,12 @@ uint8_t device_descriptor[] =
     /* bNumConfigurations			*/ 0x01
 };
 
-uint8_t config_descriptor[] = 
+const uint8_t config_descriptor[] = 
 {
     // Configuration Descriptor
     0x09,                       //Descriptor size in bytes
     0x02,                       //Descriptor type
-    0x20,0x00,                  //Total length of data
+    0x27,0x00,                  //Total length of data
     0x01,                       //Number of interfaces
     0x01,                       //Index value of this configuration
     0x00,                       //Configuration string index
@@ -94,7 +97,7 @@ uint8_t config_descriptor[] =
     0x04,                       // INTERFACE descriptor type
     0x00,                       // Interface Number
     0x00,                       // Alternate Setting Number
-    0x02,                       // Number of endpoints in this intf
+    0x03,                       // Number of endpoints in this intf
     0x00,                       // Class code
     0x00,                       // Subclass code
     0x00,                       // Protocol code
@@ -114,10 +117,17 @@ uint8_t config_descriptor[] =
     0x82,                       //EndpointAddress
     0x02,                       //Attributes
     0x40,0x00,                  //size
-    0x00                        //Interval
+    0x00,                       //Interval
+    //EP03 IN - Scope
+    0x07,                       //Size of this descriptor in bytes
+    0x05,                       //Endpoint Descriptor
+    0x83,                       //EndpointAddress
+    0x03,                       //Attributes (Interrupt)
+    0x00,0x0a,                  //size (512 bytes, 2 transactions per microframe)
+    0x01                        //Interval (every microframe)
 };
 
-uint8_t device_qualifier[] = 
+const uint8_t device_qualifier[] = 
 {
     0x0a,                       //Size of this descriptor in bytes
     0x06,                       //Descriptor type (0x06)
@@ -130,7 +140,7 @@ uint8_t device_qualifier[] =
     0x00                        //Reserved
 };
 
-uint8_t MSOSDescriptor[] =
+const uint8_t MSOSDescriptor[] =
 {   
     //bLength - length of this descriptor in bytes
     0x0b,                           
@@ -147,7 +157,7 @@ uint8_t MSOSDescriptor[] =
 };    
 
 //Extended Compatability ID Feature Descriptor
-uint8_t ExtCompatIDFeatureDescriptor[] =
+const uint8_t ExtCompatIDFeatureDescriptor[] =
 {
     0x28, 0x00, 0x00, 0x00,                             /* dwLength Length of this descriptor */
     0x00, 0x01,                                         /* bcdVersion = Version 1.0 */
@@ -161,7 +171,7 @@ uint8_t ExtCompatIDFeatureDescriptor[] =
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00                  /* Reserved */
 };
     
-uint8_t ExtPropertyFeatureDescriptor[] =
+const uint8_t ExtPropertyFeatureDescriptor[] =
 {
     //----------Header Section--------------
     0x8e, 0x00, 0x00, 0x00,                             //dwLength (4 bytes)
@@ -187,21 +197,68 @@ uint8_t ExtPropertyFeatureDescriptor[] =
 };    
 
 //Language - 0x0409 - English
-uint8_t string0[] =  {4, 0x03, 0x09, 0x04};
+const uint8_t string0[] =  {4, 0x03, 0x09, 0x04};
 
 //iManufacturer
-uint8_t string1[] = {28, 3, 'A', 0, 'n', 0, 't', 0, 'i', 0, 'm', 0, 'a', 0, 't', 0, 't', 0, 'e', 0, 'r', 0, '.', 0, 'm', 0, 'e', 0};   
+const uint8_t string1[] = {28, 3, 'A', 0, 'n', 0, 't', 0, 'i', 0, 'm', 0, 'a', 0, 't', 0, 't', 0, 'e', 0, 'r', 0, '.', 0, 'm', 0, 'e', 0};   
 
 //iProduct	
-uint8_t string2[] = {26, 3, 'M', 0, 'a', 0, 'i', 0, 'n', 0, 'B', 0, 'r', 0, 'a', 0, 'i', 0, 'n', 0, ' ', 0, 'M', 0, 'Z', 0};
+const uint8_t string2[] = {26, 3, 'M', 0, 'a', 0, 'i', 0, 'n', 0, 'B', 0, 'r', 0, 'a', 0, 'i', 0, 'n', 0, ' ', 0, 'M', 0, 'Z', 0};
  
 //iSerialNumber	
-uint8_t string3[] = {10, 3, '0', 0, '0', 0, '0', 0, '1', 0};
+const uint8_t string3[] = {10, 3, '0', 0, '0', 0, '0', 0, '1', 0};
+
+//GET_STATUS - bus powered, no remote wakeup
+const uint8_t device_status[] = {0x00, 0x00};
+
+//Vendor requests
+#define VENDOR_READ_STATUS      0x01
+#define VENDOR_READ_SRAM        0x02
+#define VENDOR_WRITE_SRAM       0x03
+#define VENDOR_READ_LOCKS       0x04
+#define VENDOR_READ_COLLISIONS  0x05
+#define VENDOR_READ_EVENTS      0x06
+#define VENDOR_READ_SHADOW      0x07
+#define VENDOR_READ_FLASH_JOBS  0x08
+#define VENDOR_READ_FLASH_STALLS 0x09
+#define VENDOR_READ_FLASH_CACHE 0x0a
+
+//Largest vendor request data stage
+#define EP0_BUFFER_SIZE         512
+
+//Read SRAM and Write SRAM stop at the end of the 70V05, Read SRAM
+//before the mailbox interrupt word (reading it clears a board's
+//interrupt)
+#define VENDOR_SRAM_SIZE        0x2000
+#define VENDOR_SRAM_READ_END    0x1fff
+
+typedef enum
+{
+    EP0_IDLE,
+    EP0_DATA_IN,
+    EP0_DATA_OUT,
+    EP0_STATUS
+} EP0_STATE;
+
+static volatile EP0_STATE ep0_state = EP0_IDLE;
+static const uint8_t *ep0_tx_data;
+static uint16_t ep0_tx_remaining;
+static bool ep0_tx_zlp;
+static uint8_t *ep0_rx_data;
+static uint16_t ep0_rx_remaining;
+static void (*ep0_rx_done)(void);
+static bool ep0_stall;
+static uint8_t ep0_buffer[EP0_BUFFER_SIZE];
 
 void EP0_control_transaction(void);
-void USB_queue_EP0(uint8_t *buffer, int size, int max_size);
-void EP0_RX(int length);
+void EP0_Service(void);
+void EP0_Setup(void);
+void EP0_Send(const uint8_t *data, uint16_t size);
+void EP0_Receive(uint8_t *buffer, uint16_t size, void (*done)(void));
+void EP0_Stall(void);
+void EP0_RX(void);
 void EP0_TX(void);
+void Vendor_Request(void);
 void Host_CMDs(void);
 
 int runCount = 0;
@@ -257,12 +314,23 @@ void USB_init(void)
     USBIENCSR2bits.TEP = 0x02;
     USBIENCSR0bits.FLUSH = 1;
 
+    //EP 3
+    USBCSR3bits.ENDPOINT = 3;
+    
+    //TX - 1024 byte FIFO holds one full scope frame
+    USBOTGbits.TXFIFOSZ = 0x07;
+    USBFIFOAbits.TXFIFOAD = 0x0100;
+    USBIENCSR0bits.FLUSH = 1;
+
     //Endpoint 1 is RX
     USBE1CSR0bits.MODE = 0;
     
     //Endpoint 2 is TX
     USBE2CSR0bits.MODE = 1;
     
+    //Endpoint 3 is TX
+    USBE3CSR0bits.MODE = 1;
+    
     // Set endpoint 0 buffer to 64 bytes (multiples of 8).
     USBE0CSR0bits.TXMAXP = 64; 
 
@@ -304,6 +372,9 @@ void USB_init(void)
 //USB
 void __attribute__((vector(_USB_VECTOR), interrupt(ipl7srs), nomips16)) USB_handler()
 {       
+    //Timestamp for the benchmark commands
+    Bench_ISR_Enter();
+    
     //Reset
     if(USBCSR2bits.RESETIF)
     {
@@ -333,6 +404,22 @@ void __attribute__((vector(_USB_VECTOR), interrupt(ipl7srs), nomips16)) USB_hand
         //01 = Isochronous
         //00 = Control
         
+        // Endpoint 3 - Scope stream
+        // 512 bytes with one additional transaction per microframe
+        USBE3CSR0bits.MODE = 1;
+        USBE3CSR0bits.TXMAXP = 512;
+        USBE3CSR0bits.MULT = 1;
+        USBE3CSR2bits.SPEED = 1;
+        USBE3CSR2bits.PROTOCOL = 3;
+        USBE3CSR2bits.TEP = 3;
+        USBE3CSR3bits.TXINTERV = 1;
+        
+        // Any stream or control transfer in progress ends with the reset
+        Scope_Stop();
+        ep0_state = EP0_IDLE;
+        BenchSourceRemaining = 0;
+        USBCSR1bits.EP2TXIE = 0;
+        
         USBCSR1bits.EP1TXIE = 1;    // Endpoint 1 TX interrupt enable
         USBCSR2bits.EP1RXIE = 1;    // Endpoint 1 RX interrupt enable
                     
@@ -350,29 +437,7 @@ void __attribute__((vector(_USB_VECTOR), interrupt(ipl7srs), nomips16)) USB_hand
             SetAddress = false;
         }
         
-        if(USBE0CSR0bits.RXRDY)
-        {
-            EP0_RX(USBE0CSR2bits.RXCNT);
-            
-            USB_transaction.bmRequestType = EP[0].rx_buffer[0];
-            USB_transaction.bRequest = EP[0].rx_buffer[1];
-            USB_transaction.wValue = (int)(EP[0].rx_buffer[3] << 8) | EP[0].rx_buffer[2];
-            USB_transaction.wIndex = (int)(EP[0].rx_buffer[5] << 8) | EP[0].rx_buffer[4];
-            USB_transaction.wLength = (int)(EP[0].rx_buffer[7] << 8) | EP[0].rx_buffer[6];
-            
-            EP0_control_transaction();
-            
-            // End of Data Control bit (Device mode) 
-            if (USB_transaction.wLength == 0)
-            {
-                USBE0CSR0bits.DATAEND = 1; 
-            }
-        }
-                
-        if (USBE0CSR0bits.SETEND) 
-        {
-            USBE0CSR0bits.SETENDC = 1;
-        }
+        EP0_Service();
         
         // Clear the USB EndPoint 0 Interrupt Flag.
         USBCSR0bits.EP0IF = 0;  
@@ -387,15 +452,43 @@ void __attribute__((vector(_USB_VECTOR), interrupt(ipl7srs), nomips16)) USB_hand
 	
         USBCSR1bits.EP1RXIF = 0;
     }
+    
+    //Endpoint 2 TX complete - only enabled while the benchmark source runs
+    if(USBCSR0bits.EP2TXIF == 1)
+    {
+        Bench_Source_Next();
+        
+        USBCSR0bits.EP2TXIF = 0;
+    }
+    
+    //Start of Frame - paces the scope stream on Endpoint 3
+    if(USBCSR2bits.SOFIF == 1)
+    {
+        Scope_Service();
+        
+        USBCSR2bits.SOFIF = 0;
+    }
 
     IFS4bits.USBIF = 0;   
+    
+    //The main loop shares the PMP, no SRAM burst outlives the interrupt
+    SRAM_DMA_Wait();
+    
+    Bench_ISR_Exit();
 }
 
 void Host_CMDs()
 {
   uint8_t test;
+  uint8_t sequence[16];
   uint8_t SeqNum;
   
+  //Packets for the sink benchmark are counted, not dispatched
+  if(Bench_Sink())
+  {
+      return;
+  }
+  
   switch (EP[1].rx_buffer[0])
   {
       //connected
@@ -428,6 +521,10 @@ void Host_CMDs()
       //Back light
       case 0x03:
           Backlight_Control(EP[1].rx_buffer[1]); 
+          
+          //Saved by the main loop
+          default_Display_Brightness = EP[1].rx_buffer[1];
+          SaveBrightness = true;
         break;
         
     
@@ -441,8 +538,11 @@ void Host_CMDs()
           
       case 0x06:
           //Run Sequence
+          //The host takes over from Motion.c
+          Motion_Stop();
+          
           //Motion Command Byte
-          REN70V05_WR(0x3ff, EP[1].rx_buffer[1]) ;
+          SRAM_Shadow_WR(0x3ff, EP[1].rx_buffer[1]) ;
         break;
         
       case 0x07:    
@@ -456,11 +556,13 @@ void Host_CMDs()
                         
       case 0x09:
           //Update Button
+          Motion_Stop();
+          
           //Update Speed
-          REN70V05_WR(0x3f8, EP[1].rx_buffer[1]) ;
+          SRAM_Shadow_WR(0x3f8, EP[1].rx_buffer[1]) ;
           
           //Update Direction
-          REN70V05_WR(0x3ff, EP[1].rx_buffer[2]) ;
+          SRAM_Shadow_WR(0x3ff, EP[1].rx_buffer[2]) ;
           
         break;
 
@@ -469,58 +571,49 @@ void Host_CMDs()
           //Sequence Number
           SeqNum = (EP[1].rx_buffer[1]) - 1;
 
-          REN70V05_WR(0x300 + (SeqNum * seqSize), EP[1].rx_buffer[1]) ;
-          //Flash_WR(0x300 + (SeqNum * seqSize), EP[1].rx_buffer[1]);
-                  
+          //Sequence Number
+          sequence[0] = EP[1].rx_buffer[1];
+          
           //Sequence Direction
-          REN70V05_WR(0x307 + (SeqNum * seqSize), EP[1].rx_buffer[2]) ;
-          //Flash_WR(0x307 + (SeqNum * seqSize), EP[1].rx_buffer[2]);
+          sequence[7] = EP[1].rx_buffer[2];
           
           //Sequence Acceleration
-          REN70V05_WR(0x306 + (SeqNum * seqSize), EP[1].rx_buffer[3]) ;
-          //Flash_WR(0x306 + (SeqNum * seqSize), EP[1].rx_buffer[3]);
+          sequence[6] = EP[1].rx_buffer[3];
           
           //Sequence Speed
-          REN70V05_WR(0x308 + (SeqNum * seqSize), EP[1].rx_buffer[4]) ;
-          //Flash_WR(0x308 + (SeqNum * seqSize), EP[1].rx_buffer[4]);
+          sequence[8] = EP[1].rx_buffer[4];
           
           //Sequence Deceleration
-          REN70V05_WR(0x301 + (SeqNum * seqSize), EP[1].rx_buffer[5]) ;
-          //Flash_WR(0x301 + (SeqNum * seqSize), EP[1].rx_buffer[5]);
+          sequence[1] = EP[1].rx_buffer[5];
           
           //Sequence Run Distance
-          REN70V05_WR(0x302 + (SeqNum * seqSize), EP[1].rx_buffer[6]) ;
-          REN70V05_WR(0x303 + (SeqNum * seqSize), EP[1].rx_buffer[7]) ;
-          REN70V05_WR(0x304 + (SeqNum * seqSize), EP[1].rx_buffer[8]) ;
-          REN70V05_WR(0x305 + (SeqNum * seqSize), EP[1].rx_buffer[9]) ;
-                   
-          //Flash_WR(0x302 + (SeqNum * seqSize), EP[1].rx_buffer[6]);
-          //Flash_WR(0x303 + (SeqNum * seqSize), EP[1].rx_buffer[7]);
-          //Flash_WR(0x304 + (SeqNum * seqSize), EP[1].rx_buffer[8]);
-          //Flash_WR(0x305 + (SeqNum * seqSize), EP[1].rx_buffer[9]);
+          sequence[2] = EP[1].rx_buffer[6];
+          sequence[3] = EP[1].rx_buffer[7];
+          sequence[4] = EP[1].rx_buffer[8];
+          sequence[5] = EP[1].rx_buffer[9];
 
           //Sequence Stop Distance
-          REN70V05_WR(0x309 + (SeqNum * seqSize), EP[1].rx_buffer[10]) ;
-          REN70V05_WR(0x30a + (SeqNum * seqSize), EP[1].rx_buffer[11]) ;
-          REN70V05_WR(0x30b + (SeqNum * seqSize), EP[1].rx_buffer[12]) ;
-          REN70V05_WR(0x30c + (SeqNum * seqSize), EP[1].rx_buffer[13]) ;
-
-          //Flash_WR(0x309 + (SeqNum * seqSize), EP[1].rx_buffer[10]);
-          //Flash_WR(0x30a + (SeqNum * seqSize), EP[1].rx_buffer[11]);
-          //Flash_WR(0x30b + (SeqNum * seqSize), EP[1].rx_buffer[12]);
-          //Flash_WR(0x30c + (SeqNum * seqSize), EP[1].rx_buffer[13]);
+          sequence[9] = EP[1].rx_buffer[10];
+          sequence[10] = EP[1].rx_buffer[11];
+          sequence[11] = EP[1].rx_buffer[12];
+          sequence[12] = EP[1].rx_buffer[13];
 
           //Delay between Sequences
-          REN70V05_WR(0x30d + (SeqNum * seqSize), EP[1].rx_buffer[14]) ;
-          //Flash_WR(0x30d + (SeqNum * seqSize), EP[1].rx_buffer[14]);
+          sequence[13] = EP[1].rx_buffer[14];
           
           //Total Number of Sequences to run
-          REN70V05_WR(0x30e + (SeqNum * seqSize), EP[1].rx_buffer[15]) ;
-          //Flash_WR(0x30e + (SeqNum * seqSize), EP[1].rx_buffer[15]);
+          sequence[14] = EP[1].rx_buffer[15];
           
           //seqLoop
-          REN70V05_WR(0x30f + (SeqNum * seqSize), EP[1].rx_buffer[16]) ;
-          //Flash_WR(0x30f + (SeqNum * seqSize), EP[1].rx_buffer[16]);
+          sequence[15] = EP[1].rx_buffer[16];
+          
+          SRAM_Shadow_Write(0x300 + (SeqNum * seqSize), sequence, seqSize);
+          
+          //Saved to flash by the main loop
+          if(SeqNum < FLASH_KV_SEQUENCES)
+          {
+              SaveSequence[SeqNum] = true;
+          }
 
           NeedsRefresh = false;
           
@@ -529,11 +622,38 @@ void Host_CMDs()
 	case 0x0b:
 	    screen = DEBUG_SCREEN;
 	    break;
+	    
+      //Benchmark - Loopback
+      case 0x10:
+          Bench_Loopback();
+        break;
+        
+      //Benchmark - Source
+      case 0x11:
+          Bench_Source_Start();
+        break;
+        
+      //Benchmark - Sink
+      case 0x12:
+          Bench_Sink_Start();
+        break;
+        
+      //Benchmark - Report
+      case 0x13:
+          Bench_Report();
+        break;
+        
+      //Benchmark - SRAM byte vs block access
+      case 0x14:
+          Bench_SRAM();
+        break;
+        
       //This is where we send the full 64 bytes of data whenever the 
       //Host requests it
       case 0x64:	  	
 
-	//read the current board data into the tx buffer
+	//start reading the current board data into the tx buffer,
+	//the burst runs while the ADC values are converted
 	SRAM2USB();	
 	//REN70V05_WR(((((current_board_address) - 1) * 0x400) + 10), 0x89);  
 	
@@ -562,12 +682,8 @@ void Host_CMDs()
         EP[2].tx_buffer[5] = converter.bytes[2];          
         EP[2].tx_buffer[4] = converter.bytes[3];
         
-	REN70V05_RD(((((current_board_address) - 1) * 0x400) + 10));
-	EP[2].tx_buffer[10] = mdata_70V05;
-	
-	//return the status data
-	REN70V05_RD(((((current_board_address) - 1) * 0x400) + 20));
-	EP[2].tx_buffer[20] = mdata_70V05;
+	//the board data, including the status data at 20, is in place
+	SRAM_DMA_Wait();
 	
 //        //Motion data
 //        //PWM Frequency        
@@ -690,10 +806,9 @@ void Host_CMDs()
     *****************************************/
     //Command 0 - Send byte to board
     case 0x65:	
-	//transfer USB data to SRAM
-	BoardData2SRAM();
+	//USB data to the board's queue, SRAM when its turn comes
+	BoardData2Directive(true);
 	
-	requestDirective = 1;
 	NeedsRefresh = true;
 	screen = BOARD_SCREEN;
 	cmd = 0x65;
@@ -702,10 +817,9 @@ void Host_CMDs()
 	
     //Command 2 - Set DAC
     case 0x67:
-	//transfer USB data to SRAM
-	BoardData2SRAM();
+	//USB data to the board's queue, SRAM when its turn comes
+	BoardData2Directive(true);
 	
-	requestDirective = 1;
 	NeedsRefresh = true;
 	screen = BOARD_SCREEN;
 	cmd = 0x67;
@@ -731,10 +845,9 @@ void Host_CMDs()
 	
     //Command 4 - DAC - Wave Form
     case 0x69:
-	//transfer USB data to SRAM
-	BoardData2SRAM();
+	//USB data to the board's queue, SRAM when its turn comes
+	BoardData2Directive(true);
 	
-	requestDirective = 1;
 	NeedsRefresh = true;
 	screen = BOARD_SCREEN;
 	cmd = 0x69;
@@ -748,11 +861,8 @@ void Host_CMDs()
 	
 	//ADC Read Value
   case 0x6a:
-	//transfer USB data to SRAM
-	BoardData2SRAM();
-
 	//sends command to current board to write it's data to the SRAM
-	requestDirective = 1;
+	BoardData2Directive(true);
 	
 	//Set the current Screen
 	screen = ADC_SCREEN;
@@ -768,10 +878,8 @@ void Host_CMDs()
 	//Send Command
 	current_board_address = EP[1].rx_buffer[1];
 	
-	REN70V05_WR(((((current_board_address) - 1) * 0x400)), EP[1].rx_buffer[0]);
-	
 	//sends command to current board to write it's data to the SRAM
-	requestDirective = 1;
+	Directive_Submit(current_board_address, (const uint8_t *)EP[1].rx_buffer, 1, true);
 	
 	//Set the current Screen
 	screen = ADC_SCREEN;
@@ -782,10 +890,9 @@ void Host_CMDs()
       
 	//Switches
   case 0x6c:
-	//transfer USB data to SRAM
-	BoardData2SRAM();
+	//USB data to the board's queue, SRAM when its turn comes
+	BoardData2Directive(true);
 	
-	requestDirective = 1;
 	NeedsRefresh = true;
 	screen = BOARD_SCREEN;
 	cmd = 0x6c;
@@ -796,24 +903,22 @@ void Host_CMDs()
   case 0x6d:
 	current_board_address = EP[1].rx_buffer[1];
 
-	//transfer USB data to SRAM
-	BoardData2SRAM();
+	//USB data to the board's queue, SRAM when its turn comes
+	BoardData2Directive(false);
 
 	requestDirective = 0;
 	NeedsRefresh = true;
 	screen = BOARD_SCREEN;
 	cmd = 0x6d;
-	Directive(current_board_address);
 	break;
 
 	//Write Flash
   case 0x6e:
 	current_board_address = EP[1].rx_buffer[1];
 
-	//transfer USB data to SRAM
-	BoardData2SRAM();
+	//USB data to the board's queue, SRAM when its turn comes
+	BoardData2Directive(true);
 
-	requestDirective = 1;
 	NeedsRefresh = true;
 	screen = BOARD_SCREEN;
 	cmd = 0x6e;
@@ -824,10 +929,9 @@ void Host_CMDs()
   case 0x6f:
 	current_board_address = EP[1].rx_buffer[1];
 
-	//transfer USB data to SRAM
-	BoardData2SRAM();
+	//USB data to the board's queue, SRAM when its turn comes
+	BoardData2Directive(true);
 
-	requestDirective = 1;
 	NeedsRefresh = true;
 	screen = BOARD_SCREEN;
 	cmd = 0x6f;
@@ -837,10 +941,9 @@ void Host_CMDs()
   case 0x70:
 	current_board_address = EP[1].rx_buffer[1];
 
-	//transfer USB data to SRAM
-	BoardData2SRAM();
+	//USB data to the board's queue, SRAM when its turn comes
+	BoardData2Directive(true);
 
-	requestDirective = 1;
 	NeedsRefresh = true;
 	screen = SCOPE_SCREEN;
 	cmd = 0x70;
@@ -851,10 +954,9 @@ void Host_CMDs()
   case 0x71:
 	current_board_address = EP[1].rx_buffer[1];
 
-	//transfer USB data to SRAM
-	BoardData2SRAM();
+	//USB data to the board's queue, SRAM when its turn comes
+	BoardData2Directive(true);
 
-	requestDirective = 1;
 	NeedsRefresh = true;
 	screen = BOARD_SCREEN;
 	cmd = 0x71;
@@ -903,42 +1005,139 @@ void Host_CMDs()
 	    }
 	}
 	
-	//transfer USB data to SRAM
-	USB2SRAM();
-
-	//Write the command to address 0x00 each time
-	REN70V05_WR((((current_board_address) - 1) * 0x400),EP[1].rx_buffer[0]);
-
-	//This initiates an I/O cycle
-	Directive(current_board_address);
+	//The packet, command at address 0x00, goes to the board's
+	//region when its turn comes
+	BoardData2Directive(false);
 	
 	break;
 	
    case 0x73:
        current_board_address = EP[1].rx_buffer[1];
-	//transfer USB data to SRAM
-	USB2SRAM();
-
-//	//Write the command to address 0x00 each time
-//	REN70V05_WR((((current_board_address) - 1) * 0x400),EP[1].rx_buffer[0]);
-//
-	//This initiates an I/O cycle
-	Directive(current_board_address);
+	//The packet goes to the board's region when its turn comes
+	BoardData2Directive(false);
 	
        break;
+
+	//Scope Stream
+	//rx_buffer[1] = channel mask, 0 stops the stream
+  case 0x74:
+	if(EP[1].rx_buffer[1] == 0)
+	{
+	    Scope_Stop();
+	}
+	else
+	{
+	    Scope_Start(EP[1].rx_buffer[1]);
+	    screen = SCOPE_SCREEN;
+	}
+	break;
+
+	//Memory Test
+	//rx_buffer[1] = 0 quick, 1 thorough
+  case 0x75:
+	SRAM_Test_Request();
+	break;
+
+	//Flash Used
+	//rx_buffer[1] = 1 scans the flash first
+  case 0x76:
+	Flash_Map_Report();
+	break;
+
+	//Asset Begin
+	//rx_buffer[1-4] = length of the new asset store
+  case 0x77:
+	Asset_Begin_Report();
+	break;
+
+	//Asset Write
+	//rx_buffer[1-3] = offset, [4] = bytes, [5-] = the bytes
+  case 0x78:
+	Asset_Write_Report();
+	break;
+
+	//Asset Status
+	//rx_buffer[1] = 1 checks the written store
+  case 0x79:
+	Asset_Status_Report();
+	break;
+
+	//Directive Stats
+	//rx_buffer[1] = 1 sets the priorities to [2-8], 2 clears
+  case 0x7a:
+	Directive_Stats_Report();
+	break;
+
+	//Peripherals
+	//rx_buffer[1] = 1 probes every board again
+  case 0x7b:
+	Peripheral_Report();
+	break;
+
+	//Board Latency
+	//rx_buffer[1] = board, [2] = 1 clears its counts
+  case 0x7c:
+	Peripheral_Latency_Report();
+	break;
+
+	//Service Requests
+	//rx_buffer[1] = 1 clears the counters
+  case 0x7d:
+	Service_Report();
+	break;
+
+	//Motion
+	//rx_buffer[1] = 0 read, 1 run, 2 stop, 3 clear the timing
+	//rx_buffer[2] = first record, rx_buffer[3] = 1 S-curve
+  case 0x7e:
+	Motion_Report();
+	break;
+
+	//Mailbox
+	//rx_buffer[1] = board, [2] = 1 posts [3] command, [4] tag,
+	//[5] length, [6-] payload
+  case 0x7f:
+	Mailbox_Request();
+	break;
+
+	//Flash Program Begin
+	//rx_buffer[1-3] = flash address, [4-7] = length of the image
+  case 0x80:
+	Flash_Program_Begin_Report();
+	break;
+
+	//Flash Program Data
+	//rx_buffer[1-3] = offset, [4] = bytes, [5-] = the bytes
+  case 0x81:
+	Flash_Program_Data_Report();
+	break;
+
+	//Flash Program Status
+	//rx_buffer[1] = 1 stops the image
+  case 0x82:
+	Flash_Program_Status_Report();
+	break;
+
   default:
       //default
       break;	
   }
+  
+    //What the command wrote goes out in one go
+    SRAM_Shadow_FlushAll();
+    
     updated = true;
 }
 
 //DEBUG
 void dumpMem(void)
 {
+    uint8_t board[7];
+    
+    SRAM_Shadow_Read((((current_board_address) - 1) * 0x400), board, sizeof(board));
+    
     //Command
-    REN70V05_RD((((current_board_address) - 1) * 0x400) + 0);
-    Binary2ASCIIHex(mdata_70V05);
+    Binary2ASCIIHex(board[0]);
     WriteChar(40, 10, 'M', black, white);
     WriteChar(55, 10, d_hex[1], black, white);
     WriteChar(70, 10, d_hex[0], black, white);
@@ -950,38 +1149,32 @@ void dumpMem(void)
     WriteChar(170, 10, d_hex[0], black, white);
 
     //Board Address
-    REN70V05_RD((((current_board_address) - 1) * 0x400) + 1);
-    Binary2ASCIIHex(mdata_70V05);
+    Binary2ASCIIHex(board[1]);
     WriteChar(40, 30, d_hex[1], black, white);
     WriteChar(55, 30, d_hex[0], black, white);
 
     //Data 1 lo-byte
-    REN70V05_RD((((current_board_address) - 1) * 0x400) + 2);
-    Binary2ASCIIHex(mdata_70V05);
+    Binary2ASCIIHex(board[2]);
     WriteChar(70, 50, d_hex[1], black, white);
     WriteChar(85, 50, d_hex[0], black, white);
 
     //Data 1 hi-byte
-    REN70V05_RD((((current_board_address) - 1) * 0x400) + 3);
-    Binary2ASCIIHex(mdata_70V05);
+    Binary2ASCIIHex(board[3]);
     WriteChar(40, 50, d_hex[1], black, white);
     WriteChar(55, 50, d_hex[0], black, white);
 
     //Data 2 lo-byte
-    REN70V05_RD((((current_board_address) - 1) * 0x400) + 4);
-    Binary2ASCIIHex(mdata_70V05);
+    Binary2ASCIIHex(board[4]);
     WriteChar(70, 70, d_hex[1], black, white);
     WriteChar(85, 70, d_hex[0], black, white);	
     
     //Data 2 hi-byte
-    REN70V05_RD((((current_board_address) - 1) * 0x400) + 5);
-    Binary2ASCIIHex(mdata_70V05);
+    Binary2ASCIIHex(board[5]);
     WriteChar(40, 70, d_hex[1], black, white);
     WriteChar(55, 70, d_hex[0], black, white);	
     
     //Sub-Command
-    REN70V05_RD((((current_board_address) - 1) * 0x400) + 6);
-    Binary2ASCIIHex(mdata_70V05);
+    Binary2ASCIIHex(board[6]);
     WriteChar(40, 90, d_hex[1], black, white);
     WriteChar(55, 90, d_hex[0], black, white);	
 }
@@ -1021,8 +1214,8 @@ int EP2_TX(volatile uint8_t* tx_buffer)
 
         cnt++;
         
-        // Have we sent 64 bytes?
-        if ((cnt > 0) && (cnt % 64 == 0))
+        // Have we sent 64 bytes and is there more to send?
+        if ((cnt % 64 == 0) && (cnt < EP[2].tx_num_bytes))
         {
             //Set TXRDY and wait for it to be cleared before sending any more bytes
             USBE2CSR0bits.TXPKTRDY = 1;            
@@ -1056,24 +1249,27 @@ int EP1_RX()
     //unload the RX FIFO
     USBE1CSR1bits.RXPKTRDY = 0;
 
+    EP[1].rx_num_bytes = rx_bytes;
+
     return rx_bytes;
 }
 
 void EP0_control_transaction()
 {
-    uint16_t length;
-
-    if ((USB_transaction.bmRequestType == 0xC0) && (USB_transaction.wIndex == 0x04))
+    //Vendor specific, device target
+    if((USB_transaction.bmRequestType & 0x7f) == 0x40)
     {
-       length = USB_transaction.wLength;
-       if (length > sizeof(ExtCompatIDFeatureDescriptor))
-       {
-           length = sizeof(ExtCompatIDFeatureDescriptor);
-       }
-       
-       USB_queue_EP0(ExtCompatIDFeatureDescriptor, sizeof(ExtCompatIDFeatureDescriptor), length); 
-       
-       return;
+        //Extended Compatibility ID Feature Descriptor
+        if((USB_transaction.bRequest == 0xee) && (USB_transaction.wIndex == 0x04))
+        {
+            EP0_Send(ExtCompatIDFeatureDescriptor, sizeof(ExtCompatIDFeatureDescriptor)); 
+        }
+        else
+        {
+            Vendor_Request();
+        }
+        
+        return;
     }
     
     //Class specific, device to host, interface target
@@ -1085,17 +1281,7 @@ void EP0_control_transaction()
             //Figure out which descriptor is being requested
             if(USB_transaction.wIndex == 0x05)    
             {
-                //Determine number of bytes to send to host 
-                //Lesser of: requested amount, or total size of the descriptor
-                length = sizeof(ExtPropertyFeatureDescriptor);
-                if(USB_transaction.wLength < length)
-                {
-                    length = USB_transaction.wLength;
-                }
-                
-                USB_queue_EP0(ExtPropertyFeatureDescriptor, sizeof(ExtPropertyFeatureDescriptor), length);  
-                        
-                USBE0CSR0bits.TXRDY = 1;    
+                EP0_Send(ExtPropertyFeatureDescriptor, sizeof(ExtPropertyFeatureDescriptor));  
                 
                 return;
             }
@@ -1107,39 +1293,26 @@ void EP0_control_transaction()
     {
         case 0xC:
         {
-            USBE0CSR0bits.STALL = 1;
+            EP0_Stall();
             break;
             
         }
         case 0x0: 
         {
             if (USB_transaction.bmRequestType == 0x80) // Get status
-                USB_queue_EP0(device_descriptor, 0, 0);
-            if (USB_transaction.bmRequestType == 0x00) // Select function
-                USB_queue_EP0(device_descriptor, 0, 0);
+                EP0_Send(device_status, sizeof(device_status));
             break;            
         }
         
         //Set USB address
         case 0x5: 
         {
-            USBE0CSR0bits.RXRDYC = 1;
             usbAddress = EP[0].rx_buffer[2];
 
             SetAddress = true;
             break;
         }
 	
-	//added by chatgpt
-	case 0xEE:  // Microsoft OS Descriptor request
-	{
-	    if (USB_transaction.bmRequestType == 0xC0) // Vendor-specific request
-	    {
-		USB_queue_EP0(MSOSDescriptor, sizeof(MSOSDescriptor), USB_transaction.wLength);
-	    }
-	    break;
-	}
-        
         //Get descriptor
         case 0x6: 
         {
@@ -1148,14 +1321,14 @@ void EP0_control_transaction()
                 //Device descriptor
                 case 0x1: 
                 {
-                    USB_queue_EP0(device_descriptor, sizeof(device_descriptor), USB_transaction.wLength);                             
+                    EP0_Send(device_descriptor, sizeof(device_descriptor));                             
                     break;
                 }
                 
                 //Configuration descriptor
                 case 0x2: 
                 {
-                    USB_queue_EP0(config_descriptor, sizeof(config_descriptor), USB_transaction.wLength);
+                    EP0_Send(config_descriptor, sizeof(config_descriptor));
                     break;
                 }
                 
@@ -1167,31 +1340,31 @@ void EP0_control_transaction()
                         //String 0 - Language ID
                         case 0x0: 
                         {
-                            USB_queue_EP0(string0, sizeof(string0), USB_transaction.wLength);
+                            EP0_Send(string0, sizeof(string0));
                             break;
                         }
                         //String 1 - iManufacturer
                         case 0x1: 
                         {
-                            USB_queue_EP0(string1, sizeof(string1), USB_transaction.wLength);                           
+                            EP0_Send(string1, sizeof(string1));                           
                             break;
                         }
                         //String 2 - iProduct
                         case 0x2: 
                         {
-                            USB_queue_EP0(string2, sizeof(string2), USB_transaction.wLength);
+                            EP0_Send(string2, sizeof(string2));
                             break;
                         }
                         //String 3 - iSerialNumber
                         case 0x3: 
                         {
-                            USB_queue_EP0(string3, sizeof(string3), USB_transaction.wLength);
+                            EP0_Send(string3, sizeof(string3));
                             break;
                         }
                         //MS OS Descriptor Query
                         case 0xee:
                         {
-                            USB_queue_EP0(MSOSDescriptor, sizeof(MSOSDescriptor), USB_transaction.wLength);
+                            EP0_Send(MSOSDescriptor, sizeof(MSOSDescriptor));
                             break;
                         }                       
                         break;
@@ -1202,21 +1375,21 @@ void EP0_control_transaction()
 		case 0x04: // Extended Compatibility ID Feature Descriptor
 		if (USB_transaction.wIndex == 0x0004)
 		{
-		    USB_queue_EP0(ExtCompatIDFeatureDescriptor, sizeof(ExtCompatIDFeatureDescriptor), USB_transaction.wLength);
+		    EP0_Send(ExtCompatIDFeatureDescriptor, sizeof(ExtCompatIDFeatureDescriptor));
 		}
 		break;
                 
 		case 0x05: // Extended Properties Feature Descriptor
 		if (USB_transaction.wIndex == 0x0005)
 		{
-		    USB_queue_EP0(ExtPropertyFeatureDescriptor, sizeof(ExtPropertyFeatureDescriptor), USB_transaction.wLength);
+		    EP0_Send(ExtPropertyFeatureDescriptor, sizeof(ExtPropertyFeatureDescriptor));
 		}
 		break;
 
 	    //Device Qualifier
                 case 0x6: 
                 {          
-                    USB_queue_EP0(device_qualifier, sizeof(device_qualifier), USB_transaction.wLength);
+                    EP0_Send(device_qualifier, sizeof(device_qualifier));
                     break;
                 }                        
             }
@@ -1233,73 +1406,420 @@ void EP0_control_transaction()
         
         default: 
         {
-            USBE0CSR0bits.STALL = 1;
+            EP0_Stall();
             break;
         }  
     }
 }
 
-//USB_queue_EP0(config_descriptor, sizeof(config_descriptor), USB_transaction.wLength);
-void USB_queue_EP0(uint8_t *buffer, int size, int max_size)
+/*************************************************************
+ Endpoint 0
+ Every control transfer runs SETUP -> DATA -> STATUS. The IN
+ data stage is sent straight from where the data lives, the
+ descriptors in flash or ep0_buffer for the vendor requests,
+ one 64 byte packet per Endpoint 0 interrupt. A new SETUP
+ (SETEND) or a stall returns the state machine to idle.
+*************************************************************/
+void EP0_Service(void)
 {
-    int cnt;
+    if(USBE0CSR0bits.STALLED)
+    {
+        USBE0CSR0bits.STALLED = 0;
+        ep0_state = EP0_IDLE;
+    }
     
-    if (max_size < size)
-        size = max_size;
+    if(USBE0CSR0bits.SETEND) 
+    {
+        USBE0CSR0bits.SETENDC = 1;
+        ep0_state = EP0_IDLE;
+    }
     
-    EP[0].tx_num_bytes = size;
+    switch(ep0_state)
+    {
+        //The last packet was taken by the Host
+        case EP0_DATA_IN:
+            if(USBE0CSR0bits.TXRDY == 0)
+            {
+                EP0_TX();
+            }
+            break;
+            
+        case EP0_DATA_OUT:
+            if(USBE0CSR0bits.RXRDY)
+            {
+                EP0_RX();
+            }
+            break;
+            
+        //Status stage complete
+        case EP0_STATUS:
+            ep0_state = EP0_IDLE;
+            break;
+            
+        default:
+            break;
+    }
     
-    for (cnt = 0; cnt < size; cnt++)
+    if((ep0_state == EP0_IDLE) && USBE0CSR0bits.RXRDY)
     {
-        EP[0].tx_buffer[cnt] = buffer[cnt];
-    }       
+        EP0_Setup();
+    }
+}
+
+void EP0_Setup(void)
+{
+    // Store number of bytes received
+    EP[0].rx_num_bytes = USBE0CSR2bits.RXCNT;
+    
+    for(int i=0;i<8;i++)
+    {
+        EP[0].rx_buffer[i] = *((volatile uint8_t *)&USBFIFO0);
+    }
+    
+    USB_transaction.bmRequestType = EP[0].rx_buffer[0];
+    USB_transaction.bRequest = EP[0].rx_buffer[1];
+    USB_transaction.wValue = (int)(EP[0].rx_buffer[3] << 8) | EP[0].rx_buffer[2];
+    USB_transaction.wIndex = (int)(EP[0].rx_buffer[5] << 8) | EP[0].rx_buffer[4];
+    USB_transaction.wLength = (int)(EP[0].rx_buffer[7] << 8) | EP[0].rx_buffer[6];
+    
+    ep0_tx_remaining = 0;
+    ep0_rx_remaining = 0;
+    ep0_rx_done = NULL;
+    ep0_stall = false;
+    
+    EP0_control_transaction();
     
-    EP0_TX();
+    //A data stage nobody took is refused
+    if((ep0_state == EP0_IDLE) && (USB_transaction.wLength != 0))
+    {
+        ep0_stall = true;
+    }
+    
+    if(ep0_stall)
+    {
+        ep0_state = EP0_IDLE;
+        USBE0CSR0bits.RXRDYC = 1;
+        USBE0CSR0bits.STALL = 1;
+        return;
+    }
+    
+    switch(ep0_state)
+    {
+        case EP0_DATA_IN:
+            USBE0CSR0bits.RXRDYC = 1;
+            EP0_TX();
+            break;
+            
+        case EP0_DATA_OUT:
+            USBE0CSR0bits.RXRDYC = 1;
+            break;
+            
+        //No data stage
+        default:
+            ep0_state = EP0_STATUS;
+            USBE0CSR0bits.DATAEND = 1;
+            USBE0CSR0bits.RXRDYC = 1;
+            break;
+    }
 }
 
-/* Non-blocking EP0_TX */
-void EP0_TX()
+//Starts an IN data stage, data must stay put until it has been sent
+void EP0_Send(const uint8_t *data, uint16_t size)
 {
-    static int ep0_tx_cnt = 0;
-    uint8_t *FIFO_buffer = (uint8_t *)&USBFIFO0;
+    if(USB_transaction.wLength == 0)
+    {
+        return;
+    }
+    
+    if(size > USB_transaction.wLength)
+    {
+        size = USB_transaction.wLength;
+    }
+    
+    ep0_tx_data = data;
+    ep0_tx_remaining = size;
+    
+    //A full last packet needs a zero length packet after it when the Host asked for more
+    ep0_tx_zlp = (size < USB_transaction.wLength) && ((size % 64) == 0);
+    
+    ep0_state = EP0_DATA_IN;
+}
 
-    while ((ep0_tx_cnt < EP[0].tx_num_bytes) && !USBE0CSR0bits.TXRDY)
+//Starts an OUT data stage, done is called once all of it has arrived
+void EP0_Receive(uint8_t *buffer, uint16_t size, void (*done)(void))
+{
+    if((size == 0) || (size != USB_transaction.wLength))
     {
-	*FIFO_buffer = EP[0].tx_buffer[ep0_tx_cnt++];
-	if ((ep0_tx_cnt % 64) == 0)
-	{
-	    USBE0CSR0bits.TXRDY = 1;
-	    return; // Exit; next chunk will be sent in next ISR
-	}
+        ep0_stall = true;
+        return;
+    }
+    
+    ep0_rx_data = buffer;
+    ep0_rx_remaining = size;
+    ep0_rx_done = done;
+    
+    ep0_state = EP0_DATA_OUT;
+}
+
+void EP0_Stall(void)
+{
+    ep0_stall = true;
+}
+
+void EP0_TX(void)
+{
+    uint16_t count = (ep0_tx_remaining < 64) ? ep0_tx_remaining : 64;
+    
+    for(int i=0;i<count;i++)
+    {
+        *((volatile uint8_t *)&USBFIFO0) = ep0_tx_data[i];
+    }
+    
+    ep0_tx_data = ep0_tx_data + count;
+    ep0_tx_remaining = ep0_tx_remaining - count;
+    
+    //A short packet ends the data stage, so does a full one when nothing is left
+    if((count < 64) || ((ep0_tx_remaining == 0) && !ep0_tx_zlp))
+    {
+        ep0_state = EP0_STATUS;
+        USBE0CSR0bits.DATAEND = 1;
     }
+    
+    USBE0CSR0bits.TXRDY = 1;
+}
 
-    // Final chunk
-    if (ep0_tx_cnt >= EP[0].tx_num_bytes)
+void EP0_RX(void)
+{
+    uint16_t count = USBE0CSR2bits.RXCNT;
+    uint8_t data;
+    
+    for(int i=0;i<count;i++)
     {
-	USBE0CSR0bits.TXRDY = 1;
-	ep0_tx_cnt = 0; // Reset for next transfer
+        data = *((volatile uint8_t *)&USBFIFO0);
+        
+        if(ep0_rx_remaining > 0)
+        {
+            *ep0_rx_data++ = data;
+            ep0_rx_remaining--;
+        }
     }
+    
+    if((ep0_rx_remaining == 0) || (count < 64))
+    {
+        ep0_state = EP0_STATUS;
+        USBE0CSR0bits.DATAEND = 1;
+        USBE0CSR0bits.RXRDYC = 1;
+        
+        if(ep0_rx_done != NULL)
+        {
+            ep0_rx_done();
+        }
+    }
+    else
+    {
+        USBE0CSR0bits.RXRDYC = 1;
+    }
+}
 
+/*************************************************************
+ Vendor requests
+ Served on Endpoint 0 so they never wait behind bulk traffic.
+
+ 0x01 Read Status (IN, 16 bytes)
+    Byte 0      USB state
+    Byte 1      Device state
+    Byte 2      Screen
+    Byte 3      Current board address
+    Byte 4-7    lastError (little endian)
+    Byte 8-14   Peripheral list
+    Byte 15     Scope channel mask
+ 0x02 Read SRAM (IN), wIndex = address, wLength = bytes
+ 0x03 Write SRAM (OUT), wIndex = address, wLength = bytes
+    Stalled when the bytes go past the end of the SRAM, or for
+    Read SRAM include the mailbox interrupt word (0x1fff)
+ 0x04 Read Lock Stats (IN, 128 bytes)
+    16 bytes per semaphore flag (region) 0 - 7, little endian
+    Byte 0-3    locks
+    Byte 4-7    locks that had to wait
+    Byte 8-11   lock timeouts
+    Byte 12-15  longest wait (Core Timer ticks)
+ 0x05 Read Collision Stats (IN, 128 bytes)
+    16 bytes per semaphore flag (region) 0 - 7, little endian
+    Byte 0-3    words that collided (BUSY)
+    Byte 4-7    retries
+    Byte 8-11   words still colliding after the last retry
+    Byte 12-15  DMA bursts done again a word at a time
+ 0x06 Read Board Events (IN), wLength = bytes
+    Takes as many queued board notifications as fit
+    Byte 0      number of events
+    Byte 1-4    events lost to a full queue (little endian)
+    6 bytes per event from Byte 5
+    Byte 0      board address
+    Byte 1      event code
+    Byte 2-5    Core Timer count (little endian)
+ 0x07 Read Shadow Stats (IN, 128 bytes)
+    16 bytes per region 0 - 7, little endian
+    Byte 0-3    line lookups served from the copy
+    Byte 4-7    lines read from the SRAM
+    Byte 8-11   blocks written by flushes
+    Byte 12-15  bytes written by flushes
+ 0x08 Read Flash Job Stats (IN, 32 bytes)
+    FLASH_JOB_STATS, little endian
+    Byte 0-3    jobs            Byte 16-19  program time (Core Timer)
+    Byte 4-7    failures        Byte 20-23  erase time (Core Timer)
+    Byte 8-11   bytes           Byte 24-27  time in the tick
+    Byte 12-15  sectors         Byte 28-31  jobs waited for
+ 0x09 Read Flash Stall Stats (IN, 48 bytes)
+    16 bytes per job type (program, sector erase, chip erase)
+    Byte 0-3    reads that came during the operation
+    Byte 4-7    erase suspends
+    Byte 8-11   Core Timer ticks the reads waited
+    Byte 12-15  longest wait (Core Timer ticks)
+ 0x0a Read Flash Cache Stats (IN, 16 bytes)
+    FLASH_CACHE_STATS, little endian
+    Byte 0-3    reads through the cache
+    Byte 4-7    blocks found in the cache
+    Byte 8-11   blocks read from the flash
+    Byte 12-15  blocks invalidated by programs and erases
+*************************************************************/
+static void Vendor_Write_SRAM(void)
+{
+    SRAM_Shadow_InvalidateRange(USB_transaction.wIndex, USB_transaction.wLength);
+    REN70V05_WriteBlock(USB_transaction.wIndex, ep0_buffer, USB_transaction.wLength);
 }
 
-void EP0_RX(int length)
+//Sends 32-bit counters, little endian
+static void Vendor_Stats(const uint32_t *stats, int count)
 {
-    int cnt;
-    uint8_t *FIFO_buffer;
+    for(int i=0;i<(count * 4);i++)
+    {
+        ep0_buffer[i] = stats[i / 4] >> ((i % 4) * 8);
+    }
     
-    // Store number of bytes received
-    EP[0].rx_num_bytes = USBE0CSR2bits.RXCNT;
+    EP0_Send(ep0_buffer, count * 4);
+}
+
+static void Vendor_Events(void)
+{
+    BOARD_EVENT event;
+    uint16_t length = USB_transaction.wLength;
+    uint16_t count = 0;
+    uint16_t i = 5;
     
-    // Get 8-bit pointer to USB FIFO for endpoint 0
-    FIFO_buffer = (uint8_t *)&USBFIFO0;
+    if(length > EP0_BUFFER_SIZE)
+    {
+        length = EP0_BUFFER_SIZE;
+    }
     
-    for(cnt = 0; cnt < length; cnt++)
+    if(length < 5)
+    {
+        EP0_Stall();
+        return;
+    }
+    
+    while(((i + 6) <= length) && (count < 255) && Board_Event_Get(&event))
+    {
+        ep0_buffer[i] = event.board;
+        ep0_buffer[i + 1] = event.code;
+        ep0_buffer[i + 2] = event.time;
+        ep0_buffer[i + 3] = event.time >> 8;
+        ep0_buffer[i + 4] = event.time >> 16;
+        ep0_buffer[i + 5] = event.time >> 24;
+        
+        i = i + 6;
+        count++;
+    }
+    
+    ep0_buffer[0] = count;
+    ep0_buffer[1] = BoardEventsLost;
+    ep0_buffer[2] = BoardEventsLost >> 8;
+    ep0_buffer[3] = BoardEventsLost >> 16;
+    ep0_buffer[4] = BoardEventsLost >> 24;
+    
+    EP0_Send(ep0_buffer, i);
+}
+
+void Vendor_Request(void)
+{
+    switch(USB_transaction.bRequest)
     {
-        // Read in one byte at a time
-        EP[0].rx_buffer[cnt] = *(FIFO_buffer + (cnt & 3));
+        case VENDOR_READ_STATUS:
+            ep0_buffer[0] = USBState;
+            ep0_buffer[1] = DeviceState;
+            ep0_buffer[2] = screen;
+            ep0_buffer[3] = current_board_address;
+            ep0_buffer[4] = lastError;
+            ep0_buffer[5] = lastError >> 8;
+            ep0_buffer[6] = lastError >> 16;
+            ep0_buffer[7] = lastError >> 24;
+            
+            for(int i=0;i<7;i++)
+            {
+                ep0_buffer[8 + i] = PeripheralList[i];
+            }
+            
+            ep0_buffer[15] = ScopeChannelMask;
+            
+            EP0_Send(ep0_buffer, 16);
+            break;
+            
+        case VENDOR_READ_SRAM:
+            if((USB_transaction.wLength > EP0_BUFFER_SIZE) ||
+               ((USB_transaction.wIndex + USB_transaction.wLength) > VENDOR_SRAM_READ_END))
+            {
+                EP0_Stall();
+                break;
+            }
+            
+            SRAM_Shadow_FlushRange(USB_transaction.wIndex, USB_transaction.wLength);
+            REN70V05_ReadBlock(USB_transaction.wIndex, ep0_buffer, USB_transaction.wLength);
+            
+            EP0_Send(ep0_buffer, USB_transaction.wLength);
+            break;
+            
+        case VENDOR_WRITE_SRAM:
+            if((USB_transaction.wLength > EP0_BUFFER_SIZE) ||
+               ((USB_transaction.wIndex + USB_transaction.wLength) > VENDOR_SRAM_SIZE))
+            {
+                EP0_Stall();
+                break;
+            }
+            
+            EP0_Receive(ep0_buffer, USB_transaction.wLength, Vendor_Write_SRAM);
+            break;
+            
+        case VENDOR_READ_LOCKS:
+            Vendor_Stats((const uint32_t *)SRAMLockStats, sizeof(SRAMLockStats) / 4);
+            break;
+            
+        case VENDOR_READ_COLLISIONS:
+            Vendor_Stats((const uint32_t *)SRAMCollisionStats, sizeof(SRAMCollisionStats) / 4);
+            break;
+            
+        case VENDOR_READ_EVENTS:
+            Vendor_Events();
+            break;
+            
+        case VENDOR_READ_SHADOW:
+            Vendor_Stats((const uint32_t *)SRAMShadowStats, sizeof(SRAMShadowStats) / 4);
+            break;
+            
+        case VENDOR_READ_FLASH_JOBS:
+            Vendor_Stats((const uint32_t *)&FlashJobStats, sizeof(FlashJobStats) / 4);
+            break;
+            
+        case VENDOR_READ_FLASH_STALLS:
+            Vendor_Stats((const uint32_t *)FlashStallStats, sizeof(FlashStallStats) / 4);
+            break;
+            
+        case VENDOR_READ_FLASH_CACHE:
+            Vendor_Stats((const uint32_t *)&FlashCacheStats, sizeof(FlashCacheStats) / 4);
+            break;
+            
+        default:
+            EP0_Stall();
+            break;
     }
-     
-    USBE0CSR0bits.RXRDYC = 1;
 }
 
 int EP0_Wait_TXRDY()
@@ -1327,7 +1847,7 @@ int EP2_Wait_TXRDY()
     
     timeout = 0;
     
-    while (USBE1CSR0bits.TXPKTRDY)
+    while (USBE2CSR0bits.TXPKTRDY)
     {
         timeout++;
         
@@ -1379,37 +1899,86 @@ void setTime(void)
     RTCCONbits.RTCWREN = 0;
 }
 
+/*************************************************************
+ USB <-> SRAM
+ Each one is a single DMA burst (SRAM_DMA.c) that completes
+ on its own, SRAM_DMA_Wait() waits for it.
+ The board's region is locked with its semaphore for the burst
+ and released when the burst completes. A board that holds it
+ longer than SRAM_BRIDGE_LOCK_US is not waited for, the burst
+ goes ahead and the timeout is counted in SRAMLockStats.
+*************************************************************/
+#define SRAM_BRIDGE_LOCK_US     50
+
+static uint8_t bridge_flag;
+static bool bridge_locked = false;
+
+static void SRAM_Bridge_Lock(uint32_t address)
+{
+    bridge_flag = SRAM_FLAG(address);
+    bridge_locked = REN70V05_LOCK(bridge_flag, SRAM_BRIDGE_LOCK_US);
+}
+
+static void SRAM_Bridge_Release(void)
+{
+    if(bridge_locked)
+    {
+        bridge_locked = false;
+        REN70V05_RELEASE(bridge_flag);
+    }
+}
+
 void SRAM2USB(void)
 {
+    uint32_t region;
+    
     //Get Board Address
     current_board_address = EP[1].rx_buffer[1];
+    region = ((current_board_address) - 1) * 0x400;
 
-    for(int i=4;i<=63;i++)
-    {
-	EP[2].tx_buffer[i] = REN70V05_RD((((current_board_address) - 1) * 0x400) + i);
-    }
+    //Bytes 0 - 7 carry the ADC readings
+    SRAM_Shadow_Flush(current_board_address);
+    SRAM_Bridge_Lock(region);
+    SRAM_DMA_Read(region + 8, &EP[2].tx_buffer[8], 56, SRAM_Bridge_Release);
 }
 
 void BoardData2SRAM(void)
 {
+    uint32_t region;
+    
     //Get Board Address
     current_board_address = EP[1].rx_buffer[1];
+    region = ((current_board_address) - 1) * 0x400;
     
-    for(int i=0;i<=63;i++)
-    {
-	REN70V05_WR(((((current_board_address) - 1) * 0x400) + i), EP[1].rx_buffer[i]);
-    }
+    SRAM_Shadow_InvalidateRange(region, 64);
+    SRAM_Bridge_Lock(region);
+    SRAM_DMA_Write(region, EP[1].rx_buffer, 64, SRAM_Bridge_Release);
     
     //dumpMem();
 }
 
+/*************************************************************
+ The packet is copied to the board's directive queue
+ (Directives.c), it goes to the start of the region when the
+ board is next, while another board works.
+*************************************************************/
+void BoardData2Directive(bool refresh)
+{
+    //Get Board Address
+    current_board_address = EP[1].rx_buffer[1];
+    
+    Directive_Submit(current_board_address, (const uint8_t *)EP[1].rx_buffer, 64, refresh);
+}
+
 void USB2SRAM(void)
 {
+    uint32_t region;
+    
     //Get Board Address
     current_board_address = EP[1].rx_buffer[1];
+    region = ((current_board_address) - 1) * 0x400;
     
-    for(int i=0;i<064;i++)
-    {
-	REN70V05_WR(((((current_board_address) - 1) * 0x400) + i), EP[1].rx_buffer[i]);
-    }
+    SRAM_Shadow_InvalidateRange(region, 64);
+    SRAM_Bridge_Lock(region);
+    SRAM_DMA_Write(region, EP[1].rx_buffer, 64, SRAM_Bridge_Release);
 }
\ No newline at end of file
@@ -0,0 +1,194 @@
+/*********************************************************************
+    FileName:     	Mailbox_Board.c
+    Dependencies:	See #includes
+    Processor:		Any (portable C)
+    Hardware:		MainBrain MZ I/O boards
+    Complier:		C99
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        Board side of the mailbox, reference implementation
+
+    File Description:
+        Call Mailbox_Board_Init() once at power up, then
+        Mailbox_Board_Service() from the board's main loop. Each call
+        answers every request that is waiting, as long as there is
+        room in the response ring. A request is only taken (the
+        request tail moves) once its response is in place, so the
+        MainBrain never sees a slot freed before it is answered.
+
+        The indices are read and written one byte at a time, the
+        70V05 makes a single byte access atomic.
+
+        Mailbox_Board_Request_Service() writes a service request,
+        the caller then pulses the service request line (RA7 on the
+        MainBrain) low. Mailbox_Board_Directive() does the same with
+        a command the MainBrain is to write at offset 0 and run as a
+        directive, it goes in the response ring before the request.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <stddef.h>
+#include "Mailbox_Board.h"
+
+static void mailbox_read_frame(MAILBOX_BOARD *board, uint16_t offset, MAILBOX_FRAME *frame)
+{
+    uint8_t *bytes = (uint8_t *)frame;
+
+    for(int i=0;i<3;i++)
+    {
+        bytes[i] = board->read(board->context, offset + i);
+    }
+
+    if(frame->length > MAILBOX_PAYLOAD_MAX)
+    {
+        frame->length = MAILBOX_PAYLOAD_MAX;
+    }
+
+    for(int i=0;i<frame->length;i++)
+    {
+        frame->data[i] = board->read(board->context, offset + 3 + i);
+    }
+}
+
+static void mailbox_write_frame(MAILBOX_BOARD *board, uint16_t offset, const MAILBOX_FRAME *frame)
+{
+    const uint8_t *bytes = (const uint8_t *)frame;
+
+    for(int i=0;i<(3 + frame->length);i++)
+    {
+        board->write(board->context, offset + i, bytes[i]);
+    }
+}
+
+void Mailbox_Board_Init(MAILBOX_BOARD *board)
+{
+    //Start where the MainBrain left the rings
+    board->request_tail = board->read(board->context, MAILBOX_REQUEST_HEAD);
+    board->response_head = board->read(board->context, MAILBOX_RESPONSE_TAIL);
+    board->handled = 0;
+    board->service_count = board->read(board->context, MAILBOX_SERVICE_COUNT);
+
+    board->write(board->context, MAILBOX_REQUEST_TAIL, board->request_tail);
+    board->write(board->context, MAILBOX_RESPONSE_HEAD, board->response_head);
+    board->write(board->context, MAILBOX_READY, MAILBOX_READY_MARK);
+}
+
+//Returns the number of requests answered
+int Mailbox_Board_Service(MAILBOX_BOARD *board)
+{
+    MAILBOX_FRAME request;
+    MAILBOX_FRAME response;
+    uint8_t request_head;
+    uint8_t response_tail;
+    int count = 0;
+
+    request_head = board->read(board->context, MAILBOX_REQUEST_HEAD);
+    response_tail = board->read(board->context, MAILBOX_RESPONSE_TAIL);
+
+    while(board->request_tail != request_head)
+    {
+        //No room for the answer, the MainBrain has to receive first
+        if((uint8_t)(board->response_head - response_tail) >= MAILBOX_SLOTS)
+        {
+            break;
+        }
+
+        mailbox_read_frame(board, MAILBOX_REQUEST_SLOTS + ((board->request_tail % MAILBOX_SLOTS) * MAILBOX_SLOT_SIZE),
+			   &request);
+
+        response.length = 0;
+        response.command = request.command;
+        response.tag = request.tag;
+
+        if(board->handler != NULL)
+        {
+            board->handler(board, &request, &response);
+        }
+
+        if(response.length > MAILBOX_PAYLOAD_MAX)
+        {
+            response.length = MAILBOX_PAYLOAD_MAX;
+        }
+
+        mailbox_write_frame(board, MAILBOX_RESPONSE_SLOTS + ((board->response_head % MAILBOX_SLOTS) * MAILBOX_SLOT_SIZE),
+			    &response);
+
+        //The response, then the request slot is given back
+        board->response_head++;
+        board->write(board->context, MAILBOX_RESPONSE_HEAD, board->response_head);
+
+        board->request_tail++;
+        board->write(board->context, MAILBOX_REQUEST_TAIL, board->request_tail);
+
+        board->handled++;
+        count++;
+    }
+
+    return count;
+}
+
+//Returns false when the response ring is full or the command is
+//longer than a payload
+bool Mailbox_Board_Directive(MAILBOX_BOARD *board, const uint8_t *command, uint8_t length, uint8_t priority, uint8_t reason)
+{
+    MAILBOX_FRAME frame;
+    uint8_t response_tail;
+
+    if((length == 0) || (length > MAILBOX_PAYLOAD_MAX))
+    {
+        return false;
+    }
+
+    response_tail = board->read(board->context, MAILBOX_RESPONSE_TAIL);
+    if((uint8_t)(board->response_head - response_tail) >= MAILBOX_SLOTS)
+    {
+        return false;
+    }
+
+    frame.length = length;
+    frame.command = MAILBOX_SERVICE_DIRECTIVE;
+    frame.tag = 0;
+    for(int i=0;i<length;i++)
+    {
+        frame.data[i] = command[i];
+    }
+
+    mailbox_write_frame(board, MAILBOX_RESPONSE_SLOTS + ((board->response_head % MAILBOX_SLOTS) * MAILBOX_SLOT_SIZE),
+			&frame);
+
+    //The frame, then the request that makes the MainBrain look
+    board->response_head++;
+    board->write(board->context, MAILBOX_RESPONSE_HEAD, board->response_head);
+
+    Mailbox_Board_Request_Service(board, priority, reason);
+
+    return true;
+}
+
+//priority 0 - 3, 3 first, reason 0 - 63
+void Mailbox_Board_Request_Service(MAILBOX_BOARD *board, uint8_t priority, uint8_t reason)
+{
+    //The code, then the count the MainBrain looks at
+    board->write(board->context, MAILBOX_SERVICE_CODE, MAILBOX_SERVICE_CODE_OF(priority, reason));
+
+    board->service_count++;
+    board->write(board->context, MAILBOX_SERVICE_COUNT, board->service_count);
+}
@@ -0,0 +1,68 @@
+/*********************************************************************
+    FileName:     	Mailbox_Board.h
+    Dependencies:	Mailbox.h
+    Processor:		Any (portable C)
+    Hardware:		MainBrain MZ I/O boards
+    Complier:		C99
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        Board side of the mailbox, reference implementation
+
+    File Description:
+        The board supplies byte access to its side of the SRAM (the
+        offset is from the start of the board's region) and a
+        handler that turns a request into a response.
+
+    Change History:
+
+/***********************************************************************/
+
+#ifndef MAILBOX_BOARD_H
+#define	MAILBOX_BOARD_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "../Mailbox.h"
+
+typedef struct MAILBOX_BOARD MAILBOX_BOARD;
+
+//Fills in the response, the length, command and tag are preset
+//from the request (length 0)
+typedef void (*MAILBOX_HANDLER)(MAILBOX_BOARD *board, const MAILBOX_FRAME *request, MAILBOX_FRAME *response);
+
+struct MAILBOX_BOARD
+{
+    uint8_t (*read)(void *context, uint16_t offset);
+    void (*write)(void *context, uint16_t offset, uint8_t value);
+    void *context;
+    MAILBOX_HANDLER handler;
+
+    //Indices owned by the board
+    uint8_t request_tail;
+    uint8_t response_head;
+    uint8_t service_count;
+
+    uint32_t handled;
+};
+
+void Mailbox_Board_Init(MAILBOX_BOARD *board);
+int Mailbox_Board_Service(MAILBOX_BOARD *board);
+void Mailbox_Board_Request_Service(MAILBOX_BOARD *board, uint8_t priority, uint8_t reason);
+bool Mailbox_Board_Directive(MAILBOX_BOARD *board, const uint8_t *command, uint8_t length, uint8_t priority, uint8_t reason);
+
+#endif	/* MAILBOX_BOARD_H */
@@ -0,0 +1,1737 @@
+/*********************************************************************
+    FileName:     	mbz.c
+    Dependencies:	See #includes
+    Processor:		Host (Linux)
+    Hardware:		MainBrain MZ
+    Complier:		GCC
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        Host side client library for the MainBrain MZ
+
+    File Description:
+        Packets travel over a local stream socket, each one framed as
+        Byte 0      Endpoint address (0x01, 0x82 or 0x83)
+        Byte 1-2    Payload length (little endian)
+        Byte 3-     Payload
+
+    Change History:
+
+/***********************************************************************/
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "mbz.h"
+
+//Marks a request that has not completed yet
+#define MBZ_PENDING             1
+
+#define MBZ_FRAME_HEADER        3
+
+const MBZ_OPCODE_INFO MBZ_OPCODES[] =
+{
+    {MBZ_CONNECT,               "Connect",              false},
+    {MBZ_DATA_CHECK,            "Data Check",           true},
+    {MBZ_SEND_MESSAGE,          "Send Message",         false},
+    {MBZ_BACKLIGHT,             "Back light",           false},
+    {MBZ_RUN_SEQUENCE,          "Run Sequence",         false},
+    {MBZ_BOARD_COMM_CHECK,      "Board Comm Check",     true},
+    {MBZ_UPDATE_BUTTON,         "Update Button",        false},
+    {MBZ_SAVE_SEQUENCE,         "Save Sequence",        false},
+    {MBZ_DEBUG_SCREEN,          "Debug Screen",         false},
+    {MBZ_BENCH_LOOPBACK,        "Bench Loopback",       true},
+    {MBZ_BENCH_SOURCE,          "Bench Source",         false},
+    {MBZ_BENCH_SINK,            "Bench Sink",           false},
+    {MBZ_BENCH_REPORT,          "Bench Report",         true},
+    {MBZ_BENCH_SRAM,            "Bench SRAM",           true},
+    {MBZ_GET_DATA,              "Get Data",             true},
+    {MBZ_SEND_BYTE,             "Send Byte",            false},
+    {MBZ_SET_DAC,               "Set DAC",              false},
+    {MBZ_SET_PWM,               "Set PWM",              false},
+    {MBZ_DAC_WAVEFORM,          "DAC Wave Form",        false},
+    {MBZ_ADC_READ,              "ADC Read",             false},
+    {MBZ_GET_BOARD_DATA,        "Get Board Data",       false},
+    {MBZ_SWITCHES,              "Switches",             false},
+    {MBZ_READ_FLASH,            "Read Flash",           false},
+    {MBZ_WRITE_FLASH,           "Write Flash",          false},
+    {MBZ_FLASH_CHIP_ERASE,      "Flash Chip Erase",     false},
+    {MBZ_SCOPE,                 "Scope",                false},
+    {MBZ_FLASH_COPY_BUFFER,     "Flash Copy Buffer",    false},
+    {MBZ_COPY_FILE,             "Copy File",            false},
+    {MBZ_FILE_DATA,             "File Data",            false},
+    {MBZ_SCOPE_STREAM,          "Scope Stream",         false},
+    {MBZ_MEMORY_TEST,           "Memory Test",          true},
+    {MBZ_FLASH_USED,            "Flash Used",           true},
+    {MBZ_ASSET_BEGIN,           "Asset Begin",          true},
+    {MBZ_ASSET_WRITE,           "Asset Write",          true},
+    {MBZ_ASSET_STATUS,          "Asset Status",         true},
+    {MBZ_DIRECTIVE_STATS,       "Directive Stats",      true},
+    {MBZ_PERIPHERALS,           "Peripherals",          true},
+    {MBZ_BOARD_LATENCY,         "Board Latency",        true},
+    {MBZ_SERVICE_REQUESTS,      "Service Requests",     true},
+    {MBZ_MOTION,                "Motion",               true},
+    {MBZ_MAILBOX,               "Mailbox",              true},
+    {MBZ_FLASH_PROGRAM_BEGIN,   "Flash Program Begin",  true},
+    {MBZ_FLASH_PROGRAM_DATA,    "Flash Program Data",   true},
+    {MBZ_FLASH_PROGRAM_STATUS,  "Flash Program Status", true},
+};
+
+const int MBZ_NUM_OPCODES = sizeof(MBZ_OPCODES) / sizeof(MBZ_OPCODES[0]);
+
+struct MBZ_DEVICE
+{
+    int fd;
+    int pipeline_depth;
+    int timeout_ms;
+    bool closed;
+    bool pumping;
+
+    //Waiting to be sent
+    MBZ_REQUEST *queue_head;
+    MBZ_REQUEST *queue_tail;
+
+    //Sent and waiting for a reply
+    MBZ_REQUEST *wire_head;
+    MBZ_REQUEST *wire_tail;
+    int in_flight;
+
+    uint8_t rx[MBZ_FRAME_HEADER + MBZ_MAX_PACKET];
+    int rx_len;
+
+    MBZ_STREAM_CALLBACK stream_callback;
+    void *stream_context;
+
+    MBZ_STREAM_CALLBACK bulk_callback;
+    void *bulk_context;
+
+    //Control transfer waiting for its reply
+    bool control_pending;
+    uint8_t control_in[MBZ_MAX_PACKET];
+    int control_len;
+
+    MBZ_STATS stats[256];
+};
+
+uint64_t MBZ_Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
+
+const MBZ_OPCODE_INFO *MBZ_Opcode(uint8_t opcode)
+{
+    for(int i=0;i<MBZ_NUM_OPCODES;i++)
+    {
+        if(MBZ_OPCODES[i].opcode == opcode)
+        {
+            return &MBZ_OPCODES[i];
+        }
+    }
+
+    return NULL;
+}
+
+MBZ_DEVICE *MBZ_Open(const char *path, int pipeline_depth)
+{
+    struct sockaddr_un addr;
+    MBZ_DEVICE *dev;
+    int fd;
+
+    if(path == NULL)
+    {
+        path = MBZ_SIM_SOCKET;
+    }
+
+    if((pipeline_depth < 1) || (strlen(path) >= sizeof(addr.sun_path)))
+    {
+        return NULL;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    dev = calloc(1, sizeof(MBZ_DEVICE));
+    if(dev == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    dev->fd = fd;
+    dev->pipeline_depth = pipeline_depth;
+    dev->timeout_ms = MBZ_DEFAULT_TIMEOUT_MS;
+
+    MBZ_ResetStats(dev);
+
+    return dev;
+}
+
+static void mbz_complete(MBZ_DEVICE *dev, MBZ_REQUEST *req, int status)
+{
+    MBZ_STATS *s = &dev->stats[req->out[0]];
+    uint64_t latency;
+
+    req->status = status;
+    req->complete_ns = MBZ_Now();
+    req->next = NULL;
+
+    latency = req->complete_ns - req->submit_ns;
+
+    s->count++;
+    if(status != MBZ_OK)
+    {
+        s->errors++;
+    }
+    else if(req->has_reply)
+    {
+        s->bytes_in += MBZ_PACKET_SIZE;
+    }
+
+    s->latency_sum_ns += latency;
+    if(latency < s->latency_min_ns)
+    {
+        s->latency_min_ns = latency;
+    }
+    if(latency > s->latency_max_ns)
+    {
+        s->latency_max_ns = latency;
+    }
+    s->last_complete_ns = req->complete_ns;
+
+    if(req->callback != NULL)
+    {
+        req->callback(req, req->context);
+    }
+}
+
+//Fails everything that is queued or on the wire
+static void mbz_fail_all(MBZ_DEVICE *dev, int status)
+{
+    MBZ_REQUEST *req;
+
+    dev->closed = true;
+
+    while(dev->wire_head != NULL)
+    {
+        req = dev->wire_head;
+        dev->wire_head = req->next;
+        mbz_complete(dev, req, status);
+    }
+    dev->wire_tail = NULL;
+    dev->in_flight = 0;
+
+    while(dev->queue_head != NULL)
+    {
+        req = dev->queue_head;
+        dev->queue_head = req->next;
+        mbz_complete(dev, req, status);
+    }
+    dev->queue_tail = NULL;
+}
+
+void MBZ_Close(MBZ_DEVICE *dev)
+{
+    if(dev == NULL)
+    {
+        return;
+    }
+
+    mbz_fail_all(dev, MBZ_ERR_CLOSED);
+    close(dev->fd);
+    free(dev);
+}
+
+void MBZ_SetTimeout(MBZ_DEVICE *dev, int timeout_ms)
+{
+    dev->timeout_ms = timeout_ms;
+}
+
+void MBZ_SetStreamCallback(MBZ_DEVICE *dev, MBZ_STREAM_CALLBACK callback, void *context)
+{
+    dev->stream_callback = callback;
+    dev->stream_context = context;
+}
+
+void MBZ_SetBulkCallback(MBZ_DEVICE *dev, MBZ_STREAM_CALLBACK callback, void *context)
+{
+    dev->bulk_callback = callback;
+    dev->bulk_context = context;
+}
+
+static int mbz_write_all(int fd, const uint8_t *data, int length)
+{
+    int sent = 0;
+    ssize_t n;
+
+    while(sent < length)
+    {
+        n = write(fd, data + sent, length - sent);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return MBZ_ERR_IO;
+        }
+        sent += n;
+    }
+
+    return MBZ_OK;
+}
+
+//Moves queued requests onto the wire while the pipeline has room
+static void mbz_pump(MBZ_DEVICE *dev)
+{
+    uint8_t frame[MBZ_FRAME_HEADER + MBZ_PACKET_SIZE];
+    MBZ_REQUEST *req;
+
+    //A callback that submits from inside the pump is picked up by this loop
+    if(dev->pumping)
+    {
+        return;
+    }
+    dev->pumping = true;
+
+    while((dev->queue_head != NULL) && (dev->in_flight < dev->pipeline_depth) && !dev->closed)
+    {
+        req = dev->queue_head;
+        dev->queue_head = req->next;
+        if(dev->queue_head == NULL)
+        {
+            dev->queue_tail = NULL;
+        }
+        req->next = NULL;
+
+        frame[0] = MBZ_EP_OUT;
+        frame[1] = MBZ_PACKET_SIZE;
+        frame[2] = 0;
+        memcpy(&frame[MBZ_FRAME_HEADER], req->out, MBZ_PACKET_SIZE);
+
+        if(mbz_write_all(dev->fd, frame, sizeof(frame)) != MBZ_OK)
+        {
+            mbz_complete(dev, req, MBZ_ERR_IO);
+            mbz_fail_all(dev, MBZ_ERR_IO);
+            break;
+        }
+
+        req->sent_ns = MBZ_Now();
+        dev->stats[req->out[0]].bytes_out += MBZ_PACKET_SIZE;
+
+        if(req->has_reply)
+        {
+            if(dev->wire_tail == NULL)
+            {
+                dev->wire_head = req;
+            }
+            else
+            {
+                dev->wire_tail->next = req;
+            }
+            dev->wire_tail = req;
+            dev->in_flight++;
+        }
+        else
+        {
+            mbz_complete(dev, req, MBZ_OK);
+        }
+    }
+
+    dev->pumping = false;
+}
+
+int MBZ_Submit(MBZ_DEVICE *dev, MBZ_REQUEST *req)
+{
+    const MBZ_OPCODE_INFO *info;
+    MBZ_STATS *s;
+
+    if((dev == NULL) || (req == NULL))
+    {
+        return MBZ_ERR_ARG;
+    }
+
+    if(dev->closed)
+    {
+        return MBZ_ERR_CLOSED;
+    }
+
+    //Unknown opcodes are sent anyway, the device ignores them
+    info = MBZ_Opcode(req->out[0]);
+    req->has_reply = (info != NULL) && info->has_reply;
+    req->status = MBZ_PENDING;
+    req->submit_ns = MBZ_Now();
+    req->sent_ns = 0;
+    req->complete_ns = 0;
+    req->next = NULL;
+
+    s = &dev->stats[req->out[0]];
+    if(s->first_submit_ns == 0)
+    {
+        s->first_submit_ns = req->submit_ns;
+    }
+
+    if(dev->queue_tail == NULL)
+    {
+        dev->queue_head = req;
+    }
+    else
+    {
+        dev->queue_tail->next = req;
+    }
+    dev->queue_tail = req;
+
+    mbz_pump(dev);
+
+    return MBZ_OK;
+}
+
+//Splits the receive buffer into frames
+static int mbz_parse(MBZ_DEVICE *dev)
+{
+    MBZ_REQUEST *req;
+    int completed = 0;
+    int length;
+    int used = 0;
+
+    while((dev->rx_len - used) >= MBZ_FRAME_HEADER)
+    {
+        uint8_t *frame = &dev->rx[used];
+
+        length = frame[1] | (frame[2] << 8);
+        if(length > MBZ_MAX_PACKET)
+        {
+            mbz_fail_all(dev, MBZ_ERR_IO);
+            return completed;
+        }
+
+        if((dev->rx_len - used) < (MBZ_FRAME_HEADER + length))
+        {
+            break;
+        }
+
+        if(frame[0] == MBZ_EP_IN)
+        {
+            //The oldest request waiting for a reply owns this one
+            req = dev->wire_head;
+            if(req != NULL)
+            {
+                dev->wire_head = req->next;
+                if(dev->wire_head == NULL)
+                {
+                    dev->wire_tail = NULL;
+                }
+                dev->in_flight--;
+
+                memset(req->in, 0, MBZ_PACKET_SIZE);
+                memcpy(req->in, &frame[MBZ_FRAME_HEADER], (length < MBZ_PACKET_SIZE) ? length : MBZ_PACKET_SIZE);
+                mbz_complete(dev, req, MBZ_OK);
+                completed++;
+            }
+            else if(dev->bulk_callback != NULL)
+            {
+                dev->bulk_callback(&frame[MBZ_FRAME_HEADER], length, dev->bulk_context);
+            }
+        }
+        else if(frame[0] == MBZ_EP_CONTROL_IN)
+        {
+            if(dev->control_pending && (length > 0))
+            {
+                memcpy(dev->control_in, &frame[MBZ_FRAME_HEADER], length);
+                dev->control_len = length;
+                dev->control_pending = false;
+            }
+        }
+        else if(frame[0] == MBZ_EP_SCOPE)
+        {
+            if(dev->stream_callback != NULL)
+            {
+                dev->stream_callback(&frame[MBZ_FRAME_HEADER], length, dev->stream_context);
+            }
+        }
+
+        used += MBZ_FRAME_HEADER + length;
+    }
+
+    memmove(dev->rx, &dev->rx[used], dev->rx_len - used);
+    dev->rx_len -= used;
+
+    return completed;
+}
+
+//Times out the oldest request on the wire
+static int mbz_check_timeout(MBZ_DEVICE *dev)
+{
+    MBZ_REQUEST *req = dev->wire_head;
+
+    if(req == NULL)
+    {
+        return 0;
+    }
+
+    if((MBZ_Now() - req->sent_ns) < ((uint64_t)dev->timeout_ms * 1000000ull))
+    {
+        return 0;
+    }
+
+    dev->wire_head = req->next;
+    if(dev->wire_head == NULL)
+    {
+        dev->wire_tail = NULL;
+    }
+    dev->in_flight--;
+
+    mbz_complete(dev, req, MBZ_ERR_TIMEOUT);
+
+    return 1;
+}
+
+int MBZ_Poll(MBZ_DEVICE *dev, int timeout_ms)
+{
+    struct pollfd pfd;
+    int completed = 0;
+    ssize_t n;
+
+    if(dev->closed)
+    {
+        return MBZ_ERR_CLOSED;
+    }
+
+    mbz_pump(dev);
+
+    pfd.fd = dev->fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    if(poll(&pfd, 1, timeout_ms) < 0)
+    {
+        return (errno == EINTR) ? 0 : MBZ_ERR_IO;
+    }
+
+    if(pfd.revents & (POLLIN | POLLHUP | POLLERR))
+    {
+        n = read(dev->fd, &dev->rx[dev->rx_len], sizeof(dev->rx) - dev->rx_len);
+        if(n <= 0)
+        {
+            mbz_fail_all(dev, MBZ_ERR_CLOSED);
+            return MBZ_ERR_CLOSED;
+        }
+
+        dev->rx_len += n;
+        completed += mbz_parse(dev);
+    }
+
+    completed += mbz_check_timeout(dev);
+
+    //Replies made room in the pipeline
+    mbz_pump(dev);
+
+    return completed;
+}
+
+int MBZ_Pending(MBZ_DEVICE *dev)
+{
+    int pending = dev->in_flight;
+
+    for(MBZ_REQUEST *req = dev->queue_head;req != NULL;req = req->next)
+    {
+        pending++;
+    }
+
+    return pending;
+}
+
+int MBZ_Drain(MBZ_DEVICE *dev)
+{
+    int status;
+
+    while((dev->queue_head != NULL) || (dev->wire_head != NULL))
+    {
+        status = MBZ_Poll(dev, 10);
+        if(status < 0)
+        {
+            return status;
+        }
+    }
+
+    return MBZ_OK;
+}
+
+int MBZ_Transfer(MBZ_DEVICE *dev, MBZ_REQUEST *req)
+{
+    int status;
+
+    status = MBZ_Submit(dev, req);
+    if(status != MBZ_OK)
+    {
+        return status;
+    }
+
+    while(req->status == MBZ_PENDING)
+    {
+        status = MBZ_Poll(dev, 10);
+        if(status < 0)
+        {
+            return status;
+        }
+    }
+
+    return req->status;
+}
+
+/*************************************************************
+ Control transfers
+ On the wire the SETUP packet and any OUT data go out as one
+ frame, the reply is the status byte and any IN data.
+*************************************************************/
+int MBZ_Control(MBZ_DEVICE *dev, uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+	uint8_t *data, uint16_t length)
+{
+    uint8_t frame[MBZ_FRAME_HEADER + 8 + MBZ_VENDOR_MAX];
+    bool in = (request_type & 0x80) != 0;
+    int frame_len = 8;
+    uint64_t start_ns;
+    int status;
+
+    if((dev == NULL) || (length > MBZ_VENDOR_MAX) || ((length > 0) && (data == NULL)))
+    {
+        return MBZ_ERR_ARG;
+    }
+
+    if(dev->closed)
+    {
+        return MBZ_ERR_CLOSED;
+    }
+
+    frame[MBZ_FRAME_HEADER + 0] = request_type;
+    frame[MBZ_FRAME_HEADER + 1] = request;
+    frame[MBZ_FRAME_HEADER + 2] = value & 0xff;
+    frame[MBZ_FRAME_HEADER + 3] = value >> 8;
+    frame[MBZ_FRAME_HEADER + 4] = index & 0xff;
+    frame[MBZ_FRAME_HEADER + 5] = index >> 8;
+    frame[MBZ_FRAME_HEADER + 6] = length & 0xff;
+    frame[MBZ_FRAME_HEADER + 7] = length >> 8;
+
+    if(!in)
+    {
+        memcpy(&frame[MBZ_FRAME_HEADER + 8], data, length);
+        frame_len += length;
+    }
+
+    frame[0] = MBZ_EP_CONTROL_OUT;
+    frame[1] = frame_len & 0xff;
+    frame[2] = frame_len >> 8;
+
+    dev->control_pending = true;
+
+    if(mbz_write_all(dev->fd, frame, MBZ_FRAME_HEADER + frame_len) != MBZ_OK)
+    {
+        mbz_fail_all(dev, MBZ_ERR_IO);
+        return MBZ_ERR_IO;
+    }
+
+    start_ns = MBZ_Now();
+    while(dev->control_pending)
+    {
+        status = MBZ_Poll(dev, 10);
+        if(status < 0)
+        {
+            return status;
+        }
+
+        if((MBZ_Now() - start_ns) > ((uint64_t)dev->timeout_ms * 1000000ull))
+        {
+            dev->control_pending = false;
+            return MBZ_ERR_TIMEOUT;
+        }
+    }
+
+    if(dev->control_in[0] != MBZ_CONTROL_ACK)
+    {
+        return MBZ_ERR_STALL;
+    }
+
+    if(!in)
+    {
+        return length;
+    }
+
+    if((dev->control_len - 1) < length)
+    {
+        length = dev->control_len - 1;
+    }
+    memcpy(data, &dev->control_in[1], length);
+
+    return length;
+}
+
+int MBZ_ReadStatus(MBZ_DEVICE *dev, MBZ_STATUS *status)
+{
+    uint8_t data[16];
+    int length;
+
+    length = MBZ_Control(dev, MBZ_VENDOR_IN, MBZ_VENDOR_READ_STATUS, 0, 0, data, sizeof(data));
+    if(length < 0)
+    {
+        return length;
+    }
+    if(length != sizeof(data))
+    {
+        return MBZ_ERR_IO;
+    }
+
+    status->usb_state = data[0];
+    status->device_state = data[1];
+    status->screen = data[2];
+    status->board_address = data[3];
+    status->last_error = data[4] | (data[5] << 8) | (data[6] << 16) | ((uint32_t)data[7] << 24);
+    memcpy(status->peripherals, &data[8], sizeof(status->peripherals));
+    status->scope_mask = data[15];
+
+    return MBZ_OK;
+}
+
+int MBZ_ReadSRAM(MBZ_DEVICE *dev, uint16_t address, uint8_t *data, uint16_t length)
+{
+    return MBZ_Control(dev, MBZ_VENDOR_IN, MBZ_VENDOR_READ_SRAM, 0, address, data, length);
+}
+
+int MBZ_WriteSRAM(MBZ_DEVICE *dev, uint16_t address, const uint8_t *data, uint16_t length)
+{
+    return MBZ_Control(dev, MBZ_VENDOR_OUT, MBZ_VENDOR_WRITE_SRAM, 0, address, (uint8_t *)data, length);
+}
+
+//Both stats replies are 4 counters per flag, little endian
+static int mbz_read_counters(MBZ_DEVICE *dev, uint8_t request, uint32_t counters[MBZ_LOCK_FLAGS][4])
+{
+    uint8_t data[MBZ_LOCK_FLAGS * 16];
+    const uint8_t *p;
+    int length;
+
+    length = MBZ_Control(dev, MBZ_VENDOR_IN, request, 0, 0, data, sizeof(data));
+    if(length < 0)
+    {
+        return length;
+    }
+    if(length != sizeof(data))
+    {
+        return MBZ_ERR_IO;
+    }
+
+    for(int flag=0;flag<MBZ_LOCK_FLAGS;flag++)
+    {
+        for(int i=0;i<4;i++)
+        {
+            p = &data[(flag * 16) + (i * 4)];
+            counters[flag][i] = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+        }
+    }
+
+    return MBZ_OK;
+}
+
+int MBZ_ReadLockStats(MBZ_DEVICE *dev, MBZ_LOCK_STATS stats[MBZ_LOCK_FLAGS])
+{
+    uint32_t counters[MBZ_LOCK_FLAGS][4];
+    int status;
+
+    status = mbz_read_counters(dev, MBZ_VENDOR_READ_LOCKS, counters);
+    if(status != MBZ_OK)
+    {
+        return status;
+    }
+
+    for(int flag=0;flag<MBZ_LOCK_FLAGS;flag++)
+    {
+        stats[flag].locks = counters[flag][0];
+        stats[flag].contended = counters[flag][1];
+        stats[flag].timeouts = counters[flag][2];
+        stats[flag].wait_max_ticks = counters[flag][3];
+    }
+
+    return MBZ_OK;
+}
+
+int MBZ_ReadCollisionStats(MBZ_DEVICE *dev, MBZ_COLLISION_STATS stats[MBZ_LOCK_FLAGS])
+{
+    uint32_t counters[MBZ_LOCK_FLAGS][4];
+    int status;
+
+    status = mbz_read_counters(dev, MBZ_VENDOR_READ_COLLISIONS, counters);
+    if(status != MBZ_OK)
+    {
+        return status;
+    }
+
+    for(int flag=0;flag<MBZ_LOCK_FLAGS;flag++)
+    {
+        stats[flag].collisions = counters[flag][0];
+        stats[flag].retries = counters[flag][1];
+        stats[flag].failures = counters[flag][2];
+        stats[flag].bursts = counters[flag][3];
+    }
+
+    return MBZ_OK;
+}
+
+int MBZ_ReadShadowStats(MBZ_DEVICE *dev, MBZ_SHADOW_STATS stats[MBZ_LOCK_FLAGS])
+{
+    uint32_t counters[MBZ_LOCK_FLAGS][4];
+    int status;
+
+    status = mbz_read_counters(dev, MBZ_VENDOR_READ_SHADOW, counters);
+    if(status != MBZ_OK)
+    {
+        return status;
+    }
+
+    for(int flag=0;flag<MBZ_LOCK_FLAGS;flag++)
+    {
+        stats[flag].hits = counters[flag][0];
+        stats[flag].misses = counters[flag][1];
+        stats[flag].bursts = counters[flag][2];
+        stats[flag].bytes = counters[flag][3];
+    }
+
+    return MBZ_OK;
+}
+
+//Returns the number of events taken from the device's queue
+int MBZ_ReadFlashJobStats(MBZ_DEVICE *dev, MBZ_FLASH_JOB_STATS *stats)
+{
+    uint8_t data[32];
+    uint32_t counters[8];
+    const uint8_t *p;
+    int length;
+
+    length = MBZ_Control(dev, MBZ_VENDOR_IN, MBZ_VENDOR_READ_FLASH_JOBS, 0, 0, data, sizeof(data));
+    if(length < 0)
+    {
+        return length;
+    }
+    if(length != sizeof(data))
+    {
+        return MBZ_ERR_IO;
+    }
+
+    for(int i=0;i<8;i++)
+    {
+        p = &data[i * 4];
+        counters[i] = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    stats->jobs = counters[0];
+    stats->failures = counters[1];
+    stats->bytes = counters[2];
+    stats->sectors = counters[3];
+    stats->program_ticks = counters[4];
+    stats->erase_ticks = counters[5];
+    stats->tick_ticks = counters[6];
+    stats->waits = counters[7];
+
+    return MBZ_OK;
+}
+
+int MBZ_ReadFlashStallStats(MBZ_DEVICE *dev, MBZ_FLASH_STALL_STATS stats[MBZ_FLASH_JOB_TYPES])
+{
+    uint8_t data[MBZ_FLASH_JOB_TYPES * 16];
+    uint32_t counters[4];
+    const uint8_t *p;
+    int length;
+
+    length = MBZ_Control(dev, MBZ_VENDOR_IN, MBZ_VENDOR_READ_FLASH_STALLS, 0, 0, data, sizeof(data));
+    if(length < 0)
+    {
+        return length;
+    }
+    if(length != sizeof(data))
+    {
+        return MBZ_ERR_IO;
+    }
+
+    for(int type=0;type<MBZ_FLASH_JOB_TYPES;type++)
+    {
+        for(int i=0;i<4;i++)
+        {
+            p = &data[(type * 16) + (i * 4)];
+            counters[i] = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+        }
+
+        stats[type].reads = counters[0];
+        stats[type].suspends = counters[1];
+        stats[type].stall_ticks = counters[2];
+        stats[type].stall_max_ticks = counters[3];
+    }
+
+    return MBZ_OK;
+}
+
+int MBZ_ReadFlashCacheStats(MBZ_DEVICE *dev, MBZ_FLASH_CACHE_STATS *stats)
+{
+    uint8_t data[16];
+    uint32_t counters[4];
+    const uint8_t *p;
+    int length;
+
+    length = MBZ_Control(dev, MBZ_VENDOR_IN, MBZ_VENDOR_READ_FLASH_CACHE, 0, 0, data, sizeof(data));
+    if(length < 0)
+    {
+        return length;
+    }
+    if(length != sizeof(data))
+    {
+        return MBZ_ERR_IO;
+    }
+
+    for(int i=0;i<4;i++)
+    {
+        p = &data[i * 4];
+        counters[i] = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    stats->reads = counters[0];
+    stats->hits = counters[1];
+    stats->misses = counters[2];
+    stats->invalidated = counters[3];
+
+    return MBZ_OK;
+}
+
+int MBZ_ReadBoardEvents(MBZ_DEVICE *dev, MBZ_BOARD_EVENT *events, int max, uint32_t *lost)
+{
+    uint8_t data[MBZ_VENDOR_MAX];
+    const uint8_t *p;
+    int length;
+    int count;
+
+    if((max < 1) || (max > MBZ_EVENTS_MAX))
+    {
+        max = MBZ_EVENTS_MAX;
+    }
+
+    length = MBZ_Control(dev, MBZ_VENDOR_IN, MBZ_VENDOR_READ_EVENTS, 0, 0, data, 5 + (max * 6));
+    if(length < 0)
+    {
+        return length;
+    }
+
+    count = data[0];
+    if((length < 5) || (length < 5 + (count * 6)))
+    {
+        return MBZ_ERR_IO;
+    }
+
+    if(lost != NULL)
+    {
+        *lost = data[1] | (data[2] << 8) | (data[3] << 16) | ((uint32_t)data[4] << 24);
+    }
+
+    for(int i=0;i<count;i++)
+    {
+        p = &data[5 + (i * 6)];
+
+        events[i].board = p[0];
+        events[i].code = p[1];
+        events[i].time = p[2] | (p[3] << 8) | (p[4] << 16) | ((uint32_t)p[5] << 24);
+    }
+
+    return count;
+}
+
+/*************************************************************
+ Command helpers
+ Byte 0 is always the opcode, for board commands Byte 1 is
+ the board address (1 - 7) and the data follows from Byte 2.
+*************************************************************/
+void MBZ_Prepare(MBZ_REQUEST *req, uint8_t opcode, uint8_t board, const uint8_t *data, int length)
+{
+    memset(req->out, 0, MBZ_PACKET_SIZE);
+
+    req->out[0] = opcode;
+    req->out[1] = board;
+
+    if(length > (MBZ_PACKET_SIZE - 2))
+    {
+        length = MBZ_PACKET_SIZE - 2;
+    }
+
+    if((data != NULL) && (length > 0))
+    {
+        memcpy(&req->out[2], data, length);
+    }
+}
+
+void MBZ_Connect(MBZ_REQUEST *req, bool connected)
+{
+    MBZ_Prepare(req, MBZ_CONNECT, connected ? 0x02 : 0x05, NULL, 0);
+}
+
+void MBZ_DataCheck(MBZ_REQUEST *req)
+{
+    MBZ_Prepare(req, MBZ_DATA_CHECK, 0, NULL, 0);
+}
+
+void MBZ_Backlight(MBZ_REQUEST *req, uint8_t level)
+{
+    MBZ_Prepare(req, MBZ_BACKLIGHT, level, NULL, 0);
+}
+
+void MBZ_RunSequence(MBZ_REQUEST *req, uint8_t command)
+{
+    MBZ_Prepare(req, MBZ_RUN_SEQUENCE, command, NULL, 0);
+}
+
+void MBZ_UpdateButton(MBZ_REQUEST *req, uint8_t speed, uint8_t direction)
+{
+    MBZ_Prepare(req, MBZ_UPDATE_BUTTON, speed, &direction, 1);
+}
+
+//Distances are sent least significant byte first
+void MBZ_SaveSequence(MBZ_REQUEST *req, uint8_t number, uint8_t direction, uint8_t acceleration,
+	uint8_t speed, uint8_t deceleration, uint32_t run_distance, uint32_t stop_distance,
+	uint8_t delay, uint8_t total, uint8_t loop)
+{
+    MBZ_Prepare(req, MBZ_SAVE_SEQUENCE, number, NULL, 0);
+
+    req->out[2] = direction;
+    req->out[3] = acceleration;
+    req->out[4] = speed;
+    req->out[5] = deceleration;
+
+    for(int i=0;i<4;i++)
+    {
+        req->out[6 + i] = (run_distance >> (i * 8)) & 0xff;
+        req->out[10 + i] = (stop_distance >> (i * 8)) & 0xff;
+    }
+
+    req->out[14] = delay;
+    req->out[15] = total;
+    req->out[16] = loop;
+}
+
+void MBZ_GetData(MBZ_REQUEST *req, uint8_t board)
+{
+    MBZ_Prepare(req, MBZ_GET_DATA, board, NULL, 0);
+}
+
+void MBZ_BoardCommand(MBZ_REQUEST *req, uint8_t opcode, uint8_t board, const uint8_t *data, int length)
+{
+    MBZ_Prepare(req, opcode, board, data, length);
+}
+
+void MBZ_ScopeStream(MBZ_REQUEST *req, uint8_t channel_mask)
+{
+    MBZ_Prepare(req, MBZ_SCOPE_STREAM, channel_mask, NULL, 0);
+}
+
+void MBZ_BenchLoopback(MBZ_REQUEST *req, const uint8_t *data, int length)
+{
+    //The reply has room for 54 bytes after its header
+    if(length > 54)
+    {
+        length = 54;
+    }
+
+    MBZ_Prepare(req, MBZ_BENCH_LOOPBACK, length, data, length);
+}
+
+//Counts are sent least significant byte first from Byte 1
+static void mbz_put32(uint8_t *buffer, uint32_t value)
+{
+    for(int i=0;i<4;i++)
+    {
+        buffer[i] = (value >> (i * 8)) & 0xff;
+    }
+}
+
+void MBZ_BenchSource(MBZ_REQUEST *req, uint32_t packets)
+{
+    MBZ_Prepare(req, MBZ_BENCH_SOURCE, 0, NULL, 0);
+    mbz_put32(&req->out[1], packets);
+}
+
+void MBZ_BenchSink(MBZ_REQUEST *req, uint32_t packets)
+{
+    MBZ_Prepare(req, MBZ_BENCH_SINK, 0, NULL, 0);
+    mbz_put32(&req->out[1], packets);
+}
+
+void MBZ_BenchReport(MBZ_REQUEST *req, bool reset)
+{
+    MBZ_Prepare(req, MBZ_BENCH_REPORT, reset ? 1 : 0, NULL, 0);
+}
+
+void MBZ_BenchSRAM(MBZ_REQUEST *req, uint16_t address, uint16_t length)
+{
+    MBZ_Prepare(req, MBZ_BENCH_SRAM, 0, NULL, 0);
+
+    //Both least significant byte first from Byte 1
+    req->out[1] = address & 0xff;
+    req->out[2] = address >> 8;
+    req->out[3] = length & 0xff;
+    req->out[4] = length >> 8;
+}
+
+void MBZ_AssetBegin(MBZ_REQUEST *req, uint32_t length)
+{
+    MBZ_Prepare(req, MBZ_ASSET_BEGIN, 0, NULL, 0);
+    mbz_put32(&req->out[1], length);
+}
+
+//offset is 24 bits, Byte 1-3
+void MBZ_AssetWrite(MBZ_REQUEST *req, uint32_t offset, const uint8_t *data, int length)
+{
+    MBZ_Prepare(req, MBZ_ASSET_WRITE, 0, NULL, 0);
+
+    if(length > MBZ_ASSET_WRITE_MAX)
+    {
+        length = MBZ_ASSET_WRITE_MAX;
+    }
+
+    req->out[1] = offset & 0xff;
+    req->out[2] = (offset >> 8) & 0xff;
+    req->out[3] = (offset >> 16) & 0xff;
+    req->out[4] = length;
+    memcpy(&req->out[5], data, length);
+}
+
+void MBZ_AssetStatus(MBZ_REQUEST *req, uint8_t check)
+{
+    MBZ_Prepare(req, MBZ_ASSET_STATUS, check, NULL, 0);
+}
+
+void MBZ_FlashProgramBegin(MBZ_REQUEST *req, uint32_t address, uint32_t length)
+{
+    MBZ_Prepare(req, MBZ_FLASH_PROGRAM_BEGIN, 0, NULL, 0);
+
+    req->out[1] = address & 0xff;
+    req->out[2] = (address >> 8) & 0xff;
+    req->out[3] = (address >> 16) & 0xff;
+    mbz_put32(&req->out[4], length);
+}
+
+void MBZ_FlashProgramData(MBZ_REQUEST *req, uint32_t offset, const uint8_t *data, int length)
+{
+    MBZ_Prepare(req, MBZ_FLASH_PROGRAM_DATA, 0, NULL, 0);
+
+    if(length > MBZ_FLASH_PROGRAM_DATA_MAX)
+    {
+        length = MBZ_FLASH_PROGRAM_DATA_MAX;
+    }
+
+    req->out[1] = offset & 0xff;
+    req->out[2] = (offset >> 8) & 0xff;
+    req->out[3] = (offset >> 16) & 0xff;
+    req->out[4] = length;
+    memcpy(&req->out[5], data, length);
+}
+
+void MBZ_FlashProgramStatus(MBZ_REQUEST *req, bool stop)
+{
+    MBZ_Prepare(req, MBZ_FLASH_PROGRAM_STATUS, stop ? 1 : 0, NULL, 0);
+}
+
+//request MBZ_DIRECTIVE_PRIORITY sets the boards' priorities first
+void MBZ_DirectiveStats(MBZ_REQUEST *req, uint8_t request, const uint8_t priority[MBZ_BOARDS])
+{
+    MBZ_Prepare(req, MBZ_DIRECTIVE_STATS, request, priority, (priority != NULL) ? MBZ_BOARDS : 0);
+}
+
+//probe = true has the device probe every board again
+void MBZ_Peripherals(MBZ_REQUEST *req, bool probe)
+{
+    MBZ_Prepare(req, MBZ_PERIPHERALS, probe ? 1 : 0, NULL, 0);
+}
+
+//clear = true zeroes the board's counts after the reply
+void MBZ_BoardLatency(MBZ_REQUEST *req, uint8_t board, bool clear)
+{
+    uint8_t data = clear ? 1 : 0;
+
+    MBZ_Prepare(req, MBZ_BOARD_LATENCY, board, &data, 1);
+}
+
+//Takes up to MBZ_SERVICE_MAX requests, clear = true zeroes the
+//counters first
+void MBZ_ServiceRequests(MBZ_REQUEST *req, bool clear)
+{
+    MBZ_Prepare(req, MBZ_SERVICE_REQUESTS, clear ? 1 : 0, NULL, 0);
+}
+
+//Posts post to the board first when it is not NULL, the reply
+//has the answers the device took from the boards
+void MBZ_Mailbox(MBZ_REQUEST *req, uint8_t board, const MBZ_MAILBOX_FRAME *post)
+{
+    uint8_t length;
+
+    MBZ_Prepare(req, MBZ_MAILBOX, board, NULL, 0);
+
+    if(post == NULL)
+    {
+        return;
+    }
+
+    length = (post->length > MBZ_MAILBOX_PAYLOAD) ? MBZ_MAILBOX_PAYLOAD : post->length;
+
+    req->out[2] = 1;
+    req->out[3] = post->command;
+    req->out[4] = post->tag;
+    req->out[5] = length;
+    memcpy(&req->out[6], post->data, length);
+}
+
+/*************************************************************
+ Motion sequences (Motion.c)
+ MBZ_MOTION_RUN starts the program at record sequence (1 - 8,
+ saved with MBZ_SaveSequence()) with the profile, the reply is
+ the status from before the device compiled it.
+*************************************************************/
+void MBZ_Motion(MBZ_REQUEST *req, uint8_t action, uint8_t sequence, uint8_t profile)
+{
+    uint8_t data[2] = {sequence, profile};
+
+    MBZ_Prepare(req, MBZ_MOTION, action, data, 2);
+}
+
+/*************************************************************
+ Flash programming
+ The image goes out in Flash Program Data packets, with
+ MBZ_FLASH_PROGRAM_DEPTH of them in flight. The device takes the
+ bytes in order only: a busy or refused reply sends the image
+ again from the offset the device expects, the replies to
+ packets sent before that are then ignored.
+*************************************************************/
+typedef struct
+{
+    MBZ_DEVICE *dev;
+    const uint8_t *data;
+    uint32_t length;
+    uint32_t next;
+    uint32_t epoch;
+    uint32_t epochs[MBZ_FLASH_PROGRAM_DEPTH];
+    MBZ_REQUEST reqs[MBZ_FLASH_PROGRAM_DEPTH];
+    MBZ_FLASH_PROGRESS *status;
+    int in_flight;
+    int error;
+} MBZ_PROGRAM_STATE;
+
+static uint32_t mbz_get24(const uint8_t *buffer)
+{
+    return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16);
+}
+
+static uint32_t mbz_get32(const uint8_t *buffer)
+{
+    return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+//CRC-32 as CRC32() in Convert.c
+static uint32_t mbz_crc32(const uint8_t *data, uint32_t length)
+{
+    uint32_t crc = 0xffffffff;
+
+    for(uint32_t i=0;i<length;i++)
+    {
+        crc = crc ^ data[i];
+
+        for(int j=0;j<8;j++)
+        {
+            crc = (crc & 1) ? ((crc >> 1) ^ 0xedb88320) : (crc >> 1);
+        }
+    }
+
+    return crc ^ 0xffffffff;
+}
+
+static void mbz_program_done(MBZ_REQUEST *req, void *context);
+
+static void mbz_program_send(MBZ_PROGRAM_STATE *state, MBZ_REQUEST *req)
+{
+    uint32_t count = state->length - state->next;
+    uint32_t block_left = MBZ_FLASH_PROGRAM_BLOCK - (state->next % MBZ_FLASH_PROGRAM_BLOCK);
+
+    if((state->next >= state->length) || (state->error != MBZ_OK))
+    {
+        return;
+    }
+
+    if(count > MBZ_FLASH_PROGRAM_DATA_MAX)
+    {
+        count = MBZ_FLASH_PROGRAM_DATA_MAX;
+    }
+    if(count > block_left)
+    {
+        count = block_left;
+    }
+
+    MBZ_FlashProgramData(req, state->next, &state->data[state->next], count);
+    req->callback = mbz_program_done;
+    req->context = state;
+
+    state->epochs[req - state->reqs] = state->epoch;
+    state->next += count;
+    state->in_flight++;
+
+    if(MBZ_Submit(state->dev, req) != MBZ_OK)
+    {
+        state->in_flight--;
+        state->error = MBZ_ERR_CLOSED;
+    }
+}
+
+static void mbz_program_done(MBZ_REQUEST *req, void *context)
+{
+    MBZ_PROGRAM_STATE *state = context;
+    uint32_t expected;
+
+    state->in_flight--;
+
+    if(req->status != MBZ_OK)
+    {
+        state->error = req->status;
+        return;
+    }
+
+    expected = mbz_get24(&req->in[2]);
+    state->status->received = expected;
+
+    if((req->in[1] != 1) && (state->epochs[req - state->reqs] == state->epoch))
+    {
+        //Refused where the device expected it, it will not take it
+        if((req->in[1] == 2) && (mbz_get24(&req->out[1]) == expected))
+        {
+            state->error = MBZ_ERR_IO;
+            return;
+        }
+
+        state->epoch++;
+        state->next = expected;
+    }
+
+    mbz_program_send(state, req);
+}
+
+int MBZ_ReadFlashProgram(MBZ_DEVICE *dev, bool stop, MBZ_FLASH_PROGRESS *status)
+{
+    MBZ_REQUEST req;
+    int result;
+
+    memset(&req, 0, sizeof(req));
+    MBZ_FlashProgramStatus(&req, stop);
+
+    result = MBZ_Transfer(dev, &req);
+    if(result != MBZ_OK)
+    {
+        return result;
+    }
+
+    status->state = req.in[1];
+    status->received = mbz_get32(&req.in[2]);
+    status->checked = mbz_get32(&req.in[6]);
+    status->length = mbz_get32(&req.in[10]);
+    status->crc = mbz_get32(&req.in[14]);
+    status->errors = req.in[18] | (req.in[19] << 8);
+    status->failed_block = req.in[20] | (req.in[21] << 8);
+    status->ticks = mbz_get32(&req.in[22]);
+
+    return MBZ_OK;
+}
+
+//Sends the image to address (on a sector), returns when the
+//device has programmed and checked it
+int MBZ_ProgramFlash(MBZ_DEVICE *dev, uint32_t address, const uint8_t *data, uint32_t length,
+	MBZ_FLASH_PROGRESS *status, MBZ_PROGRESS progress, void *context)
+{
+    MBZ_PROGRAM_STATE *state;
+    MBZ_REQUEST req;
+    int result;
+
+    memset(status, 0, sizeof(*status));
+    status->length = length;
+
+    memset(&req, 0, sizeof(req));
+    MBZ_FlashProgramBegin(&req, address, length);
+
+    result = MBZ_Transfer(dev, &req);
+    if(result != MBZ_OK)
+    {
+        return result;
+    }
+    if(req.in[1] != 1)
+    {
+        return MBZ_ERR_ARG;
+    }
+
+    state = calloc(1, sizeof(MBZ_PROGRAM_STATE));
+    if(state == NULL)
+    {
+        return MBZ_ERR_IO;
+    }
+
+    state->dev = dev;
+    state->data = data;
+    state->length = length;
+    state->status = status;
+    state->error = MBZ_OK;
+    status->state = MBZ_FLASH_PROGRAM_RUNNING;
+
+    for(int i=0;i<MBZ_FLASH_PROGRAM_DEPTH;i++)
+    {
+        mbz_program_send(state, &state->reqs[i]);
+    }
+
+    while(state->in_flight > 0)
+    {
+        result = MBZ_Poll(dev, 10);
+        if(result < 0)
+        {
+            free(state);
+            return result;
+        }
+
+        if(progress != NULL)
+        {
+            progress(status, context);
+        }
+    }
+
+    result = state->error;
+    free(state);
+
+    if(result != MBZ_OK)
+    {
+        MBZ_ReadFlashProgram(dev, true, status);
+        return result;
+    }
+
+    do
+    {
+        result = MBZ_ReadFlashProgram(dev, false, status);
+        if(result != MBZ_OK)
+        {
+            return result;
+        }
+
+        if(progress != NULL)
+        {
+            progress(status, context);
+        }
+    }
+    while(status->state == MBZ_FLASH_PROGRAM_RUNNING);
+
+    if((status->state != MBZ_FLASH_PROGRAM_DONE) || (status->crc != mbz_crc32(data, length)))
+    {
+        return MBZ_ERR_IO;
+    }
+
+    return MBZ_OK;
+}
+
+/*************************************************************
+ Directive scheduler (Directives.c), the boards that are there
+ (Peripherals.c), their service requests (Service.c) and
+ mailboxes (Mailbox.c)
+*************************************************************/
+int MBZ_ReadDirectiveStats(MBZ_DEVICE *dev, uint8_t request, const uint8_t priority[MBZ_BOARDS],
+	MBZ_SCHEDULER_STATS *stats)
+{
+    MBZ_REQUEST req;
+    int result;
+
+    memset(&req, 0, sizeof(req));
+    MBZ_DirectiveStats(&req, request, priority);
+
+    result = MBZ_Transfer(dev, &req);
+    if(result != MBZ_OK)
+    {
+        return result;
+    }
+
+    stats->queued = req.in[1];
+    for(int i=0;i<MBZ_BOARDS;i++)
+    {
+        stats->priority[i] = req.in[2 + i];
+    }
+    stats->directives = mbz_get32(&req.in[9]);
+    stats->acks = mbz_get32(&req.in[13]);
+    stats->timeouts = mbz_get32(&req.in[17]);
+    stats->rate = mbz_get32(&req.in[21]);
+    stats->prefills = mbz_get32(&req.in[25]);
+    stats->waits = mbz_get32(&req.in[29]);
+    stats->ack_ticks = mbz_get32(&req.in[33]);
+    stats->ack_max = mbz_get32(&req.in[37]);
+
+    return MBZ_OK;
+}
+
+//The table from before the probes when probe is true
+int MBZ_ReadPeripherals(MBZ_DEVICE *dev, bool probe, MBZ_PERIPHERAL boards[MBZ_BOARDS], uint32_t *enumerate_ticks)
+{
+    MBZ_REQUEST req;
+    const uint8_t *entry;
+    int result;
+
+    memset(&req, 0, sizeof(req));
+    MBZ_Peripherals(&req, probe);
+
+    result = MBZ_Transfer(dev, &req);
+    if(result != MBZ_OK)
+    {
+        return result;
+    }
+
+    if(enumerate_ticks != NULL)
+    {
+        *enumerate_ticks = mbz_get32(&req.in[2]);
+    }
+
+    for(int i=0;i<MBZ_BOARDS;i++)
+    {
+        entry = &req.in[6 + (i * 8)];
+
+        boards[i].present = entry[0];
+        boards[i].misses = entry[1];
+        boards[i].changes = entry[2] | (entry[3] << 8);
+        boards[i].ack_ticks = mbz_get32(&entry[4]);
+    }
+
+    return MBZ_OK;
+}
+
+int MBZ_ReadBoardLatency(MBZ_DEVICE *dev, uint8_t board, bool clear, MBZ_LATENCY *latency)
+{
+    MBZ_REQUEST req;
+    int result;
+
+    memset(&req, 0, sizeof(req));
+    MBZ_BoardLatency(&req, board, clear);
+
+    result = MBZ_Transfer(dev, &req);
+    if(result != MBZ_OK)
+    {
+        return result;
+    }
+
+    if(req.in[1] != board)
+    {
+        return MBZ_ERR_ARG;
+    }
+
+    latency->acks = mbz_get32(&req.in[2]);
+    latency->timeouts = mbz_get32(&req.in[6]);
+    latency->min_ticks = mbz_get32(&req.in[10]);
+    latency->max_ticks = mbz_get32(&req.in[14]);
+    latency->mean_ticks = mbz_get32(&req.in[18]);
+    for(int i=0;i<MBZ_LATENCY_BUCKETS;i++)
+    {
+        latency->buckets[i] = req.in[22 + (i * 2)] | (req.in[23 + (i * 2)] << 8);
+    }
+
+    return MBZ_OK;
+}
+
+//Returns the number of requests taken
+int MBZ_ReadServiceRequests(MBZ_DEVICE *dev, bool clear, MBZ_SERVICE_STATS *stats,
+	MBZ_SERVICE_EVENT events[MBZ_SERVICE_MAX])
+{
+    MBZ_REQUEST req;
+    const uint8_t *entry;
+    int count;
+    int result;
+
+    memset(&req, 0, sizeof(req));
+    MBZ_ServiceRequests(&req, clear);
+
+    result = MBZ_Transfer(dev, &req);
+    if(result != MBZ_OK)
+    {
+        return result;
+    }
+
+    count = req.in[1];
+    if(count > MBZ_SERVICE_MAX)
+    {
+        return MBZ_ERR_IO;
+    }
+
+    stats->requests = mbz_get32(&req.in[2]);
+    stats->scans = mbz_get32(&req.in[6]);
+    stats->lost = mbz_get32(&req.in[10]);
+    stats->scan_max_ticks = mbz_get32(&req.in[14]);
+    stats->queued = req.in[60];
+
+    for(int i=0;i<count;i++)
+    {
+        entry = &req.in[18 + (i * 6)];
+
+        events[i].board = entry[0];
+        events[i].priority = entry[1] & 3;
+        events[i].reason = entry[1] >> 2;
+        events[i].time = mbz_get32(&entry[2]);
+    }
+
+    return count;
+}
+
+//Returns the number of answers taken
+int MBZ_ReadMailbox(MBZ_DEVICE *dev, uint8_t board, const MBZ_MAILBOX_FRAME *post,
+	MBZ_MAILBOX_STATUS *status, MBZ_MAILBOX_FRAME frames[MBZ_MAILBOX_MAX])
+{
+    MBZ_REQUEST req;
+    const uint8_t *entry;
+    int count;
+    int result;
+
+    memset(&req, 0, sizeof(req));
+    MBZ_Mailbox(&req, board, post);
+
+    result = MBZ_Transfer(dev, &req);
+    if(result != MBZ_OK)
+    {
+        return result;
+    }
+
+    count = req.in[3];
+    if(count > MBZ_MAILBOX_MAX)
+    {
+        return MBZ_ERR_IO;
+    }
+
+    status->posted = req.in[1] != 0;
+    status->pending = req.in[2];
+    status->kept = req.in[4];
+    status->lost = mbz_get32(&req.in[5]);
+
+    for(int i=0;i<count;i++)
+    {
+        entry = &req.in[9 + (i * 17)];
+
+        frames[i].board = entry[0];
+        frames[i].length = (entry[1] > MBZ_MAILBOX_PAYLOAD) ? MBZ_MAILBOX_PAYLOAD : entry[1];
+        frames[i].command = entry[2];
+        frames[i].tag = entry[3];
+        memcpy(frames[i].data, &entry[4], MBZ_MAILBOX_PAYLOAD);
+    }
+
+    return count;
+}
+
+int MBZ_ReadMotion(MBZ_DEVICE *dev, uint8_t action, uint8_t sequence, uint8_t profile,
+	MBZ_MOTION_STATUS *status)
+{
+    MBZ_REQUEST req;
+    int result;
+
+    memset(&req, 0, sizeof(req));
+    MBZ_Motion(&req, action, sequence, profile);
+
+    result = MBZ_Transfer(dev, &req);
+    if(result != MBZ_OK)
+    {
+        return result;
+    }
+
+    status->running = req.in[1] != 0;
+    status->sequence = req.in[2];
+    status->result = req.in[3];
+    status->setpoint = req.in[4] | (req.in[5] << 8);
+    status->distance = mbz_get32(&req.in[6]);
+    status->ticks = mbz_get32(&req.in[10]);
+    status->records = mbz_get32(&req.in[14]);
+    status->underruns = mbz_get32(&req.in[18]);
+    status->late_max_ticks = mbz_get32(&req.in[22]);
+    status->late_mean_ticks = mbz_get32(&req.in[26]);
+    status->interval_min_ticks = mbz_get32(&req.in[30]);
+    status->interval_max_ticks = mbz_get32(&req.in[34]);
+    status->write_max_ticks = mbz_get32(&req.in[38]);
+    status->busy = mbz_get32(&req.in[42]);
+
+    return MBZ_OK;
+}
+
+/*************************************************************
+ Statistics
+*************************************************************/
+void MBZ_GetStats(MBZ_DEVICE *dev, uint8_t opcode, MBZ_STATS *stats)
+{
+    *stats = dev->stats[opcode];
+}
+
+void MBZ_ResetStats(MBZ_DEVICE *dev)
+{
+    memset(dev->stats, 0, sizeof(dev->stats));
+
+    for(int i=0;i<256;i++)
+    {
+        dev->stats[i].latency_min_ns = UINT64_MAX;
+    }
+}
+
+void MBZ_PrintStats(MBZ_DEVICE *dev, FILE *out)
+{
+    const MBZ_OPCODE_INFO *info;
+    MBZ_STATS *s;
+    double seconds;
+
+    fprintf(out, "%-4s %-20s %10s %7s %10s %10s %10s %12s %10s\n",
+	    "op", "name", "count", "errors", "avg us", "min us", "max us", "ops/s", "KB/s");
+
+    for(int op=0;op<256;op++)
+    {
+        s = &dev->stats[op];
+        if(s->count == 0)
+        {
+            continue;
+        }
+
+        info = MBZ_Opcode(op);
+        seconds = (s->last_complete_ns - s->first_submit_ns) / 1e9;
+
+        fprintf(out, "0x%02x %-20s %10llu %7llu %10.1f %10.1f %10.1f %12.0f %10.1f\n",
+		op,
+		(info != NULL) ? info->name : "?",
+		(unsigned long long)s->count,
+		(unsigned long long)s->errors,
+		(s->latency_sum_ns / (double)s->count) / 1e3,
+		s->latency_min_ns / 1e3,
+		s->latency_max_ns / 1e3,
+		(seconds > 0) ? s->count / seconds : 0.0,
+		(seconds > 0) ? ((s->bytes_out + s->bytes_in) / 1024.0) / seconds : 0.0);
+    }
+}
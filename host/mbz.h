@@ -0,0 +1,539 @@
+/*********************************************************************
+    FileName:     	mbz.h
+    Dependencies:	See #includes
+    Processor:		Host (Linux)
+    Hardware:		MainBrain MZ
+    Complier:		GCC
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        Host side client library for the MainBrain MZ
+
+    File Description:
+        Every Host_CMDs opcode is listed in MBZ_OPCODES together with
+        whether the device answers it on Endpoint 2.
+
+        Requests are submitted asynchronously. Up to pipeline_depth
+        requests are on the wire at once, the rest wait in a queue.
+        Replies from the device are not tagged, they come back in the
+        order the commands were sent, so each reply completes the
+        oldest request that expects one. Requests without a reply
+        complete as soon as the device has accepted the packet.
+
+        MBZ_Poll() drives the I/O and calls the completion callbacks.
+
+        Endpoint 2 packets that no request is waiting for (the
+        benchmark source stream) go to the bulk callback.
+
+        MBZ_Control() runs one control transfer on Endpoint 0 and
+        waits for it. The vendor requests read the device status and
+        read or write the SRAM without queueing behind bulk traffic.
+
+        Latency and throughput are counted per opcode.
+
+    Change History:
+
+/***********************************************************************/
+
+#ifndef MBZ_H
+#define	MBZ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//Bulk packet size on Endpoints 1 and 2
+#define MBZ_PACKET_SIZE         64
+
+//Largest packet on any endpoint (scope frames on Endpoint 3)
+#define MBZ_MAX_PACKET          1024
+
+//Endpoints as seen on the wire
+#define MBZ_EP_CONTROL_OUT      0x00
+#define MBZ_EP_CONTROL_IN       0x80
+#define MBZ_EP_OUT              0x01
+#define MBZ_EP_IN               0x82
+#define MBZ_EP_SCOPE            0x83
+
+//Default path of the simulated device socket
+#define MBZ_SIM_SOCKET          "/tmp/mainbrain.sock"
+
+#define MBZ_DEFAULT_TIMEOUT_MS  1000
+
+//First byte of a control transfer reply on the wire
+#define MBZ_CONTROL_ACK         0
+#define MBZ_CONTROL_STALL       1
+
+//Vendor control requests
+#define MBZ_VENDOR_IN           0xc0
+#define MBZ_VENDOR_OUT          0x40
+#define MBZ_VENDOR_READ_STATUS  0x01
+#define MBZ_VENDOR_READ_SRAM    0x02
+#define MBZ_VENDOR_WRITE_SRAM   0x03
+#define MBZ_VENDOR_READ_LOCKS   0x04
+#define MBZ_VENDOR_READ_COLLISIONS 0x05
+#define MBZ_VENDOR_READ_EVENTS  0x06
+#define MBZ_VENDOR_READ_SHADOW  0x07
+#define MBZ_VENDOR_READ_FLASH_JOBS 0x08
+#define MBZ_VENDOR_READ_FLASH_STALLS 0x09
+#define MBZ_VENDOR_READ_FLASH_CACHE 0x0a
+
+//Largest vendor request data stage
+#define MBZ_VENDOR_MAX          512
+
+//Request status
+#define MBZ_OK                  0
+#define MBZ_ERR_IO              -1
+#define MBZ_ERR_TIMEOUT         -2
+#define MBZ_ERR_CLOSED          -3
+#define MBZ_ERR_ARG             -4
+#define MBZ_ERR_STALL           -5
+
+//Host_CMDs opcodes
+typedef enum
+{
+    MBZ_CONNECT =               0x00,
+    MBZ_DATA_CHECK =            0x01,
+    MBZ_SEND_MESSAGE =          0x02,
+    MBZ_BACKLIGHT =             0x03,
+    MBZ_RUN_SEQUENCE =          0x06,
+    MBZ_BOARD_COMM_CHECK =      0x07,
+    MBZ_UPDATE_BUTTON =         0x09,
+    MBZ_SAVE_SEQUENCE =         0x0a,
+    MBZ_DEBUG_SCREEN =          0x0b,
+    MBZ_BENCH_LOOPBACK =        0x10,
+    MBZ_BENCH_SOURCE =          0x11,
+    MBZ_BENCH_SINK =            0x12,
+    MBZ_BENCH_REPORT =          0x13,
+    MBZ_BENCH_SRAM =            0x14,
+    MBZ_GET_DATA =              0x64,
+    MBZ_SEND_BYTE =             0x65,
+    MBZ_SET_DAC =               0x67,
+    MBZ_SET_PWM =               0x68,
+    MBZ_DAC_WAVEFORM =          0x69,
+    MBZ_ADC_READ =              0x6a,
+    MBZ_GET_BOARD_DATA =        0x6b,
+    MBZ_SWITCHES =              0x6c,
+    MBZ_READ_FLASH =            0x6d,
+    MBZ_WRITE_FLASH =           0x6e,
+    MBZ_FLASH_CHIP_ERASE =      0x6f,
+    MBZ_SCOPE =                 0x70,
+    MBZ_FLASH_COPY_BUFFER =     0x71,
+    MBZ_COPY_FILE =             0x72,
+    MBZ_FILE_DATA =             0x73,
+    MBZ_SCOPE_STREAM =          0x74,
+    MBZ_MEMORY_TEST =           0x75,
+    MBZ_FLASH_USED =            0x76,
+    MBZ_ASSET_BEGIN =           0x77,
+    MBZ_ASSET_WRITE =           0x78,
+    MBZ_ASSET_STATUS =          0x79,
+    MBZ_DIRECTIVE_STATS =       0x7a,
+    MBZ_PERIPHERALS =           0x7b,
+    MBZ_BOARD_LATENCY =         0x7c,
+    MBZ_SERVICE_REQUESTS =      0x7d,
+    MBZ_MOTION =                0x7e,
+    MBZ_MAILBOX =               0x7f,
+    MBZ_FLASH_PROGRAM_BEGIN =   0x80,
+    MBZ_FLASH_PROGRAM_DATA =    0x81,
+    MBZ_FLASH_PROGRAM_STATUS =  0x82
+} MBZ_OPCODE;
+
+//Asset store update (Assets.c), Asset Status reply Byte 1
+#define MBZ_ASSET_IDLE          0
+#define MBZ_ASSET_ERASING       1
+#define MBZ_ASSET_WRITING       2
+#define MBZ_ASSET_VERIFYING     3
+#define MBZ_ASSET_FAILED        4
+
+//Asset Status request Byte 1
+#define MBZ_ASSET_CHECK         1
+#define MBZ_ASSET_CHECK_FLASH   2
+
+//Bytes per Asset Write
+#define MBZ_ASSET_WRITE_MAX     56
+
+typedef struct
+{
+    uint8_t opcode;
+    const char *name;
+    bool has_reply;
+} MBZ_OPCODE_INFO;
+
+extern const MBZ_OPCODE_INFO MBZ_OPCODES[];
+extern const int MBZ_NUM_OPCODES;
+
+typedef struct MBZ_DEVICE MBZ_DEVICE;
+typedef struct MBZ_REQUEST MBZ_REQUEST;
+
+typedef void (*MBZ_CALLBACK)(MBZ_REQUEST *req, void *context);
+
+struct MBZ_REQUEST
+{
+    //Filled in by the caller
+    uint8_t out[MBZ_PACKET_SIZE];
+    MBZ_CALLBACK callback;
+    void *context;
+
+    //Filled in by the library
+    uint8_t in[MBZ_PACKET_SIZE];
+    int status;
+    bool has_reply;
+    uint64_t submit_ns;
+    uint64_t sent_ns;
+    uint64_t complete_ns;
+    MBZ_REQUEST *next;
+};
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t errors;
+    uint64_t bytes_out;
+    uint64_t bytes_in;
+    uint64_t latency_sum_ns;
+    uint64_t latency_min_ns;
+    uint64_t latency_max_ns;
+    uint64_t first_submit_ns;
+    uint64_t last_complete_ns;
+} MBZ_STATS;
+
+//Vendor Read Status
+typedef struct
+{
+    uint8_t usb_state;
+    uint8_t device_state;
+    uint8_t screen;
+    uint8_t board_address;
+    uint32_t last_error;
+    uint8_t peripherals[7];             //1 for a board that is there, [0] is board 1
+    uint8_t scope_mask;
+} MBZ_STATUS;
+
+//Vendor Read Lock Stats, one per SRAM semaphore flag
+typedef struct
+{
+    uint32_t locks;
+    uint32_t contended;
+    uint32_t timeouts;
+    uint32_t wait_max_ticks;
+} MBZ_LOCK_STATS;
+
+//Directive Stats request Byte 1
+#define MBZ_DIRECTIVE_READ      0
+#define MBZ_DIRECTIVE_PRIORITY  1
+#define MBZ_DIRECTIVE_CLEAR     2
+
+//Board priorities for the directive scheduler, 3 goes first
+#define MBZ_PRIORITY_LOW        0
+#define MBZ_PRIORITY_NORMAL     1
+#define MBZ_PRIORITY_HIGH       3
+#define MBZ_BOARDS              7
+
+//Directive Stats (Directives.c), times are Core Timer ticks (100 MHz)
+typedef struct
+{
+    uint8_t queued;                         //bit 0 is board 1
+    uint8_t priority[MBZ_BOARDS];
+    uint32_t directives;
+    uint32_t acks;
+    uint32_t timeouts;
+    uint32_t rate;                          //directives per second
+    uint32_t prefills;                      //written while another board worked
+    uint32_t waits;                         //for a full board queue
+    uint32_t ack_ticks;
+    uint32_t ack_max;
+} MBZ_SCHEDULER_STATS;
+
+//Peripherals (Peripherals.c), one per board
+typedef struct
+{
+    uint8_t present;
+    uint8_t misses;                         //time outs in a row
+    uint16_t changes;                       //times added or removed
+    uint32_t ack_ticks;                     //select to ACK, last ACK
+} MBZ_PERIPHERAL;
+
+//Board Latency (Peripherals.c), select to ACK in Core Timer ticks,
+//bucket n counts 2^n to 2^(n+1) - 1 ticks, the last one the rest
+#define MBZ_LATENCY_BUCKETS     16
+
+typedef struct
+{
+    uint32_t acks;
+    uint32_t timeouts;
+    uint32_t min_ticks;
+    uint32_t max_ticks;
+    uint32_t mean_ticks;
+    uint16_t buckets[MBZ_LATENCY_BUCKETS];  //0xffff for 0xffff or more
+} MBZ_LATENCY;
+
+//Service Requests (Service.c), the boards' requests on RA7
+#define MBZ_SERVICE_MAX         7
+
+typedef struct
+{
+    uint8_t board;
+    uint8_t priority;                       //0 - 3, 3 first
+    uint8_t reason;
+    uint32_t time;                          //Core Timer count of the scan
+} MBZ_SERVICE_EVENT;
+
+typedef struct
+{
+    uint32_t requests;
+    uint32_t scans;
+    uint32_t lost;                          //queue full
+    uint32_t scan_max_ticks;
+    uint8_t queued;                         //left on the device
+} MBZ_SERVICE_STATS;
+
+//Mailbox (Mailbox.c), requests posted to a board and its answers
+#define MBZ_MAILBOX_MAX         3
+#define MBZ_MAILBOX_PAYLOAD     13
+
+typedef struct
+{
+    uint8_t board;                          //answers only
+    uint8_t command;
+    uint8_t tag;
+    uint8_t length;
+    uint8_t data[MBZ_MAILBOX_PAYLOAD];
+} MBZ_MAILBOX_FRAME;
+
+typedef struct
+{
+    bool posted;
+    uint8_t pending;                        //requests the board has not taken
+    uint8_t kept;                           //answers left on the device
+    uint32_t lost;                          //the device kept too many
+} MBZ_MAILBOX_STATUS;
+
+//Motion (Motion.c), sequences run on the device
+#define MBZ_MOTION_READ         0
+#define MBZ_MOTION_RUN          1
+#define MBZ_MOTION_STOP         2
+#define MBZ_MOTION_CLEAR        3
+
+#define MBZ_PROFILE_TRAPEZOID   0
+#define MBZ_PROFILE_SCURVE      1
+
+//Last run request
+#define MBZ_MOTION_STARTED      0
+#define MBZ_MOTION_NO_RECORD    1
+#define MBZ_MOTION_NO_BOARD     2
+
+//Times are Core Timer ticks (100 MHz), one tick every 1 ms
+typedef struct
+{
+    bool running;
+    uint8_t sequence;                       //record running
+    uint8_t result;
+    uint16_t setpoint;                      //8.8 fixed point
+    uint32_t distance;                      //speed x ms
+    uint32_t ticks;
+    uint32_t records;
+    uint32_t underruns;
+    uint32_t late_max_ticks;                //period to interrupt
+    uint32_t late_mean_ticks;
+    uint32_t interval_min_ticks;            //between ticks
+    uint32_t interval_max_ticks;
+    uint32_t write_max_ticks;
+    uint32_t busy;
+} MBZ_MOTION_STATUS;
+
+#define MBZ_LOCK_FLAGS          8
+
+//Vendor Read Collision Stats, one per SRAM semaphore flag
+typedef struct
+{
+    uint32_t collisions;
+    uint32_t retries;
+    uint32_t failures;
+    uint32_t bursts;
+} MBZ_COLLISION_STATS;
+
+//Vendor Read Shadow Stats, one per SRAM region
+typedef struct
+{
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t bursts;
+    uint32_t bytes;
+} MBZ_SHADOW_STATS;
+
+//Vendor Read Flash Job Stats, times are Core Timer ticks (100 MHz)
+typedef struct
+{
+    uint32_t jobs;
+    uint32_t failures;
+    uint32_t bytes;
+    uint32_t sectors;
+    uint32_t program_ticks;
+    uint32_t erase_ticks;
+    uint32_t tick_ticks;
+    uint32_t waits;
+} MBZ_FLASH_JOB_STATS;
+
+//Vendor Read Flash Stall Stats, one per job type
+typedef struct
+{
+    uint32_t reads;
+    uint32_t suspends;
+    uint32_t stall_ticks;
+    uint32_t stall_max_ticks;
+} MBZ_FLASH_STALL_STATS;
+
+//Vendor Read Flash Cache Stats, counts of 64 byte blocks
+typedef struct
+{
+    uint32_t reads;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t invalidated;
+} MBZ_FLASH_CACHE_STATS;
+
+#define MBZ_FLASH_PROGRAM       0
+#define MBZ_FLASH_SECTOR_ERASE  1
+#define MBZ_FLASH_CHIP_ERASE    2
+#define MBZ_FLASH_JOB_TYPES     3
+
+//Flash Program Status (Flash_Program.c)
+#define MBZ_FLASH_PROGRAM_IDLE      0
+#define MBZ_FLASH_PROGRAM_RUNNING   1
+#define MBZ_FLASH_PROGRAM_DONE      2
+#define MBZ_FLASH_PROGRAM_FAILED    3
+
+//Bytes per Flash Program Data, a packet never crosses a block
+#define MBZ_FLASH_PROGRAM_DATA_MAX  56
+#define MBZ_FLASH_PROGRAM_BLOCK     0x1000
+
+//Flash Program Data packets in flight
+#define MBZ_FLASH_PROGRAM_DEPTH     8
+
+typedef struct
+{
+    uint8_t state;
+    uint32_t received;
+    uint32_t checked;
+    uint32_t length;
+    uint32_t crc;
+    uint16_t errors;
+    uint16_t failed_block;
+    uint32_t ticks;
+} MBZ_FLASH_PROGRESS;
+
+//Called while an image is sent and checked
+typedef void (*MBZ_PROGRESS)(const MBZ_FLASH_PROGRESS *status, void *context);
+
+//Vendor Read Board Events
+typedef struct
+{
+    uint8_t board;
+    uint8_t code;
+    uint32_t time;
+} MBZ_BOARD_EVENT;
+
+#define MBZ_BOARD_EVENT_DONE    0
+#define MBZ_BOARD_EVENT_ADDED   0x1c    //a board answered a probe
+#define MBZ_BOARD_EVENT_REMOVED 0x1d    //a board stopped answering
+#define MBZ_BOARD_EVENT_ACK     0x1e    //the directive ended with the /ACK
+#define MBZ_BOARD_EVENT_TIMEOUT 0x1f    //the directive timed out
+#define MBZ_EVENTS_MAX          ((MBZ_VENDOR_MAX - 5) / 6)
+
+typedef void (*MBZ_STREAM_CALLBACK)(const uint8_t *frame, int length, void *context);
+
+//Connection
+MBZ_DEVICE *MBZ_Open(const char *path, int pipeline_depth);
+void MBZ_Close(MBZ_DEVICE *dev);
+void MBZ_SetTimeout(MBZ_DEVICE *dev, int timeout_ms);
+void MBZ_SetStreamCallback(MBZ_DEVICE *dev, MBZ_STREAM_CALLBACK callback, void *context);
+void MBZ_SetBulkCallback(MBZ_DEVICE *dev, MBZ_STREAM_CALLBACK callback, void *context);
+
+//Requests
+const MBZ_OPCODE_INFO *MBZ_Opcode(uint8_t opcode);
+void MBZ_Prepare(MBZ_REQUEST *req, uint8_t opcode, uint8_t board, const uint8_t *data, int length);
+int MBZ_Submit(MBZ_DEVICE *dev, MBZ_REQUEST *req);
+int MBZ_Poll(MBZ_DEVICE *dev, int timeout_ms);
+int MBZ_Drain(MBZ_DEVICE *dev);
+int MBZ_Pending(MBZ_DEVICE *dev);
+int MBZ_Transfer(MBZ_DEVICE *dev, MBZ_REQUEST *req);
+
+//Control transfers, return the data stage length or an error
+int MBZ_Control(MBZ_DEVICE *dev, uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+	uint8_t *data, uint16_t length);
+int MBZ_ReadStatus(MBZ_DEVICE *dev, MBZ_STATUS *status);
+int MBZ_ReadSRAM(MBZ_DEVICE *dev, uint16_t address, uint8_t *data, uint16_t length);
+int MBZ_ReadLockStats(MBZ_DEVICE *dev, MBZ_LOCK_STATS stats[MBZ_LOCK_FLAGS]);
+int MBZ_ReadCollisionStats(MBZ_DEVICE *dev, MBZ_COLLISION_STATS stats[MBZ_LOCK_FLAGS]);
+int MBZ_ReadShadowStats(MBZ_DEVICE *dev, MBZ_SHADOW_STATS stats[MBZ_LOCK_FLAGS]);
+int MBZ_ReadFlashJobStats(MBZ_DEVICE *dev, MBZ_FLASH_JOB_STATS *stats);
+int MBZ_ReadFlashStallStats(MBZ_DEVICE *dev, MBZ_FLASH_STALL_STATS stats[MBZ_FLASH_JOB_TYPES]);
+int MBZ_ReadFlashCacheStats(MBZ_DEVICE *dev, MBZ_FLASH_CACHE_STATS *stats);
+int MBZ_ReadBoardEvents(MBZ_DEVICE *dev, MBZ_BOARD_EVENT *events, int max, uint32_t *lost);
+int MBZ_WriteSRAM(MBZ_DEVICE *dev, uint16_t address, const uint8_t *data, uint16_t length);
+int MBZ_ReadFlashProgram(MBZ_DEVICE *dev, bool stop, MBZ_FLASH_PROGRESS *status);
+int MBZ_ReadDirectiveStats(MBZ_DEVICE *dev, uint8_t request, const uint8_t priority[MBZ_BOARDS],
+	MBZ_SCHEDULER_STATS *stats);
+int MBZ_ReadPeripherals(MBZ_DEVICE *dev, bool probe, MBZ_PERIPHERAL boards[MBZ_BOARDS], uint32_t *enumerate_ticks);
+int MBZ_ReadBoardLatency(MBZ_DEVICE *dev, uint8_t board, bool clear, MBZ_LATENCY *latency);
+int MBZ_ReadServiceRequests(MBZ_DEVICE *dev, bool clear, MBZ_SERVICE_STATS *stats,
+	MBZ_SERVICE_EVENT events[MBZ_SERVICE_MAX]);
+int MBZ_ReadMailbox(MBZ_DEVICE *dev, uint8_t board, const MBZ_MAILBOX_FRAME *post,
+	MBZ_MAILBOX_STATUS *status, MBZ_MAILBOX_FRAME frames[MBZ_MAILBOX_MAX]);
+int MBZ_ReadMotion(MBZ_DEVICE *dev, uint8_t action, uint8_t sequence, uint8_t profile,
+	MBZ_MOTION_STATUS *status);
+int MBZ_ProgramFlash(MBZ_DEVICE *dev, uint32_t address, const uint8_t *data, uint32_t length,
+	MBZ_FLASH_PROGRESS *status, MBZ_PROGRESS progress, void *context);
+
+//Command helpers, each fills in a request ready for MBZ_Submit()
+void MBZ_Connect(MBZ_REQUEST *req, bool connected);
+void MBZ_DataCheck(MBZ_REQUEST *req);
+void MBZ_Backlight(MBZ_REQUEST *req, uint8_t level);
+void MBZ_RunSequence(MBZ_REQUEST *req, uint8_t command);
+void MBZ_UpdateButton(MBZ_REQUEST *req, uint8_t speed, uint8_t direction);
+void MBZ_SaveSequence(MBZ_REQUEST *req, uint8_t number, uint8_t direction, uint8_t acceleration,
+	uint8_t speed, uint8_t deceleration, uint32_t run_distance, uint32_t stop_distance,
+	uint8_t delay, uint8_t total, uint8_t loop);
+void MBZ_GetData(MBZ_REQUEST *req, uint8_t board);
+void MBZ_BoardCommand(MBZ_REQUEST *req, uint8_t opcode, uint8_t board, const uint8_t *data, int length);
+void MBZ_ScopeStream(MBZ_REQUEST *req, uint8_t channel_mask);
+void MBZ_BenchLoopback(MBZ_REQUEST *req, const uint8_t *data, int length);
+void MBZ_BenchSource(MBZ_REQUEST *req, uint32_t packets);
+void MBZ_BenchSink(MBZ_REQUEST *req, uint32_t packets);
+void MBZ_BenchReport(MBZ_REQUEST *req, bool reset);
+void MBZ_BenchSRAM(MBZ_REQUEST *req, uint16_t address, uint16_t length);
+void MBZ_AssetBegin(MBZ_REQUEST *req, uint32_t length);
+void MBZ_AssetWrite(MBZ_REQUEST *req, uint32_t offset, const uint8_t *data, int length);
+void MBZ_AssetStatus(MBZ_REQUEST *req, uint8_t check);
+void MBZ_FlashProgramBegin(MBZ_REQUEST *req, uint32_t address, uint32_t length);
+void MBZ_FlashProgramData(MBZ_REQUEST *req, uint32_t offset, const uint8_t *data, int length);
+void MBZ_FlashProgramStatus(MBZ_REQUEST *req, bool stop);
+void MBZ_DirectiveStats(MBZ_REQUEST *req, uint8_t request, const uint8_t priority[MBZ_BOARDS]);
+void MBZ_Peripherals(MBZ_REQUEST *req, bool probe);
+void MBZ_BoardLatency(MBZ_REQUEST *req, uint8_t board, bool clear);
+void MBZ_ServiceRequests(MBZ_REQUEST *req, bool clear);
+void MBZ_Mailbox(MBZ_REQUEST *req, uint8_t board, const MBZ_MAILBOX_FRAME *post);
+void MBZ_Motion(MBZ_REQUEST *req, uint8_t action, uint8_t sequence, uint8_t profile);
+
+//Statistics
+void MBZ_GetStats(MBZ_DEVICE *dev, uint8_t opcode, MBZ_STATS *stats);
+void MBZ_ResetStats(MBZ_DEVICE *dev);
+void MBZ_PrintStats(MBZ_DEVICE *dev, FILE *out);
+uint64_t MBZ_Now(void);
+
+#endif	/* MBZ_H */
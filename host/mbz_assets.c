@@ -0,0 +1,507 @@
+/*********************************************************************
+    FileName:     	mbz_assets.c
+    Dependencies:	See #includes
+    Processor:		Host (Linux)
+    Hardware:		MainBrain MZ
+    Complier:		GCC
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        Asset store builder for the MainBrain MZ
+
+    File Description:
+        Builds the asset store (layout in Assets.c) from the images
+        in assets/ and sends it to the external flash. Each image is
+        run length encoded when that makes it smaller.
+
+        The store goes in with the flash programming commands
+        (Flash_Program.c), Asset Status then has the MainBrain check
+        it and load the directory. With -a it is sent with Asset
+        Begin and Asset Write instead, a packet at a time.
+
+        Usage: mbz_assets [-s socket] [-o file] [-n] [-a]
+            -o  writes the store to file as well
+            -n  builds the store without sending it
+            -a  sends the store with the asset commands
+
+    Change History:
+
+/***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mbz.h"
+
+#define ASSETS_HEADER           16
+#define ASSETS_ENTRY            32
+#define ASSETS_NAME             16
+#define ASSETS_VERSION          1
+
+#define ASSETS_RAW              0
+#define ASSETS_RLE              1
+
+//Longest run or literal of a record
+#define ASSETS_RECORD_MAX       128
+
+//Where Assets.c keeps the store
+#define ASSETS_ADDRESS          0x9000
+
+//Gives up on a busy device after this long
+#define ASSETS_TIMEOUT_NS       30000000000ull
+
+//The images, built from assets/
+extern const uint16_t SplashImage[48000];
+extern const uint16_t ConfigImage[307200];
+extern const uint16_t DisplayMenu[22500];
+
+typedef struct
+{
+    const char *name;
+    const uint16_t *pixels;
+    int step;
+    uint16_t width;
+    uint16_t height;
+} ASSETS_IMAGE;
+
+//The splash image keeps every other value
+static const ASSETS_IMAGE assets_images[] =
+{
+    {"splash",  SplashImage,    2,  480,    48},
+    {"config",  ConfigImage,    1,  480,    320},
+    {"menu",    DisplayMenu,    1,  150,    150},
+};
+
+#define ASSETS_IMAGES           (sizeof(assets_images) / sizeof(assets_images[0]))
+
+static void put16(uint8_t *buffer, uint16_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+}
+
+static void put32(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+static uint32_t get32(const uint8_t *buffer)
+{
+    return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+//CRC-32 as CRC32() in Convert.c
+static uint32_t crc32(const uint8_t *data, uint32_t length)
+{
+    uint32_t crc = 0xffffffff;
+
+    for(uint32_t i=0;i<length;i++)
+    {
+        crc = crc ^ data[i];
+
+        for(int j=0;j<8;j++)
+        {
+            crc = (crc & 1) ? ((crc >> 1) ^ 0xedb88320) : (crc >> 1);
+        }
+    }
+
+    return crc ^ 0xffffffff;
+}
+
+static uint16_t pixel(const ASSETS_IMAGE *image, uint32_t i)
+{
+    return image->pixels[i * image->step];
+}
+
+//Records as Asset_Read() decodes them, returns the bytes
+static uint32_t encode_rle(const ASSETS_IMAGE *image, uint8_t *out)
+{
+    uint32_t count = (uint32_t)image->width * image->height;
+    uint32_t length = 0;
+    uint32_t i = 0;
+    uint32_t run;
+    uint32_t literal;
+
+    while(i < count)
+    {
+        run = 1;
+        while(((i + run) < count) && (run < ASSETS_RECORD_MAX) && (pixel(image, i + run) == pixel(image, i)))
+        {
+            run++;
+        }
+
+        if(run > 1)
+        {
+            out[length++] = 0x80 | (run - 1);
+            put16(&out[length], pixel(image, i));
+            length += 2;
+            i += run;
+            continue;
+        }
+
+        //Literals up to the next run of two
+        literal = 1;
+        while(((i + literal) < count) && (literal < ASSETS_RECORD_MAX))
+        {
+            if(((i + literal + 1) < count) && (pixel(image, i + literal) == pixel(image, i + literal + 1)))
+            {
+                break;
+            }
+            literal++;
+        }
+
+        out[length++] = literal - 1;
+        for(uint32_t j=0;j<literal;j++)
+        {
+            put16(&out[length], pixel(image, i + j));
+            length += 2;
+        }
+        i += literal;
+    }
+
+    return length;
+}
+
+static uint32_t encode_raw(const ASSETS_IMAGE *image, uint8_t *out)
+{
+    uint32_t count = (uint32_t)image->width * image->height;
+
+    for(uint32_t i=0;i<count;i++)
+    {
+        put16(&out[i * 2], pixel(image, i));
+    }
+
+    return count * 2;
+}
+
+//Returns the store, its length in length
+static uint8_t *build_store(uint32_t *length)
+{
+    uint32_t size = ASSETS_HEADER + (ASSETS_IMAGES * ASSETS_ENTRY);
+    uint32_t raw;
+    uint32_t rle;
+    uint8_t *store;
+    uint8_t *entry;
+
+    for(size_t i=0;i<ASSETS_IMAGES;i++)
+    {
+        //Worst case for either format
+        size += (uint32_t)assets_images[i].width * assets_images[i].height * 3;
+    }
+
+    store = calloc(1, size);
+    if(store == NULL)
+    {
+        return NULL;
+    }
+
+    size = ASSETS_HEADER + (ASSETS_IMAGES * ASSETS_ENTRY);
+
+    for(size_t i=0;i<ASSETS_IMAGES;i++)
+    {
+        const ASSETS_IMAGE *image = &assets_images[i];
+
+        entry = &store[ASSETS_HEADER + (i * ASSETS_ENTRY)];
+        strncpy((char *)entry, image->name, ASSETS_NAME - 1);
+        put16(&entry[16], image->width);
+        put16(&entry[18], image->height);
+        put32(&entry[20], size);
+
+        raw = (uint32_t)image->width * image->height * 2;
+        rle = encode_rle(image, &store[size]);
+
+        if(rle < raw)
+        {
+            entry[28] = ASSETS_RLE;
+        }
+        else
+        {
+            rle = encode_raw(image, &store[size]);
+            entry[28] = ASSETS_RAW;
+        }
+
+        memset(&entry[29], 0xff, 3);
+        put32(&entry[24], rle);
+
+        printf("%-10s %3ux%-3u %7u bytes, %s %5.1f%%\n", image->name, image->width, image->height,
+	       rle, (entry[28] == ASSETS_RLE) ? "rle" : "raw", (100.0 * rle) / raw);
+
+        size += rle;
+    }
+
+    //'A' 'S' is programmed by the MainBrain once the store checks out
+    store[0] = 'A';
+    store[1] = 'S';
+    store[2] = ASSETS_VERSION;
+    store[3] = ASSETS_IMAGES;
+    put32(&store[4], size);
+    put32(&store[8], crc32(&store[ASSETS_HEADER], size - ASSETS_HEADER));
+    memset(&store[12], 0xff, 4);
+
+    *length = size;
+
+    return store;
+}
+
+static int asset_status(MBZ_DEVICE *dev, uint8_t check, MBZ_REQUEST *req)
+{
+    memset(req, 0, sizeof(*req));
+    MBZ_AssetStatus(req, check);
+
+    return MBZ_Transfer(dev, req);
+}
+
+//Polls Asset Status until the state is not state
+static int wait_state(MBZ_DEVICE *dev, uint8_t state, MBZ_REQUEST *req)
+{
+    uint64_t start = MBZ_Now();
+    int status;
+
+    do
+    {
+        status = asset_status(dev, 0, req);
+        if(status != MBZ_OK)
+        {
+            return -1;
+        }
+
+        if(req->in[1] != state)
+        {
+            return req->in[1];
+        }
+    }
+    while((MBZ_Now() - start) < ASSETS_TIMEOUT_NS);
+
+    return -1;
+}
+
+//Has the MainBrain check the store, check is MBZ_ASSET_CHECK*
+static int check_store(MBZ_DEVICE *dev, uint8_t check, MBZ_REQUEST *req)
+{
+    int state;
+
+    if(asset_status(dev, check, req) != MBZ_OK)
+    {
+        return 1;
+    }
+
+    state = wait_state(dev, MBZ_ASSET_VERIFYING, req);
+    if(state != MBZ_ASSET_IDLE)
+    {
+        fprintf(stderr, "mbz_assets: store failed its check, %u errors\n", req->in[9] | (req->in[10] << 8));
+        return 1;
+    }
+
+    return 0;
+}
+
+static int send_store(MBZ_DEVICE *dev, const uint8_t *store, uint32_t length)
+{
+    MBZ_REQUEST req;
+    uint64_t start = MBZ_Now();
+    uint64_t busy_ns;
+    uint32_t offset;
+    uint32_t count;
+    long retries = 0;
+    int state;
+
+    memset(&req, 0, sizeof(req));
+    MBZ_AssetBegin(&req, length);
+
+    if((MBZ_Transfer(dev, &req) != MBZ_OK) || (req.in[1] != 1))
+    {
+        fprintf(stderr, "mbz_assets: Asset Begin refused, room for %u bytes\n", get32(&req.in[4]));
+        return 1;
+    }
+
+    printf("erasing up to %u sectors\n", req.in[2] | (req.in[3] << 8));
+
+    state = wait_state(dev, MBZ_ASSET_ERASING, &req);
+    if(state != MBZ_ASSET_WRITING)
+    {
+        fprintf(stderr, "mbz_assets: erase failed (state %d)\n", state);
+        return 1;
+    }
+
+    for(offset=0;offset<length;offset+=count)
+    {
+        count = length - offset;
+        if(count > MBZ_ASSET_WRITE_MAX)
+        {
+            count = MBZ_ASSET_WRITE_MAX;
+        }
+
+        busy_ns = MBZ_Now();
+
+        //Busy while the write jobs before it are programmed
+        do
+        {
+            memset(&req, 0, sizeof(req));
+            MBZ_AssetWrite(&req, offset, &store[offset], count);
+
+            if(MBZ_Transfer(dev, &req) != MBZ_OK)
+            {
+                fprintf(stderr, "mbz_assets: connection lost at %u\n", offset);
+                return 1;
+            }
+
+            if(req.in[1] == 0)
+            {
+                retries++;
+            }
+        }
+        while((req.in[1] == 0) && ((MBZ_Now() - busy_ns) < ASSETS_TIMEOUT_NS));
+
+        if(req.in[1] != 1)
+        {
+            fprintf(stderr, "mbz_assets: Asset Write at %u refused\n", offset);
+            return 1;
+        }
+    }
+
+    if(check_store(dev, MBZ_ASSET_CHECK, &req) != 0)
+    {
+        return 1;
+    }
+
+    printf("%u assets, %u bytes programmed, %u sectors erased, %ld busy replies, %.2f s\n",
+	   req.in[2], get32(&req.in[3]), req.in[7] | (req.in[8] << 8), retries,
+	   (MBZ_Now() - start) / 1e9);
+
+    return 0;
+}
+
+//The 'A' 'S' stays erased, the check programs it
+static int program_store(MBZ_DEVICE *dev, uint8_t *store, uint32_t length)
+{
+    MBZ_FLASH_PROGRESS progress;
+    MBZ_REQUEST req;
+    uint64_t start = MBZ_Now();
+    int result;
+
+    store[0] = 0xff;
+    store[1] = 0xff;
+
+    result = MBZ_ProgramFlash(dev, ASSETS_ADDRESS, store, length, &progress, NULL, NULL);
+    if(result != MBZ_OK)
+    {
+        fprintf(stderr, "mbz_assets: programming failed (%d), %u errors, block %u\n", result,
+		progress.errors, progress.failed_block);
+        return 1;
+    }
+
+    printf("programmed in %.3f s, %.1f KB/s\n", progress.ticks / 1e8, (length / 1024.0) / (progress.ticks / 1e8));
+
+    if(check_store(dev, MBZ_ASSET_CHECK_FLASH, &req) != 0)
+    {
+        return 1;
+    }
+
+    printf("%u assets, %.2f s\n", req.in[2], (MBZ_Now() - start) / 1e9);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = NULL;
+    const char *file = NULL;
+    bool send = true;
+    bool packets = false;
+    MBZ_DEVICE *dev;
+    uint8_t *store;
+    uint32_t length;
+    FILE *out;
+    int result;
+    int opt;
+
+    while((opt = getopt(argc, argv, "s:o:na")) != -1)
+    {
+        switch(opt)
+        {
+            case 's':
+                path = optarg;
+                break;
+            case 'o':
+                file = optarg;
+                break;
+            case 'n':
+                send = false;
+                break;
+            case 'a':
+                packets = true;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-s socket] [-o file] [-n] [-a]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    store = build_store(&length);
+    if(store == NULL)
+    {
+        fprintf(stderr, "mbz_assets: out of memory\n");
+        return 1;
+    }
+
+    printf("store %u bytes\n", length);
+
+    if(file != NULL)
+    {
+        out = fopen(file, "wb");
+        if((out == NULL) || (fwrite(store, 1, length, out) != length))
+        {
+            fprintf(stderr, "mbz_assets: cannot write %s\n", file);
+            free(store);
+            return 1;
+        }
+        fclose(out);
+    }
+
+    if(!send)
+    {
+        free(store);
+        return 0;
+    }
+
+    dev = MBZ_Open(path, MBZ_FLASH_PROGRAM_DEPTH);
+    if(dev == NULL)
+    {
+        fprintf(stderr, "mbz_assets: cannot connect to %s\n", path ? path : MBZ_SIM_SOCKET);
+        free(store);
+        return 1;
+    }
+
+    if(packets)
+    {
+        result = send_store(dev, store, length);
+    }
+    else
+    {
+        result = program_store(dev, store, length);
+    }
+
+    MBZ_Close(dev);
+    free(store);
+
+    return result;
+}
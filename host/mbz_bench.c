@@ -0,0 +1,626 @@
+/*********************************************************************
+    FileName:     	mbz_bench.c
+    Dependencies:	See #includes
+    Processor:		Host (Linux)
+    Hardware:		MainBrain MZ
+    Complier:		GCC
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        USB benchmark for the MainBrain MZ
+
+    File Description:
+        Runs the benchmark commands in Bench.c and prints a report:
+
+        Loopback    pipelined echo, round trip latency percentiles and
+                    the time the device held each packet
+        Source      device sends packets back to back, Host and device
+                    packet rates and lost packets
+        Sink        Host sends packets back to back, device packet rate
+        Control     vendor Read Status on Endpoint 0, latency percentiles
+        SRAM        bytes per uS of the dual port SRAM, a byte at a
+                    time, as a block and as a DMA block
+
+        Each test is bracketed by Bench Report commands, the device's
+        USB interrupt time for the test is shown as a share of the
+        Core Timer time that passed.
+
+        Usage: mbz_bench [-s socket] [-n packets] [-p depth] [-l bytes] [-a address]
+            -n  packets per test (default 10000)
+            -p  loopback pipeline depth (default 8)
+            -l  loopback payload bytes, 4 - 54 (default 54)
+            -a  SRAM test address (default 0x1c00, the unused eighth
+                board region), 512 bytes are read and written back.
+                Keep clear of 0x1ffe - 0x1fff, reading or writing the
+                mailbox interrupt words signals the other port.
+
+        Exits with 1 when a packet is lost or corrupted.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mbz.h"
+
+//Source stream gives up when nothing arrives for this long
+#define BENCH_IDLE_NS           2000000000ull
+
+//Opcode the device does not know, used for sink packets
+#define BENCH_SINK_FILL         0xff
+
+#define BENCH_SRAM_ADDRESS      0x1c00
+#define BENCH_SRAM_LENGTH       512
+
+typedef struct
+{
+    uint32_t now;
+    uint32_t hz;
+    uint32_t isr_count;
+    uint32_t isr_ticks;
+    uint32_t isr_max;
+    uint32_t sink_packets;
+    uint32_t sink_bytes;
+    uint32_t sink_first;
+    uint32_t sink_last;
+    uint32_t source_packets;
+    uint32_t source_first;
+    uint32_t source_last;
+} BENCH_REPORT;
+
+typedef struct
+{
+    MBZ_DEVICE *dev;
+    int length;
+    long remaining;
+    long sequence;
+    long completed;
+    long errors;
+    uint64_t *latency_ns;
+    uint64_t device_ticks;
+} LOOPBACK_STATE;
+
+typedef struct
+{
+    long expected;
+    long received;
+    long out_of_order;
+    uint32_t next_sequence;
+    uint32_t first_stamp;
+    uint32_t last_stamp;
+    uint64_t first_ns;
+    uint64_t last_ns;
+    bool done;
+} SOURCE_STATE;
+
+static uint32_t get32(const uint8_t *buffer)
+{
+    return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+//Nearest rank percentile of a sorted array
+static double percentile_us(const uint64_t *sorted, long count, double p)
+{
+    long index = (long)(p * (count - 1) + 0.5);
+
+    return sorted[index] / 1e3;
+}
+
+static int bench_report(MBZ_DEVICE *dev, bool reset, BENCH_REPORT *report)
+{
+    MBZ_REQUEST req;
+    int status;
+
+    memset(&req, 0, sizeof(req));
+    MBZ_BenchReport(&req, reset);
+
+    status = MBZ_Transfer(dev, &req);
+    if(status != MBZ_OK)
+    {
+        return status;
+    }
+
+    report->now = get32(&req.in[2]);
+    report->hz = get32(&req.in[6]);
+    report->isr_count = get32(&req.in[10]);
+    report->isr_ticks = get32(&req.in[14]);
+    report->isr_max = get32(&req.in[18]);
+    report->sink_packets = get32(&req.in[22]);
+    report->sink_bytes = get32(&req.in[26]);
+    report->sink_first = get32(&req.in[30]);
+    report->sink_last = get32(&req.in[34]);
+    report->source_packets = get32(&req.in[38]);
+    report->source_first = get32(&req.in[42]);
+    report->source_last = get32(&req.in[46]);
+
+    return MBZ_OK;
+}
+
+//USB interrupt time between two reports, the first one reset the counters
+static void print_isr(const BENCH_REPORT *start, const BENCH_REPORT *end)
+{
+    double ticks_us = 1e6 / end->hz;
+    uint32_t elapsed = end->now - start->now;
+
+    printf("    USB interrupt  %u calls, %.1f us total, %.2f%% of %.1f ms, avg %.2f us, max %.2f us\n",
+	   end->isr_count,
+	   end->isr_ticks * ticks_us,
+	   (elapsed > 0) ? (100.0 * end->isr_ticks) / elapsed : 0.0,
+	   (elapsed * ticks_us) / 1e3,
+	   (end->isr_count > 0) ? (end->isr_ticks * ticks_us) / end->isr_count : 0.0,
+	   end->isr_max * ticks_us);
+}
+
+/*************************************************************
+ Loopback
+*************************************************************/
+static void loopback_fill(LOOPBACK_STATE *state, MBZ_REQUEST *req)
+{
+    uint8_t payload[MBZ_PACKET_SIZE];
+
+    //Sequence number first, then a pattern that changes with it
+    for(int i=0;i<state->length;i++)
+    {
+        payload[i] = (i < 4) ? (state->sequence >> (i * 8)) : (state->sequence + i);
+    }
+
+    state->sequence++;
+    MBZ_BenchLoopback(req, payload, state->length);
+}
+
+static void loopback_done(MBZ_REQUEST *req, void *context)
+{
+    LOOPBACK_STATE *state = context;
+
+    if((req->status != MBZ_OK) || (req->in[0] != MBZ_BENCH_LOOPBACK) || (req->in[1] != state->length) ||
+       (memcmp(&req->in[10], &req->out[2], state->length) != 0))
+    {
+        state->errors++;
+    }
+    else
+    {
+        state->latency_ns[state->completed] = req->complete_ns - req->sent_ns;
+        state->device_ticks += get32(&req->in[6]) - get32(&req->in[2]);
+        state->completed++;
+    }
+
+    if(state->remaining > 0)
+    {
+        state->remaining--;
+        loopback_fill(state, req);
+        MBZ_Submit(state->dev, req);
+    }
+}
+
+static int bench_loopback(MBZ_DEVICE *dev, long count, int depth, int length)
+{
+    LOOPBACK_STATE state;
+    BENCH_REPORT start, end;
+    MBZ_REQUEST *reqs;
+    uint64_t begin_ns, seconds_ns;
+    double seconds;
+
+    if(depth > count)
+    {
+        depth = count;
+    }
+
+    memset(&state, 0, sizeof(state));
+    state.dev = dev;
+    state.length = length;
+    state.remaining = count - depth;
+    state.latency_ns = calloc(count, sizeof(uint64_t));
+    reqs = calloc(depth, sizeof(MBZ_REQUEST));
+
+    if(bench_report(dev, true, &start) != MBZ_OK)
+    {
+        free(state.latency_ns);
+        free(reqs);
+        return -1;
+    }
+
+    begin_ns = MBZ_Now();
+
+    for(int i=0;i<depth;i++)
+    {
+        loopback_fill(&state, &reqs[i]);
+        reqs[i].callback = loopback_done;
+        reqs[i].context = &state;
+        MBZ_Submit(dev, &reqs[i]);
+    }
+
+    MBZ_Drain(dev);
+    seconds_ns = MBZ_Now() - begin_ns;
+    seconds = seconds_ns / 1e9;
+
+    if(bench_report(dev, false, &end) != MBZ_OK)
+    {
+        state.errors++;
+    }
+
+    printf("Loopback  %ld packets, %d bytes, depth %d\n", count, length, depth);
+    printf("    completed      %ld, errors %ld\n", state.completed, state.errors);
+
+    if(state.completed > 0)
+    {
+        qsort(state.latency_ns, state.completed, sizeof(uint64_t), compare_u64);
+
+        printf("    throughput     %.0f packets/s, %.1f KB/s payload each way\n",
+	       state.completed / seconds, (state.completed * length / 1024.0) / seconds);
+        printf("    round trip us  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+	       percentile_us(state.latency_ns, state.completed, 0.50),
+	       percentile_us(state.latency_ns, state.completed, 0.90),
+	       percentile_us(state.latency_ns, state.completed, 0.99),
+	       percentile_us(state.latency_ns, state.completed, 0.999),
+	       state.latency_ns[state.completed - 1] / 1e3);
+
+        if(end.hz > 0)
+        {
+            printf("    device held    avg %.2f us\n", ((double)state.device_ticks / state.completed) * (1e6 / end.hz));
+        }
+    }
+
+    if(end.hz > 0)
+    {
+        print_isr(&start, &end);
+    }
+
+    free(state.latency_ns);
+    free(reqs);
+
+    return (state.errors == 0) ? 0 : -1;
+}
+
+/*************************************************************
+ Source
+*************************************************************/
+static void source_packet(const uint8_t *packet, int length, void *context)
+{
+    SOURCE_STATE *state = context;
+    uint32_t sequence;
+
+    if((length < 10) || (packet[0] != MBZ_BENCH_SOURCE))
+    {
+        return;
+    }
+
+    sequence = get32(&packet[2]);
+
+    if(state->received == 0)
+    {
+        state->first_ns = MBZ_Now();
+        state->first_stamp = get32(&packet[6]);
+    }
+    state->last_ns = MBZ_Now();
+    state->last_stamp = get32(&packet[6]);
+
+    if(sequence != state->next_sequence)
+    {
+        state->out_of_order++;
+    }
+    state->next_sequence = sequence + 1;
+    state->received++;
+
+    if(packet[1] == 1)
+    {
+        state->done = true;
+    }
+}
+
+static int bench_source(MBZ_DEVICE *dev, long count)
+{
+    SOURCE_STATE state;
+    BENCH_REPORT start, end;
+    MBZ_REQUEST req;
+    uint64_t idle_ns;
+    double seconds;
+    uint32_t hz = 0;
+
+    memset(&state, 0, sizeof(state));
+    state.expected = count;
+
+    if(bench_report(dev, true, &start) != MBZ_OK)
+    {
+        return -1;
+    }
+    hz = start.hz;
+
+    MBZ_SetBulkCallback(dev, source_packet, &state);
+
+    memset(&req, 0, sizeof(req));
+    MBZ_BenchSource(&req, count);
+    MBZ_Transfer(dev, &req);
+
+    idle_ns = MBZ_Now();
+    while(!state.done)
+    {
+        long before = state.received;
+
+        if(MBZ_Poll(dev, 10) < 0)
+        {
+            break;
+        }
+
+        if(state.received != before)
+        {
+            idle_ns = MBZ_Now();
+        }
+        else if((MBZ_Now() - idle_ns) > BENCH_IDLE_NS)
+        {
+            break;
+        }
+    }
+
+    MBZ_SetBulkCallback(dev, NULL, NULL);
+
+    if(bench_report(dev, false, &end) != MBZ_OK)
+    {
+        return -1;
+    }
+
+    printf("Source    %ld packets\n", count);
+    printf("    received       %ld, lost %ld, out of order %ld\n",
+	   state.received, state.expected - state.received, state.out_of_order);
+
+    if(state.received > 1)
+    {
+        seconds = (state.last_ns - state.first_ns) / 1e9;
+
+        printf("    host rate      %.0f packets/s, %.1f KB/s\n",
+	       (state.received - 1) / seconds, ((state.received - 1) * MBZ_PACKET_SIZE / 1024.0) / seconds);
+
+        if(hz > 0)
+        {
+            seconds = (uint32_t)(state.last_stamp - state.first_stamp) / (double)hz;
+            printf("    device rate    %.0f packets/s, %.1f KB/s\n",
+		   (state.received - 1) / seconds, ((state.received - 1) * MBZ_PACKET_SIZE / 1024.0) / seconds);
+        }
+    }
+
+    print_isr(&start, &end);
+
+    return ((state.received == state.expected) && (state.out_of_order == 0)) ? 0 : -1;
+}
+
+/*************************************************************
+ Sink
+*************************************************************/
+static int bench_sink(MBZ_DEVICE *dev, long count)
+{
+    BENCH_REPORT start, end;
+    MBZ_REQUEST req;
+    uint64_t begin_ns;
+    double seconds;
+
+    if(bench_report(dev, true, &start) != MBZ_OK)
+    {
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    MBZ_BenchSink(&req, count);
+    MBZ_Transfer(dev, &req);
+
+    begin_ns = MBZ_Now();
+
+    //No reply, each packet completes once it is written
+    for(long i=0;i<count;i++)
+    {
+        MBZ_Prepare(&req, BENCH_SINK_FILL, 0, NULL, 0);
+        for(int j=0;j<4;j++)
+        {
+            req.out[2 + j] = (i >> (j * 8)) & 0xff;
+        }
+
+        if(MBZ_Submit(dev, &req) != MBZ_OK)
+        {
+            break;
+        }
+    }
+
+    seconds = (MBZ_Now() - begin_ns) / 1e9;
+
+    if(bench_report(dev, false, &end) != MBZ_OK)
+    {
+        return -1;
+    }
+
+    printf("Sink      %ld packets\n", count);
+    printf("    device counted %u packets, %u bytes\n", end.sink_packets, end.sink_bytes);
+    printf("    host rate      %.0f packets/s, %.1f KB/s\n",
+	   count / seconds, (count * MBZ_PACKET_SIZE / 1024.0) / seconds);
+
+    if(end.sink_packets > 1)
+    {
+        seconds = (uint32_t)(end.sink_last - end.sink_first) / (double)end.hz;
+        printf("    device rate    %.0f packets/s, %.1f KB/s\n",
+	       (end.sink_packets - 1) / seconds, ((end.sink_packets - 1) * MBZ_PACKET_SIZE / 1024.0) / seconds);
+    }
+
+    print_isr(&start, &end);
+
+    return (end.sink_packets == count) ? 0 : -1;
+}
+
+/*************************************************************
+ Control
+*************************************************************/
+static int bench_control(MBZ_DEVICE *dev, long count)
+{
+    MBZ_STATUS status;
+    uint64_t *latency_ns;
+    uint64_t begin_ns, start_ns;
+    long completed = 0;
+    long errors = 0;
+    double seconds;
+
+    latency_ns = calloc(count, sizeof(uint64_t));
+
+    begin_ns = MBZ_Now();
+
+    for(long i=0;i<count;i++)
+    {
+        start_ns = MBZ_Now();
+
+        if(MBZ_ReadStatus(dev, &status) != MBZ_OK)
+        {
+            errors++;
+            continue;
+        }
+
+        latency_ns[completed++] = MBZ_Now() - start_ns;
+    }
+
+    seconds = (MBZ_Now() - begin_ns) / 1e9;
+
+    printf("Control   %ld vendor Read Status\n", count);
+    printf("    completed      %ld, errors %ld\n", completed, errors);
+
+    if(completed > 0)
+    {
+        qsort(latency_ns, completed, sizeof(uint64_t), compare_u64);
+
+        printf("    throughput     %.0f transfers/s\n", completed / seconds);
+        printf("    round trip us  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+	       percentile_us(latency_ns, completed, 0.50),
+	       percentile_us(latency_ns, completed, 0.90),
+	       percentile_us(latency_ns, completed, 0.99),
+	       percentile_us(latency_ns, completed, 0.999),
+	       latency_ns[completed - 1] / 1e3);
+    }
+
+    free(latency_ns);
+
+    return (errors == 0) ? 0 : -1;
+}
+
+static int bench_sram(MBZ_DEVICE *dev, uint16_t address)
+{
+    static const char *names[] = {"byte read", "byte write", "block read",
+				  "block write", "DMA read", "DMA write"};
+    MBZ_REQUEST req;
+    BENCH_REPORT report;
+    uint32_t length, ticks;
+    double ticks_us;
+
+    //The Core Timer frequency
+    if(bench_report(dev, false, &report) != MBZ_OK)
+    {
+        return -1;
+    }
+    ticks_us = 1e6 / report.hz;
+
+    memset(&req, 0, sizeof(req));
+    MBZ_BenchSRAM(&req, address, BENCH_SRAM_LENGTH);
+
+    if(MBZ_Transfer(dev, &req) != MBZ_OK)
+    {
+        return -1;
+    }
+
+    if(req.in[1] != 0)
+    {
+        printf("SRAM      0x%04x held by a board, not run\n", address);
+        return 0;
+    }
+
+    length = get32(&req.in[2]);
+
+    printf("SRAM      %u bytes at 0x%04x\n", length, address);
+
+    for(int i=0;i<6;i++)
+    {
+        ticks = get32(&req.in[6 + (i * 4)]);
+
+        printf("    %-14s %8.1f us  %7.2f bytes/us\n", names[i], ticks * ticks_us,
+	       (ticks > 0) ? length / (ticks * ticks_us) : 0.0);
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = NULL;
+    MBZ_DEVICE *dev;
+    long count = 10000;
+    int depth = 8;
+    int length = 54;
+    uint16_t address = BENCH_SRAM_ADDRESS;
+    int failed = 0;
+    int opt;
+
+    while((opt = getopt(argc, argv, "s:n:p:l:a:")) != -1)
+    {
+        switch(opt)
+        {
+            case 's':
+                path = optarg;
+                break;
+            case 'n':
+                count = strtol(optarg, NULL, 0);
+                break;
+            case 'p':
+                depth = strtol(optarg, NULL, 0);
+                break;
+            case 'l':
+                length = strtol(optarg, NULL, 0);
+                break;
+            case 'a':
+                address = strtol(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-s socket] [-n packets] [-p depth] [-l bytes] [-a address]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if((count < 1) || (depth < 1) || (length < 4) || (length > 54))
+    {
+        fprintf(stderr, "usage: %s [-s socket] [-n packets] [-p depth] [-l bytes] [-a address]\n", argv[0]);
+        return 1;
+    }
+
+    dev = MBZ_Open(path, depth);
+    if(dev == NULL)
+    {
+        fprintf(stderr, "mbz_bench: cannot connect to %s\n", path ? path : MBZ_SIM_SOCKET);
+        return 1;
+    }
+
+    failed |= bench_loopback(dev, count, depth, length);
+    failed |= bench_source(dev, count);
+    failed |= bench_sink(dev, count);
+    failed |= bench_control(dev, count);
+    failed |= bench_sram(dev, address);
+
+    MBZ_Close(dev);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,895 @@
+/*********************************************************************
+    FileName:     	mbz_cli.c
+    Dependencies:	See #includes
+    Processor:		Host (Linux)
+    Hardware:		MainBrain MZ
+    Complier:		GCC
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        Command line client for the MainBrain MZ
+
+    File Description:
+        Sends one opcode, optionally many times through the pipeline,
+        and prints the reply and the per opcode statistics.
+
+        Usage: mbz_cli [-s socket] [-n count] [-p depth] [-b boards] opcode [byte1 byte2 ...]
+            opcode and bytes are numbers, 0x prefix for hex
+            byte1 is the board address for board commands, -b sends
+            them to boards 1 - boards in turn instead
+        Example: mbz_cli -n 100000 -p 16 0x01
+
+        mbz_cli -l lists the opcodes.
+        mbz_cli -k prints the SRAM lock, collision and shadow statistics.
+        mbz_cli -e prints (and takes) the queued board events.
+        mbz_cli -j prints the flash job counters, throughput, the
+        reads that waited for an operation and the read cache.
+        mbz_cli -w address file programs file into the external flash
+        at address (a sector from 0x9000 on) and prints the speed.
+        mbz_cli -d prints the directive scheduler counters and rate,
+        -d p1 ... p7 sets the priorities of boards 1 - 7 (0 - 3) first.
+        mbz_cli -t prints which boards are there and how fast they
+        ACK, -T has the device probe them all again first.
+        mbz_cli -a prints the ACK time histogram of each board, -A
+        clears the counts after.
+        mbz_cli -r prints (and takes) the boards' service requests,
+        highest priority first, -R clears the counters first.
+        mbz_cli -m board [command tag bytes...] posts a request to the
+        board's mailbox when a command is given and prints (and
+        takes) the answers the device has from the boards.
+        mbz_cli -g n runs the motion sequence from record n with
+        trapezoid ramps, -G n with S-curves, waits for the end and
+        prints the tick timing. -o prints where a sequence is and
+        the timing, -O stops it.
+
+    Change History:
+
+/***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mbz.h"
+
+typedef struct
+{
+    MBZ_DEVICE *dev;
+    long remaining;
+    long completed;
+    long errors;
+    bool print;
+    int boards;
+    int next_board;
+} CLI_STATE;
+
+static void cli_done(MBZ_REQUEST *req, void *context)
+{
+    CLI_STATE *state = context;
+
+    state->completed++;
+
+    if(req->status != MBZ_OK)
+    {
+        state->errors++;
+    }
+    else if(state->print && req->has_reply)
+    {
+        for(int i=0;i<MBZ_PACKET_SIZE;i++)
+        {
+            printf("%02x%c", req->in[i], ((i % 16) == 15) ? '\n' : ' ');
+        }
+    }
+
+    //Keep the pipeline full by reusing the request
+    if(state->remaining > 0)
+    {
+        state->remaining--;
+        if(state->boards > 0)
+        {
+            req->out[1] = (state->next_board++ % state->boards) + 1;
+        }
+        MBZ_Submit(state->dev, req);
+    }
+}
+
+static int cli_locks(const char *path)
+{
+    MBZ_LOCK_STATS stats[MBZ_LOCK_FLAGS];
+    MBZ_COLLISION_STATS collisions[MBZ_LOCK_FLAGS];
+    MBZ_SHADOW_STATS shadow[MBZ_LOCK_FLAGS];
+    MBZ_DEVICE *dev;
+    int status;
+
+    dev = MBZ_Open(path, 1);
+    if(dev == NULL)
+    {
+        fprintf(stderr, "mbz_cli: cannot connect to %s\n", path ? path : MBZ_SIM_SOCKET);
+        return 1;
+    }
+
+    status = MBZ_ReadLockStats(dev, stats);
+    if(status == MBZ_OK)
+    {
+        status = MBZ_ReadCollisionStats(dev, collisions);
+    }
+    if(status == MBZ_OK)
+    {
+        status = MBZ_ReadShadowStats(dev, shadow);
+    }
+    MBZ_Close(dev);
+
+    if(status != MBZ_OK)
+    {
+        fprintf(stderr, "mbz_cli: reading the SRAM statistics failed (%d)\n", status);
+        return 1;
+    }
+
+    printf("flag  region         locks  contended  timeouts  max wait us\n");
+    for(int i=0;i<MBZ_LOCK_FLAGS;i++)
+    {
+        printf("%4d  0x%04x %14u %10u %9u %12.2f\n", i, i * 0x400, stats[i].locks,
+	       stats[i].contended, stats[i].timeouts, stats[i].wait_max_ticks / 100.0);
+    }
+
+    printf("\nflag  region    collisions    retries  failures  DMA redone\n");
+    for(int i=0;i<MBZ_LOCK_FLAGS;i++)
+    {
+        printf("%4d  0x%04x %13u %10u %9u %11u\n", i, i * 0x400, collisions[i].collisions,
+	       collisions[i].retries, collisions[i].failures, collisions[i].bursts);
+    }
+
+    printf("\nregion        shadow hits  line reads  flush blocks  flush bytes\n");
+    for(int i=0;i<MBZ_LOCK_FLAGS;i++)
+    {
+        printf("0x%04x %18u %11u %13u %12u\n", i * 0x400, shadow[i].hits,
+	       shadow[i].misses, shadow[i].bursts, shadow[i].bytes);
+    }
+
+    return 0;
+}
+
+static int cli_events(const char *path)
+{
+    MBZ_BOARD_EVENT events[MBZ_EVENTS_MAX];
+    const char *code;
+    MBZ_DEVICE *dev;
+    uint32_t lost = 0;
+    int count;
+
+    dev = MBZ_Open(path, 1);
+    if(dev == NULL)
+    {
+        fprintf(stderr, "mbz_cli: cannot connect to %s\n", path ? path : MBZ_SIM_SOCKET);
+        return 1;
+    }
+
+    count = MBZ_ReadBoardEvents(dev, events, MBZ_EVENTS_MAX, &lost);
+    MBZ_Close(dev);
+
+    if(count < 0)
+    {
+        fprintf(stderr, "mbz_cli: Read Board Events failed (%d)\n", count);
+        return 1;
+    }
+
+    printf("%d events, %u lost\n", count, lost);
+    for(int i=0;i<count;i++)
+    {
+        switch(events[i].code)
+        {
+            case MBZ_BOARD_EVENT_DONE:
+                code = "done";
+                break;
+
+            case MBZ_BOARD_EVENT_ADDED:
+                code = "added";
+                break;
+
+            case MBZ_BOARD_EVENT_REMOVED:
+                code = "removed";
+                break;
+
+            case MBZ_BOARD_EVENT_ACK:
+                code = "ack";
+                break;
+
+            case MBZ_BOARD_EVENT_TIMEOUT:
+                code = "timeout";
+                break;
+
+            default:
+                code = "other";
+                break;
+        }
+
+        printf("board %d  %-7s  core timer %u\n", events[i].board, code, events[i].time);
+    }
+
+    return 0;
+}
+
+static int cli_directives(const char *path, char **priorities, int count)
+{
+    MBZ_SCHEDULER_STATS stats;
+    MBZ_DEVICE *dev;
+    uint8_t priority[MBZ_BOARDS];
+    int result;
+
+    if((count != 0) && (count != MBZ_BOARDS))
+    {
+        fprintf(stderr, "mbz_cli: -d takes the priorities of all %d boards\n", MBZ_BOARDS);
+        return 1;
+    }
+
+    for(int i=0;i<count;i++)
+    {
+        priority[i] = strtol(priorities[i], NULL, 0);
+    }
+
+    dev = MBZ_Open(path, 1);
+    if(dev == NULL)
+    {
+        fprintf(stderr, "mbz_cli: cannot connect to %s\n", path ? path : MBZ_SIM_SOCKET);
+        return 1;
+    }
+
+    result = MBZ_ReadDirectiveStats(dev, (count != 0) ? MBZ_DIRECTIVE_PRIORITY : MBZ_DIRECTIVE_READ,
+	    (count != 0) ? priority : NULL, &stats);
+    MBZ_Close(dev);
+
+    if(result != MBZ_OK)
+    {
+        fprintf(stderr, "mbz_cli: Directive Stats failed (%d)\n", result);
+        return 1;
+    }
+
+    printf("%-6s %8s %6s\n", "board", "priority", "queued");
+    for(int i=0;i<MBZ_BOARDS;i++)
+    {
+        printf("%-6d %8d %6s\n", i + 1, stats.priority[i], (stats.queued & (1 << i)) ? "yes" : "");
+    }
+
+    printf("\n%u directives, %u acks, %u time outs, %u ops/s\n",
+	   stats.directives, stats.acks, stats.timeouts, stats.rate);
+    printf("%u written while another board worked, %u waits for a full queue\n",
+	   stats.prefills, stats.waits);
+    printf("select to ack %.1f us avg, %.1f us max\n",
+	   (stats.acks > 0) ? (stats.ack_ticks / (double)stats.acks) / 100.0 : 0.0, stats.ack_max / 100.0);
+
+    return 0;
+}
+
+static int cli_peripherals(const char *path, bool probe)
+{
+    MBZ_PERIPHERAL boards[MBZ_BOARDS];
+    MBZ_DEVICE *dev;
+    uint32_t enumerate_ticks;
+    int result;
+
+    dev = MBZ_Open(path, 1);
+    if(dev == NULL)
+    {
+        fprintf(stderr, "mbz_cli: cannot connect to %s\n", path ? path : MBZ_SIM_SOCKET);
+        return 1;
+    }
+
+    result = MBZ_ReadPeripherals(dev, probe, boards, &enumerate_ticks);
+    if((result == MBZ_OK) && probe)
+    {
+        //The probes take 200 us for a board that is not there
+        usleep(10000);
+        result = MBZ_ReadPeripherals(dev, false, boards, &enumerate_ticks);
+    }
+    MBZ_Close(dev);
+
+    if(result != MBZ_OK)
+    {
+        fprintf(stderr, "mbz_cli: Peripherals failed (%d)\n", result);
+        return 1;
+    }
+
+    printf("power on probes took %.1f us\n\n", enumerate_ticks / 100.0);
+    printf("%-6s %-7s %8s %8s %10s\n", "board", "there", "misses", "changes", "ack us");
+    for(int i=0;i<MBZ_BOARDS;i++)
+    {
+        printf("%-6d %-7s %8u %8u %10.2f\n", i + 1, boards[i].present ? "yes" : "no",
+	       boards[i].misses, boards[i].changes, boards[i].ack_ticks / 100.0);
+    }
+
+    return 0;
+}
+
+static int cli_latency(const char *path, bool clear)
+{
+    MBZ_LATENCY latency;
+    MBZ_DEVICE *dev;
+    int result = MBZ_OK;
+
+    dev = MBZ_Open(path, 1);
+    if(dev == NULL)
+    {
+        fprintf(stderr, "mbz_cli: cannot connect to %s\n", path ? path : MBZ_SIM_SOCKET);
+        return 1;
+    }
+
+    printf("%-6s %10s %9s %10s %10s %10s\n", "board", "acks", "time outs", "min us", "mean us", "max us");
+
+    for(int board=1;(board<=MBZ_BOARDS) && (result == MBZ_OK);board++)
+    {
+        result = MBZ_ReadBoardLatency(dev, board, clear, &latency);
+        if(result != MBZ_OK)
+        {
+            break;
+        }
+
+        printf("%-6d %10u %9u %10.2f %10.2f %10.2f\n", board, latency.acks, latency.timeouts,
+	       latency.min_ticks / 100.0, latency.mean_ticks / 100.0, latency.max_ticks / 100.0);
+
+        //Buckets with ACKs in them, from - to in us
+        for(int i=0;i<MBZ_LATENCY_BUCKETS;i++)
+        {
+            if(latency.buckets[i] == 0)
+            {
+                continue;
+            }
+
+            if(i == (MBZ_LATENCY_BUCKETS - 1))
+            {
+                printf("       %9.2f -           us %6u%s\n", (1u << i) / 100.0, latency.buckets[i],
+		       (latency.buckets[i] == 0xffff) ? "+" : "");
+            }
+            else
+            {
+                printf("       %9.2f - %9.2f us %6u%s\n", (1u << i) / 100.0, ((2u << i) - 1) / 100.0,
+		       latency.buckets[i], (latency.buckets[i] == 0xffff) ? "+" : "");
+            }
+        }
+    }
+
+    MBZ_Close(dev);
+
+    if(result != MBZ_OK)
+    {
+        fprintf(stderr, "mbz_cli: Board Latency failed (%d)\n", result);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int cli_service(const char *path, bool clear)
+{
+    MBZ_SERVICE_EVENT events[MBZ_SERVICE_MAX];
+    MBZ_SERVICE_STATS stats;
+    MBZ_DEVICE *dev;
+    int count;
+
+    dev = MBZ_Open(path, 1);
+    if(dev == NULL)
+    {
+        fprintf(stderr, "mbz_cli: cannot connect to %s\n", path ? path : MBZ_SIM_SOCKET);
+        return 1;
+    }
+
+    do
+    {
+        count = MBZ_ReadServiceRequests(dev, clear, &stats, events);
+        clear = false;
+
+        for(int i=0;i<count;i++)
+        {
+            printf("board %d  priority %d  reason %2d  core timer %u\n", events[i].board,
+		   events[i].priority, events[i].reason, events[i].time);
+        }
+    }
+    while((count > 0) && (stats.queued > 0));
+
+    MBZ_Close(dev);
+
+    if(count < 0)
+    {
+        fprintf(stderr, "mbz_cli: Service Requests failed (%d)\n", count);
+        return 1;
+    }
+
+    printf("%u requests, %u scans, %u dropped, longest scan %.2f us\n", stats.requests, stats.scans,
+	   stats.lost, stats.scan_max_ticks / 100.0);
+
+    return 0;
+}
+
+static int cli_mailbox(const char *path, uint8_t board, char **args, int count)
+{
+    MBZ_MAILBOX_FRAME frames[MBZ_MAILBOX_MAX];
+    MBZ_MAILBOX_FRAME post;
+    MBZ_MAILBOX_STATUS status;
+    MBZ_DEVICE *dev;
+    int taken;
+
+    memset(&post, 0, sizeof(post));
+    if(count > 0)
+    {
+        post.command = strtoul(args[0], NULL, 0);
+        post.tag = (count > 1) ? strtoul(args[1], NULL, 0) : 0;
+        for(int i=2;(i<count) && (post.length < MBZ_MAILBOX_PAYLOAD);i++)
+        {
+            post.data[post.length++] = strtoul(args[i], NULL, 0);
+        }
+    }
+
+    dev = MBZ_Open(path, 1);
+    if(dev == NULL)
+    {
+        fprintf(stderr, "mbz_cli: cannot connect to %s\n", path ? path : MBZ_SIM_SOCKET);
+        return 1;
+    }
+
+    do
+    {
+        taken = MBZ_ReadMailbox(dev, board, (count > 0) ? &post : NULL, &status, frames);
+        if((count > 0) && (taken >= 0))
+        {
+            printf("board %d request %s, %d not taken yet\n", board, status.posted ? "posted" : "not posted",
+		   status.pending);
+        }
+        count = 0;
+
+        for(int i=0;i<taken;i++)
+        {
+            printf("board %d  command 0x%02x  tag %3d ", frames[i].board, frames[i].command, frames[i].tag);
+            for(int j=0;j<frames[i].length;j++)
+            {
+                printf(" %02x", frames[i].data[j]);
+            }
+            printf("\n");
+        }
+    }
+    while((taken > 0) && (status.kept > 0));
+
+    MBZ_Close(dev);
+
+    if(taken < 0)
+    {
+        fprintf(stderr, "mbz_cli: Mailbox failed (%d)\n", taken);
+        return 1;
+    }
+
+    printf("%u answers dropped\n", status.lost);
+
+    return 0;
+}
+
+static void cli_motion_print(const MBZ_MOTION_STATUS *status)
+{
+    static const char *results[] = {"started", "no such record", "no motion board"};
+
+    printf("%s, record %d, setpoint %.2f, distance %u (last run: %s)\n",
+	   status->running ? "running" : "stopped", status->sequence, status->setpoint / 256.0,
+	   status->distance, (status->result < 3) ? results[status->result] : "?");
+    printf("%u ticks, %u records, %u underruns, %u writes waited for the board\n",
+	   status->ticks, status->records, status->underruns, status->busy);
+    printf("late     max %8.2f us  mean %8.2f us\n", status->late_max_ticks / 100.0,
+	   status->late_mean_ticks / 100.0);
+    printf("period   min %8.2f us  max  %8.2f us  jitter %.2f us\n", status->interval_min_ticks / 100.0,
+	   status->interval_max_ticks / 100.0,
+	   (status->interval_max_ticks - status->interval_min_ticks) / 100.0);
+    printf("write    max %8.2f us\n", status->write_max_ticks / 100.0);
+}
+
+//Run waits until the sequence is done
+static int cli_motion(const char *path, uint8_t action, uint8_t sequence, uint8_t profile)
+{
+    MBZ_MOTION_STATUS status;
+    MBZ_DEVICE *dev;
+    int result;
+
+    dev = MBZ_Open(path, 1);
+    if(dev == NULL)
+    {
+        fprintf(stderr, "mbz_cli: cannot connect to %s\n", path ? path : MBZ_SIM_SOCKET);
+        return 1;
+    }
+
+    if(action == MBZ_MOTION_RUN)
+    {
+        result = MBZ_ReadMotion(dev, MBZ_MOTION_CLEAR, 0, 0, &status);
+        if(result == MBZ_OK)
+        {
+            result = MBZ_ReadMotion(dev, MBZ_MOTION_RUN, sequence, profile, &status);
+        }
+
+        //Started by the main loop
+        do
+        {
+            usleep(100000);
+            if(result == MBZ_OK)
+            {
+                result = MBZ_ReadMotion(dev, MBZ_MOTION_READ, 0, 0, &status);
+            }
+        }
+        while((result == MBZ_OK) && status.running);
+    }
+    else
+    {
+        result = MBZ_ReadMotion(dev, action, sequence, profile, &status);
+    }
+
+    MBZ_Close(dev);
+
+    if(result != MBZ_OK)
+    {
+        fprintf(stderr, "mbz_cli: Motion failed (%d)\n", result);
+        return 1;
+    }
+
+    cli_motion_print(&status);
+
+    return 0;
+}
+
+static int cli_flash_jobs(const char *path)
+{
+    static const char *types[MBZ_FLASH_JOB_TYPES] = {"program", "sector erase", "chip erase"};
+    MBZ_FLASH_STALL_STATS stalls[MBZ_FLASH_JOB_TYPES];
+    MBZ_FLASH_JOB_STATS stats;
+    MBZ_FLASH_CACHE_STATS cache;
+    MBZ_DEVICE *dev;
+    int status;
+
+    dev = MBZ_Open(path, 1);
+    if(dev == NULL)
+    {
+        fprintf(stderr, "mbz_cli: cannot connect to %s\n", path ? path : MBZ_SIM_SOCKET);
+        return 1;
+    }
+
+    status = MBZ_ReadFlashJobStats(dev, &stats);
+    if(status == MBZ_OK)
+    {
+        status = MBZ_ReadFlashStallStats(dev, stalls);
+    }
+    if(status == MBZ_OK)
+    {
+        status = MBZ_ReadFlashCacheStats(dev, &cache);
+    }
+    MBZ_Close(dev);
+
+    if(status != MBZ_OK)
+    {
+        fprintf(stderr, "mbz_cli: reading the flash statistics failed (%d)\n", status);
+        return 1;
+    }
+
+    printf("jobs %u  failures %u  waited for %u\n", stats.jobs, stats.failures, stats.waits);
+    printf("programmed %u bytes in %.3f ms", stats.bytes, stats.program_ticks / 1e5);
+    if(stats.program_ticks != 0)
+    {
+        printf(", %.1f KB/s", (stats.bytes / 1024.0) / (stats.program_ticks / 1e8));
+    }
+    printf("\nerased %u sectors in %.3f ms", stats.sectors, stats.erase_ticks / 1e5);
+    if(stats.sectors != 0)
+    {
+        printf(", %.3f ms per sector", (stats.erase_ticks / 1e5) / stats.sectors);
+    }
+    printf("\ntime in the tick %.3f ms\n", stats.tick_ticks / 1e5);
+
+    printf("\nreads during     reads  suspends  waited ms  max wait us\n");
+    for(int i=0;i<MBZ_FLASH_JOB_TYPES;i++)
+    {
+        printf("%-12s %9u %9u %10.3f %12.2f\n", types[i], stalls[i].reads, stalls[i].suspends,
+	       stalls[i].stall_ticks / 1e5, stalls[i].stall_max_ticks / 100.0);
+    }
+
+    printf("\ncache reads %u  blocks found %u  read %u  invalidated %u", cache.reads, cache.hits,
+	   cache.misses, cache.invalidated);
+    if((cache.hits + cache.misses) != 0)
+    {
+        printf(", %.1f%% found", (100.0 * cache.hits) / (cache.hits + cache.misses));
+    }
+    printf("\n");
+
+    return 0;
+}
+
+static void cli_progress(const MBZ_FLASH_PROGRESS *status, void *context)
+{
+    uint32_t *shown = context;
+
+    if((status->checked - *shown) >= 0x10000)
+    {
+        *shown = status->checked;
+        fprintf(stderr, "\r%u of %u bytes", status->checked, status->length);
+    }
+}
+
+static int cli_program(const char *path, uint32_t address, const char *file)
+{
+    MBZ_FLASH_PROGRESS status;
+    MBZ_DEVICE *dev;
+    uint8_t *data;
+    uint32_t shown = 0;
+    uint64_t start;
+    long length;
+    FILE *in;
+    int result;
+
+    in = fopen(file, "rb");
+    if(in == NULL)
+    {
+        fprintf(stderr, "mbz_cli: cannot open %s\n", file);
+        return 1;
+    }
+
+    fseek(in, 0, SEEK_END);
+    length = ftell(in);
+    rewind(in);
+
+    data = malloc(length > 0 ? length : 1);
+    if((data == NULL) || (length <= 0) || (fread(data, 1, length, in) != (size_t)length))
+    {
+        fprintf(stderr, "mbz_cli: cannot read %s\n", file);
+        fclose(in);
+        free(data);
+        return 1;
+    }
+    fclose(in);
+
+    dev = MBZ_Open(path, MBZ_FLASH_PROGRAM_DEPTH);
+    if(dev == NULL)
+    {
+        fprintf(stderr, "mbz_cli: cannot connect to %s\n", path ? path : MBZ_SIM_SOCKET);
+        free(data);
+        return 1;
+    }
+
+    start = MBZ_Now();
+    result = MBZ_ProgramFlash(dev, address, data, length, &status, cli_progress, &shown);
+    MBZ_Close(dev);
+    free(data);
+
+    if(result != MBZ_OK)
+    {
+        fprintf(stderr, "\nmbz_cli: programming failed (%d), state %u, %u errors, block %u\n",
+		result, status.state, status.errors, status.failed_block);
+        return 1;
+    }
+
+    if(shown != 0)
+    {
+        fprintf(stderr, "\n");
+    }
+    printf("%u bytes at 0x%05x, CRC-32 %08x\n", status.length, address, status.crc);
+    printf("device %.3f s, %.1f KB/s, host %.3f s\n", status.ticks / 1e8,
+	   (status.length / 1024.0) / (status.ticks / 1e8), (MBZ_Now() - start) / 1e9);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = NULL;
+    MBZ_REQUEST *reqs;
+    CLI_STATE state;
+    uint8_t packet[MBZ_PACKET_SIZE];
+    long count = 1;
+    int depth = 1;
+    int length = 0;
+    bool locks = false;
+    bool events = false;
+    bool jobs = false;
+    bool directives = false;
+    int peripherals = 0;
+    int latency = 0;
+    int service = 0;
+    int mailbox = 0;
+    int motion = -1;
+    uint8_t sequence = 0;
+    uint8_t profile = MBZ_PROFILE_TRAPEZOID;
+    int boards = 0;
+    long program = -1;
+    int opt;
+
+    while((opt = getopt(argc, argv, "s:n:p:b:lkejdtTaArRm:g:G:oOw:")) != -1)
+    {
+        switch(opt)
+        {
+            case 's':
+                path = optarg;
+                break;
+            case 'n':
+                count = strtol(optarg, NULL, 0);
+                break;
+            case 'p':
+                depth = strtol(optarg, NULL, 0);
+                break;
+            case 'b':
+                boards = strtol(optarg, NULL, 0);
+                break;
+            case 'l':
+                for(int i=0;i<MBZ_NUM_OPCODES;i++)
+                {
+                    printf("0x%02x  %-20s %s\n", MBZ_OPCODES[i].opcode, MBZ_OPCODES[i].name,
+			   MBZ_OPCODES[i].has_reply ? "reply" : "");
+                }
+                return 0;
+            case 'k':
+                locks = true;
+                break;
+            case 'e':
+                events = true;
+                break;
+            case 'j':
+                jobs = true;
+                break;
+            case 'd':
+                directives = true;
+                break;
+            case 't':
+                peripherals = 1;
+                break;
+            case 'T':
+                peripherals = 2;
+                break;
+            case 'a':
+                latency = 1;
+                break;
+            case 'A':
+                latency = 2;
+                break;
+            case 'r':
+                service = 1;
+                break;
+            case 'R':
+                service = 2;
+                break;
+            case 'm':
+                mailbox = strtol(optarg, NULL, 0);
+                break;
+            case 'g':
+            case 'G':
+                motion = MBZ_MOTION_RUN;
+                sequence = strtoul(optarg, NULL, 0);
+                profile = (opt == 'G') ? MBZ_PROFILE_SCURVE : MBZ_PROFILE_TRAPEZOID;
+                break;
+            case 'o':
+                motion = MBZ_MOTION_READ;
+                break;
+            case 'O':
+                motion = MBZ_MOTION_STOP;
+                break;
+            case 'w':
+                program = strtol(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-s socket] [-n count] [-p depth] [-b boards] opcode [bytes...]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if(locks)
+    {
+        return cli_locks(path);
+    }
+
+    if(events)
+    {
+        return cli_events(path);
+    }
+
+    if(jobs)
+    {
+        return cli_flash_jobs(path);
+    }
+
+    if(directives)
+    {
+        return cli_directives(path, &argv[optind], argc - optind);
+    }
+
+    if(peripherals != 0)
+    {
+        return cli_peripherals(path, peripherals == 2);
+    }
+
+    if(latency != 0)
+    {
+        return cli_latency(path, latency == 2);
+    }
+
+    if(service != 0)
+    {
+        return cli_service(path, service == 2);
+    }
+
+    if(mailbox != 0)
+    {
+        return cli_mailbox(path, mailbox, &argv[optind], argc - optind);
+    }
+
+    if(motion >= 0)
+    {
+        return cli_motion(path, motion, sequence, profile);
+    }
+
+    if(program >= 0)
+    {
+        if(optind >= argc)
+        {
+            fprintf(stderr, "usage: %s [-s socket] -w address file\n", argv[0]);
+            return 1;
+        }
+        return cli_program(path, program, argv[optind]);
+    }
+
+    if((optind >= argc) || (count < 1) || (depth < 1) || (boards < 0) || (boards > MBZ_BOARDS))
+    {
+        fprintf(stderr, "usage: %s [-s socket] [-n count] [-p depth] [-b boards] opcode [bytes...]\n", argv[0]);
+        return 1;
+    }
+
+    memset(packet, 0, sizeof(packet));
+    for(int i=optind;(i<argc) && (length < MBZ_PACKET_SIZE);i++)
+    {
+        packet[length++] = strtol(argv[i], NULL, 0);
+    }
+
+    state.dev = MBZ_Open(path, depth);
+    if(state.dev == NULL)
+    {
+        fprintf(stderr, "mbz_cli: cannot connect to %s\n", path ? path : MBZ_SIM_SOCKET);
+        return 1;
+    }
+
+    if(depth > count)
+    {
+        depth = count;
+    }
+
+    state.remaining = count - depth;
+    state.completed = 0;
+    state.errors = 0;
+    state.print = (count == 1);
+    state.boards = boards;
+    state.next_board = 0;
+
+    reqs = calloc(depth, sizeof(MBZ_REQUEST));
+
+    for(int i=0;i<depth;i++)
+    {
+        if(boards > 0)
+        {
+            packet[1] = (state.next_board++ % boards) + 1;
+        }
+        MBZ_Prepare(&reqs[i], packet[0], packet[1], &packet[2], length - 2);
+        reqs[i].callback = cli_done;
+        reqs[i].context = &state;
+        MBZ_Submit(state.dev, &reqs[i]);
+    }
+
+    if(MBZ_Drain(state.dev) != MBZ_OK)
+    {
+        fprintf(stderr, "mbz_cli: connection lost after %ld requests\n", state.completed);
+    }
+
+    MBZ_PrintStats(state.dev, stdout);
+    MBZ_Close(state.dev);
+    free(reqs);
+
+    return (state.errors == 0) ? 0 : 1;
+}
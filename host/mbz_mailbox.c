@@ -0,0 +1,287 @@
+/*********************************************************************
+    FileName:     	mbz_mailbox.c
+    Dependencies:	See #includes
+    Processor:		Host (Linux)
+    Hardware:		MainBrain MZ (simulated)
+    Complier:		GCC
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        Board mailbox benchmark on simulated SRAM
+
+    File Description:
+        The firmware's Mailbox.c (MainBrain side) and the reference
+        board/Mailbox_Board.c run in two threads on the simulated
+        SRAM, and are compared with the single command byte protocol:
+
+        Directive   the command goes to offset 0, the board is rung
+                    and the MainBrain waits for it to answer before
+                    the next one, like Directive() and /ACK
+        Mailbox     the MainBrain keeps up to 8 requests posted and
+                    receives the responses as they come
+
+        The board looks at the SRAM once per poll period, the way a
+        board main loop does, so the Directive protocol can not do
+        better than one command per period.
+
+        Every answer is checked (tag and data), the program exits with
+        1 when one is wrong or missing.
+
+        Usage: mbz_mailbox [-n operations] [-b board] [-t poll_us]
+            -n  operations per protocol (default 20000)
+            -b  board address, 1 - 7 (default 1)
+            -t  board poll period in uS, 1 or more (default 5)
+
+    Change History:
+
+/***********************************************************************/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "MainBrain.h"
+#include "board/Mailbox_Board.h"
+#include "mbz.h"
+#include "sim.h"
+
+//Board command used by both protocols, the answer is the operand + 1
+#define MAILBOX_BENCH_COMMAND   0x42
+
+typedef struct
+{
+    MAILBOX_BOARD board;
+    uint32_t region;
+    uint64_t poll_ns;
+    volatile int doorbell;
+    volatile bool mailbox;
+    volatile bool stop;
+} BENCH_BOARD;
+
+static uint8_t board_read(void *context, uint16_t offset)
+{
+    BENCH_BOARD *bench = context;
+
+    __sync_synchronize();
+    return ((volatile uint8_t *)Sim_SRAM)[bench->region + offset];
+}
+
+static void board_write(void *context, uint16_t offset, uint8_t value)
+{
+    BENCH_BOARD *bench = context;
+
+    ((volatile uint8_t *)Sim_SRAM)[bench->region + offset] = value;
+    __sync_synchronize();
+}
+
+static void board_handler(MAILBOX_BOARD *board, const MAILBOX_FRAME *request, MAILBOX_FRAME *response)
+{
+    if(request->command == MAILBOX_BENCH_COMMAND)
+    {
+        response->data[0] = request->data[0] + 1;
+        response->length = 1;
+    }
+}
+
+static void *board_thread(void *argument)
+{
+    BENCH_BOARD *bench = argument;
+    uint64_t next = MBZ_Now();
+
+    while(!bench->stop)
+    {
+        //Wait for the next poll, the Host may have a single CPU
+        while(MBZ_Now() < next)
+        {
+            sched_yield();
+        }
+        next = next + bench->poll_ns;
+
+        if(bench->mailbox)
+        {
+            Mailbox_Board_Service(&bench->board);
+        }
+        else if(__atomic_load_n(&bench->doorbell, __ATOMIC_ACQUIRE))
+        {
+            //Command at 0, operand at 2, answer at 20
+            if(board_read(bench, 0) == MAILBOX_BENCH_COMMAND)
+            {
+                board_write(bench, 20, board_read(bench, 2) + 1);
+            }
+
+            //The /ACK
+            __atomic_store_n(&bench->doorbell, 0, __ATOMIC_RELEASE);
+        }
+    }
+
+    return NULL;
+}
+
+static double bench_directive(BENCH_BOARD *bench, long count, long *errors)
+{
+    uint64_t start = MBZ_Now();
+    uint8_t operand;
+
+    for(long i=0;i<count;i++)
+    {
+        operand = i;
+
+        REN70V05_WR(bench->region + 2, operand);
+        REN70V05_WR(bench->region, MAILBOX_BENCH_COMMAND);
+
+        __atomic_store_n(&bench->doorbell, 1, __ATOMIC_RELEASE);
+        while(__atomic_load_n(&bench->doorbell, __ATOMIC_ACQUIRE))
+        {
+            sched_yield();
+        }
+
+        if((uint8_t)REN70V05_RD(bench->region + 20) != (uint8_t)(operand + 1))
+        {
+            (*errors)++;
+        }
+    }
+
+    return (MBZ_Now() - start) / 1e9;
+}
+
+static double bench_mailbox(uint8_t board, long count, long *errors)
+{
+    MAILBOX_FRAME frame;
+    uint64_t start = MBZ_Now();
+    long posted = 0;
+    long received = 0;
+    uint64_t idle = start;
+    uint8_t operand;
+
+    while(received < count)
+    {
+        while((posted < count) && (posted - received < MAILBOX_SLOTS))
+        {
+            operand = posted;
+
+            if(!Mailbox_Post(board, MAILBOX_BENCH_COMMAND, posted, &operand, 1))
+            {
+                break;
+            }
+            posted++;
+        }
+
+        while(Mailbox_Receive(board, &frame))
+        {
+            //The answers come back in order
+            if((frame.tag != (uint8_t)received) || (frame.length != 1) ||
+	       (frame.data[0] != (uint8_t)(received + 1)))
+            {
+                (*errors)++;
+            }
+            received++;
+            idle = MBZ_Now();
+        }
+
+        sched_yield();
+
+        //The board stopped answering
+        if(MBZ_Now() - idle > 1000000000ull)
+        {
+            *errors = *errors + (count - received);
+            break;
+        }
+    }
+
+    return (MBZ_Now() - start) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    static BENCH_BOARD bench;
+    pthread_t thread;
+    long count = 20000;
+    long errors = 0;
+    long total = 0;
+    int board = 1;
+    int poll_us = 5;
+    double directive_s, mailbox_s;
+    int opt;
+
+    while((opt = getopt(argc, argv, "n:b:t:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n':
+                count = strtol(optarg, NULL, 0);
+                break;
+            case 'b':
+                board = strtol(optarg, NULL, 0);
+                break;
+            case 't':
+                poll_us = strtol(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n operations] [-b board] [-t poll_us]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if((count < 1) || (board < 1) || (board > 7) || (poll_us < 1))
+    {
+        fprintf(stderr, "usage: %s [-n operations] [-b board] [-t poll_us]\n", argv[0]);
+        return 1;
+    }
+
+    memset(Sim_SRAM, 0, sizeof(Sim_SRAM));
+
+    bench.region = (board - 1) * 0x400;
+    bench.poll_ns = poll_us * 1000ull;
+    bench.board.read = board_read;
+    bench.board.write = board_write;
+    bench.board.context = &bench;
+    bench.board.handler = board_handler;
+
+    Mailbox_Init();
+    Mailbox_Board_Init(&bench.board);
+
+    if(!Mailbox_Ready(board))
+    {
+        fprintf(stderr, "mbz_mailbox: board %d did not mark its mailbox ready\n", board);
+        return 1;
+    }
+
+    pthread_create(&thread, NULL, board_thread, &bench);
+
+    directive_s = bench_directive(&bench, count, &errors);
+    total = errors;
+    printf("Directive %ld operations, board poll %d us\n", count, poll_us);
+    printf("    errors         %ld\n", errors);
+    printf("    rate           %.0f ops/s\n", count / directive_s);
+
+    errors = 0;
+    bench.mailbox = true;
+
+    mailbox_s = bench_mailbox(board, count, &errors);
+    total = total + errors;
+    printf("Mailbox   %ld operations, %d slots\n", count, MAILBOX_SLOTS);
+    printf("    errors         %ld, board answered %u\n", errors, bench.board.handled);
+    printf("    rate           %.0f ops/s, %.1fx\n", count / mailbox_s, directive_s / mailbox_s);
+
+    bench.stop = true;
+    pthread_join(thread, NULL);
+
+    return (total == 0) ? 0 : 1;
+}
@@ -0,0 +1,647 @@
+/*********************************************************************
+    FileName:     	mbz_sim.c
+    Dependencies:	See #includes
+    Processor:		Host (Linux)
+    Hardware:		MainBrain MZ (simulated)
+    Complier:		GCC
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        Simulated MainBrain MZ device
+
+    File Description:
+        Runs the firmware's own command dispatcher (Host_CMDs in
+        USB_MZ.c) against simulated SRAM, display and I/O boards, and
+        serves it on a local socket using the framing in mbz.c.
+
+        Each OUT packet is loaded into EP[1].rx_buffer and dispatched
+        the same way the USB interrupt does. Whatever the dispatcher
+        queues on Endpoint 2 is sent back, then the parts of the main
+        loop that act on the flags Host_CMDs sets are run and what
+        they queue is sent back too.
+
+        Control transfers go through the firmware's USB interrupt,
+        the simulator plays the Endpoint 0 hardware: it loads the
+        SETUP and OUT packets, takes the IN packets and raises an
+        Endpoint 0 interrupt for each stage.
+
+        The directive interrupts (/ACK, Timer 3) are a call to
+        Directive_Tick() after each packet and while a directive is
+        running. While a motion sequence runs Timer 8 is run from
+        the same loop, Motion_Service() compiles its next record.
+
+        Usage: mbz_sim [-s socket] [-d display.ppm] [-f address] [-b us] [-m mask] [-1] [-v]
+            -s  socket path (default /tmp/mainbrain.sock)
+            -d  write the display to a PPM file when a client leaves
+            -f  SRAM address with bit 0 stuck at 0, for the self test
+            -b  microseconds a simulated board takes to ACK (default 20)
+            -m  boards that are there, bit 0 is board 1 (default 0x7f),
+                a SIGUSR1 swaps them with the boards that are not,
+                a SIGUSR2 has each board that is there ask for
+                service, board n at priority n % 4
+            -1  exit after the first client disconnects
+            -v  log directives and characters drawn
+
+    Change History:
+
+/***********************************************************************/
+
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <xc.h>
+#include "MainBrain.h"
+#include "mbz.h"
+#include "sim.h"
+
+//Simulated Timer 1 rate and USB microframe
+#define SIM_SAMPLE_NS           500000ull
+#define SIM_SOF_NS              125000ull
+#define SIM_SECOND_NS           1000000000ull
+
+//Timers that fall further behind than this skip ahead
+#define SIM_MAX_LAG_NS          10000000ull
+
+void Host_CMDs(void);
+void USB_handler(void);
+
+static volatile sig_atomic_t sim_quit = 0;
+
+static void sim_signal(int sig)
+{
+    sim_quit = 1;
+}
+
+//Boards pulled out and put in, the background probes find them
+static void sim_hotplug(int sig)
+{
+    Sim_Boards = Sim_Boards ^ 0x7f;
+}
+
+static volatile sig_atomic_t sim_service = 0;
+
+static void sim_service_signal(int sig)
+{
+    sim_service = 1;
+}
+
+//The boards asked for service, the requests are posted on RA7
+static void sim_service_requests(void)
+{
+    sim_service = 0;
+
+    for(int board=1;board<=7;board++)
+    {
+        if((Sim_Boards & (1 << (board - 1))) != 0)
+        {
+            Sim_Service_Request(board, MAILBOX_SERVICE_CODE_OF(board % 4, 1));
+        }
+    }
+}
+
+static int sim_send(int fd, uint8_t ep, const uint8_t *data, int length)
+{
+    uint8_t frame[3 + MBZ_MAX_PACKET];
+    int sent = 0;
+    ssize_t n;
+
+    frame[0] = ep;
+    frame[1] = length & 0xff;
+    frame[2] = length >> 8;
+    memcpy(&frame[3], data, length);
+
+    while(sent < (length + 3))
+    {
+        n = write(fd, frame + sent, (length + 3) - sent);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        sent += n;
+    }
+
+    return 0;
+}
+
+//Sends whatever the firmware queued on Endpoint 2
+static int sim_endpoint2(int fd)
+{
+    uint8_t packet[MBZ_PACKET_SIZE];
+
+    if(USBE2CSR0bits.TXPKTRDY == 0)
+    {
+        return 0;
+    }
+
+    for(int i=0;i<MBZ_PACKET_SIZE;i++)
+    {
+        packet[i] = EP[2].tx_buffer[i];
+    }
+
+    USBE2CSR0bits.TXPKTRDY = 0;
+
+    return sim_send(fd, MBZ_EP_IN, packet, MBZ_PACKET_SIZE);
+}
+
+//The parts of main() that act on flags set by Host_CMDs
+static void sim_main_loop(void)
+{
+    if(Message == 1)
+    {
+        if(Sim_Verbose)
+        {
+            fprintf(stderr, "sim: message \"%s\"\n", myStr);
+        }
+        Message = 0;
+    }
+
+    if(requestDirective == 1)
+    {
+        Directive_Queue(current_board_address, true);
+        requestDirective = 0;
+    }
+
+    Directive_Tick();
+    Directive_Service();
+    Service_Dispatch();
+    Mailbox_Service();
+    Peripheral_Service();
+    Motion_Service();
+
+    Flash_Jobs_Tick();
+    Flash_Jobs_Service();
+    Asset_Service();
+    Flash_Program_Service();
+    SRAM_Test_Service();
+    Flash_Map_Service();
+}
+
+/*************************************************************
+ Endpoint 0
+*************************************************************/
+static void sim_ep0_interrupt(void)
+{
+    USBCSR0bits.EP0IF = 1;
+    USB_handler();
+
+    //Serviced bits clear their flags
+    if(USBE0CSR0bits.RXRDYC)
+    {
+        USBE0CSR0bits.RXRDY = 0;
+        USBE0CSR0bits.RXRDYC = 0;
+    }
+    if(USBE0CSR0bits.SETENDC)
+    {
+        USBE0CSR0bits.SETEND = 0;
+        USBE0CSR0bits.SETENDC = 0;
+    }
+}
+
+//packet is the SETUP packet followed by the OUT data stage
+static int sim_control(int fd, const uint8_t *packet, int length)
+{
+    uint8_t reply[MBZ_MAX_PACKET];
+    int reply_len = 1;
+    int out_sent = 8;
+    int count;
+    bool last;
+
+    if(length < 8)
+    {
+        return 0;
+    }
+
+    reply[0] = MBZ_CONTROL_ACK;
+
+    USBE0CSR2bits.RXCNT = 8;
+    USBE0CSR0bits.RXRDY = 1;
+    Sim_EP0Load(packet, 8);
+    sim_ep0_interrupt();
+
+    for(int guard=0;guard<1000;guard++)
+    {
+        if(USBE0CSR0bits.STALL)
+        {
+            USBE0CSR0bits.STALL = 0;
+            USBE0CSR0bits.STALLED = 1;
+            sim_ep0_interrupt();
+
+            reply[0] = MBZ_CONTROL_STALL;
+            reply_len = 1;
+            break;
+        }
+
+        if(USBE0CSR0bits.TXRDY)
+        {
+            //IN packet, the interrupt after the last one ends the status stage
+            count = Sim_EP0Take(&reply[reply_len]);
+            if(count > (MBZ_MAX_PACKET - reply_len))
+            {
+                count = MBZ_MAX_PACKET - reply_len;
+            }
+            reply_len += count;
+
+            last = USBE0CSR0bits.DATAEND;
+            USBE0CSR0bits.TXRDY = 0;
+            USBE0CSR0bits.DATAEND = 0;
+            sim_ep0_interrupt();
+
+            if(last)
+            {
+                break;
+            }
+        }
+        else if(USBE0CSR0bits.DATAEND)
+        {
+            //Status stage
+            USBE0CSR0bits.DATAEND = 0;
+            sim_ep0_interrupt();
+            break;
+        }
+        else if((out_sent < length) && !USBE0CSR0bits.RXRDY)
+        {
+            count = ((length - out_sent) < 64) ? (length - out_sent) : 64;
+
+            USBE0CSR2bits.RXCNT = count;
+            USBE0CSR0bits.RXRDY = 1;
+            Sim_EP0Load(&packet[out_sent], count);
+            out_sent += count;
+            sim_ep0_interrupt();
+        }
+        else
+        {
+            //Nothing left to move, the firmware did not finish the transfer
+            reply[0] = MBZ_CONTROL_STALL;
+            reply_len = 1;
+            break;
+        }
+    }
+
+    return sim_send(fd, MBZ_EP_CONTROL_IN, reply, reply_len);
+}
+
+/*************************************************************
+ Timer 1 and the USB Start of Frame for the scope stream
+*************************************************************/
+static uint64_t next_sample_ns;
+static uint64_t next_sof_ns;
+static uint64_t next_second_ns;
+static uint32_t sample_count;
+
+static void sim_timers_reset(void)
+{
+    uint64_t now = MBZ_Now();
+
+    next_sample_ns = now;
+    next_sof_ns = now;
+    next_second_ns = now + SIM_SECOND_NS;
+}
+
+static int sim_timers(int fd)
+{
+    uint8_t frame[MBZ_MAX_PACKET];
+    uint64_t now = MBZ_Now();
+    int length;
+
+    if((now - next_sample_ns) > SIM_MAX_LAG_NS)
+    {
+        next_sample_ns = now;
+    }
+    if((now - next_sof_ns) > SIM_MAX_LAG_NS)
+    {
+        next_sof_ns = now;
+    }
+
+    while(next_sample_ns <= now)
+    {
+        double t = sample_count++ * (SIM_SAMPLE_NS / 1e9);
+
+        //50 Hz sine on channel 0, 10 Hz triangle on channel 1
+        Scope_Capture(2048 + (int)(2000 * sin(2 * M_PI * 50 * t)),
+		      (uint16_t)(fabs(fmod(t * 10, 1.0) - 0.5) * 8190));
+
+        next_sample_ns += SIM_SAMPLE_NS;
+    }
+
+    while(next_sof_ns <= now)
+    {
+        Scope_Service();
+
+        if(USBE3CSR0bits.TXPKTRDY)
+        {
+            length = Sim_TakeScopeFrame(frame);
+            USBE3CSR0bits.TXPKTRDY = 0;
+
+            if(sim_send(fd, MBZ_EP_SCOPE, frame, length) < 0)
+            {
+                return -1;
+            }
+        }
+
+        next_sof_ns += SIM_SOF_NS;
+    }
+
+    if(now >= next_second_ns)
+    {
+        Scope_Tick();
+        next_second_ns += SIM_SECOND_NS;
+    }
+
+    return 0;
+}
+
+/*************************************************************
+ Benchmark source
+ Each pass stands in for one Endpoint 2 TX complete interrupt.
+*************************************************************/
+#define SIM_SOURCE_BURST        64
+
+static int sim_source(int fd)
+{
+    for(int i=0;(i<SIM_SOURCE_BURST) && BenchSourceRemaining;i++)
+    {
+        Bench_ISR_Enter();
+        Bench_Source_Next();
+        Bench_ISR_Exit();
+
+        if(sim_endpoint2(fd) < 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void sim_client(int fd)
+{
+    uint8_t rx[3 + MBZ_MAX_PACKET];
+    struct pollfd pfd;
+    int rx_len = 0;
+    int length;
+    int used;
+    ssize_t n;
+
+    sim_timers_reset();
+
+    while(!sim_quit)
+    {
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        //Streaming needs the timers serviced every microframe,
+        //a running directive needs its /ACK seen, a motion
+        //sequence its tick
+        if(poll(&pfd, 1, (ScopeChannelMask || BenchSourceRemaining || !Directive_Idle() || Motion_Running()) ? 0 : 100) < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+
+        if(pfd.revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            n = read(fd, &rx[rx_len], sizeof(rx) - rx_len);
+            if(n <= 0)
+            {
+                return;
+            }
+            rx_len += n;
+
+            used = 0;
+            while((rx_len - used) >= 3)
+            {
+                length = rx[used + 1] | (rx[used + 2] << 8);
+                if(length > MBZ_MAX_PACKET)
+                {
+                    return;
+                }
+                if((rx_len - used) < (3 + length))
+                {
+                    break;
+                }
+
+                if(rx[used] == MBZ_EP_CONTROL_OUT)
+                {
+                    if(sim_control(fd, &rx[used + 3], length) < 0)
+                    {
+                        return;
+                    }
+                }
+                else if((rx[used] == MBZ_EP_OUT) && (length <= MBZ_PACKET_SIZE))
+                {
+                    memset((void *)EP[1].rx_buffer, 0, MBZ_PACKET_SIZE);
+                    for(int i=0;i<length;i++)
+                    {
+                        EP[1].rx_buffer[i] = rx[used + 3 + i];
+                    }
+                    EP[1].rx_num_bytes = length;
+
+                    //Same order as the Endpoint 1 interrupt followed by the main loop
+                    Bench_ISR_Enter();
+                    Host_CMDs();
+                    Bench_ISR_Exit();
+
+                    if(sim_endpoint2(fd) < 0)
+                    {
+                        return;
+                    }
+
+                    sim_main_loop();
+
+                    //Replies the main loop sends (0x75, 0x76)
+                    if(sim_endpoint2(fd) < 0)
+                    {
+                        return;
+                    }
+                }
+
+                used += 3 + length;
+            }
+
+            memmove(rx, &rx[used], rx_len - used);
+            rx_len -= used;
+        }
+
+        if(ScopeChannelMask)
+        {
+            if(sim_timers(fd) < 0)
+            {
+                return;
+            }
+        }
+
+        if(BenchSourceRemaining)
+        {
+            if(sim_source(fd) < 0)
+            {
+                return;
+            }
+        }
+
+        if(!Directive_Idle())
+        {
+            Directive_Tick();
+            Directive_Service();
+        }
+
+        Peripheral_Service();
+
+        Sim_Timer8();
+        Motion_Service();
+
+        if(sim_service)
+        {
+            sim_service_requests();
+            Service_Dispatch();
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = MBZ_SIM_SOCKET;
+    const char *display_path = NULL;
+    struct sockaddr_un addr;
+    bool once = false;
+    int server;
+    int client;
+    int opt;
+
+    while((opt = getopt(argc, argv, "s:d:f:b:m:1v")) != -1)
+    {
+        switch(opt)
+        {
+            case 's':
+                path = optarg;
+                break;
+            case 'd':
+                display_path = optarg;
+                break;
+            case '1':
+                once = true;
+                break;
+            case 'f':
+                Sim_SRAM_Fault = strtol(optarg, NULL, 0);
+                break;
+            case 'b':
+                Sim_Board_Ticks = strtoul(optarg, NULL, 0) * 100;
+                break;
+            case 'm':
+                Sim_Boards = strtoul(optarg, NULL, 0) & 0x7f;
+                break;
+            case 'v':
+                Sim_Verbose = true;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-s socket] [-d display.ppm] [-f address] [-b us] [-m mask] [-1] [-v]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if(strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "mbz_sim: socket path too long\n");
+        return 1;
+    }
+
+    signal(SIGINT, sim_signal);
+    signal(SIGTERM, sim_signal);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGUSR1, sim_hotplug);
+    signal(SIGUSR2, sim_service_signal);
+
+    server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(server < 0)
+    {
+        perror("mbz_sim: socket");
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    if((bind(server, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(server, 1) < 0))
+    {
+        perror("mbz_sim: bind");
+        return 1;
+    }
+
+    //Power on state
+    Display_CLRSCN(white);
+    Flash_Init();
+    Directive_Init();
+    Peripheral_Enumerate();
+    Mailbox_Init();
+    Service_Init();
+    Motion_Init();
+    USBState = ATTACHED;
+
+    fprintf(stderr, "mbz_sim: listening on %s\n", path);
+
+    while(!sim_quit)
+    {
+        client = accept(server, NULL, NULL);
+        if(client < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        sim_client(client);
+        close(client);
+
+        //A new client starts with the streams stopped
+        Scope_Stop();
+        BenchSourceRemaining = 0;
+
+        if(display_path != NULL)
+        {
+            Sim_DumpDisplay(display_path);
+        }
+
+        if(once)
+        {
+            break;
+        }
+    }
+
+    close(server);
+    unlink(path);
+
+    return 0;
+}
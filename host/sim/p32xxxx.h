@@ -0,0 +1,2 @@
+//Stand-in for the XC32 header of the same name
+#include <xc.h>
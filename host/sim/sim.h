@@ -0,0 +1,63 @@
+/*********************************************************************
+    FileName:     	sim.h
+    Dependencies:	See #includes
+    Processor:		Host (Linux)
+    Hardware:		MainBrain MZ (simulated)
+    Complier:		GCC
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        Simulated MainBrain MZ hardware
+
+    File Description:
+
+    Change History:
+
+/***********************************************************************/
+
+#ifndef SIM_H
+#define	SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SIM_SRAM_SIZE           0x2000
+#define SIM_FLASH_SIZE          0x80000
+#define SIM_DISPLAY_WIDTH       480
+#define SIM_DISPLAY_HEIGHT      320
+#define SIM_SCOPE_FIFO_WORDS    256
+#define SIM_EP0_FIFO_SLOTS      128
+
+extern uint8_t Sim_SRAM[SIM_SRAM_SIZE];
+extern uint8_t Sim_Flash[SIM_FLASH_SIZE];
+extern uint16_t Sim_Display[SIM_DISPLAY_HEIGHT][SIM_DISPLAY_WIDTH];
+extern uint8_t Sim_Backlight;
+extern uint32_t Sim_Directives;
+extern uint32_t Sim_Board_Ticks;
+extern uint8_t Sim_Boards;
+extern bool Sim_Verbose;
+extern int32_t Sim_SRAM_Fault;
+
+int Sim_TakeScopeFrame(uint8_t *frame);
+void Sim_EP0Load(const uint8_t *data, int length);
+int Sim_EP0Take(uint8_t *data);
+int Sim_DumpDisplay(const char *path);
+void Sim_Service_Request(uint8_t board, uint8_t code);
+void Sim_Timer8(void);
+
+#endif	/* SIM_H */
@@ -0,0 +1,771 @@
+/*********************************************************************
+    FileName:     	sim_hw.c
+    Dependencies:	See #includes
+    Processor:		Host (Linux)
+    Hardware:		MainBrain MZ (simulated)
+    Complier:		GCC
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        Hardware stand-ins for the simulated MainBrain MZ
+
+    File Description:
+        Replaces the driver files (Main.c, REN70V05.c, Flash.c,
+        Display.c, Timers.c) with versions that work on plain memory:
+
+        SRAM        8K array, same addressing as the 70V05
+        Flash       512K array, programming only clears bits
+        Display     480x320 RGB565 frame buffer, characters are drawn
+                    as solid cells and logged as text
+        I/O Boards  Selecting a board runs a simulated board on the
+                    board's 0x400 region at once: the command byte
+                    (offset 0) is copied to the status byte (offset 20)
+                    and the directive count is kept at offset 10. The
+                    board pulls /ACK low Sim_Board_Ticks Core Timer
+                    counts later, the firmware's own scheduler
+                    (Directives.c) sees it on its next tick. Only the
+                    boards in Sim_Boards answer, for the others Timer 3
+                    (PR3 at 1:256 of 200 MHz from the select) runs out.
+                    Sim_Service_Request() writes a service request in a
+                    board's mailbox and runs the RA7 interrupt
+        Timer 8     Sim_Timer8() runs the motion tick (Motion.c) for
+                    the period that has passed, with TMR8 at how late
+                    it is, periods missed in between are lost
+
+    Change History:
+
+/***********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <xc.h>
+#include "MainBrain.h"
+#include "sim.h"
+
+//Special function registers
+SIM_SFR_BITS USBCSR0bits;
+SIM_SFR_BITS USBCSR1bits;
+SIM_SFR_BITS USBCSR2bits;
+SIM_SFR_BITS USBCSR3bits;
+SIM_SFR_BITS USBOTGbits;
+SIM_SFR_BITS USBFIFOAbits;
+SIM_SFR_BITS USBCRCONbits;
+SIM_SFR_BITS USBIENCSR0bits;
+SIM_SFR_BITS USBIENCSR1bits;
+SIM_SFR_BITS USBIENCSR2bits;
+SIM_SFR_BITS USBIENCSR3bits;
+SIM_SFR_BITS USBE0CSR0bits;
+SIM_SFR_BITS USBE0CSR2bits;
+SIM_SFR_BITS USBE1CSR0bits;
+SIM_SFR_BITS USBE1CSR1bits;
+SIM_SFR_BITS USBE1CSR2bits;
+SIM_SFR_BITS USBE2CSR0bits;
+SIM_SFR_BITS USBE3CSR0bits;
+SIM_SFR_BITS USBE3CSR2bits;
+SIM_SFR_BITS USBE3CSR3bits;
+SIM_SFR_BITS IEC4bits;
+SIM_SFR_BITS IFS4bits;
+SIM_SFR_BITS IPC33bits;
+SIM_SFR_BITS RTCCONbits;
+SIM_SFR_BITS RTCTIMEbits;
+SIM_SFR_BITS TRISGbits;
+SIM_SFR_BITS CNCONGbits;
+SIM_SFR_BITS CNNEGbits;
+SIM_SFR_BITS IPC31bits;
+SIM_SFR_BITS IFS3bits;
+SIM_SFR_BITS IEC3bits;
+SIM_SFR_BITS T3CONbits;
+SIM_SFR_BITS IPC3bits;
+SIM_SFR_BITS IFS0bits;
+SIM_SFR_BITS IEC0bits;
+SIM_SFR_BITS TRISAbits;
+SIM_SFR_BITS CNCONAbits;
+SIM_SFR_BITS CNNEAbits;
+SIM_SFR_BITS IPC29bits;
+SIM_SFR_BITS T8CONbits;
+SIM_SFR_BITS IPC9bits;
+SIM_SFR_BITS IFS1bits;
+SIM_SFR_BITS IEC1bits;
+uint32_t CNFACLR;
+uint32_t PR3, TMR3, T3CONSET, T3CONCLR;
+uint32_t T8CON, PR8, TMR8;
+uint32_t CNFGCLR;
+
+//Main.c
+uint8_t screen;
+bool NeedsRefresh = true;
+uint8_t CurrentLevel = HOMELEVEL;
+bool Message = false;
+char myStr[20] = "null";
+uint8_t requestDirective = 0;
+uint8_t current_board_address;
+uint8_t PeripheralList[7] = {0};
+uint8_t default_Display_Brightness = 5;
+volatile bool SaveBrightness = false;
+volatile bool SaveSequence[FLASH_KV_SEQUENCES];
+uint32_t lastError;
+bool updated = false;
+
+//Timers.c
+int ADC0_result;
+float ADC6_result;
+
+//Display.c
+uint16_t hchar;
+uint16_t vchar;
+
+//REN70V05.c
+uint8_t mdata_70V05;
+
+uint8_t Sim_SRAM[SIM_SRAM_SIZE];
+uint16_t Sim_Display[SIM_DISPLAY_HEIGHT][SIM_DISPLAY_WIDTH];
+uint8_t Sim_Backlight = 5;
+uint32_t Sim_Directives = 0;
+uint32_t Sim_Board_Ticks = 2000;
+uint8_t Sim_Boards = 0x7f;
+bool Sim_Verbose = false;
+int32_t Sim_SRAM_Fault = -1;
+
+static volatile uint32_t sim_fifo_dummy;
+static uint32_t sim_ep0_fifo[SIM_EP0_FIFO_SLOTS];
+static int sim_ep0_index = 0;
+static int sim_ep0_loaded = 0;
+static uint32_t sim_scope_fifo[SIM_SCOPE_FIFO_WORDS];
+static int sim_scope_words = 0;
+
+/*************************************************************
+ Core Timer
+*************************************************************/
+uint32_t Sim_CoreTimer(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint32_t)((((uint64_t)ts.tv_sec * 1000000000ull) + ts.tv_nsec) / 10);
+}
+
+/*************************************************************
+ USB FIFOs
+ Endpoint 3 words are collected so the simulator can send
+ the scope frame once TXPKTRDY is set.
+
+ Endpoint 0 is accessed a byte at a time, every access gets
+ the next slot. The slots loaded by Sim_EP0Load() are read
+ first, the firmware's writes land in the slots after them.
+*************************************************************/
+volatile uint32_t *Sim_USBFIFO(int ep)
+{
+    if(ep == 0)
+    {
+        if(sim_ep0_index < SIM_EP0_FIFO_SLOTS)
+        {
+            return &sim_ep0_fifo[sim_ep0_index++];
+        }
+    }
+    else if(ep == 3)
+    {
+        if(sim_scope_words < SIM_SCOPE_FIFO_WORDS)
+        {
+            return &sim_scope_fifo[sim_scope_words++];
+        }
+    }
+
+    return &sim_fifo_dummy;
+}
+
+int Sim_TakeScopeFrame(uint8_t *frame)
+{
+    int length = sim_scope_words * 4;
+
+    memcpy(frame, sim_scope_fifo, length);
+    sim_scope_words = 0;
+
+    return length;
+}
+
+void Sim_EP0Load(const uint8_t *data, int length)
+{
+    for(int i=0;i<length;i++)
+    {
+        sim_ep0_fifo[i] = data[i];
+    }
+
+    sim_ep0_loaded = length;
+    sim_ep0_index = 0;
+}
+
+int Sim_EP0Take(uint8_t *data)
+{
+    int length = sim_ep0_index - sim_ep0_loaded;
+
+    for(int i=0;i<length;i++)
+    {
+        data[i] = sim_ep0_fifo[sim_ep0_loaded + i] & 0xff;
+    }
+
+    sim_ep0_loaded = 0;
+    sim_ep0_index = 0;
+
+    return (length > 0) ? length : 0;
+}
+
+/*************************************************************
+ SRAM
+*************************************************************/
+void REN70V05_WR(uint32_t address_70V05, uint8_t mdata_70V05)
+{
+    Sim_SRAM[address_70V05 & (SIM_SRAM_SIZE - 1)] = mdata_70V05;
+}
+
+int8_t REN70V05_RD(uint32_t address_70V05)
+{
+    mdata_70V05 = Sim_SRAM[address_70V05 & (SIM_SRAM_SIZE - 1)];
+
+    return mdata_70V05;
+}
+
+void REN70V05_ReadBlock(uint32_t address, uint8_t *data, uint16_t length)
+{
+    for(int i=0;i<length;i++)
+    {
+        data[i] = Sim_SRAM[(address + i) & (SIM_SRAM_SIZE - 1)];
+    }
+}
+
+void REN70V05_WriteBlock(uint32_t address, const uint8_t *data, uint16_t length)
+{
+    for(int i=0;i<length;i++)
+    {
+        Sim_SRAM[(address + i) & (SIM_SRAM_SIZE - 1)] = data[i];
+    }
+}
+
+//The self test reads through these, Sim_SRAM_Fault (mbz_sim -f)
+//holds bit 0 of one address at 0
+void REN70V05_ReadWords(uint32_t address, uint8_t *data, uint16_t length)
+{
+    for(int i=0;i<length;i++)
+    {
+        data[i] = Sim_SRAM[(address + i) & (SIM_SRAM_SIZE - 1)];
+
+        if((address + i) == (uint32_t)Sim_SRAM_Fault)
+        {
+            data[i] = data[i] & 0xfe;
+        }
+    }
+}
+
+void REN70V05_WriteWords(uint32_t address, const uint8_t *data, uint16_t length)
+{
+    REN70V05_WriteBlock(address, data, length);
+}
+
+//The MainBrain is the only side, every lock is granted
+SRAM_LOCK_STATS SRAMLockStats[8];
+
+//Nothing else drives the simulated SRAM, there are no collisions
+SRAM_COLLISION_STATS SRAMCollisionStats[8];
+
+bool REN70V05_SEM(uint8_t flag)
+{
+    SRAMLockStats[flag & 7].locks++;
+
+    return true;
+}
+
+bool REN70V05_LOCK(uint8_t flag, uint32_t timeout_us)
+{
+    return REN70V05_SEM(flag);
+}
+
+void REN70V05_RELEASE(uint8_t flag)
+{
+
+}
+
+//Nothing else uses a simulated PMP
+void REN70V05_PMP_Take(REN70V05_PMP_STATE *state)
+{
+
+}
+
+void REN70V05_PMP_Give(const REN70V05_PMP_STATE *state)
+{
+
+}
+
+//The bursts complete before they return
+void SRAM_DMA_Init(void)
+{
+
+}
+
+void SRAM_DMA_Write(uint32_t address, const volatile uint8_t *source, uint16_t length, void (*done)(void))
+{
+    for(int i=0;i<length;i++)
+    {
+        Sim_SRAM[(address + i) & (SIM_SRAM_SIZE - 1)] = source[i];
+    }
+
+    if(done != NULL)
+    {
+        done();
+    }
+}
+
+void SRAM_DMA_Read(uint32_t address, volatile uint8_t *destination, uint16_t length, void (*done)(void))
+{
+    for(int i=0;i<length;i++)
+    {
+        destination[i] = Sim_SRAM[(address + i) & (SIM_SRAM_SIZE - 1)];
+    }
+
+    if(done != NULL)
+    {
+        done();
+    }
+}
+
+bool SRAM_DMA_Busy(void)
+{
+    return false;
+}
+
+void SRAM_DMA_Wait(void)
+{
+
+}
+
+/*************************************************************
+ I/O Boards
+*************************************************************/
+static SIM_SFR_BITS sim_portg = { .RG13 = 1 };
+static SIM_SFR_BITS sim_cnfg;
+static bool sim_ack_pending = false;
+static uint32_t sim_ack_due;
+static bool sim_t3_running = false;
+static uint32_t sim_t3_due;
+
+//The /ACK of the selected board once its time has come
+static void Sim_Board_Update(void)
+{
+    if((CNFGCLR & (1 << 13)) != 0)
+    {
+        sim_cnfg.CNFG13 = 0;
+        CNFGCLR = 0;
+    }
+
+    if(sim_ack_pending && ((int32_t)(Sim_CoreTimer() - sim_ack_due) >= 0))
+    {
+        sim_ack_pending = false;
+        sim_portg.RG13 = 0;
+        sim_cnfg.CNFG13 = 1;
+    }
+
+    if(sim_t3_running && ((int32_t)(Sim_CoreTimer() - sim_t3_due) >= 0))
+    {
+        sim_t3_running = false;
+        IFS0bits.T3IF = 1;
+    }
+}
+
+SIM_SFR_BITS *Sim_PortG(void)
+{
+    Sim_Board_Update();
+
+    return &sim_portg;
+}
+
+SIM_SFR_BITS *Sim_CNFG(void)
+{
+    Sim_Board_Update();
+
+    return &sim_cnfg;
+}
+
+void SetPeripheralAddress(uint8_t padd)
+{
+    uint32_t region;
+
+    sim_portg.RG13 = 1;
+    sim_ack_pending = false;
+    sim_t3_running = false;
+
+    if((padd < 1) || (padd > 7))
+    {
+        return;
+    }
+
+    //Timer 3 counts at 200 MHz / 256, 128 Core Timer counts
+    sim_t3_due = Sim_CoreTimer() + (PR3 * 128);
+    sim_t3_running = true;
+
+    if((Sim_Boards & (1 << (padd - 1))) == 0)
+    {
+        return;
+    }
+
+    region = (padd - 1) * 0x400;
+
+    Sim_SRAM[region + 20] = Sim_SRAM[region];
+    Sim_SRAM[region + 10]++;
+    Sim_Directives++;
+
+    //The board writes the mailbox interrupt word when it is done,
+    //then pulls /ACK
+    Board_Event_Post((BOARD_EVENT_DONE << 3) | padd);
+
+    sim_ack_due = Sim_CoreTimer() + Sim_Board_Ticks;
+    sim_ack_pending = true;
+
+    if(Sim_Verbose)
+    {
+        fprintf(stderr, "sim: directive board %d command 0x%02x\n", padd, Sim_SRAM[region]);
+    }
+}
+
+void CNA_ISR(void);
+
+void Sim_Service_Request(uint8_t board, uint8_t code)
+{
+    uint32_t region = (board - 1) * 0x400;
+
+    Sim_SRAM[region + MAILBOX_SERVICE_CODE] = code;
+    Sim_SRAM[region + MAILBOX_SERVICE_COUNT]++;
+
+    CNA_ISR();
+
+    if(Sim_Verbose)
+    {
+        fprintf(stderr, "sim: service request board %d code 0x%02x\n", board, code);
+    }
+}
+
+/*************************************************************
+ Timer 8, PBCLK3 = 200 MHz, two counts per Core Timer count
+*************************************************************/
+static bool sim_t8_running = false;
+static uint32_t sim_t8_due;
+
+void TMR8_handler(void);
+
+void Sim_Timer8(void)
+{
+    uint32_t prescale;
+    uint32_t period;
+    uint32_t late;
+
+    if(!T8CONbits.ON)
+    {
+        sim_t8_running = false;
+        return;
+    }
+
+    prescale = (T8CONbits.TCKPS == 7) ? 256 : (1 << T8CONbits.TCKPS);
+    period = ((PR8 + 1) * prescale) / 2;
+
+    if(!sim_t8_running)
+    {
+        sim_t8_running = true;
+        sim_t8_due = Sim_CoreTimer() + period;
+        return;
+    }
+
+    late = Sim_CoreTimer() - sim_t8_due;
+    if((int32_t)late < 0)
+    {
+        return;
+    }
+
+    sim_t8_due = sim_t8_due + (period * ((late / period) + 1));
+    TMR8 = ((late % period) * 2) / prescale;
+
+    IFS1bits.T8IF = 1;
+    TMR8_handler();
+}
+
+/*************************************************************
+ Flash, a 512K MX29LV040 that starts erased
+*************************************************************/
+uint8_t Sim_Flash[SIM_FLASH_SIZE];
+uint8_t data_flash;
+uint8_t Flash_MID = 0xc2;
+uint8_t Flash_DID = 0x4f;
+unsigned long Bytes_used;
+
+void Flash_Init(void)
+{
+    memset(Sim_Flash, 0xff, sizeof(Sim_Flash));
+    Flash_Map_Init();
+    Flash_KV_Init();
+    Asset_Init();
+}
+
+//Through the cache, like Flash.c
+void Flash_RD(unsigned address_flash)
+{
+    data_flash = Flash_Cache_RD(address_flash);
+}
+
+//Through the job engine, like Flash.c
+void Flash_WR(unsigned address_flash, uint8_t data)
+{
+    FLASH_JOB job;
+
+    if(Flash_Jobs_Program(&job, address_flash, &data, 1, NULL, NULL))
+    {
+        Flash_Jobs_Wait(&job);
+    }
+}
+
+void Flash_Sector_Erase(int erase_sector)
+{
+    FLASH_JOB job;
+
+    if(Flash_Jobs_Erase(&job, erase_sector, NULL, NULL))
+    {
+        Flash_Jobs_Wait(&job);
+    }
+}
+
+void Flash_Chip_Erase(void)
+{
+    FLASH_JOB job;
+
+    if(Flash_Jobs_Chip_Erase(&job, NULL, NULL))
+    {
+        Flash_Jobs_Wait(&job);
+    }
+}
+
+//Core Timer ticks an operation reads busy, 10 us and 2 ms
+#define SIM_FLASH_PROGRAM_TICKS 1000
+#define SIM_FLASH_ERASE_TICKS   200000
+
+static uint32_t sim_flash_end;
+static uint32_t sim_flash_left = 0;
+static bool sim_flash_busy = false;
+static bool sim_flash_suspended = false;
+
+static void sim_flash_start(uint32_t ticks)
+{
+    sim_flash_end = Sim_CoreTimer() + ticks;
+    sim_flash_busy = true;
+}
+
+//Programming only clears bits
+void Flash_Program_Start(unsigned address_flash, uint8_t data)
+{
+    Sim_Flash[address_flash & (SIM_FLASH_SIZE - 1)] &= data;
+    sim_flash_start(SIM_FLASH_PROGRAM_TICKS);
+}
+
+void Flash_Erase_Start(int erase_sector)
+{
+    memset(&Sim_Flash[(erase_sector << 12) & (SIM_FLASH_SIZE - 1)], 0xff, 0x1000);
+    sim_flash_start(SIM_FLASH_ERASE_TICKS);
+}
+
+void Flash_Chip_Erase_Start(void)
+{
+    memset(Sim_Flash, 0xff, sizeof(Sim_Flash));
+    sim_flash_start(SIM_FLASH_ERASE_TICKS);
+}
+
+uint8_t Flash_Status(unsigned address_flash, uint8_t expect)
+{
+    if(sim_flash_busy && ((int32_t)(Sim_CoreTimer() - sim_flash_end) < 0))
+    {
+        return FLASH_BUSY;
+    }
+
+    sim_flash_busy = false;
+
+    return (Sim_Flash[address_flash & (SIM_FLASH_SIZE - 1)] == expect) ? FLASH_DONE : FLASH_FAILED;
+}
+
+//The erase keeps the time it had left
+bool Flash_Erase_Suspend(unsigned address_flash)
+{
+    if(sim_flash_busy)
+    {
+        sim_flash_left = sim_flash_end - Sim_CoreTimer();
+        sim_flash_suspended = true;
+    }
+
+    return true;
+}
+
+void Flash_Erase_Resume(unsigned address_flash)
+{
+    if(sim_flash_suspended)
+    {
+        sim_flash_start(sim_flash_left);
+        sim_flash_suspended = false;
+    }
+}
+
+uint16_t Flash_Blank_Length(unsigned address_flash, uint16_t length)
+{
+    uint16_t i;
+
+    Flash_Jobs_Hold(address_flash, length);
+
+    for(i=0;i<length;i++)
+    {
+        if(Sim_Flash[(address_flash + i) & (SIM_FLASH_SIZE - 1)] != 0xff)
+        {
+            break;
+        }
+    }
+
+    Flash_Jobs_Release();
+
+    return i;
+}
+
+void Flash_Read(unsigned address_flash, uint8_t *data, uint16_t length)
+{
+    Flash_Jobs_Hold(address_flash, length);
+
+    for(int i=0;i<length;i++)
+    {
+        data[i] = Sim_Flash[(address_flash + i) & (SIM_FLASH_SIZE - 1)];
+    }
+
+    Flash_Jobs_Release();
+}
+
+void Flash_Get_Bytes_Used(void)
+{
+    Bytes_used = (unsigned long)Flash_Map_Used() * 0x1000;
+}
+
+/*************************************************************
+ Display
+*************************************************************/
+void Backlight_Control(uint8_t back_level)
+{
+    Sim_Backlight = back_level;
+}
+
+void LED_Port(int8_t led_port_data)
+{
+
+}
+
+void Display_Rect(unsigned col_start, unsigned col_end, unsigned row_start, unsigned row_end, unsigned rect_color)
+{
+    for(unsigned row=row_start;(row<row_end) && (row<SIM_DISPLAY_HEIGHT);row++)
+    {
+        for(unsigned col=col_start;(col<col_end) && (col<SIM_DISPLAY_WIDTH);col++)
+        {
+            Sim_Display[row][col] = rect_color;
+        }
+    }
+}
+
+//The memory write Display_Window() starts, column by column,
+//then row by row inside the window
+static unsigned sim_window[4];
+static unsigned sim_window_col;
+static unsigned sim_window_row;
+
+void Display_Window(unsigned col_start, unsigned col_end, unsigned row_start, unsigned row_end)
+{
+    sim_window[0] = col_start;
+    sim_window[1] = col_end;
+    sim_window[2] = row_start;
+    sim_window[3] = row_end;
+    sim_window_col = col_start;
+    sim_window_row = row_start;
+}
+
+void Display_Pixels(const uint16_t *pixels, uint16_t count)
+{
+    for(int i=0;i<count;i++)
+    {
+        if((sim_window_row < SIM_DISPLAY_HEIGHT) && (sim_window_col < SIM_DISPLAY_WIDTH) &&
+           (sim_window_row <= sim_window[3]))
+        {
+            Sim_Display[sim_window_row][sim_window_col] = pixels[i];
+        }
+
+        if(++sim_window_col > sim_window[1])
+        {
+            sim_window_col = sim_window[0];
+            sim_window_row++;
+        }
+    }
+}
+
+void Display_CLRSCN(int CanvasColor)
+{
+    Display_Rect(0, SIM_DISPLAY_WIDTH, 0, SIM_DISPLAY_HEIGHT, CanvasColor);
+}
+
+void WriteChar(unsigned col_start, unsigned row_start, unsigned ascii_char, int TextColor, int CanvasColor)
+{
+    Display_Rect(col_start, col_start + 15, row_start, row_start + 22, (ascii_char == ' ') ? CanvasColor : TextColor);
+
+    if(Sim_Verbose)
+    {
+        fprintf(stderr, "sim: char '%c' at %u,%u\n", (ascii_char < 0x7f) ? ascii_char : '*', col_start, row_start);
+    }
+
+    //this keeps track of the horizontal position.
+    hchar = hchar + 15;
+}
+
+void WriteString(unsigned col_start, unsigned row_start, char array_name[], int TextColor, int CanvasColor)
+{
+    for(int i=0;array_name[i] != '\0';i++)
+    {
+        WriteChar(col_start, row_start, array_name[i], TextColor, CanvasColor);
+        col_start = col_start + 15;
+    }
+}
+
+//Writes the frame buffer as a binary PPM
+int Sim_DumpDisplay(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+
+    if(f == NULL)
+    {
+        return -1;
+    }
+
+    fprintf(f, "P6\n%d %d\n255\n", SIM_DISPLAY_WIDTH, SIM_DISPLAY_HEIGHT);
+
+    for(int row=0;row<SIM_DISPLAY_HEIGHT;row++)
+    {
+        for(int col=0;col<SIM_DISPLAY_WIDTH;col++)
+        {
+            uint16_t p = Sim_Display[row][col];
+            uint8_t rgb[3] = {(p >> 8) & 0xf8, (p >> 3) & 0xfc, (p << 3) & 0xf8};
+            fwrite(rgb, 1, 3, f);
+        }
+    }
+
+    fclose(f);
+
+    return 0;
+}
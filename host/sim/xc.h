@@ -0,0 +1,158 @@
+/*********************************************************************
+    FileName:     	xc.h
+    Dependencies:	See #includes
+    Processor:		Host (Linux)
+    Hardware:		MainBrain MZ (simulated)
+    Complier:		GCC
+    Author:		Larry Knight 2026
+/*********************************************************************
+
+    Software License Agreement:
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Description:
+        Stand-in for the XC32 device header
+
+    File Description:
+        Lets the firmware sources that hold no driver code (the USB
+        command dispatcher, conversions, scope framing) compile on the
+        host. Every special function register is plain memory, the
+        register bits share one structure that has a member for each
+        bit name the firmware uses.
+
+        Add a member to SIM_SFR_BITS when the firmware starts using a
+        new bit name.
+
+    Change History:
+
+/***********************************************************************/
+
+#ifndef SIM_XC_H
+#define	SIM_XC_H
+
+#include <stdint.h>
+
+//Interrupt attributes have no meaning on the host
+#define vector(v)       unused
+#define interrupt(i)    unused
+#define nomips16        unused
+#define coherent        unused
+
+//Nothing interrupts the simulated firmware
+#define __builtin_disable_interrupts()  0
+#define __builtin_mtc0(r, s, v)         ((void)(v))
+
+//Core Timer, runs at half the 200 MHz system clock
+uint32_t Sim_CoreTimer(void);
+#define _CP0_GET_COUNT()    Sim_CoreTimer()
+
+typedef struct
+{
+    //USB
+    uint32_t SOFTCONN, FUNC, HSEN, ENDPOINT;
+    uint32_t EP0IF, EP1RXIF, EP1TXIE, EP1RXIE, EP2TXIF, EP2TXIE, EP3TXIE;
+    uint32_t RESETIE, RESETIF, SOFIE, SOFIF;
+    uint32_t RXFIFOSZ, TXFIFOSZ, RXFIFOAD, TXFIFOAD;
+    uint32_t RXMAXP, TXMAXP, MULT, PROTOCOL, TEP, SPEED, TXINTERV, FLUSH;
+    uint32_t MODE, RXRDY, RXRDYC, TXRDY, DATAEND, SETEND, SETENDC, STALL, STALLED;
+    uint32_t RXCNT, RXPKTRDY, TXPKTRDY, PIDERR;
+    uint32_t USBIE, USBIF, USBIP, VBUSMONEN;
+
+    //RTCC
+    uint32_t RTCWREN, HR10, HR01, MIN10, MIN01, SEC10, SEC01;
+
+    //Directives, /ACK change notice and Timer 3
+    uint32_t ON, TRISG13, RG13, EDGEDETECT, CNNEG13, CNFG13;
+    uint32_t CNGIP, CNGIS, CNGIF, CNGIE, TCKPS, T3IP, T3IS, T3IF, T3IE;
+
+    //Service requests, RA7 change notice
+    uint32_t TRISA7, CNNEA7, CNAIP, CNAIS, CNAIF, CNAIE;
+
+    //Motion tick, Timer 8
+    uint32_t T8IP, T8IS, T8IF, T8IE;
+} SIM_SFR_BITS;
+
+#define SIM_SFR(name)   extern SIM_SFR_BITS name##bits
+
+SIM_SFR(USBCSR0);
+SIM_SFR(USBCSR1);
+SIM_SFR(USBCSR2);
+SIM_SFR(USBCSR3);
+SIM_SFR(USBOTG);
+SIM_SFR(USBFIFOA);
+SIM_SFR(USBCRCON);
+SIM_SFR(USBIENCSR0);
+SIM_SFR(USBIENCSR1);
+SIM_SFR(USBIENCSR2);
+SIM_SFR(USBIENCSR3);
+SIM_SFR(USBE0CSR0);
+SIM_SFR(USBE0CSR2);
+SIM_SFR(USBE1CSR0);
+SIM_SFR(USBE1CSR1);
+SIM_SFR(USBE1CSR2);
+SIM_SFR(USBE2CSR0);
+SIM_SFR(USBE3CSR0);
+SIM_SFR(USBE3CSR2);
+SIM_SFR(USBE3CSR3);
+SIM_SFR(IEC4);
+SIM_SFR(IFS4);
+SIM_SFR(IPC33);
+SIM_SFR(RTCCON);
+SIM_SFR(RTCTIME);
+SIM_SFR(TRISG);
+SIM_SFR(CNCONG);
+SIM_SFR(CNNEG);
+SIM_SFR(IPC31);
+SIM_SFR(IFS3);
+SIM_SFR(IEC3);
+SIM_SFR(T3CON);
+SIM_SFR(IPC3);
+SIM_SFR(IFS0);
+SIM_SFR(IEC0);
+SIM_SFR(TRISA);
+SIM_SFR(CNCONA);
+SIM_SFR(CNNEA);
+SIM_SFR(IPC29);
+SIM_SFR(T8CON);
+SIM_SFR(IPC9);
+SIM_SFR(IFS1);
+SIM_SFR(IEC1);
+
+//Only written, Sim_Service_Request() runs the interrupt
+extern uint32_t CNFACLR;
+
+//Timer 3 runs from the board select, see SetPeripheralAddress()
+extern uint32_t PR3, TMR3, T3CONSET, T3CONCLR;
+
+//Timer 8 runs from Sim_Timer8() on T8CONbits, T8CON is not tied to them
+extern uint32_t T8CON, PR8, TMR8;
+
+//The /ACK line and its change notice flag follow the simulated
+//boards, a write to CNFGCLR takes effect on the next read
+SIM_SFR_BITS *Sim_PortG(void);
+SIM_SFR_BITS *Sim_CNFG(void);
+extern uint32_t CNFGCLR;
+
+#define PORTGbits       (*Sim_PortG())
+#define CNFGbits        (*Sim_CNFG())
+
+//Endpoint FIFOs, words written to a FIFO are collected by the simulator
+volatile uint32_t *Sim_USBFIFO(int ep);
+
+#define USBFIFO0        (*Sim_USBFIFO(0))
+#define USBFIFO1        (*Sim_USBFIFO(1))
+#define USBFIFO2        (*Sim_USBFIFO(2))
+#define USBFIFO3        (*Sim_USBFIFO(3))
+
+#endif	/* SIM_XC_H */